@@ -0,0 +1,108 @@
+#include <sys/resource.h>
+
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <system_error>
+#include <thread>
+
+#include "SessionHost.h"
+
+// Serves sessions of the given roms until interrupted, printing statistics every 5 seconds. A
+// single .c8p argument is a pack from chip8-pack, and the Start message indexes its roms.
+//
+// chip8-host <socket path> <rom>...
+// chip8-host <socket path> <pack.c8p>
+
+namespace {
+
+SessionHost* running_host = nullptr;
+
+void handle_signal(int) {
+  if (running_host != nullptr) {
+    running_host->stop();
+  }
+}
+
+// Every session is a socket, allow as many as the hard limit
+void raise_file_limit() {
+  rlimit limit;
+  if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+  }
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  if (argc < 3) {
+    std::cerr << "Usage: " << argv[0] << " <socket path> <rom>... | <pack.c8p>\n";
+    return 1;
+  }
+
+  SessionHost::Config config;
+  config.socket_path = argv[1];
+  if (argc == 3 && std::filesystem::path(argv[2]).extension() == ".c8p") {
+    try {
+      config.pack = std::make_shared<RomPack>(argv[2]);
+    } catch (const std::system_error& error) {
+      std::cerr << error.what() << '\n';
+      return 1;
+    }
+  }
+  for (int i = 2; i < argc && config.pack == nullptr; i++) {
+    std::ifstream rom(argv[i], std::ios::binary);
+    if (!rom) {
+      std::cerr << "Can't read " << argv[i] << '\n';
+      return 1;
+    }
+    config.roms.emplace_back(std::istreambuf_iterator<char>(rom), std::istreambuf_iterator<char>());
+  }
+
+  raise_file_limit();
+  SessionHost host(config);
+  running_host = &host;
+  std::signal(SIGINT, handle_signal);
+  std::signal(SIGTERM, handle_signal);
+
+  // Statistics are printed from another thread while this one serves
+  std::atomic<bool> done{false};
+  std::thread reporter([&host, &done]() {
+    auto previous = host.statistics();
+    auto previous_time = std::chrono::steady_clock::now();
+    while (!done) {
+      for (auto i = 0; i < 50 && !done; i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+      }
+
+      const auto statistics = host.statistics();
+      const auto now = std::chrono::steady_clock::now();
+      const std::chrono::duration<double> elapsed = now - previous_time;
+      const auto updates = statistics.updates_sent - previous.updates_sent;
+      const auto bytes = statistics.bytes_sent - previous.bytes_sent;
+      std::cerr << statistics.sessions << " sessions, " << updates / elapsed.count()
+                << " updates/s, " << (updates > 0 ? bytes / updates : 0) << " bytes/update, "
+                << statistics.frames_skipped << " frames skipped, " << statistics.dropped_slow
+                << " slow clients dropped, " << statistics.arena_bytes / (1 << 20)
+                << " MB of session slabs ("
+                << (statistics.arena_bytes > 0
+                        ? 100 - 100 * statistics.arena_live_bytes / statistics.arena_bytes
+                        : 0)
+                << "% free)\n";
+      previous = statistics;
+      previous_time = now;
+    }
+  });
+
+  host.run();
+  running_host = nullptr;
+  done = true;
+  reporter.join();
+  return 0;
+}
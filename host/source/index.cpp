@@ -0,0 +1,47 @@
+#include <array>
+#include <exception>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "RomIndex.h"
+
+// Indexes a directory tree of roms, so loaders find their platform and quirks by hash (see
+// RomIndex.h).
+//
+// chip8-index <rom directory> <index file> [threads]
+
+int main(int argc, char** argv) {
+  if (argc < 3) {
+    std::cerr << "Usage: " << argv[0] << " <rom directory> <index file> [threads]\n";
+    return 1;
+  }
+  const auto threads = argc > 3 ? static_cast<unsigned>(std::stoul(argv[3])) : 0u;
+
+  RomIndexStatistics stats;
+  std::vector<IndexedRom> roms;
+  try {
+    roms = scan_rom_directory(argv[1], threads, &stats);
+    write_rom_index(roms, argv[2]);
+  } catch (const std::exception& error) {
+    std::cerr << error.what() << '\n';
+    return 1;
+  }
+
+  std::array<uint64_t, 4> platforms{};
+  uint64_t quirky = 0;
+  uint64_t self_modifying = 0;
+  for (const auto& rom : roms) {
+    platforms[static_cast<std::size_t>(rom.info.platform)]++;
+    quirky += rom.info.quirks != 0;
+    self_modifying += rom.info.self_modifying;
+  }
+  std::cout << stats.files << " roms (" << stats.bytes << " bytes, " << stats.duplicates
+            << " duplicates, " << stats.unreadable << " unreadable)\n";
+  for (std::size_t platform = 0; platform < platforms.size(); platform++) {
+    std::cout << platform_name(static_cast<RomPlatform>(platform)) << ": " << platforms[platform]
+              << '\n';
+  }
+  std::cout << quirky << " relying on quirks, " << self_modifying << " self-modifying\n";
+  return 0;
+}
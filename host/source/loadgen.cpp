@@ -0,0 +1,226 @@
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <array>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "DeltaCodec.h"
+#include "LatencyHistogram.h"
+#include "SessionProtocol.h"
+
+// Load generator for chip8-host: opens many sessions, presses random keys, and applies and
+// acknowledges every frame like a real client, then reports throughput and key to update latency.
+//
+// chip8-loadgen <socket path> <sessions> [seconds = 10] [roms = 1] [key interval ms = 100]
+
+using namespace session_protocol;
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+struct Client {
+  int fd = -1;
+  bool started = false;
+  bool closed = false;
+  MessageReader input;
+  std::vector<uint8_t> output;
+  std::array<uint8_t, 64 * 32> screen{};
+  uint32_t frame = 0;
+  int held_key = -1;
+  Clock::time_point key_time;  // Of the last key event without an update since
+  bool key_pending = false;
+};
+
+struct Totals {
+  uint64_t started = 0;
+  uint64_t errors = 0;
+  uint64_t updates = 0;
+  uint64_t bytes = 0;
+  uint64_t bad_frames = 0;  // Wrong base frame or malformed delta
+  LatencyHistogram key_to_update;
+};
+
+void raise_file_limit() {
+  rlimit limit;
+  if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+  }
+}
+
+int connect_to(const std::string& path) {
+  sockaddr_un address{};
+  address.sun_family = AF_UNIX;
+  std::strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+  const auto fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0 || connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0) {
+    if (fd >= 0) {
+      close(fd);
+    }
+    return -1;
+  }
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+  return fd;
+}
+
+void flush(Client& client) {
+  while (!client.output.empty()) {
+    const auto written = send(client.fd, client.output.data(), client.output.size(), MSG_NOSIGNAL);
+    if (written <= 0) {
+      return;
+    }
+    client.output.erase(client.output.begin(), client.output.begin() + written);
+  }
+}
+
+void handle(Client& client, const Message& message, Totals& totals) {
+  switch (message.type) {
+    case MessageType::Started:
+      client.started = true;
+      totals.started++;
+      break;
+
+    case MessageType::Frame: {
+      if (message.size < 16 || load32(message.payload + 4) != client.frame
+          || !delta_apply(message.payload + 16, message.size - 16, client.screen.data(),
+                          client.screen.size())) {
+        totals.bad_frames++;
+        break;
+      }
+      client.frame = load32(message.payload);
+      append_ack(client.output, client.frame);
+      totals.updates++;
+      totals.bytes += header_size + message.size;
+      if (client.key_pending) {
+        client.key_pending = false;
+        totals.key_to_update.record(static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - client.key_time)
+                .count()));
+      }
+      break;
+    }
+
+    case MessageType::Error:
+      totals.errors++;
+      client.closed = true;
+      break;
+
+    default:
+      break;
+  }
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  if (argc < 3) {
+    std::cerr << "Usage: " << argv[0]
+              << " <socket path> <sessions> [seconds] [roms] [key interval ms]\n";
+    return 1;
+  }
+  const std::string path = argv[1];
+  const auto session_count = std::strtoul(argv[2], nullptr, 10);
+  const auto seconds = argc > 3 ? std::strtod(argv[3], nullptr) : 10.0;
+  const auto roms = argc > 4 ? std::max(1ul, std::strtoul(argv[4], nullptr, 10)) : 1ul;
+  const auto key_interval = std::chrono::milliseconds(argc > 5 ? std::atoi(argv[5]) : 100);
+
+  raise_file_limit();
+  const auto epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  std::vector<Client> clients(session_count);
+  for (std::size_t index = 0; index < clients.size(); index++) {
+    auto& client = clients[index];
+    client.fd = connect_to(path);
+    if (client.fd < 0) {
+      std::cerr << "Connection " << index << " failed: " << std::strerror(errno) << '\n';
+      return 1;
+    }
+    append_start(client.output, static_cast<uint16_t>(index % roms), index);
+    flush(client);
+
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.u64 = index;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, client.fd, &event);
+  }
+
+  Totals totals;
+  std::mt19937 random(1);
+  const auto start = Clock::now();
+  auto next_keys = start;
+  std::vector<epoll_event> events(1024);
+
+  while (Clock::now() - start < std::chrono::duration<double>(seconds)) {
+    // Every key interval each session releases its key or presses a new one
+    if (Clock::now() >= next_keys) {
+      const auto now = Clock::now();
+      for (auto& client : clients) {
+        if (!client.started || client.closed) {
+          continue;
+        }
+        if (client.held_key >= 0) {
+          append_key(client.output, static_cast<uint8_t>(client.held_key), false);
+          client.held_key = -1;
+        } else {
+          client.held_key = static_cast<int>(random() % 16);
+          append_key(client.output, static_cast<uint8_t>(client.held_key), true);
+        }
+        if (!client.key_pending) {
+          client.key_pending = true;
+          client.key_time = now;
+        }
+        flush(client);
+      }
+      next_keys += key_interval;
+    }
+
+    const auto count = epoll_wait(epoll_fd, events.data(), static_cast<int>(events.size()), 1);
+    for (int i = 0; i < count; i++) {
+      auto& client = clients[events[i].data.u64];
+      while (!client.closed) {
+        const auto received = recv(client.fd, client.input.prepare(4096), 4096, 0);
+        if (received <= 0) {
+          if (received == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+            client.closed = true;
+          }
+          break;
+        }
+        client.input.received(static_cast<std::size_t>(received));
+        Message message;
+        while (client.input.next(message)) {
+          handle(client, message, totals);
+        }
+      }
+      if (client.closed) {
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, client.fd, nullptr);
+      }
+      flush(client);
+    }
+  }
+
+  const std::chrono::duration<double> elapsed = Clock::now() - start;
+  std::size_t closed = 0;
+  for (auto& client : clients) {
+    closed += client.closed;
+    close(client.fd);
+  }
+  close(epoll_fd);
+
+  std::cout << totals.started << " sessions started, " << closed << " closed by the host, "
+            << totals.errors << " errors, " << totals.bad_frames << " bad frames\n"
+            << totals.updates / elapsed.count() << " updates/s, "
+            << (totals.updates > 0 ? totals.bytes / totals.updates : 0) << " bytes/update\n"
+            << "key to update latency (us): p50 " << totals.key_to_update.percentile(50)
+            << ", p99 " << totals.key_to_update.percentile(99) << ", max "
+            << totals.key_to_update.max() << '\n';
+  return totals.bad_frames == 0 ? 0 : 1;
+}
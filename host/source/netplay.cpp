@@ -0,0 +1,109 @@
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <thread>
+#include <vector>
+
+#include "Emulator.h"
+#include "Hash.h"
+#include "Netplay.h"
+#include "NetplaySocket.h"
+#include "Rng.h"
+
+// Headless rollback netplay peer, to try netplay on one machine: start it twice over loopback, as
+// player 0 and player 1 with the ports swapped. Both press random keys of their half of the pad,
+// and once the given number of frames is confirmed on both sides, print a hash of the machine
+// state, which must be the same for the two.
+//
+// chip8-netplay <rom> <player 0|1> <local port> <remote port> [frames = 600] [delay ms = 0]
+//               [loss % = 0] [jitter ms = 0]
+
+using Clock = std::chrono::steady_clock;
+
+int main(int argc, char** argv) {
+  if (argc < 5) {
+    std::cerr << "Usage: " << argv[0]
+              << " <rom> <player 0|1> <local port> <remote port> [frames] [delay ms] [loss %]"
+                 " [jitter ms]\n";
+    return 1;
+  }
+  std::ifstream file(argv[1], std::ios::binary);
+  const std::vector<uint8_t> rom{std::istreambuf_iterator<char>(file),
+                                 std::istreambuf_iterator<char>()};
+  if (rom.empty()) {
+    std::cerr << "Can't read " << argv[1] << '\n';
+    return 1;
+  }
+
+  Netplay::Config config;
+  config.player = std::atoi(argv[2]) == 0 ? 0 : 1;
+  NetplaySocket::Config socket_config;
+  socket_config.local_port = static_cast<uint16_t>(std::atoi(argv[3]));
+  socket_config.remote_port = static_cast<uint16_t>(std::atoi(argv[4]));
+  const auto frames = static_cast<uint32_t>(argc > 5 ? std::atoi(argv[5]) : 600);
+  socket_config.delay_ms = argc > 6 ? std::atoi(argv[6]) : 0;
+  socket_config.loss = argc > 7 ? std::atof(argv[7]) / 100 : 0;
+  socket_config.jitter_ms = argc > 8 ? std::atoi(argv[8]) : 0;
+  socket_config.seed = config.player + 1;
+
+  Emulator emulator;
+  emulator.load_rom(rom.data(), rom.size());
+  Netplay netplay(emulator, config);
+  NetplaySocket socket(socket_config);
+
+  // A new random key combination about every 10 frames
+  SplitMix64 random(config.player + 100);
+  uint16_t keys = 0;
+  double rollback_ms = 0;
+
+  const auto period = std::chrono::microseconds(16667);
+  auto next_frame = Clock::now();
+  const auto give_up = Clock::now() + std::chrono::seconds(60) + period * frames;
+  // Keeps going once all the local frames are run, until both sides have everything
+  while (netplay.confirmed_frame() < frames || netplay.acknowledged_frame() < frames) {
+    if (Clock::now() > give_up) {
+      std::cerr << "Player " << int(config.player) << " timed out at frame " << netplay.frame()
+                << ", confirmed " << netplay.confirmed_frame() << '\n';
+      return 1;
+    }
+
+    socket.poll(netplay);
+    const auto start = Clock::now();
+    netplay.synchronize();
+    rollback_ms += std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+    if (netplay.frame() < frames) {
+      if (random.next64() % 10 == 0) {
+        keys = static_cast<uint16_t>(random.next64());
+      }
+      netplay.advance(keys);
+    }
+    socket.send(netplay);
+
+    next_frame += period;
+    std::this_thread::sleep_until(next_frame);
+  }
+  netplay.synchronize();
+
+  // The other side may still be waiting for the acknowledgement of its last inputs
+  for (int frame = 0; frame < 60; frame++) {
+    socket.poll(netplay);
+    socket.send(netplay);
+    std::this_thread::sleep_for(period);
+  }
+
+  std::vector<uint8_t> state;
+  emulator.save_state(state);
+  const auto& statistics = netplay.statistics();
+  const auto& socket_statistics = socket.statistics();
+  std::cout << "player " << int(config.player) << " frame " << netplay.frame() << " state "
+            << std::hex << fnv1a64(state.data(), state.size()) << std::dec << '\n'
+            << "  " << statistics.rollbacks << " rollbacks, " << statistics.resimulated_frames
+            << " frames re-simulated (max " << statistics.max_rollback << ") in " << rollback_ms
+            << " ms, " << statistics.stalls << " stalls\n"
+            << "  " << socket_statistics.sent << " packets sent, " << socket_statistics.dropped
+            << " dropped, " << socket_statistics.received << " received\n";
+  return 0;
+}
@@ -0,0 +1,74 @@
+#include <algorithm>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <vector>
+
+#include "RomPack.h"
+
+// Packs roms into one file for chip8-host and other loaders, see RomPack.h. Directories are walked
+// for rom files, which are named by their path relative to the directory; single roms by their file
+// name.
+//
+// chip8-pack <output.c8p> <rom or directory>...
+
+namespace {
+
+namespace fs = std::filesystem;
+
+bool read(const fs::path& path, std::string name, std::vector<PackedRom>& roms) {
+  std::ifstream file(path, std::ios::binary);
+  std::vector<uint8_t> data{std::istreambuf_iterator<char>(file),
+                            std::istreambuf_iterator<char>()};
+  if (!file && !file.eof()) {
+    std::cerr << "Can't read " << path.string() << '\n';
+    return false;
+  }
+  roms.push_back({std::move(name), std::move(data)});
+  return true;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  if (argc < 3) {
+    std::cerr << "Usage: " << argv[0] << " <output.c8p> <rom or directory>...\n";
+    return 1;
+  }
+
+  std::vector<PackedRom> roms;
+  try {
+    for (int i = 2; i < argc; i++) {
+      const fs::path argument(argv[i]);
+      if (!fs::is_directory(argument)) {
+        if (!read(argument, argument.filename().string(), roms)) {
+          return 1;
+        }
+        continue;
+      }
+      std::vector<fs::path> files;
+      for (const auto& entry : fs::recursive_directory_iterator(argument)) {
+        if (entry.is_regular_file() && rom_file_name(entry.path().filename().string())) {
+          files.push_back(entry.path());
+        }
+      }
+      std::sort(files.begin(), files.end());
+      for (const auto& file : files) {
+        if (!read(file, file.lexically_relative(argument).generic_string(), roms)) {
+          return 1;
+        }
+      }
+    }
+    write_rom_pack(roms, argv[1]);
+
+    const RomPack pack(argv[1]);
+    std::cout << roms.size() << " roms, " << pack.size() << " packed, "
+              << fs::file_size(argv[1]) << " bytes\n";
+  } catch (const std::exception& error) {
+    std::cerr << error.what() << '\n';
+    return 1;
+  }
+  return 0;
+}
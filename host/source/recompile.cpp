@@ -0,0 +1,46 @@
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <vector>
+
+#include "Recompiler.h"
+
+// Recompiles roms ahead of time to one C++ translation unit, to build into a program linking the
+// emulator library. The native code is then picked by rom hash with find_native_program().
+//
+// chip8-recompile <output.cpp> <rom>...
+
+int main(int argc, char** argv) {
+  if (argc < 3) {
+    std::cerr << "Usage: " << argv[0] << " <output.cpp> <rom>...\n";
+    return 1;
+  }
+
+  std::vector<RecompilerRom> roms;
+  for (int i = 2; i < argc; i++) {
+    std::ifstream file(argv[i], std::ios::binary);
+    std::vector<uint8_t> data{std::istreambuf_iterator<char>(file),
+                              std::istreambuf_iterator<char>()};
+    if (!file && data.empty()) {
+      std::cerr << "Can't read " << argv[i] << '\n';
+      return 1;
+    }
+    roms.push_back({std::filesystem::path(argv[i]).stem().string(), std::move(data)});
+  }
+
+  // Generated in memory first, so a failed run never leaves a truncated file behind
+  std::ostringstream source;
+  const auto stats = recompile(roms, source);
+  std::ofstream out(argv[1], std::ios::binary);
+  out << source.str();
+  if (!out.flush()) {
+    std::cerr << "Can't write " << argv[1] << '\n';
+    return 1;
+  }
+
+  std::cout << stats.programs << " programs, " << stats.blocks << " blocks, "
+            << stats.instructions << " instructions\n";
+  return 0;
+}
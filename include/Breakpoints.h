@@ -0,0 +1,39 @@
+#ifndef CHIP8EMUTESTS_BREAKPOINTS_H
+#define CHIP8EMUTESTS_BREAKPOINTS_H
+
+#include <bitset>
+#include <cinttypes>
+
+// Program counter breakpoints and memory watchpoints, one bit per address of the 4 KB address
+// space. Attach them to an emulator with Emulator::set_breakpoints().
+class Breakpoints {
+public:
+  static constexpr uint16_t no_address = 0xFFFF;
+
+  void add_breakpoint(uint16_t address);
+  void remove_breakpoint(uint16_t address);
+  bool has_breakpoint(uint16_t address) const;
+
+  // Stop before an instruction reads (DXYN, FX65) or writes (FX33, FX55) a watched address.
+  void add_read_watchpoint(uint16_t address);
+  void remove_read_watchpoint(uint16_t address);
+  void add_write_watchpoint(uint16_t address);
+  void remove_write_watchpoint(uint16_t address);
+
+  // Returns the first watched address in [address, address + length), wrapping at 0xFFF, or
+  // no_address.
+  uint16_t find_read_watchpoint(uint16_t address, uint16_t length) const;
+  uint16_t find_write_watchpoint(uint16_t address, uint16_t length) const;
+
+  // True when at least one breakpoint or watchpoint is set
+  bool any() const;
+
+  void clear();
+
+private:
+  std::bitset<4096> breakpoints;
+  std::bitset<4096> read_watchpoints;
+  std::bitset<4096> write_watchpoints;
+};
+
+#endif  // CHIP8EMUTESTS_BREAKPOINTS_H
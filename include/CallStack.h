@@ -0,0 +1,36 @@
+#ifndef CHIP8EMUTESTS_CALLSTACK_H
+#define CHIP8EMUTESTS_CALLSTACK_H
+
+#include <array>
+#include <cinttypes>
+#include <cstddef>
+
+// Fixed capacity stack of return addresses. The original CHIP-8 has 16 levels of nesting, keeping
+// them inline avoids any allocation and lets the emulator detect overflows. Usable in constant
+// expressions like the rest of the core.
+class CallStack {
+public:
+  static constexpr std::size_t capacity = 16;
+
+  constexpr bool empty() const { return count == 0; }
+  constexpr bool full() const { return count == capacity; }
+  constexpr std::size_t size() const { return count; }
+
+  // Bottom-most entry first
+  constexpr uint16_t operator[](std::size_t index) const { return entries[index]; }
+
+  constexpr uint16_t top() const { return entries[count - 1]; }
+  constexpr void push(uint16_t address) { entries[count++] = address; }
+  constexpr void pop() { count--; }
+
+  constexpr void clear() {
+    entries = {};
+    count = 0;
+  }
+
+private:
+  std::array<uint16_t, capacity> entries{};
+  uint8_t count = 0;
+};
+
+#endif  // CHIP8EMUTESTS_CALLSTACK_H
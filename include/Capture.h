@@ -0,0 +1,124 @@
+#ifndef CHIP8EMUTESTS_CAPTURE_H
+#define CHIP8EMUTESTS_CAPTURE_H
+
+#include <array>
+#include <atomic>
+#include <cinttypes>
+#include <fstream>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Emulator.h"
+#include "Renderer.h"
+
+// Records the screen of an emulator into a video stream, without a window.
+//
+// The capture subscribes to the draw events of the emulator and is told where frames end by
+// end_frame(). Frames whose screen changed are pushed into a bounded lock-free queue, and a writer
+// thread encodes them. The emulation thread never waits for the writer: when the queue is full the
+// frame is dropped and counted, and the previous screen is repeated in its place.
+//
+// Formats:
+//  - Y4M: uncompressed 4:4:4 YUV4MPEG2 at frames_per_second, readable by ffmpeg and most players.
+//  - RawRGBA: bare width * height * 4 bytes per frame, for piping into other tools.
+//  - Gif: looping animated GIF89a, consecutive identical frames merged into one longer frame.
+class Capture {
+public:
+  enum class Format : uint8_t { Y4M, RawRGBA, Gif };
+
+  struct Config {
+    Format format = Format::Y4M;
+    unsigned scale = 4;  // Output pixels per CHIP-8 pixel, in both directions
+    unsigned frames_per_second = 60;
+    std::size_t queue_capacity = 256;  // Frames
+    uint32_t foreground = 0xFFFFFF;    // 0xRRGGBB
+    uint32_t background = 0x000000;
+  };
+
+  // Writes to a file, throws std::system_error if it can't be created.
+  Capture(const Config& config, const std::string& path);
+  // Writes to a stream that must outlive the capture.
+  Capture(const Config& config, std::ostream& out);
+  ~Capture();
+
+  Capture(const Capture&) = delete;
+  Capture& operator=(const Capture&) = delete;
+
+  // Subscribes to the draw events of `emulator`, replacing any other draw listener. The emulator
+  // must stay attached until detach() or finish().
+  void attach(Emulator& emulator);
+  void detach();
+
+  // Marks the end of one emulated frame, call once per frame from the emulation thread.
+  void end_frame();
+
+  // Writes the remaining frames and the end of the stream, then stops the writer thread. Called by
+  // the destructor if needed.
+  void finish();
+
+  uint64_t frames() const;          // Frames ended so far
+  uint64_t dropped_frames() const;  // Changed frames lost because the queue was full
+  uint64_t written_frames() const;  // Frames in the output, after merging for GIF
+
+  static Format format_from_path(const std::string& path);
+
+private:
+  struct Frame {
+    uint64_t index;
+    std::array<uint8_t, 64 * 32> pixels;
+  };
+
+  Config config;
+  std::ofstream file;
+  std::ostream& out;
+
+  // Owned by the emulation thread
+  Emulator* emulator = nullptr;
+  bool drawn = false;
+  std::array<uint8_t, 64 * 32> last_queued{};
+  uint64_t frame_count = 0;
+
+  // Emulation thread -> writer thread, single producer single consumer ring
+  std::vector<Frame> queue;
+  std::atomic<uint64_t> queue_head{0};
+  std::atomic<uint64_t> queue_tail{0};
+  std::atomic<uint64_t> dropped{0};
+  std::atomic<uint64_t> written{0};
+  std::atomic<uint64_t> total_frames{0};  // Published by finish()
+  std::atomic<bool> finishing{false};
+  bool finished = false;
+  std::thread writer;
+
+  // Owned by the writer thread
+  std::array<uint8_t, 64 * 32> previous{};  // Last screen handed to the encoder
+  uint64_t next_index = 0;                  // Index of the next frame to encode
+  std::vector<uint8_t> scaled;              // Scaled frame, one palette index per pixel
+  std::vector<uint8_t> encoded;
+  Renderer rgba_renderer;
+  std::vector<uint32_t> rgba;
+  // GIF frame waiting for its duration, which is only known once a different frame comes
+  bool gif_pending = false;
+  uint64_t gif_pending_start = 0;
+  std::array<uint8_t, 64 * 32> gif_pixels{};
+
+  static void on_draw(void* context, const Emulator& emulator);
+
+  void start();
+  // Queues a changed screen, false if the queue is full
+  bool push(uint64_t index, const std::array<uint8_t, 64 * 32>& pixels);
+
+  void write();
+  void write_header();
+  void write_frames(const std::array<uint8_t, 64 * 32>& pixels, uint64_t until);
+  void write_trailer();
+  void write_y4m_frame();
+  void write_rgba_frame();
+  void write_gif_frame(uint64_t start, uint64_t end);
+  void scale(const std::array<uint8_t, 64 * 32>& pixels);
+  unsigned width() const;
+  unsigned height() const;
+};
+
+#endif  // CHIP8EMUTESTS_CAPTURE_H
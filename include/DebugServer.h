@@ -0,0 +1,136 @@
+#ifndef CHIP8EMUTESTS_DEBUGSERVER_H
+#define CHIP8EMUTESTS_DEBUGSERVER_H
+
+#ifndef _WIN32
+
+#include <sys/types.h>
+
+#include <array>
+#include <atomic>
+#include <cinttypes>
+#include <string>
+#include <thread>
+
+#include "Breakpoints.h"
+#include "Emulator.h"
+
+// GDB remote serial protocol stub for a live emulator, on a Unix socket or a loopback TCP port.
+//
+// The socket is served by a thread of its own, while the emulation thread keeps ownership of the
+// Emulator and calls service() once per frame instead of Emulator::run(). Debugger commands reach
+// the emulation thread through a lock-free queue, and the emulation thread hands snapshots of the
+// machine back through a lock-free triple buffer, so register and memory packets never pause
+// emulation.
+//
+// Registers, as numbered by `p` packets: 0-15 V0 to VF (8 bit), 16 I (16 bit), 17 pc (16 bit),
+// 18 SP (8 bit) and 19-34 the stack entries (16 bit). Values are little-endian. The target
+// description debuggers read with qXfer:features:read:target.xml names them V0-VF, I, pc, SP and
+// stack0-stack15.
+// Supported packets: ?, g, p, m, s, c, Z0-Z4, z0-z4, D, k, qXfer:features:read and the 0x03
+// interrupt. Packets with a wrong checksum are answered with '-' and ignored. `k` closes the
+// connection without a reply and lets the emulator run on, like `D`.
+//
+// A Unix socket path is only ever unlinked when it is a socket: a stale one is replaced, any other
+// file makes the constructor throw with EADDRINUSE.
+class DebugServer {
+public:
+  // Throws std::system_error if the socket can't be bound
+  explicit DebugServer(const std::string& unix_socket_path);
+  // Listens on 127.0.0.1, port 0 picks a free port
+  explicit DebugServer(uint16_t tcp_port);
+  ~DebugServer();
+
+  DebugServer(const DebugServer&) = delete;
+  DebugServer& operator=(const DebugServer&) = delete;
+
+  // The TCP port actually listened on
+  uint16_t port() const;
+
+  // Applies pending debugger commands, runs up to `cycles` cycles unless a debugger halted the
+  // emulator, and publishes a snapshot of the machine. Must always be called from the same thread.
+  RunResult service(Emulator& emulator, uint64_t cycles);
+
+  bool halted() const;
+
+private:
+  enum class CommandType : uint8_t {
+    Attach,     // Halt when a debugger connects
+    Interrupt,  // Halt on a 0x03 from the debugger
+    Step,
+    Continue,
+    Detach,
+    AddBreakpoint,
+    RemoveBreakpoint,
+    AddReadWatchpoint,
+    RemoveReadWatchpoint,
+    AddWriteWatchpoint,
+    RemoveWriteWatchpoint,
+  };
+
+  struct Command {
+    CommandType type;
+    uint16_t address;
+  };
+
+  struct Snapshot {
+    MachineState state;
+    bool halted = false;
+    uint8_t signal = 5;       // Signal reported in stop replies
+    uint64_t stop_count = 0;  // Incremented every time the emulator stops
+  };
+
+  static constexpr uint8_t snapshot_fresh = 0x4;
+
+  int listen_fd = -1;
+  int client_fd = -1;
+  uint16_t tcp_port = 0;
+  std::string unix_socket_path;
+  // Of the socket file bound, only unlinked on shutdown if it's still the same
+  dev_t socket_device = 0;
+  ino_t socket_inode = 0;
+  std::string input;  // Received from the debugger and not handled yet
+
+  std::atomic<bool> stopping{false};
+  std::thread thread;
+
+  // Debugger thread -> emulation thread, single producer single consumer ring
+  std::array<Command, 64> commands;
+  std::atomic<uint32_t> commands_head{0};
+  std::atomic<uint32_t> commands_tail{0};
+
+  // Emulation thread -> debugger thread triple buffer. `middle_snapshot` holds the index of the
+  // buffer in the middle, with snapshot_fresh set when it's newer than the one being read.
+  std::array<Snapshot, 3> snapshots;
+  std::atomic<uint8_t> middle_snapshot{1};
+  uint8_t read_snapshot = 0;   // Owned by the debugger thread
+  uint8_t write_snapshot = 2;  // Owned by the emulation thread
+
+  // Owned by the emulation thread
+  Breakpoints breakpoints;
+  bool is_halted = false;
+  uint8_t stop_signal = 5;
+  uint64_t stop_count = 0;
+
+  void start();
+  void stop(uint8_t signal);
+  void publish(const Emulator& emulator);
+  void apply(const Command& command, Emulator& emulator);
+
+  void push(CommandType type, uint16_t address = 0);
+  bool pop(Command& command);
+  const Snapshot& latest();
+
+  void serve();
+  void serve_client();
+  bool read_packet(std::string& packet);
+  void send_packet(const std::string& data);
+  std::string handle_packet(const std::string& packet);
+  std::string wait_for_stop(uint64_t previous_stop_count, bool interruptible);
+  std::string read_features(const std::string& arguments) const;
+  std::string read_registers(const MachineState& state) const;
+  std::string read_register(const MachineState& state, unsigned number) const;
+};
+
+#endif  // _WIN32
+
+#endif  // CHIP8EMUTESTS_DEBUGSERVER_H
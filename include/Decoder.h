@@ -0,0 +1,186 @@
+#ifndef CHIP8EMUTESTS_DECODER_H
+#define CHIP8EMUTESTS_DECODER_H
+
+#include <cinttypes>
+
+// Operation of a decoded instruction, named after the opcode it comes from
+enum class Operation : uint8_t {
+  Invalid,
+  I00E0,
+  I00EE,
+  I1NNN,
+  I2NNN,
+  I3XNN,
+  I4XNN,
+  I5XY0,
+  I6XNN,
+  I7XNN,
+  I8XY0,
+  I8XY1,
+  I8XY2,
+  I8XY3,
+  I8XY4,
+  I8XY5,
+  I8XY6,
+  I8XY7,
+  I8XYE,
+  I9XY0,
+  IANNN,
+  IBNNN,
+  ICXNN,
+  IDXYN,
+  IEX9E,
+  IEXA1,
+  IFX07,
+  IFX0A,
+  IFX15,
+  IFX18,
+  IFX1E,
+  IFX29,
+  IFX33,
+  IFX55,
+  IFX65,
+};
+
+// An opcode split into its operation and operands, 8 bytes. The register operands are 4-bit fields,
+// so even an instruction read back from a damaged file can't index outside of the registers.
+struct Instruction {
+  uint16_t opcode = 0;
+  Operation operation = Operation::Invalid;
+  uint8_t x : 4;
+  uint8_t y : 4;
+  uint8_t nn = 0;  // Low byte, N is its low nibble
+  uint8_t reserved = 0;
+  uint16_t nnn = 0;  // Low 12 bits
+
+  constexpr Instruction() : x(0), y(0) {}
+
+  constexpr uint8_t n() const { return nn & 0x0F; }
+};
+
+static_assert(sizeof(Instruction) == 8);
+
+constexpr Instruction decode(uint16_t opcode) {
+  Instruction instruction;
+  instruction.opcode = opcode;
+  instruction.x = (opcode & 0x0F00) >> 8;
+  instruction.y = (opcode & 0x00F0) >> 4;
+  instruction.nn = opcode & 0x00FF;
+  instruction.nnn = opcode & 0x0FFF;
+
+  auto operation = Operation::Invalid;
+  switch (opcode & 0xF000) {
+    case 0x0000:
+      operation = opcode == 0x00E0 ? Operation::I00E0
+                  : opcode == 0x00EE ? Operation::I00EE
+                                     : Operation::Invalid;
+      break;
+    case 0x1000:
+      operation = Operation::I1NNN;
+      break;
+    case 0x2000:
+      operation = Operation::I2NNN;
+      break;
+    case 0x3000:
+      operation = Operation::I3XNN;
+      break;
+    case 0x4000:
+      operation = Operation::I4XNN;
+      break;
+    case 0x5000:
+      operation = (opcode & 0x000F) == 0 ? Operation::I5XY0 : Operation::Invalid;
+      break;
+    case 0x6000:
+      operation = Operation::I6XNN;
+      break;
+    case 0x7000:
+      operation = Operation::I7XNN;
+      break;
+    case 0x8000:
+      switch (opcode & 0x000F) {
+        case 0x0:
+          operation = Operation::I8XY0;
+          break;
+        case 0x1:
+          operation = Operation::I8XY1;
+          break;
+        case 0x2:
+          operation = Operation::I8XY2;
+          break;
+        case 0x3:
+          operation = Operation::I8XY3;
+          break;
+        case 0x4:
+          operation = Operation::I8XY4;
+          break;
+        case 0x5:
+          operation = Operation::I8XY5;
+          break;
+        case 0x6:
+          operation = Operation::I8XY6;
+          break;
+        case 0x7:
+          operation = Operation::I8XY7;
+          break;
+        case 0xE:
+          operation = Operation::I8XYE;
+          break;
+      }
+      break;
+    case 0x9000:
+      operation = (opcode & 0x000F) == 0 ? Operation::I9XY0 : Operation::Invalid;
+      break;
+    case 0xA000:
+      operation = Operation::IANNN;
+      break;
+    case 0xB000:
+      operation = Operation::IBNNN;
+      break;
+    case 0xC000:
+      operation = Operation::ICXNN;
+      break;
+    case 0xD000:
+      operation = Operation::IDXYN;
+      break;
+    case 0xE000:
+      operation = (opcode & 0x00FF) == 0x9E   ? Operation::IEX9E
+                  : (opcode & 0x00FF) == 0xA1 ? Operation::IEXA1
+                                              : Operation::Invalid;
+      break;
+    case 0xF000:
+      switch (opcode & 0x00FF) {
+        case 0x07:
+          operation = Operation::IFX07;
+          break;
+        case 0x0A:
+          operation = Operation::IFX0A;
+          break;
+        case 0x15:
+          operation = Operation::IFX15;
+          break;
+        case 0x18:
+          operation = Operation::IFX18;
+          break;
+        case 0x1E:
+          operation = Operation::IFX1E;
+          break;
+        case 0x29:
+          operation = Operation::IFX29;
+          break;
+        case 0x33:
+          operation = Operation::IFX33;
+          break;
+        case 0x55:
+          operation = Operation::IFX55;
+          break;
+        case 0x65:
+          operation = Operation::IFX65;
+          break;
+      }
+      break;
+  }
+  instruction.operation = operation;
+  return instruction;
+}
+
+#endif  // CHIP8EMUTESTS_DECODER_H
@@ -0,0 +1,20 @@
+#ifndef CHIP8EMUTESTS_DELTACODEC_H
+#define CHIP8EMUTESTS_DELTACODEC_H
+
+#include <cinttypes>
+#include <cstddef>
+#include <vector>
+
+// XOR + run-length delta of a buffer against a base of the same size. The delta is a sequence of
+// (unchanged byte count, changed byte count, XORed changed bytes) runs, counts being LEB128
+// varints, so identical buffers encode to nothing and small changes to a few bytes.
+
+// Appends the delta of `current` against `base` to `out`.
+void delta_encode(const uint8_t* base, const uint8_t* current, std::size_t size,
+                  std::vector<uint8_t>& out);
+
+// XORs a delta into `target`, turning the base into the encoded buffer (or back). Returns false if
+// the delta is malformed, nothing past `size` is ever written.
+bool delta_apply(const uint8_t* delta, std::size_t delta_size, uint8_t* target, std::size_t size);
+
+#endif  // CHIP8EMUTESTS_DELTACODEC_H
@@ -1,147 +1,935 @@
 #ifndef CHIP8EMUTESTS_EMULATOR_H
 #define CHIP8EMUTESTS_EMULATOR_H
 
+#include <algorithm>
 #include <array>
+#include <cassert>
 #include <cinttypes>
 #include <istream>
 #include <limits>
-#include <random>
-#include <stack>
+#include <vector>
 
-class Emulator {
+#include "Breakpoints.h"
+#include "Decoder.h"
+#include "Fingerprint.h"
+#include "Font.h"
+#include "Fusion.h"
+#include "Hash.h"
+#include "MachineState.h"
+#include "SaveState.h"
+#include "Translation.h"
+
+#ifdef CHIP8_PROFILER
+#  include "Profiler.h"
+#endif
+
+enum class FaultKind : uint8_t {
+  None,
+  InvalidOpcode,   // The opcode does not decode to any instruction
+  StackOverflow,   // 2NNN with all 16 stack levels in use
+  StackUnderflow,  // 00EE with an empty stack
+};
+
+const char* to_string(FaultKind kind);
+
+class Profiler;
+struct NativeProgram;
+template <uint64_t rom_hash> struct NativeCode;
+
+// Reported instead of executing an instruction that can't be executed. The machine state is left
+// untouched, with the program counter still pointing at the faulting instruction.
+struct Fault {
+  FaultKind kind = FaultKind::None;
+  uint16_t pc = 0;
+  uint16_t opcode = 0;
+
+  constexpr explicit operator bool() const { return kind != FaultKind::None; }
+};
+
+enum class StopReason : uint8_t {
+  Completed,        // All the requested cycles were executed
+  Breakpoint,       // The program counter reached a breakpoint
+  ReadWatchpoint,   // The next instruction reads a watched address
+  WriteWatchpoint,  // The next instruction writes a watched address
+  Fault,            // The next instruction faulted
+};
+
+struct RunResult {
+  StopReason reason = StopReason::Completed;
+  uint16_t address = 0;  // Breakpoint or watched address that stopped the run
+  uint64_t cycles = 0;   // Cycles executed before stopping
+  Fault fault;
+};
+
+// Path of one key press through the program, in emulated cycles as counted by Emulator::cycles()
+struct InputLatencySample {
+  uint64_t timestamp = 0;      // Host time given to press_key()
+  uint64_t press_cycle = 0;    // Cycles completed when the key was pressed
+  uint64_t observe_cycle = 0;  // Cycle in which EX9E, EXA1 or FX0A first saw the key
+  uint64_t draw_cycle = 0;     // First cycle changing the screen from then on
+  uint8_t key = 0;
+};
+
+class Emulator : protected MachineState {
 public:
-  Emulator();
+  // Called right after every instruction that changes the screen (00E0 and DXYN)
+  using DrawListener = void (*)(void* context, const Emulator& emulator);
+
+  constexpr Emulator();
 
 public:
-  void reset();
+  constexpr void reset();
 
   void load_rom(std::istream& rom);
+  // Loads a rom image from memory, anything that doesn't fit after 0x200 is ignored.
+  constexpr void load_rom(const uint8_t* rom, std::size_t size);
 
-  void emulate_cycle();
+  // Reseeds the CXNN random number generator. It starts from seed 0, so runs are reproducible
+  // unless the frontend seeds it from something else.
+  constexpr void seed(uint64_t seed);
 
-  void execute_opcode(uint16_t opcode);
+  constexpr Fault emulate_cycle();
 
-  void press_key(uint8_t key);
+  constexpr Fault execute_opcode(uint16_t opcode);
 
-  void release_key(uint8_t key);
+  // Executes up to `cycles` cycles, stopping early on a fault or a breakpoint/watchpoint hit. The
+  // instruction at the current program counter is always executed, so a stopped run can be
+  // resumed by calling run() again.
+  RunResult run(uint64_t cycles);
 
-  bool should_draw();
-  bool should_buzz();
+  // Breakpoints are not owned by the emulator and must outlive it (or be detached with nullptr).
+  // While none is set, run() uses the plain loop without any debug checks.
+  void set_breakpoints(const Breakpoints* breakpoints);
 
-  const std::array<uint8_t, 64 * 32>& get_graphic() const;
+  // Whether run() uses the debug loop: attached breakpoints with at least one breakpoint or
+  // watchpoint set
+  bool has_breakpoints() const;
 
-  friend class EmulatorTest;
+  // Pre-decoded instructions, see Translation.h. Not owned by the emulator and must outlive it (or
+  // be detached with nullptr). Instructions whose bytes in memory don't match are decoded as usual,
+  // so any translation gives the same results. Its superinstructions are run by run() while no
+  // breakpoint or profiler is set, see Fusion.h.
+  void set_translation(const Translation* translation);
 
-private:
-  bool draw_flag = false;
-  bool sound_flag = false;
+  // Reports every executed instruction to `profiler`, which must outlive the emulator (or be
+  // detached with nullptr). Ignored unless built with CHIP8_PROFILER, see Profiler.h.
+  void set_profiler(Profiler* profiler);
+
+  // Runs `program`, a rom recompiled to C++ (see Recompiler.h), instead of interpreting while it
+  // matches the loaded rom and no breakpoint is set. Not owned by the emulator.
+  void set_native_program(const NativeProgram* program);
+
+  // `context` is passed back to the listener untouched, nullptr unsubscribes. Only one listener can
+  // be set at a time.
+  void set_draw_listener(DrawListener listener, void* context);
+
+  // `timestamp` is any host time the frontend wants back in the input latency sample of this
+  // press.
+  constexpr void press_key(uint8_t key, uint64_t timestamp = 0);
 
-  std::array<uint8_t, 4096> memory;
-  std::array<uint8_t, 64 * 32> graphic;
+  constexpr void release_key(uint8_t key);
+
+  // Presses the keys whose bit is set in `keys` (bit N for key N) and releases the others.
+  constexpr void set_keys(uint16_t keys);
+
+  constexpr bool should_draw();
+  constexpr bool should_buzz();
+
+  constexpr const std::array<uint8_t, 64 * 32>& get_graphic() const;
+
+  // Cycles completed since construction or the last reset()
+  constexpr uint64_t cycles() const;
+  // Superinstructions run since construction or the last reset(), and the cycles they took
+  const FusionStatistics& fusion_statistics() const;
+  // Takes the oldest input latency sample, complete once the press was observed and followed by a
+  // draw. Returns false if there's none. Only the last 16 are kept.
+  bool pop_input_latency(InputLatencySample& sample);
+
+  constexpr const MachineState& state() const;
+  // Puts the machine back in a state previously taken with state()
+  constexpr void restore(const MachineState& state);
+
+  // Serializes the whole machine into the versioned save state format described in SaveState.h.
+  void save_state(std::vector<uint8_t>& out) const;
+  // Restores a save state, including the hash of the rom it was taken with. The emulator is left
+  // untouched unless Ok is returned.
+  LoadStateResult load_state(const uint8_t* data, std::size_t size);
+
+  // FNV-1a hash of the last loaded rom
+  uint64_t rom_hash() const;
+
+  // Fingerprint of everything deciding what the machine does next: memory, screen, registers,
+  // stack, timers, keys, the FX0A wait and the random generator, as restore() brings them back.
+  // Memory and screen are fingerprinted as they change (see Fingerprint.h), so this only hashes
+  // the few words of the rest. Equal states give equal fingerprints.
+  //
+  // Emulators only start keeping the fingerprint up to date with the first call, or with
+  // enable_fingerprint(), so instructions of those never fingerprinted don't pay for it.
+  constexpr Fingerprint fingerprint();
+  // Fingerprints memory and screen once, then keeps their fingerprint up to date as instructions
+  // run
+  constexpr void enable_fingerprint();
+
+  friend class EmulatorTest;
+  // Recompiled roms run the instructions below directly
+  template <uint64_t rom_hash> friend struct NativeCode;
 
 private:
-  // 2048 pixel screen
+  // Addresses wrap around the 4 KB address space, so no access can land outside of memory
+  static constexpr uint16_t address_mask = 0xFFF;
 
-  std::array<uint8_t, 16> V;   // Registers
-  uint16_t I;                  // Index register
-  uint16_t pc;                 // Program counter
-  std::stack<uint16_t> stack;  // Used for function calls
+  const Breakpoints* breakpoints = nullptr;
+  const Translation* translation = nullptr;
+  const NativeProgram* native_program = nullptr;
+#ifdef CHIP8_PROFILER
+  Profiler* profiler = nullptr;
+#endif
+  DrawListener draw_listener = nullptr;
+  void* draw_listener_context = nullptr;
 
-  // When set above zero the timers will count down to zero.
-  uint8_t delay_timer;
-  uint8_t sound_timer;  // Will make the system buzz sound when it reaches zero.
+  uint64_t cycle_count = 0;
+  // Presses being followed, by key. A release before the program sees the key drops its press.
+  std::array<InputLatencySample, 16> pending_inputs{};
+  uint16_t pressed_inputs = 0;   // Keys waiting to be observed
+  uint16_t observed_inputs = 0;  // Keys observed, waiting for a draw
+  std::array<InputLatencySample, 16> input_samples{};
+  std::size_t input_samples_head = 0;
+  std::size_t input_samples_count = 0;
+  uint64_t loaded_rom_hash = 0;
+  FusionStatistics fusion_stats;
+  bool fingerprinting = false;  // Whether the two below are kept up to date
+  Fingerprint memory_fingerprint = reset_memory_fingerprint;
+  Fingerprint screen_fingerprint = blank_screen_fingerprint;
 
-  std::array<bool, 16> keys;
-  bool waiting_for_key = false;      // For instruction FX0A
-  uint8_t waiting_for_key_register;  // For instruction FX0A
+  constexpr Fault execute(const Instruction& instruction);
+  // Executes `instruction`, known to be an `operation`
+  template <Operation operation> constexpr Fault execute(const Instruction& instruction);
+  constexpr Fault fault(FaultKind kind, uint16_t opcode) const;
+  // Ticks the timers and counts the cycle, after its instruction
+  constexpr void end_cycle();
+  // Writes memory, updating its fingerprint if it is kept
+  constexpr void write_memory(uint16_t address, uint8_t value);
+  // Fingerprints memory and screen from scratch if they are kept, after they were overwritten
+  constexpr void refresh_fingerprints();
+  // Flags the screen as changed and notifies the draw listener
+  constexpr void screen_changed();
+  // Records that the program saw `key` pressed
+  constexpr void key_observed(uint8_t key);
 
-  // RNG for instruction CXNN
-  std::mt19937 rng_engine;
-  std::uniform_int_distribution<> rng_distribution;
+  template <bool debug> RunResult run_loop(uint64_t cycles);
+  // Runs the superinstruction of the translation at the program counter, if any and if it fits in
+  // `cycles`. Returns the cycles it took, 0 when there was nothing to run, and the instruction
+  // faulting in `fault`.
+  uint64_t run_fused(uint64_t cycles, Fault& fault);
+  // Runs the operations of the `kind` superinstruction from the program counter, until one faults
+  // or a skip or jump leaves the sequence. Returns how many ran.
+  template <FusionKind kind>
+  uint64_t run_superinstruction(const Instruction* instructions, Fault& fault);
+  // Checks the breakpoints and watchpoints hit by the instruction about to be executed.
+  RunResult check_breakpoints(uint16_t opcode) const;
 
   // Instructions //
 
   // 00E0 Clears the screen.
-  void instruction_00E0();
+  constexpr void instruction_00E0();
   // 00EE Returns from a subroutine.
-  void instruction_00EE();
+  constexpr void instruction_00EE();
   // 1NNN Returns from a subroutine.
-  void instruction_1NNN(uint16_t jump_address);
+  constexpr void instruction_1NNN(uint16_t jump_address);
   // 2NNN Calls subroutine at NNN.
-  void instruction_2NNN(uint16_t subroutine_address);
+  constexpr void instruction_2NNN(uint16_t subroutine_address);
   // 3XNN Skips the next instruction if VX equals NN.
-  void instruction_3XNN(uint8_t reg, uint8_t number);
+  constexpr void instruction_3XNN(uint8_t reg, uint8_t number);
   // 4XNN Skips the next instruction if VX doesn't NN.
-  void instruction_4XNN(uint8_t reg, uint8_t number);
+  constexpr void instruction_4XNN(uint8_t reg, uint8_t number);
   // 5XY0 Skips the next instruction if VX equals VY.
-  void instruction_5XY0(uint8_t reg1, uint8_t reg2);
+  constexpr void instruction_5XY0(uint8_t reg1, uint8_t reg2);
   // 6XNN Sets VX to NN.
-  void instruction_6XNN(uint8_t reg, uint8_t value);
+  constexpr void instruction_6XNN(uint8_t reg, uint8_t value);
   // 7XNN Adds NN to VX. (Carry flag is not changed)
-  void instruction_7XNN(uint8_t reg, uint8_t value);
+  constexpr void instruction_7XNN(uint8_t reg, uint8_t value);
   // 8XY0 Sets VX to the value of VY.
-  void instruction_8XY0(uint8_t reg1, uint8_t reg2);
+  constexpr void instruction_8XY0(uint8_t reg1, uint8_t reg2);
   // 8XY1 Sets VX to VX or VY. (Bitwise OR operation)
-  void instruction_8XY1(uint8_t reg1, uint8_t reg2);
+  constexpr void instruction_8XY1(uint8_t reg1, uint8_t reg2);
   // 8XY2 Sets VX to VX and VY. (Bitwise AND operation)
-  void instruction_8XY2(uint8_t reg1, uint8_t reg2);
+  constexpr void instruction_8XY2(uint8_t reg1, uint8_t reg2);
   // 8XY3 Sets VX to VX xor VY.
-  void instruction_8XY3(uint8_t reg1, uint8_t reg2);
+  constexpr void instruction_8XY3(uint8_t reg1, uint8_t reg2);
   // 8XY4 Adds VY to VX. VF is set to 1 when there's a carry, and to 0 when there isn't.
-  void instruction_8XY4(uint8_t reg1, uint8_t reg2);
+  constexpr void instruction_8XY4(uint8_t reg1, uint8_t reg2);
   // 8XY5 VY is subtracted from VX. VF is set to 0 when there's a borrow, and 1 when there isn't.
-  void instruction_8XY5(uint8_t reg1, uint8_t reg2);
+  constexpr void instruction_8XY5(uint8_t reg1, uint8_t reg2);
   // 8XY6 Stores the least significant bit of VX in VF and then shifts VX to the right by 1.
-  void instruction_8XY6(uint8_t reg);
+  constexpr void instruction_8XY6(uint8_t reg);
   // 8XY7 Sets VX to VY minus VX. VF is set to 0 when there's a borrow, and 1 when there isn't.
-  void instruction_8XY7(uint8_t reg1, uint8_t reg2);
+  constexpr void instruction_8XY7(uint8_t reg1, uint8_t reg2);
   // 8XYE Stores the most significant bit of VX in VF and then shifts VX to the left by 1
-  void instruction_8XYE(uint8_t reg);
+  constexpr void instruction_8XYE(uint8_t reg);
   // 9XY0 Skips the next instruction if VX doesn't equal VY.
-  void instruction_9XY0(uint8_t reg1, uint8_t reg2);
+  constexpr void instruction_9XY0(uint8_t reg1, uint8_t reg2);
   // ANNN Sets I to the address NNN.
-  void instruction_ANNN(uint16_t value);
+  constexpr void instruction_ANNN(uint16_t value);
   // BNNN Jumps to the address NNN plus V0.
-  void instruction_BNNN(uint16_t jump_address);
+  constexpr void instruction_BNNN(uint16_t jump_address);
   // CXNN Sets VX to the result of a bitwise and operation on a random number (Typically: 0 to 255)
   // and NN.
-  void instruction_CXNN(uint8_t reg, uint8_t value);
+  constexpr void instruction_CXNN(uint8_t reg, uint8_t value);
   // DXYN Draws a sprite at coordinate (VX, VY) that has a width of 8 pixels and a height of N
   // pixels. Each row of 8 pixels is read as bit-coded starting from memory location I; I value
   // doesn’t change after the execution of this instruction. As described above, VF is set to 1 if
   // any screen pixels are flipped from set to unset when the sprite is drawn, and to 0 if that
   // doesn’t happen.
-  void instruction_DXYN(uint8_t reg1, uint8_t reg2, uint8_t height);
+  constexpr void instruction_DXYN(uint8_t reg1, uint8_t reg2, uint8_t height);
   // EX9E Skips the next instruction if the key stored in VX is pressed.
-  void instruction_EX9E(uint8_t key);
+  constexpr void instruction_EX9E(uint8_t key);
   // EXA1 Skips the next instruction if the key stored in VX isn't pressed.
-  void instruction_EXA1(uint8_t key);
+  constexpr void instruction_EXA1(uint8_t key);
   // FX07 Sets VX to the value of the delay timer.
-  void instruction_FX07(uint8_t reg);
+  constexpr void instruction_FX07(uint8_t reg);
   // FX0A A key press is awaited, and then stored in VX. (Blocking Operation. All instruction halted
   // until next key event)
-  void instruction_FX0A(uint8_t reg);
+  constexpr void instruction_FX0A(uint8_t reg);
   // FX15 Sets the delay timer to VX.
-  void instruction_FX15(uint8_t reg);
+  constexpr void instruction_FX15(uint8_t reg);
   // FX18 Sets the sound timer to VX.
-  void instruction_FX18(uint8_t reg);
+  constexpr void instruction_FX18(uint8_t reg);
   // FX1E Adds VX to I. VF is set to 1 when there is a range overflow (I+VX>0xFFF), and to 0 when
   // there isn't.
-  void instruction_FX1E(uint8_t reg);
+  constexpr void instruction_FX1E(uint8_t reg);
   // FX29 Sets I to the location of the sprite for the character in VX. Characters 0-F (in
   // hexadecimal) are represented by a 4x5 font.
-  void instruction_FX29(uint8_t reg);
+  constexpr void instruction_FX29(uint8_t reg);
   // FX33 Stores the binary-coded decimal representation of VX, with the most significant of three
   // digits at the address in I, the middle digit at I plus 1, and the least significant digit at I
   // plus 2. (In other words, take the decimal representation of VX, place the hundreds digit in
   // memory at location in I, the tens digit at location I+1, and the ones digit at location I+2.)
-  void instruction_FX33(uint8_t reg);
+  constexpr void instruction_FX33(uint8_t reg);
   // FX55 Stores V0 to VX (including VX) in memory starting at address I. The offset from I is
   // increased by 1 for each value written, but I itself is left unmodified.
-  void instruction_FX55(uint8_t reg);
+  constexpr void instruction_FX55(uint8_t reg);
   // FX65 Fills V0 to VX (including VX) with values from memory starting at address I. The offset
   // from I is increased by 1 for each value written, but I itself is left unmodified.
-  void instruction_FX65(uint8_t reg);
+  constexpr void instruction_FX65(uint8_t reg);
 };
 
+// Core //
+//
+// Everything executing instructions is constexpr and defined here, so an Emulator can run in
+// constant expressions: tests check opcodes with static_assert, and the state after a rom's init
+// code can be computed by the compiler, see boot().
+
+constexpr Emulator::Emulator() { reset(); }
+
+constexpr void Emulator::reset() {
+  pc = 0x200;  // Program counter starts at 0x200
+
+  // Reset registers to 0
+  V = {};
+  I = 0;
+
+  // Empty the stack
+  stack.clear();
+
+  // Clear memory
+  memory = {};
+
+  // Clear graphics
+  graphic = {};
+
+  // Load font into memory (starting from address 0)
+  for (std::size_t i = 0; i < chip8_font.size(); i++) {
+    memory[i] = chip8_font[i];
+  }
+  memory_fingerprint = reset_memory_fingerprint;
+  screen_fingerprint = blank_screen_fingerprint;
+
+  // Reset timers
+  sound_timer = 0;
+  delay_timer = 0;
+
+  loaded_rom_hash = 0;
+
+  // Release all keys
+  keys = {};
+  waiting_for_key = false;
+  waiting_for_key_register = 0;
+
+  cycle_count = 0;
+  fusion_stats = {};
+  pressed_inputs = 0;
+  observed_inputs = 0;
+  input_samples_count = 0;
+}
+
+constexpr void Emulator::load_rom(const uint8_t* rom, std::size_t size) {
+  size = std::min(size, memory.size() - 0x200);
+  for (std::size_t i = 0; i < size; i++) {
+    write_memory(static_cast<uint16_t>(0x200 + i), rom[i]);
+  }
+
+  loaded_rom_hash = fnv1a64(rom, size);
+}
+
+constexpr void Emulator::seed(uint64_t seed) { rng_engine.seed(seed); }
+
+constexpr Fault Emulator::emulate_cycle() {
+  if (!waiting_for_key) {
+    // Fetch opcode, pre-decoded if the translation still matches memory
+    const uint16_t opcode = memory[pc & address_mask] << 8 | memory[(pc + 1) & address_mask];
+    const auto translated
+        = translation != nullptr ? &translation->instructions[pc & address_mask] : nullptr;
+    const auto instruction
+        = translated != nullptr && translated->opcode == opcode ? *translated : decode(opcode);
+#ifdef CHIP8_PROFILER
+    const auto address = pc;
+#endif
+    if (auto result = execute(instruction)) {
+      return result;
+    }
+#ifdef CHIP8_PROFILER
+    if (profiler != nullptr) {
+      profiler->record(address, instruction);
+    }
+#endif
+  }
+  end_cycle();
+  return {};
+}
+
+constexpr void Emulator::end_cycle() {
+  // Tick timers
+  if (delay_timer > 0) {
+    delay_timer--;
+  }
+  if (sound_timer > 0) {
+    sound_timer--;
+
+    if (sound_timer == 0) {
+      sound_flag = true;
+    }
+  }
+
+  cycle_count++;
+}
+
+constexpr void Emulator::write_memory(uint16_t address, uint8_t value) {
+  if (fingerprinting) {
+    memory_fingerprint ^= fingerprint_key(address, memory[address]);
+    memory_fingerprint ^= fingerprint_key(address, value);
+  }
+  memory[address] = value;
+}
+
+constexpr void Emulator::refresh_fingerprints() {
+  if (fingerprinting) {
+    memory_fingerprint = fingerprint_memory(memory);
+    screen_fingerprint = fingerprint_screen(graphic);
+  }
+}
+
+constexpr void Emulator::enable_fingerprint() {
+  if (!fingerprinting) {
+    fingerprinting = true;
+    refresh_fingerprints();
+  }
+}
+
+constexpr Fingerprint Emulator::fingerprint() {
+  enable_fingerprint();
+
+  std::array<uint64_t, 10> words{};
+  for (std::size_t i = 0; i < V.size(); i++) {
+    words[i / 8] |= static_cast<uint64_t>(V[i]) << (8 * (i % 8));
+  }
+  words[2] = I | static_cast<uint64_t>(pc) << 16 | static_cast<uint64_t>(delay_timer) << 32
+             | static_cast<uint64_t>(sound_timer) << 40
+             | static_cast<uint64_t>(waiting_for_key) << 48
+             | static_cast<uint64_t>(waiting_for_key_register) << 56;
+  for (std::size_t key = 0; key < keys.size(); key++) {
+    words[3] |= static_cast<uint64_t>(keys[key]) << key;
+  }
+  words[3] |= static_cast<uint64_t>(stack.size()) << 16;
+  // Only the live entries, the ones above were popped and don't matter
+  for (std::size_t level = 0; level < stack.size(); level++) {
+    words[4 + level / 4] |= static_cast<uint64_t>(stack[level]) << (16 * (level % 4));
+  }
+  const auto rng_state = rng_engine.state();
+  words[8] = rng_state[0];
+  words[9] = rng_state[1];
+
+  Fingerprint registers{0x43484950u, 0x38464950u};
+  for (const auto word : words) {
+    registers.low = fingerprint_mix(registers.low ^ word);
+    registers.high = fingerprint_mix(registers.high ^ word ^ 0xC8C8C8C8C8C8C8C8);
+  }
+  auto fingerprint = memory_fingerprint;
+  fingerprint ^= screen_fingerprint;
+  fingerprint ^= registers;
+  return fingerprint;
+}
+
+constexpr void Emulator::screen_changed() {
+  draw_flag = true;
+  if (draw_listener != nullptr) {
+    draw_listener(draw_listener_context, *this);
+  }
+
+  // Complete the latency samples of the presses seen so far
+  for (uint8_t key = 0; observed_inputs != 0; key++) {
+    if ((observed_inputs & (1 << key)) == 0) {
+      continue;
+    }
+    observed_inputs &= ~(1 << key);
+
+    auto sample = pending_inputs[key];
+    sample.draw_cycle = cycle_count;
+    input_samples[(input_samples_head + input_samples_count) % input_samples.size()] = sample;
+    if (input_samples_count < input_samples.size()) {
+      input_samples_count++;
+    } else {
+      input_samples_head = (input_samples_head + 1) % input_samples.size();
+    }
+  }
+}
+
+constexpr void Emulator::key_observed(uint8_t key) {
+  if ((pressed_inputs & (1 << key)) != 0) {
+    pressed_inputs &= ~(1 << key);
+    observed_inputs |= 1 << key;
+    pending_inputs[key].observe_cycle = cycle_count;
+  }
+}
+
+constexpr Fault Emulator::execute_opcode(uint16_t opcode) { return execute(decode(opcode)); }
+
+template <Operation operation>
+constexpr Fault Emulator::execute(const Instruction& instruction) {
+  if constexpr (operation == Operation::I00E0) {
+    instruction_00E0();
+  } else if constexpr (operation == Operation::I00EE) {
+    if (stack.empty()) {
+      return fault(FaultKind::StackUnderflow, instruction.opcode);
+    }
+    instruction_00EE();
+  } else if constexpr (operation == Operation::I1NNN) {
+    instruction_1NNN(instruction.nnn);
+  } else if constexpr (operation == Operation::I2NNN) {
+    if (stack.full()) {
+      return fault(FaultKind::StackOverflow, instruction.opcode);
+    }
+    instruction_2NNN(instruction.nnn);
+  } else if constexpr (operation == Operation::I3XNN) {
+    instruction_3XNN(instruction.x, instruction.nn);
+  } else if constexpr (operation == Operation::I4XNN) {
+    instruction_4XNN(instruction.x, instruction.nn);
+  } else if constexpr (operation == Operation::I5XY0) {
+    instruction_5XY0(instruction.x, instruction.y);
+  } else if constexpr (operation == Operation::I6XNN) {
+    instruction_6XNN(instruction.x, instruction.nn);
+  } else if constexpr (operation == Operation::I7XNN) {
+    instruction_7XNN(instruction.x, instruction.nn);
+  } else if constexpr (operation == Operation::I8XY0) {
+    instruction_8XY0(instruction.x, instruction.y);
+  } else if constexpr (operation == Operation::I8XY1) {
+    instruction_8XY1(instruction.x, instruction.y);
+  } else if constexpr (operation == Operation::I8XY2) {
+    instruction_8XY2(instruction.x, instruction.y);
+  } else if constexpr (operation == Operation::I8XY3) {
+    instruction_8XY3(instruction.x, instruction.y);
+  } else if constexpr (operation == Operation::I8XY4) {
+    instruction_8XY4(instruction.x, instruction.y);
+  } else if constexpr (operation == Operation::I8XY5) {
+    instruction_8XY5(instruction.x, instruction.y);
+  } else if constexpr (operation == Operation::I8XY6) {
+    instruction_8XY6(instruction.x);
+  } else if constexpr (operation == Operation::I8XY7) {
+    instruction_8XY7(instruction.x, instruction.y);
+  } else if constexpr (operation == Operation::I8XYE) {
+    instruction_8XYE(instruction.x);
+  } else if constexpr (operation == Operation::I9XY0) {
+    instruction_9XY0(instruction.x, instruction.y);
+  } else if constexpr (operation == Operation::IANNN) {
+    instruction_ANNN(instruction.nnn);
+  } else if constexpr (operation == Operation::IBNNN) {
+    instruction_BNNN(instruction.nnn);
+  } else if constexpr (operation == Operation::ICXNN) {
+    instruction_CXNN(instruction.x, instruction.nn);
+  } else if constexpr (operation == Operation::IDXYN) {
+    instruction_DXYN(instruction.x, instruction.y, instruction.n());
+  } else if constexpr (operation == Operation::IEX9E) {
+    instruction_EX9E(instruction.x);
+  } else if constexpr (operation == Operation::IEXA1) {
+    instruction_EXA1(instruction.x);
+  } else if constexpr (operation == Operation::IFX07) {
+    instruction_FX07(instruction.x);
+  } else if constexpr (operation == Operation::IFX0A) {
+    instruction_FX0A(instruction.x);
+  } else if constexpr (operation == Operation::IFX15) {
+    instruction_FX15(instruction.x);
+  } else if constexpr (operation == Operation::IFX18) {
+    instruction_FX18(instruction.x);
+  } else if constexpr (operation == Operation::IFX1E) {
+    instruction_FX1E(instruction.x);
+  } else if constexpr (operation == Operation::IFX29) {
+    instruction_FX29(instruction.x);
+  } else if constexpr (operation == Operation::IFX33) {
+    instruction_FX33(instruction.x);
+  } else if constexpr (operation == Operation::IFX55) {
+    instruction_FX55(instruction.x);
+  } else if constexpr (operation == Operation::IFX65) {
+    instruction_FX65(instruction.x);
+  } else {
+    return fault(FaultKind::InvalidOpcode, instruction.opcode);
+  }
+
+  return {};
+}
+
+constexpr Fault Emulator::execute(const Instruction& instruction) {
+  switch (instruction.operation) {
+    case Operation::I00E0:
+      return execute<Operation::I00E0>(instruction);
+    case Operation::I00EE:
+      return execute<Operation::I00EE>(instruction);
+    case Operation::I1NNN:
+      return execute<Operation::I1NNN>(instruction);
+    case Operation::I2NNN:
+      return execute<Operation::I2NNN>(instruction);
+    case Operation::I3XNN:
+      return execute<Operation::I3XNN>(instruction);
+    case Operation::I4XNN:
+      return execute<Operation::I4XNN>(instruction);
+    case Operation::I5XY0:
+      return execute<Operation::I5XY0>(instruction);
+    case Operation::I6XNN:
+      return execute<Operation::I6XNN>(instruction);
+    case Operation::I7XNN:
+      return execute<Operation::I7XNN>(instruction);
+    case Operation::I8XY0:
+      return execute<Operation::I8XY0>(instruction);
+    case Operation::I8XY1:
+      return execute<Operation::I8XY1>(instruction);
+    case Operation::I8XY2:
+      return execute<Operation::I8XY2>(instruction);
+    case Operation::I8XY3:
+      return execute<Operation::I8XY3>(instruction);
+    case Operation::I8XY4:
+      return execute<Operation::I8XY4>(instruction);
+    case Operation::I8XY5:
+      return execute<Operation::I8XY5>(instruction);
+    case Operation::I8XY6:
+      return execute<Operation::I8XY6>(instruction);
+    case Operation::I8XY7:
+      return execute<Operation::I8XY7>(instruction);
+    case Operation::I8XYE:
+      return execute<Operation::I8XYE>(instruction);
+    case Operation::I9XY0:
+      return execute<Operation::I9XY0>(instruction);
+    case Operation::IANNN:
+      return execute<Operation::IANNN>(instruction);
+    case Operation::IBNNN:
+      return execute<Operation::IBNNN>(instruction);
+    case Operation::ICXNN:
+      return execute<Operation::ICXNN>(instruction);
+    case Operation::IDXYN:
+      return execute<Operation::IDXYN>(instruction);
+    case Operation::IEX9E:
+      return execute<Operation::IEX9E>(instruction);
+    case Operation::IEXA1:
+      return execute<Operation::IEXA1>(instruction);
+    case Operation::IFX07:
+      return execute<Operation::IFX07>(instruction);
+    case Operation::IFX0A:
+      return execute<Operation::IFX0A>(instruction);
+    case Operation::IFX15:
+      return execute<Operation::IFX15>(instruction);
+    case Operation::IFX18:
+      return execute<Operation::IFX18>(instruction);
+    case Operation::IFX1E:
+      return execute<Operation::IFX1E>(instruction);
+    case Operation::IFX29:
+      return execute<Operation::IFX29>(instruction);
+    case Operation::IFX33:
+      return execute<Operation::IFX33>(instruction);
+    case Operation::IFX55:
+      return execute<Operation::IFX55>(instruction);
+    case Operation::IFX65:
+      return execute<Operation::IFX65>(instruction);
+    default:
+      return fault(FaultKind::InvalidOpcode, instruction.opcode);
+  }
+}
+
+constexpr Fault Emulator::fault(FaultKind kind, uint16_t opcode) const {
+  return {kind, pc, opcode};
+}
+
+constexpr void Emulator::press_key(uint8_t key, uint64_t timestamp) {
+  assert(key <= 0xF);
+
+  if (!keys[key] && (observed_inputs & (1 << key)) == 0) {
+    pending_inputs[key] = {timestamp, cycle_count, 0, 0, key};
+    pressed_inputs |= 1 << key;
+  }
+
+  keys[key] = true;
+  if (waiting_for_key) {
+    V[waiting_for_key_register] = key;
+    waiting_for_key = false;
+    key_observed(key);
+  }
+}
+
+constexpr void Emulator::release_key(uint8_t key) {
+  assert(key <= 0xF);
+
+  keys[key] = false;
+  pressed_inputs &= ~(1 << key);
+}
+
+constexpr void Emulator::set_keys(uint16_t keys) {
+  for (uint8_t key = 0; key < 16; key++) {
+    const bool pressed = (keys >> key) & 1;
+    if (pressed && !this->keys[key]) {
+      press_key(key);
+    } else if (!pressed) {
+      release_key(key);
+    }
+  }
+}
+
+constexpr bool Emulator::should_draw() {
+  auto result = draw_flag;
+
+  draw_flag = false;
+
+  return result;
+}
+
+constexpr bool Emulator::should_buzz() {
+  auto result = sound_flag;
+
+  sound_flag = false;
+
+  return result;
+}
+
+constexpr const std::array<uint8_t, 64 * 32>& Emulator::get_graphic() const { return graphic; }
+
+constexpr uint64_t Emulator::cycles() const { return cycle_count; }
+
+constexpr const MachineState& Emulator::state() const { return *this; }
+
+constexpr void Emulator::restore(const MachineState& state) {
+  // Snapshots restored to are usually close to the current state, only the bytes that differ
+  // change the fingerprints
+  if (fingerprinting) {
+    for (uint16_t address = 0; address < memory.size(); address++) {
+      if (memory[address] != state.memory[address]) {
+        memory_fingerprint ^= fingerprint_key(address, memory[address]);
+        memory_fingerprint ^= fingerprint_key(address, state.memory[address]);
+      }
+    }
+    for (uint32_t pixel = 0; pixel < graphic.size(); pixel++) {
+      if (graphic[pixel] != state.graphic[pixel]) {
+        screen_fingerprint
+            ^= fingerprint_key(fingerprint_screen_position + pixel, graphic[pixel]);
+        screen_fingerprint
+            ^= fingerprint_key(fingerprint_screen_position + pixel, state.graphic[pixel]);
+      }
+    }
+  }
+  static_cast<MachineState&>(*this) = state;
+}
+constexpr void Emulator::instruction_00E0() {
+  graphic = {};
+  screen_fingerprint = blank_screen_fingerprint;
+  pc += 2;
+  screen_changed();
+}
+constexpr void Emulator::instruction_00EE() {
+  pc = stack.top();
+  stack.pop();
+}
+constexpr void Emulator::instruction_1NNN(uint16_t jump_address) { pc = jump_address; }
+constexpr void Emulator::instruction_2NNN(uint16_t subroutine_address) {
+  stack.push(pc + 2);
+  pc = subroutine_address;
+}
+constexpr void Emulator::instruction_3XNN(uint8_t reg, uint8_t number) {
+  pc += V[reg] == number ? 4 : 2;
+}
+constexpr void Emulator::instruction_4XNN(uint8_t reg, uint8_t number) {
+  pc += V[reg] != number ? 4 : 2;
+}
+constexpr void Emulator::instruction_5XY0(uint8_t reg1, uint8_t reg2) {
+  pc += V[reg1] == V[reg2] ? 4 : 2;
+}
+constexpr void Emulator::instruction_6XNN(uint8_t reg, uint8_t value) {
+  V[reg] = value;
+  pc += 2;
+}
+constexpr void Emulator::instruction_7XNN(uint8_t reg, uint8_t value) {
+  V[reg] += value;
+  pc += 2;
+}
+constexpr void Emulator::instruction_8XY0(uint8_t reg1, uint8_t reg2) {
+  V[reg1] = V[reg2];
+  pc += 2;
+}
+constexpr void Emulator::instruction_8XY1(uint8_t reg1, uint8_t reg2) {
+  V[reg1] |= V[reg2];
+  pc += 2;
+}
+constexpr void Emulator::instruction_8XY2(uint8_t reg1, uint8_t reg2) {
+  V[reg1] &= V[reg2];
+  pc += 2;
+}
+constexpr void Emulator::instruction_8XY3(uint8_t reg1, uint8_t reg2) {
+  V[reg1] ^= V[reg2];
+  pc += 2;
+}
+constexpr void Emulator::instruction_8XY4(uint8_t reg1, uint8_t reg2) {
+  // Carry if overflow
+  V[0xF] = V[reg2] > std::numeric_limits<uint8_t>::max() - V[reg1] ? 1 : 0;
+  V[reg1] += V[reg2];
+  pc += 2;
+}
+constexpr void Emulator::instruction_8XY5(uint8_t reg1, uint8_t reg2) {
+  // Borrow
+  V[0xF] = V[reg1] > V[reg2] ? 1 : 0;
+  V[reg1] -= V[reg2];
+  pc += 2;
+}
+constexpr void Emulator::instruction_8XY6(uint8_t reg) {
+  V[0xF] = V[reg] & 0x1;
+  V[reg] >>= 1;
+  pc += 2;
+}
+constexpr void Emulator::instruction_8XY7(uint8_t reg1, uint8_t reg2) {
+  // Borrow
+  V[0xF] = V[reg2] > V[reg1] ? 1 : 0;
+  V[reg1] = V[reg2] - V[reg1];
+  pc += 2;
+}
+constexpr void Emulator::instruction_8XYE(uint8_t reg) {
+  V[0xF] = V[reg] >> 7;
+  V[reg] <<= 1;
+  pc += 2;
+}
+constexpr void Emulator::instruction_9XY0(uint8_t reg1, uint8_t reg2) {
+  pc += V[reg1] != V[reg2] ? 4 : 2;
+}
+constexpr void Emulator::instruction_ANNN(uint16_t value) {
+  I = value;
+  pc += 2;
+}
+constexpr void Emulator::instruction_BNNN(uint16_t jump_address) { pc = V[0] + jump_address; }
+constexpr void Emulator::instruction_CXNN(uint8_t reg, uint8_t value) {
+  V[reg] = (rng_engine() >> 24) & value;
+  pc += 2;
+}
+constexpr void Emulator::instruction_DXYN(uint8_t reg1, uint8_t reg2, uint8_t height) {
+  const auto x = V[reg1];
+  const auto y = V[reg2];
+  V[0xF] = 0;
+
+  for (int yline = 0; yline < height; yline++) {
+    const auto pixel = memory[(I + yline) & address_mask];
+    for (int xline = 0; xline < 8; xline++) {
+      // Check if xlineTH bit of pixel is set to 1
+      if ((pixel & (0b10000000 >> xline)) != 0) {
+        const auto position = ((x + xline) % 64) + (((y + yline) % 32) * 64);
+        // Set the flag to 1 in case of collision
+        if (graphic[position] == 1) {
+          V[0xF] = 1;
+        }
+        if (fingerprinting && graphic[position] <= 1) {
+          screen_fingerprint ^= pixel_toggle_fingerprints[position];
+        } else if (fingerprinting) {
+          // Only restored states can have other values
+          screen_fingerprint
+              ^= fingerprint_key(fingerprint_screen_position + position, graphic[position]);
+          screen_fingerprint
+              ^= fingerprint_key(fingerprint_screen_position + position, graphic[position] ^ 1);
+        }
+        graphic[position] ^= 1;
+      }
+    }
+  }
+  pc += 2;
+  screen_changed();
+}
+constexpr void Emulator::instruction_EX9E(uint8_t key) {
+  if (keys[key]) {
+    key_observed(key);
+  }
+  pc += keys[key] ? 4 : 2;
+}
+constexpr void Emulator::instruction_EXA1(uint8_t key) {
+  if (keys[key]) {
+    key_observed(key);
+  }
+  pc += keys[key] ? 2 : 4;
+}
+constexpr void Emulator::instruction_FX07(uint8_t reg) {
+  V[reg] = delay_timer;
+  pc += 2;
+}
+constexpr void Emulator::instruction_FX0A(uint8_t reg) {
+  waiting_for_key = true;
+  waiting_for_key_register = reg;
+  pc += 2;
+}
+constexpr void Emulator::instruction_FX15(uint8_t reg) {
+  delay_timer = V[reg];
+  pc += 2;
+}
+constexpr void Emulator::instruction_FX18(uint8_t reg) {
+  sound_timer = V[reg];
+  pc += 2;
+}
+constexpr void Emulator::instruction_FX1E(uint8_t reg) {
+  I += V[reg];
+  V[0xF] = I > 0xFFF ? 1 : 0;
+  pc += 2;
+}
+constexpr void Emulator::instruction_FX29(uint8_t reg) {
+  I = V[reg] * 5;  // Font is loader in memory at address 0 and each character is 5 ints
+  pc += 2;
+}
+constexpr void Emulator::instruction_FX33(uint8_t reg) {
+  write_memory(I & address_mask, V[reg] / 100);
+  write_memory((I + 1) & address_mask, (V[reg] / 10) % 10);
+  write_memory((I + 2) & address_mask, (V[reg] % 100) % 10);
+  pc += 2;
+}
+constexpr void Emulator::instruction_FX55(uint8_t reg) {
+  for (auto i = 0; i <= reg; i++) {
+    write_memory((I + i) & address_mask, V[i]);
+  }
+  pc += 2;
+}
+constexpr void Emulator::instruction_FX65(uint8_t reg) {
+  for (auto i = 0; i <= reg; i++) {
+    V[i] = memory[(I + i) & address_mask];
+  }
+  pc += 2;
+}
+
+// `rom` after `cycles` cycles, or until its first fault. Meant for constant expressions, so a
+// session can start from a machine image baked into the binary instead of running the init code.
+template <std::size_t size> constexpr Emulator boot(const std::array<uint8_t, size>& rom,
+                                                   uint64_t cycles) {
+  Emulator emulator;
+  emulator.load_rom(rom.data(), rom.size());
+  for (uint64_t cycle = 0; cycle < cycles; cycle++) {
+    if (emulator.emulate_cycle()) {
+      break;
+    }
+  }
+  return emulator;
+}
+
 #endif  // CHIP8EMUTESTS_EMULATOR_H
@@ -0,0 +1,182 @@
+#ifndef CHIP8EMUTESTS_FINGERPRINT_H
+#define CHIP8EMUTESTS_FINGERPRINT_H
+
+#include <array>
+#include <cinttypes>
+#include <cstddef>
+#include <cstring>
+
+#include "Font.h"
+
+// 128-bit fingerprints of machine states, for transposition tables and loop detection.
+//
+// Memory and screen are fingerprinted Zobrist-style: every byte contributes a pseudo-random key
+// derived from its position and value, and the keys are combined with XOR. A write then updates
+// the fingerprint in O(1) by XOR-ing out the key of the old value and in the key of the new one,
+// so the emulator can keep it up to date as instructions run, at a cost proportional to the bytes
+// written. It starts doing it the first time it's asked for a fingerprint, so emulators never
+// fingerprinted don't pay for it. 0 has no key, so the fingerprint from scratch it starts from only
+// hashes the bytes that aren't 0.
+//
+// Keys are computed with the SplitMix64 finalizer instead of looked up, as a table for 6144
+// positions of 256 values each would be 12 MB; only the pixel toggles of DXYN have a table.
+struct Fingerprint {
+  uint64_t low = 0;
+  uint64_t high = 0;
+
+  constexpr Fingerprint& operator^=(const Fingerprint& other) {
+    low ^= other.low;
+    high ^= other.high;
+    return *this;
+  }
+  constexpr bool operator==(const Fingerprint& other) const {
+    return low == other.low && high == other.high;
+  }
+  constexpr bool operator!=(const Fingerprint& other) const { return !(*this == other); }
+};
+
+// For std::unordered_map and std::unordered_set keys
+struct FingerprintHash {
+  std::size_t operator()(const Fingerprint& fingerprint) const {
+    return static_cast<std::size_t>(fingerprint.low);
+  }
+};
+
+// Positions of the bytes: memory first, then the screen
+constexpr uint32_t fingerprint_screen_position = 4096;
+
+constexpr uint64_t fingerprint_mix(uint64_t x) {
+  x += 0x9E3779B97F4A7C15;
+  x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9;
+  x = (x ^ (x >> 27)) * 0x94D049BB133111EB;
+  return x ^ (x >> 31);
+}
+
+// Key of `value` at `position`, the two halves being independent. 0 has none.
+constexpr Fingerprint fingerprint_key(uint32_t position, uint8_t value) {
+  const auto key = static_cast<uint64_t>(position) << 8 | value;
+  // Without a branch, values in a row of bytes aren't predictable
+  const auto mask = 0 - static_cast<uint64_t>(value != 0);
+  return {fingerprint_mix(key) & mask, fingerprint_mix(key ^ 0xC8C8C8C8C8C8C8C8) & mask};
+}
+
+template <std::size_t size>
+constexpr Fingerprint fingerprint_bytes(const std::array<uint8_t, size>& bytes,
+                                        uint32_t first_position) {
+  Fingerprint fingerprint;
+  for (std::size_t i = 0; i < size; i++) {
+    fingerprint ^= fingerprint_key(first_position + static_cast<uint32_t>(i), bytes[i]);
+  }
+  return fingerprint;
+}
+
+// Of the memory after reset(), the font and zeros
+inline constexpr Fingerprint reset_memory_fingerprint = [] {
+  std::array<uint8_t, 4096> memory{};
+  for (std::size_t i = 0; i < chip8_font.size(); i++) {
+    memory[i] = chip8_font[i];
+  }
+  return fingerprint_bytes(memory, 0);
+}();
+
+inline constexpr Fingerprint blank_screen_fingerprint
+    = fingerprint_bytes(std::array<uint8_t, 64 * 32>{}, fingerprint_screen_position);
+
+// What toggling each pixel between 0 and 1 changes, so DXYN updates the fingerprint with one XOR
+// per pixel drawn
+inline constexpr std::array<Fingerprint, 64 * 32> pixel_toggle_fingerprints = [] {
+  std::array<Fingerprint, 64 * 32> toggles{};
+  for (uint32_t pixel = 0; pixel < toggles.size(); pixel++) {
+    toggles[pixel] = fingerprint_key(fingerprint_screen_position + pixel, 0);
+    toggles[pixel] ^= fingerprint_key(fingerprint_screen_position + pixel, 1);
+  }
+  return toggles;
+}();
+
+// The 8 bytes from `offset`, in native byte order
+template <std::size_t size>
+inline uint64_t fingerprint_word(const std::array<uint8_t, size>& bytes, std::size_t offset) {
+  uint64_t word;
+  std::memcpy(&word, bytes.data() + offset, sizeof(word));
+  return word;
+}
+
+// Of memory, from scratch: fingerprint_bytes(memory, 0) skipping the words of 0 in one test
+inline Fingerprint fingerprint_memory(const std::array<uint8_t, 4096>& memory) {
+  Fingerprint fingerprint;
+  for (uint32_t word = 0; word < memory.size(); word += 8) {
+    if (fingerprint_word(memory, word) != 0) {
+      for (auto address = word; address < word + 8; address++) {
+        fingerprint ^= fingerprint_key(address, memory[address]);
+      }
+    }
+  }
+  return fingerprint;
+}
+
+// Of the screen, from scratch: the same as fingerprint_bytes(), with the pixels set looked up in
+// pixel_toggle_fingerprints without branching on each of them
+inline Fingerprint fingerprint_screen(const std::array<uint8_t, 64 * 32>& graphic) {
+  Fingerprint fingerprint;
+  for (uint32_t word = 0; word < graphic.size(); word += 8) {
+    const auto pixels = fingerprint_word(graphic, word);
+    if (pixels == 0) {
+      continue;
+    }
+    for (auto pixel = word; pixel < word + 8; pixel++) {
+      if ((pixels & ~0x0101010101010101) == 0) {
+        const auto set = 0 - static_cast<uint64_t>(graphic[pixel]);
+        fingerprint.low ^= pixel_toggle_fingerprints[pixel].low & set;
+        fingerprint.high ^= pixel_toggle_fingerprints[pixel].high & set;
+      } else {
+        // Only restored states can have other values than 0 and 1
+        fingerprint ^= fingerprint_key(fingerprint_screen_position + pixel, graphic[pixel]);
+      }
+    }
+  }
+  return fingerprint;
+}
+
+// Finds when a sequence of fingerprints starts repeating, with Brent's algorithm: constant memory
+// and at most about three times the steps of the loop and what leads to it. Fed the fingerprints of
+// a deterministic emulation, with no key changing, a repeat means the program loops forever.
+class LoopDetector {
+public:
+  // Returns true once the fingerprints loop, then loop_length() is known
+  constexpr bool add(const Fingerprint& fingerprint) {
+    if (length > 0) {
+      return true;
+    }
+    if (power == 0) {
+      saved = fingerprint;
+      power = 1;
+      return false;
+    }
+    steps++;
+    if (fingerprint == saved) {
+      length = steps;
+      return true;
+    }
+    // The saved fingerprint moves ahead at every power of two, until it's inside the loop and the
+    // power of two is longer than the loop
+    if (steps == power) {
+      saved = fingerprint;
+      power *= 2;
+      steps = 0;
+    }
+    return false;
+  }
+
+  // Fingerprints in the loop, 0 until one is found
+  constexpr uint64_t loop_length() const { return length; }
+
+  constexpr void clear() { *this = {}; }
+
+private:
+  Fingerprint saved;
+  uint64_t power = 0;  // 0 before the first fingerprint
+  uint64_t steps = 0;  // Since `saved`
+  uint64_t length = 0;
+};
+
+#endif  // CHIP8EMUTESTS_FINGERPRINT_H
@@ -0,0 +1,107 @@
+#ifndef CHIP8EMUTESTS_FRAMEPACER_H
+#define CHIP8EMUTESTS_FRAMEPACER_H
+
+#include <chrono>
+#include <cinttypes>
+#include <cstddef>
+#include <ostream>
+#include <vector>
+
+// Keeps a frontend loop on a fixed frame schedule measured with the monotonic steady_clock, and
+// keeps rolling statistics of how well it does.
+//
+// Frame N is due at start + N * period. Every iteration of the loop asks frames_due() how many
+// frames to emulate, marks when emulation and presentation are done, then calls wait() which sleeps
+// until shortly before the next deadline and spins for the rest, so the scheduler quantum doesn't
+// make it oversleep. Timestamps are taken internally, the overloads taking a time point are for
+// tests and for callers that already read the clock.
+//
+// With vsync the present call already blocks, so wait() returns right away and the schedule is
+// offset by half a period: refreshes then land in the middle of frame slots, and display jitter
+// doesn't make frames alternate between 0 and 2 per refresh.
+class FramePacer {
+public:
+  using clock = std::chrono::steady_clock;
+
+  enum class Policy : uint8_t {
+    CatchUp,  // Late frames are emulated back to back, up to max_catch_up_frames, to stay on time
+    Skip,     // Late frames are skipped, later deadlines keep the phase of the schedule
+  };
+
+  struct Config {
+    double frames_per_second = 60;
+    Policy policy = Policy::CatchUp;
+    unsigned max_catch_up_frames = 4;  // Further late frames are skipped
+    bool vsync = false;
+    // Sleep until this close to the deadline, then spin
+    std::chrono::microseconds spin_threshold{1500};
+    std::size_t statistics_window = 240;  // Frames
+  };
+
+  struct Statistics {
+    std::size_t frames = 0;  // In the window
+    double average_frame_ms = 0;
+    double jitter_ms = 0;  // Standard deviation of the frame time
+    double max_frame_ms = 0;
+    double average_emulate_ms = 0;
+    double average_present_ms = 0;
+    double average_overshoot_ms = 0;  // How late wait() returned
+    uint64_t late_frames = 0;         // Total frames emulated behind schedule to catch up
+    uint64_t skipped_frames = 0;      // Total frames dropped from the schedule
+  };
+
+  FramePacer();
+  explicit FramePacer(const Config& config);
+
+  // Restarts the schedule, the first frame is due right away.
+  void start();
+  void start(clock::time_point now);
+
+  // Frames to emulate in this iteration. 1 on schedule, more when catching up, and 0 with vsync
+  // when the display refreshes faster than the emulated frame rate.
+  unsigned frames_due();
+  unsigned frames_due(clock::time_point now);
+
+  void emulated();
+  void emulated(clock::time_point now);
+  void presented();
+  void presented(clock::time_point now);
+
+  // Waits for the next frame to be due, unless vsync is on.
+  void wait();
+
+  clock::duration period() const;
+  Statistics statistics() const;
+
+  // CSV of the frames in the statistics window, oldest first
+  void dump(std::ostream& out) const;
+
+private:
+  struct Record {
+    clock::duration frame{};
+    clock::duration emulate{};
+    clock::duration present{};
+    clock::duration overshoot{};
+    unsigned frames_emulated = 0;
+  };
+
+  Config config;
+  clock::duration frame_period;
+  clock::time_point origin;
+  uint64_t scheduled_frames = 0;  // Frames handed out by frames_due() since start()
+
+  clock::time_point frame_start;
+  clock::time_point emulate_end;
+  bool has_previous_frame = false;
+  Record current;
+
+  std::vector<Record> records;  // Ring of the last statistics_window frames
+  std::size_t next_record = 0;
+  std::size_t record_count = 0;
+  uint64_t late_frames = 0;
+  uint64_t skipped_frames = 0;
+
+  clock::time_point next_deadline() const;
+};
+
+#endif  // CHIP8EMUTESTS_FRAMEPACER_H
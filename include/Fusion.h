@@ -0,0 +1,157 @@
+#ifndef CHIP8EMUTESTS_FUSION_H
+#define CHIP8EMUTESTS_FUSION_H
+
+#include <array>
+#include <cinttypes>
+#include <cstddef>
+#include <ostream>
+#include <unordered_map>
+#include <vector>
+
+#include "Decoder.h"
+
+// Superinstructions: sequences of instructions that Emulator::run() executes as one handler,
+// instead of fetching and dispatching each instruction.
+//
+// The translation marks every address where a known sequence starts (see fuse()), and run() hands
+// the cycles to the fused handler when the program counter lands on one and the bytes in memory
+// still match. Each kind of superinstruction has a handler of its own, with the operations of its
+// sequence known at compile time. Handlers keep the exact semantics of the instructions one by
+// one, the timers tick after each of them and VF is written as usual, and they stop as soon as a
+// skip or jump leaves the sequence, so skip targets are honoured.
+//
+// translate() fuses the sequences of corpus_superinstructions(), profiled over the roms/ corpus,
+// then the built-in idioms. Only sequences of a FusionKind have a handler, so the profile decides
+// which of them come first, it can't add new ones: a frequent sequence without a kind only shows
+// in FusionProfile::write(), and fusing it means adding its kind to fused_sequences.
+
+struct Translation;
+
+constexpr std::size_t max_fused_length = 4;
+constexpr std::size_t max_superinstructions = 32;
+
+enum class FusionKind : uint8_t {
+  DrawAt,  // 6XNN 6YNN ANNN DXYN, a sprite drawn at a constant spot
+  // FX07 3X00 1NNN jumping back to the FX07, spun in one go until the delay timer runs out
+  TimerPoll,
+  CountLoop,      // 7XNN 3XNN 1NNN
+  SkipJump,       // 3XNN 1NNN
+  KeyReleased,    // 6XNN EXA1
+  KeyJump,        // EX9E 1NNN
+  AddSkip,        // 7XNN 3XNN
+  DrawSprite,     // ANNN DXYN
+  ReadTimer,      // FX07 3XNN
+  LoadMask,       // 6XNN 8XY2
+  DrawMove,       // DXYN 7XNN
+  KeyPoll,        // 6XNN EX9E 1NNN
+  TableLoad,      // ANNN FX1E FX65
+  TableIndex,     // ANNN FX1E
+  DrawReturn,     // DXYN 00EE
+  SaveAt,         // ANNN FX55
+  LoadAt,         // ANNN FX65
+  AddSkipUnless,  // 7XNN 4XNN
+  DrawSkip,       // DXYN 3XNN
+};
+
+constexpr std::size_t fusion_kinds = static_cast<std::size_t>(FusionKind::DrawSkip) + 1;
+
+struct FusedSequence {
+  uint8_t length = 0;
+  std::array<Operation, max_fused_length> operations{};
+};
+
+// The operations of each kind, by FusionKind
+inline constexpr std::array<FusedSequence, fusion_kinds> fused_sequences = {{
+    {4, {Operation::I6XNN, Operation::I6XNN, Operation::IANNN, Operation::IDXYN}},
+    {3, {Operation::IFX07, Operation::I3XNN, Operation::I1NNN}},
+    {3, {Operation::I7XNN, Operation::I3XNN, Operation::I1NNN}},
+    {2, {Operation::I3XNN, Operation::I1NNN}},
+    {2, {Operation::I6XNN, Operation::IEXA1}},
+    {2, {Operation::IEX9E, Operation::I1NNN}},
+    {2, {Operation::I7XNN, Operation::I3XNN}},
+    {2, {Operation::IANNN, Operation::IDXYN}},
+    {2, {Operation::IFX07, Operation::I3XNN}},
+    {2, {Operation::I6XNN, Operation::I8XY2}},
+    {2, {Operation::IDXYN, Operation::I7XNN}},
+    {3, {Operation::I6XNN, Operation::IEX9E, Operation::I1NNN}},
+    {3, {Operation::IANNN, Operation::IFX1E, Operation::IFX65}},
+    {2, {Operation::IANNN, Operation::IFX1E}},
+    {2, {Operation::IDXYN, Operation::I00EE}},
+    {2, {Operation::IANNN, Operation::IFX55}},
+    {2, {Operation::IANNN, Operation::IFX65}},
+    {2, {Operation::I7XNN, Operation::I4XNN}},
+    {2, {Operation::IDXYN, Operation::I3XNN}},
+}};
+
+constexpr const FusedSequence& fused_sequence(FusionKind kind) {
+  return fused_sequences[static_cast<std::size_t>(kind)];
+}
+
+// Enumerator name, "DrawAt" for instance
+const char* to_string(FusionKind kind);
+
+// 6 bytes without padding, so translations stay comparable byte for byte
+struct Superinstruction {
+  FusionKind kind{};
+  uint8_t length = 0;
+  std::array<Operation, max_fused_length> operations{};
+};
+
+static_assert(sizeof(Superinstruction) == 2 + max_fused_length);
+
+// The superinstruction of `kind`
+Superinstruction make_superinstruction(FusionKind kind);
+
+struct FusionStatistics {
+  uint64_t superinstructions = 0;  // Fused handlers run
+  uint64_t instructions = 0;       // Instructions executed by them
+};
+
+// 6XNN 6YNN ANNN DXYN, FX07 3X00 1NNN polls, ANNN FX55 and ANNN FX65 saves and restores, 7XNN 3XNN
+// counted loops.
+const std::vector<Superinstruction>& builtin_superinstructions();
+
+// The FusionKinds the FusionProfile of the roms/ corpus ranks first, most dispatches saved first,
+// so a reordering of the built-in kinds rather than new ones. The list is generated into
+// source/CorpusFusion.inc by the corpus test of test/source/Fusion.cpp when
+// CHIP8_UPDATE_FUSION_PROFILE is set.
+const std::vector<Superinstruction>& corpus_superinstructions();
+
+// Adds `superinstructions` to those of `translation`, while there is room, and marks the code
+// addresses where they start. Addresses already marked keep their superinstruction, so the first
+// ones fused win. Sequences can't contain FX0A, and memory writes only come last so a handler
+// never runs code it modified. Returns how many superinstructions were added.
+std::size_t fuse(Translation& translation, const std::vector<Superinstruction>& superinstructions);
+
+class Emulator;
+struct Fault;
+
+// Counts the sequences of consecutive instructions executed, to find the ones worth fusing
+class FusionProfile {
+public:
+  // Called with each instruction about to be executed at `address`
+  void record(uint16_t address, const Instruction& instruction);
+  // Records the next instruction of `emulator` and executes it
+  Fault step(Emulator& emulator);
+
+  // The `count` sequences with a fused handler saving the most dispatches, most valuable first.
+  // Sequences without a FusionKind are left out, whatever their count.
+  std::vector<Superinstruction> superinstructions(std::size_t count) const;
+
+  // One line per sequence, "7XNN 3XNN 1NNN 1234", most executed first
+  void write(std::ostream& out) const;
+
+private:
+  struct Executed {
+    uint16_t address = 0;
+    Operation operation = Operation::Invalid;
+  };
+
+  // Last instructions executed, oldest first
+  std::array<Executed, max_fused_length> window{};
+  std::size_t recorded = 0;
+  // By sequence, packed as by pack()
+  std::unordered_map<uint32_t, uint64_t> counts;
+};
+
+#endif  // CHIP8EMUTESTS_FUSION_H
@@ -0,0 +1,20 @@
+#ifndef CHIP8EMUTESTS_HASH_H
+#define CHIP8EMUTESTS_HASH_H
+
+#include <cinttypes>
+#include <cstddef>
+
+constexpr uint64_t fnv1a64_offset_basis = 0xCBF29CE484222325;
+constexpr uint64_t fnv1a64_prime = 0x100000001B3;
+
+// 64-bit FNV-1a, used to fingerprint ROM images and framebuffers.
+constexpr uint64_t fnv1a64(const uint8_t* data, size_t size,
+                           uint64_t hash = fnv1a64_offset_basis) {
+  for (size_t i = 0; i < size; i++) {
+    hash ^= data[i];
+    hash *= fnv1a64_prime;
+  }
+  return hash;
+}
+
+#endif  // CHIP8EMUTESTS_HASH_H
@@ -0,0 +1,36 @@
+#ifndef CHIP8EMUTESTS_MACHINESTATE_H
+#define CHIP8EMUTESTS_MACHINESTATE_H
+
+#include <array>
+#include <cinttypes>
+
+#include "CallStack.h"
+#include "Rng.h"
+
+// Everything that makes up a running CHIP-8 machine. The Emulator derives from it, so taking a
+// snapshot or restoring one is a single copy.
+struct MachineState {
+  bool draw_flag = false;
+  bool sound_flag = false;
+
+  std::array<uint8_t, 4096> memory{};
+  // 2048 pixel screen
+  std::array<uint8_t, 64 * 32> graphic{};
+
+  std::array<uint8_t, 16> V{};  // Registers
+  uint16_t I = 0;               // Index register
+  uint16_t pc = 0;              // Program counter
+  CallStack stack;              // Used for function calls
+
+  // When set above zero the timers will count down to zero.
+  uint8_t delay_timer = 0;
+  uint8_t sound_timer = 0;  // Will make the system buzz sound when it reaches zero.
+
+  std::array<bool, 16> keys{};
+  bool waiting_for_key = false;          // For instruction FX0A
+  uint8_t waiting_for_key_register = 0;  // For instruction FX0A
+
+  Rng rng_engine;  // For instruction CXNN
+};
+
+#endif  // CHIP8EMUTESTS_MACHINESTATE_H
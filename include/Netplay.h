@@ -0,0 +1,104 @@
+#ifndef CHIP8EMUTESTS_NETPLAY_H
+#define CHIP8EMUTESTS_NETPLAY_H
+
+#include <array>
+#include <cinttypes>
+#include <cstddef>
+#include <vector>
+
+#include "Emulator.h"
+#include "MachineState.h"
+
+// Rollback netplay for two players sharing the 16-key pad, independent of the transport.
+//
+// Each peer runs its emulator ahead with the local keys, predicting that the remote player still
+// holds whatever their last received input was. When the remote input of a frame arrives and
+// differs from the prediction, the machine state saved before that frame is restored and every
+// frame since is emulated again with the right keys, all before the next frame is shown. A full
+// MachineState is kept for each of the last max_rollback frames, so a rollback is one copy plus
+// the re-simulation. A peer more than max_rollback frames ahead of what it received from the other
+// stalls instead.
+//
+// Inputs travel in packets written by write_packet() and read by read_packet(), which the
+// transport carries as datagrams. Every packet repeats all the local inputs the other peer hasn't
+// acknowledged yet, so lost packets need no retransmission.
+//
+// Packet: u8 version, u32 first frame, u8 input count, u32 frames of the sender's inputs received,
+// then the inputs as u16 key masks, all little-endian.
+class Netplay {
+public:
+  static constexpr uint8_t packet_version = 1;
+  // Inputs a peer keeps for the other one, and so the most a packet carries
+  static constexpr std::size_t input_history = 128;
+  static constexpr std::size_t max_packet_size = 10 + 2 * input_history;
+
+  struct Config {
+    uint8_t player = 0;  // 0 or 1, the other peer being the other one
+    // Keys each player controls, combined into the pad. Pong uses 1/4 on the left and C/D on the
+    // right, for instance.
+    std::array<uint16_t, 2> player_keys = {0x0FFF, 0xF000};
+    // Frames, at most input_history / 2: remote inputs are kept from that far back to as far ahead
+    // as the remote peer can be
+    std::size_t max_rollback = 8;
+  };
+
+  struct Statistics {
+    uint64_t rollbacks = 0;
+    uint64_t resimulated_frames = 0;
+    uint64_t max_rollback = 0;  // Longest rollback in frames
+    uint64_t stalls = 0;        // advance() calls refused for being too far ahead
+    uint64_t packets_received = 0;
+    uint64_t stale_packets = 0;  // Carrying nothing new
+  };
+
+  // Takes over the keys of `emulator`, which must outlive the netplay session
+  Netplay(Emulator& emulator, const Config& config);
+
+  // Emulates the next frame with the local keys, after any rollback due. Returns false without
+  // doing anything if that would get more than max_rollback frames ahead of the remote inputs.
+  bool advance(uint16_t local_keys);
+
+  // Rolls back and re-simulates if the remote inputs received contradict a prediction
+  void synchronize();
+
+  // Appends the local inputs the other peer hasn't acknowledged, and acknowledges theirs
+  void write_packet(std::vector<uint8_t>& out) const;
+  // Takes the remote inputs and acknowledgement of a packet, in any order and with duplicates.
+  // Returns false if it's malformed.
+  bool read_packet(const uint8_t* data, std::size_t size);
+
+  // Frames emulated
+  uint32_t frame() const;
+  // Frames whose inputs are all known, so whose emulation is final once synchronized
+  uint32_t confirmed_frame() const;
+  // Frames whose local inputs the other peer received
+  uint32_t acknowledged_frame() const;
+
+  const Statistics& statistics() const;
+
+private:
+  Emulator& emulator;
+  Config config;
+  uint8_t remote_player;
+
+  uint32_t current_frame = 0;
+  uint32_t local_acked = 0;       // Local inputs the other peer received
+  uint32_t remote_received = 0;   // Remote inputs received, they always arrive as a prefix
+  uint32_t rollback_frame = 0;    // Earliest mispredicted frame, when rollback_pending
+  bool rollback_pending = false;
+
+  // By frame modulo input_history
+  std::array<uint16_t, input_history> local_inputs{};
+  std::array<uint16_t, input_history> remote_inputs{};
+  std::array<uint16_t, input_history> predicted_inputs{};  // Remote input each frame was run with
+  // State before each of the last max_rollback + 1 frames, by frame modulo the size
+  std::vector<MachineState> snapshots;
+
+  Statistics stats;
+
+  uint16_t remote_input(uint32_t frame) const;
+  // Emulates frame `current_frame` with the inputs known or predicted for it
+  void run_frame();
+};
+
+#endif  // CHIP8EMUTESTS_NETPLAY_H
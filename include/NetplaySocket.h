@@ -0,0 +1,78 @@
+#ifndef CHIP8EMUTESTS_NETPLAYSOCKET_H
+#define CHIP8EMUTESTS_NETPLAYSOCKET_H
+
+#ifndef _WIN32
+
+#  include <chrono>
+#  include <cinttypes>
+#  include <string>
+#  include <vector>
+
+#  include "Netplay.h"
+#  include "Rng.h"
+
+// UDP transport of Netplay packets between two peers, with artificial latency, jitter and packet
+// loss on the sending side to try rollback on a single machine over loopback.
+//
+// Both calls are non-blocking, so a frontend sends and polls once per frame from its own loop.
+class NetplaySocket {
+public:
+  struct Config {
+    uint16_t local_port = 0;  // 0 for any free port, see local_port()
+    std::string remote_host = "127.0.0.1";  // IPv4 address
+    uint16_t remote_port = 0;
+
+    // Impairment of the packets sent, each one is delayed by delay_ms plus up to jitter_ms
+    // (reordering them), or dropped with probability `loss`.
+    unsigned delay_ms = 0;
+    unsigned jitter_ms = 0;
+    double loss = 0;
+    uint64_t seed = 1;
+  };
+
+  struct Statistics {
+    uint64_t sent = 0;
+    uint64_t dropped = 0;  // By the impairment
+    uint64_t received = 0;
+    uint64_t malformed = 0;
+  };
+
+  // Binds the local port, throws std::system_error if it can't.
+  explicit NetplaySocket(const Config& config);
+  ~NetplaySocket();
+
+  NetplaySocket(const NetplaySocket&) = delete;
+  NetplaySocket& operator=(const NetplaySocket&) = delete;
+
+  // Queues the current packet of `netplay`
+  void send(const Netplay& netplay);
+  // Sends the packets whose delay is over, and hands every datagram received to `netplay`
+  void poll(Netplay& netplay);
+
+  uint16_t local_port() const;
+  // Changes the port packets are sent to, for a peer bound to any free port after this socket
+  void set_remote_port(uint16_t port);
+  const Statistics& statistics() const;
+
+private:
+  using Clock = std::chrono::steady_clock;
+
+  struct Delayed {
+    Clock::time_point due;
+    std::vector<uint8_t> packet;
+  };
+
+  Config config;
+  int fd = -1;
+  uint16_t bound_port = 0;
+  SplitMix64 random;
+  std::vector<Delayed> delayed;
+  std::vector<uint8_t> packet;
+  Statistics stats;
+
+  void send_now(const std::vector<uint8_t>& bytes);
+};
+
+#endif  // _WIN32
+
+#endif  // CHIP8EMUTESTS_NETPLAYSOCKET_H
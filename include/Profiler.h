@@ -0,0 +1,73 @@
+#ifndef CHIP8EMUTESTS_PROFILER_H
+#define CHIP8EMUTESTS_PROFILER_H
+
+#include <array>
+#include <cinttypes>
+#include <cstddef>
+#include <ostream>
+#include <vector>
+
+#include "Decoder.h"
+
+// Counts executed instructions by address and by call stack, to find the hot routines of a rom.
+//
+// Attach it with Emulator::set_profiler(). The emulator only reports instructions to it when built
+// with CHIP8_PROFILER (the CHIP8EMU_PROFILER CMake option), otherwise the hook is compiled out and
+// costs nothing. Every instruction then costs two counter increments; calls and returns move
+// through a tree of the call stacks seen so far, so the cost doesn't depend on the stack depth.
+//
+// Call stacks start where the profiler was attached. A return with no call recorded, for example
+// after a state was restored, stays at the outermost level.
+class Profiler {
+public:
+  // True when emulators report to profilers
+  static constexpr bool compiled_in =
+#ifdef CHIP8_PROFILER
+      true;
+#else
+      false;
+#endif
+
+  Profiler();
+
+  void clear();
+
+  // Called by the emulator after executing `instruction` at `address`
+  void record(uint16_t address, const Instruction& instruction) {
+    address &= 0xFFF;
+    address_counts[address]++;
+    nodes[current].count++;
+    if (instruction.operation == Operation::I2NNN) {
+      enter(instruction.nnn);
+    } else if (instruction.operation == Operation::I00EE) {
+      current = nodes[current].parent;
+    }
+  }
+
+  uint64_t instructions() const;
+  // Instructions executed at each address
+  const std::array<uint64_t, 4096>& heat() const;
+
+  // One line per call stack in the folded format of flamegraph.pl and speedscope:
+  // "main;sub_2a4;sub_31c 1234", outermost first. Routines are named after their address.
+  void write_folded(std::ostream& out) const;
+  // CSV of the executed addresses, "address,count,percent", in address order
+  void write_heat_map(std::ostream& out) const;
+
+private:
+  struct Node {
+    uint16_t address = 0;  // Of the routine, called by 2NNN
+    uint32_t parent = 0;
+    uint32_t first_child = 0;  // 0 for none, the root can't be a child
+    uint32_t next_sibling = 0;
+    uint64_t count = 0;  // Instructions executed in the routine itself
+  };
+
+  std::array<uint64_t, 4096> address_counts{};
+  std::vector<Node> nodes;  // nodes[0] is the root, the code outside of any call
+  uint32_t current = 0;
+
+  void enter(uint16_t address);
+};
+
+#endif  // CHIP8EMUTESTS_PROFILER_H
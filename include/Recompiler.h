@@ -0,0 +1,55 @@
+#ifndef CHIP8EMUTESTS_RECOMPILER_H
+#define CHIP8EMUTESTS_RECOMPILER_H
+
+#include <cinttypes>
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "Emulator.h"
+
+// Ahead of time recompilation of roms to C++, used by the chip8-recompile tool.
+//
+// The control flow is recovered from 0x200 with translate(), and every basic block becomes a label
+// in one function per rom, calling the instructions of the Emulator with constant operands so the
+// compiler folds the decoding and operand lookups away. Direct jumps, calls and skips go straight
+// to the label of their target. The generated code keeps the exact cycle semantics of the
+// interpreter, one instruction and one timer tick per cycle, and falls back to it for:
+//  - addresses that aren't the start of a known block, like BNNN targets
+//  - blocks whose bytes in memory changed since the rom was loaded (checked on every entry, and
+//    blocks end after each instruction writing memory)
+//  - FX0A waiting for a key, faults, and the last cycles of a run that don't fit a whole block
+//
+// The generated translation unit includes Emulator.h and Recompiler.h, and registers its programs
+// at startup so find_native_program() returns them by rom hash.
+
+// A recompiled rom, for Emulator::set_native_program()
+struct NativeProgram {
+  uint64_t rom_hash = 0;  // FNV-1a of the rom, as Emulator::rom_hash()
+  const char* name = "";
+  // Runs up to `cycles` cycles and returns how many were run, fewer if one faulted, which is then
+  // reported in `fault`
+  uint64_t (*run)(Emulator& emulator, uint64_t cycles, Fault& fault) = nullptr;
+};
+
+// Called by generated code. Programs must outlive every lookup, as the static ones do.
+bool register_native_programs(const NativeProgram* programs, std::size_t count);
+// nullptr if no recompiled program matches
+const NativeProgram* find_native_program(uint64_t rom_hash);
+
+struct RecompilerRom {
+  std::string name;  // Shown in comments and NativeProgram::name
+  std::vector<uint8_t> data;
+};
+
+struct RecompilerStatistics {
+  std::size_t programs = 0;  // Roms with the same contents are only emitted once
+  std::size_t blocks = 0;
+  std::size_t instructions = 0;
+};
+
+// Writes a C++ translation unit with a native version of every rom
+RecompilerStatistics recompile(const std::vector<RecompilerRom>& roms, std::ostream& out);
+
+#endif  // CHIP8EMUTESTS_RECOMPILER_H
@@ -0,0 +1,71 @@
+#ifndef CHIP8EMUTESTS_RENDERER_H
+#define CHIP8EMUTESTS_RENDERER_H
+
+#include <array>
+#include <cinttypes>
+#include <cstddef>
+#include <vector>
+
+// Expands the 64 * 32 screen into 32-bit RGBA pixels (bytes R, G, B, A in memory, as
+// SDL_PIXELFORMAT_RGBA32), at an integer scale factor.
+//
+// Rows are expanded by an SSE2 or AVX2 kernel, picked at runtime from what the CPU supports, with a
+// scalar fallback everywhere else. Every other row of a scaled pixel is a copy of the first one.
+//
+// Optional effects:
+//  - Scale2x smoothing of the 64 * 32 screen to 128 * 64 before scaling, for even scales.
+//  - Scanlines: the last row of every scaled pixel is darkened.
+//  - Grid: the last row and column of every scaled pixel use the grid color.
+class Renderer {
+public:
+  enum class Kernel : uint8_t { Scalar, SSE2, AVX2 };
+  enum class Smoothing : uint8_t { None, Scale2x };
+
+  struct Config {
+    unsigned scale = 16;
+    uint32_t foreground = 0xFFFFFF;  // 0xRRGGBB
+    uint32_t background = 0x000000;
+    // Scale2x doubles the screen before scaling it, so it needs an even scale: with an odd one the
+    // renderer falls back to None, see smoothing()
+    Smoothing smoothing = Smoothing::None;
+    bool scanlines = false;
+    uint8_t scanline_brightness = 160;  // Out of 255
+    bool grid = false;
+    uint32_t grid_color = 0x202020;
+  };
+
+  Renderer();
+  explicit Renderer(const Config& config);
+  // Forces a kernel, falling back to the best supported one if the CPU can't run it
+  Renderer(const Config& config, Kernel kernel);
+
+  unsigned width() const;   // Of the output, in pixels
+  unsigned height() const;  // Of the output, in pixels
+  Kernel kernel() const;
+  // Applied to the screen, None when Scale2x was asked for with an odd scale
+  Smoothing smoothing() const;
+
+  // Writes height() rows of width() pixels, `pitch` bytes apart.
+  void render(const std::array<uint8_t, 64 * 32>& graphic, void* out, std::size_t pitch) const;
+  // Resizes `out` to width() * height() pixels, packed.
+  void render(const std::array<uint8_t, 64 * 32>& graphic, std::vector<uint32_t>& out) const;
+
+  static Kernel best_kernel();
+
+  // Pixel with the given color in RGBA32 byte order
+  static uint32_t rgba(uint32_t color, uint8_t alpha = 0xFF);
+
+private:
+  Config config;
+  Kernel selected_kernel;
+  // Source pixels per output pixel block, 2 with Scale2x
+  unsigned block_scale;
+  std::array<uint32_t, 2> palette;
+  std::array<uint32_t, 2> scanline_palette;
+  uint32_t grid_pixel;
+
+  void expand_row(const uint8_t* indices, std::size_t count, const uint32_t* colors,
+                  uint32_t* out) const;
+};
+
+#endif  // CHIP8EMUTESTS_RENDERER_H
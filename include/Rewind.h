@@ -0,0 +1,68 @@
+#ifndef CHIP8EMUTESTS_REWIND_H
+#define CHIP8EMUTESTS_REWIND_H
+
+#include <cinttypes>
+#include <cstddef>
+#include <deque>
+#include <vector>
+
+#include "Emulator.h"
+#include "MachineState.h"
+
+// Ring of recorded machine states to step a session backwards.
+//
+// Every `keyframe_interval` frames a full copy of the machine state is kept as a keyframe, and the
+// frames in between are stored as XOR + run-length deltas against their keyframe. Restoring any
+// frame is one keyframe copy plus one delta, whatever its distance. The oldest keyframe groups are
+// dropped to stay within `memory_budget`.
+class Rewind {
+public:
+  struct Config {
+    std::size_t keyframe_interval = 60;
+    std::size_t memory_budget = 4 * 1024 * 1024;  // Bytes
+    unsigned frames_per_second = 60;
+  };
+
+  Rewind();
+  explicit Rewind(const Config& config);
+
+  // Records the current state of the emulator, call once per frame.
+  void record(const Emulator& emulator);
+
+  // Restores the state recorded `frames` frames before the last one (the last one being 0),
+  // clamped to the oldest frame kept. Frames after the restored one are forgotten. Returns the
+  // number of frames actually rewound, or 0 if nothing is recorded.
+  std::size_t rewind(Emulator& emulator, std::size_t frames);
+  std::size_t rewind_seconds(Emulator& emulator, double seconds);
+
+  void clear();
+
+  std::size_t recorded_frames() const;
+  // Bytes held by keyframes and deltas
+  std::size_t memory_used() const;
+  // Average memory needed to record one minute of emulation, for sizing budgets
+  std::size_t bytes_per_minute() const;
+
+private:
+  struct Group {
+    MachineState keyframe;
+    std::vector<uint8_t> deltas;            // Deltas of the following frames, back to back
+    std::vector<std::size_t> delta_ends;    // End offset of each delta in `deltas`
+    std::size_t frames() const { return 1 + delta_ends.size(); }
+  };
+
+  static constexpr std::size_t max_spare_groups = 2;
+
+  Config config;
+  std::deque<Group> groups;
+  std::vector<Group> spare_groups;  // Dropped groups, reused to avoid reallocating their buffers
+  std::size_t frames = 0;
+  std::size_t bytes = 0;
+
+  Group& new_group();
+  void drop_oldest_group();
+  void recycle(Group&& group);
+  std::size_t group_bytes(const Group& group) const;
+};
+
+#endif  // CHIP8EMUTESTS_REWIND_H
@@ -0,0 +1,147 @@
+#ifndef CHIP8EMUTESTS_RNG_H
+#define CHIP8EMUTESTS_RNG_H
+
+#include <array>
+#include <cinttypes>
+
+// Random number generators for CXNN, picked at compile time with CHIP8_RNG (Pcg32 by default, set
+// through the CHIP8EMU_RNG CMake option).
+//
+// They are all fully specified integer arithmetic, so a seed gives the same sequence on every
+// platform and standard library, and their whole state is two 64-bit words at most. CXNN takes the
+// top 8 bits of a 32-bit output. Every engine provides:
+//  - `id`, recorded in save states, and `name`
+//  - `seed(uint64_t)`, any value is a valid seed
+//  - `operator()()`, the next 32-bit output
+//  - `state()` and `set_state()`, the raw state as 2 words, set_state() rejecting impossible ones
+
+// SplitMix64, 8 bytes of state. Every 64-bit output of the sequence is distinct, used here mostly
+// to spread seeds for the other engines.
+class SplitMix64 {
+public:
+  static constexpr uint8_t id = 1;
+  static constexpr const char* name = "SplitMix64";
+
+  constexpr SplitMix64() = default;
+  constexpr explicit SplitMix64(uint64_t value) { seed(value); }
+
+  constexpr void seed(uint64_t value) { position = value; }
+
+  constexpr uint64_t next64() {
+    auto z = position += 0x9E3779B97F4A7C15u;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9u;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBu;
+    return z ^ (z >> 31);
+  }
+  constexpr uint32_t operator()() { return static_cast<uint32_t>(next64() >> 32); }
+
+  constexpr std::array<uint64_t, 2> state() const { return {position, 0}; }
+  constexpr bool set_state(const std::array<uint64_t, 2>& words) {
+    position = words[0];
+    return true;
+  }
+
+  constexpr bool operator==(const SplitMix64& other) const { return position == other.position; }
+  constexpr bool operator!=(const SplitMix64& other) const { return !(*this == other); }
+
+private:
+  uint64_t position = 0;
+};
+
+// Xorshift64* (Vigna), 8 bytes of state that must not be 0.
+class Xorshift64Star {
+public:
+  static constexpr uint8_t id = 2;
+  static constexpr const char* name = "Xorshift64Star";
+
+  constexpr Xorshift64Star() { seed(0); }
+  constexpr explicit Xorshift64Star(uint64_t value) { seed(value); }
+
+  constexpr void seed(uint64_t value) {
+    // Spread through SplitMix64 so nearby seeds don't give correlated starts, and 0 can't come out
+    bits = SplitMix64(value).next64();
+    if (bits == 0) {
+      bits = 0x9E3779B97F4A7C15u;
+    }
+  }
+
+  constexpr uint32_t operator()() {
+    bits ^= bits >> 12;
+    bits ^= bits << 25;
+    bits ^= bits >> 27;
+    return static_cast<uint32_t>((bits * 0x2545F4914F6CDD1Du) >> 32);
+  }
+
+  constexpr std::array<uint64_t, 2> state() const { return {bits, 0}; }
+  constexpr bool set_state(const std::array<uint64_t, 2>& words) {
+    if (words[0] == 0) {
+      return false;
+    }
+    bits = words[0];
+    return true;
+  }
+
+  constexpr bool operator==(const Xorshift64Star& other) const { return bits == other.bits; }
+  constexpr bool operator!=(const Xorshift64Star& other) const { return !(*this == other); }
+
+private:
+  uint64_t bits = 0;
+};
+
+// PCG32 (XSH RR 64/32, O'Neill), 16 bytes of state: the LCG position and an odd increment selecting
+// the stream.
+class Pcg32 {
+public:
+  static constexpr uint8_t id = 3;
+  static constexpr const char* name = "Pcg32";
+  static constexpr uint64_t default_stream = 0xDA3E39CB94B95BDBu;
+
+  constexpr Pcg32() { seed(0); }
+  constexpr explicit Pcg32(uint64_t value) { seed(value); }
+  // Seeding of the reference implementation, pcg32_srandom_r()
+  constexpr Pcg32(uint64_t initial_state, uint64_t stream) { seed(initial_state, stream); }
+
+  constexpr void seed(uint64_t value) { seed(value, default_stream); }
+  constexpr void seed(uint64_t initial_state, uint64_t stream) {
+    position = 0;
+    increment = stream << 1 | 1;
+    (*this)();
+    position += initial_state;
+    (*this)();
+  }
+
+  constexpr uint32_t operator()() {
+    const auto old = position;
+    position = old * 6364136223846793005u + increment;
+    const auto xorshifted = static_cast<uint32_t>(((old >> 18) ^ old) >> 27);
+    const auto rotation = static_cast<uint32_t>(old >> 59);
+    return (xorshifted >> rotation) | (xorshifted << ((32 - rotation) & 31));
+  }
+
+  constexpr std::array<uint64_t, 2> state() const { return {position, increment}; }
+  constexpr bool set_state(const std::array<uint64_t, 2>& words) {
+    if ((words[1] & 1) == 0) {
+      return false;
+    }
+    position = words[0];
+    increment = words[1];
+    return true;
+  }
+
+  constexpr bool operator==(const Pcg32& other) const {
+    return position == other.position && increment == other.increment;
+  }
+  constexpr bool operator!=(const Pcg32& other) const { return !(*this == other); }
+
+private:
+  uint64_t position = 0;
+  uint64_t increment = 0;
+};
+
+#ifndef CHIP8_RNG
+#  define CHIP8_RNG Pcg32
+#endif
+
+using Rng = CHIP8_RNG;
+
+#endif  // CHIP8EMUTESTS_RNG_H
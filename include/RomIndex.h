@@ -0,0 +1,146 @@
+#ifndef CHIP8EMUTESTS_ROMINDEX_H
+#define CHIP8EMUTESTS_ROMINDEX_H
+
+#ifndef _WIN32
+
+#  include <cinttypes>
+#  include <cstddef>
+#  include <string>
+#  include <string_view>
+#  include <vector>
+
+struct Translation;
+
+// Index of a directory tree of roms: which platform each one targets and what it relies on, found
+// by statically scanning its code, so loaders look a rom up by hash instead of guessing from its
+// folder or notes.
+//
+// The scan follows the control flow of Translation from 0x200 and only looks at the instructions
+// reached, so data that happens to look like an opcode doesn't count. It stops at the first opcode
+// the core doesn't know, which is enough to tell the platform apart.
+
+enum class RomPlatform : uint8_t {
+  Chip8,
+  Chip8Hires,  // 64x64 VIP mode: starts with 1260 or clears its screen with 0230
+  SuperChip,   // 00FF, 00FE, 00FB, 00FC, 00FD, 00CN, DXY0, FX30, FX75 or FX85
+  XoChip,      // F000 NNNN, 5XY2, 5XY3, FX01, F002 or FX3A
+};
+
+// Behaviors that differ between interpreters and that a rom's code likely depends on
+enum RomQuirk : uint8_t {
+  // 8XY6 or 8XYE with X != Y: the COSMAC VIP shifts VY into VX, SuperChip and this core shift VX
+  ShiftsVY = 1,
+  // FX55 or FX65 followed by another use of I without setting it: the COSMAC VIP leaves I past the
+  // registers, this core doesn't move it
+  IncrementsI = 2,
+  // BNNN in a SuperChip rom, which jumps to XNN + VX there
+  JumpsWithVX = 4,
+};
+
+// "CHIP-8", "CHIP-8 hires", "SuperChip" or "XO-CHIP"
+const char* platform_name(RomPlatform platform);
+
+struct RomInfo {
+  uint64_t rom_hash = 0;  // FNV-1a, as Emulator::rom_hash()
+  uint32_t size = 0;
+  uint32_t code_size = 0;  // Addresses reached from 0x200, Translation::code_size
+  RomPlatform platform = RomPlatform::Chip8;
+  uint8_t quirks = 0;  // RomQuirk bits
+  // FX33 or FX55 right after ANNN pointing into the code found
+  bool self_modifying = false;
+  uint8_t reserved[5] = {};
+};
+
+static_assert(sizeof(RomInfo) == 24);
+
+// Scans a rom as load_rom() places it. `scratch` is overwritten, so threads scanning many roms keep
+// one each instead of allocating one per rom.
+RomInfo analyze_rom(const uint8_t* rom, std::size_t size, Translation& scratch);
+
+struct IndexedRom {
+  std::string path;  // Relative to the indexed directory, with '/' separators
+  RomInfo info;
+};
+
+struct RomIndexStatistics {
+  uint64_t files = 0;  // Roms read
+  uint64_t bytes = 0;
+  uint64_t duplicates = 0;  // Same contents as another file, only the first path is indexed
+  uint64_t unreadable = 0;
+};
+
+// Whether the file name ends with one of the rom extensions: .ch8, .c8, .sc8 or .xo8
+bool rom_file_name(const std::string& name);
+
+// Reads and scans every rom file under `directory` on `threads` threads (0
+// for one per hardware thread), sorted by path. Throws std::system_error if the directory can't be
+// walked; files that can't be read are only counted.
+std::vector<IndexedRom> scan_rom_directory(const std::string& directory, unsigned threads = 0,
+                                           RomIndexStatistics* statistics = nullptr);
+
+// The index file format: a 32-byte header, a hash table of slots, then the paths. Slots are placed
+// by rom_hash modulo slot_count, a power of two at least twice the rom count, and probed linearly;
+// empty ones have a path_size of 0. All integers are in native byte order, checked through
+// `byte_order`.
+namespace rom_index {
+
+constexpr uint8_t magic[4] = {'C', '8', 'R', 'I'};
+constexpr uint32_t version = 1;
+constexpr uint32_t byte_order = 0x01020304;
+
+struct Header {
+  uint8_t magic[4];
+  uint32_t version;
+  uint32_t byte_order;
+  uint32_t slot_count;
+  uint32_t rom_count;
+  uint32_t paths_size;
+  uint64_t reserved;
+};
+
+struct Slot {
+  RomInfo info;
+  uint32_t path_offset;  // From the first byte after the slots
+  uint32_t path_size;
+};
+
+static_assert(sizeof(Header) == 32);
+static_assert(sizeof(Slot) == 32);
+
+}  // namespace rom_index
+
+// Writes the index of `roms` to `path`, through a temporary file renamed into place. Roms with the
+// same hash are only indexed once. Throws std::system_error if it can't be written.
+void write_rom_index(const std::vector<IndexedRom>& roms, const std::string& path);
+
+// An index file, memory-mapped read-only: opening it reads nothing but the header, and each lookup
+// touches one or two slots.
+class RomIndex {
+public:
+  // Throws std::system_error if the file can't be mapped or isn't a compatible index
+  explicit RomIndex(const std::string& path);
+  ~RomIndex();
+
+  RomIndex(const RomIndex&) = delete;
+  RomIndex& operator=(const RomIndex&) = delete;
+
+  // nullptr if the rom isn't indexed
+  const RomInfo* find(uint64_t rom_hash) const;
+  // Path of an indexed rom, `info` must come from find()
+  std::string_view path(const RomInfo& info) const;
+
+  std::size_t size() const;
+
+private:
+  void* mapping = nullptr;
+  std::size_t mapping_size = 0;
+  const rom_index::Slot* slots = nullptr;
+  const char* paths = nullptr;
+  uint32_t paths_size = 0;
+  uint32_t slot_mask = 0;
+  uint32_t rom_count = 0;
+};
+
+#endif  // _WIN32
+
+#endif  // CHIP8EMUTESTS_ROMINDEX_H
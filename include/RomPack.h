@@ -0,0 +1,102 @@
+#ifndef CHIP8EMUTESTS_ROMPACK_H
+#define CHIP8EMUTESTS_ROMPACK_H
+
+#ifndef _WIN32
+
+#  include <cinttypes>
+#  include <cstddef>
+#  include <string>
+#  include <string_view>
+#  include <vector>
+
+#  include "RomIndex.h"
+
+// Many roms in one file, for hosts starting sessions of thousands of roms without opening and
+// reading each of them.
+//
+// A pack is memory-mapped read-only once: finding a rom is a binary search of its index, and
+// loading it copies the image from the mapping straight into the emulator memory, with no system
+// call. Images are aligned on 64 bytes so each starts on its own cache line. Every rom comes with
+// what analyze_rom() found, so loaders know its platform and quirks as well.
+//
+// The layout below is the format. All integers are in native byte order, checked through
+// `byte_order`.
+
+namespace rom_pack {
+
+constexpr uint8_t magic[4] = {'C', '8', 'P', 'K'};
+constexpr uint32_t version = 1;
+constexpr uint32_t byte_order = 0x01020304;
+constexpr std::size_t image_alignment = 64;
+
+struct Header {
+  uint8_t magic[4];
+  uint32_t version;
+  uint32_t byte_order;
+  uint32_t rom_count;
+  uint32_t names_offset;  // From the start of the file
+  uint32_t names_size;
+  uint64_t data_offset;  // First image, a multiple of image_alignment
+};
+
+// Follow the header, sorted by rom hash without duplicates. Then come rom_count uint32_t, the
+// indices of the entries sorted by name, then the names and the images.
+struct Entry {
+  RomInfo info;
+  uint64_t offset;  // Of the image, from the start of the file
+  uint32_t name_offset;  // From names_offset
+  uint32_t name_size;
+};
+
+static_assert(sizeof(Header) == 32);
+static_assert(sizeof(Entry) == 40);
+
+}  // namespace rom_pack
+
+struct PackedRom {
+  std::string name;  // Usually the path the rom was packed from
+  std::vector<uint8_t> data;
+};
+
+// Writes `roms` to a pack at `path`, through a temporary file renamed into place. Roms with the
+// same hash are only packed once, under the first name. Throws std::system_error if it can't
+// be written.
+void write_rom_pack(const std::vector<PackedRom>& roms, const std::string& path);
+
+class RomPack {
+public:
+  struct Rom {
+    const uint8_t* data = nullptr;  // In the mapping, valid while the pack is
+    std::size_t size = 0;
+    std::string_view name;
+    const RomInfo* info = nullptr;
+  };
+
+  // Maps the pack and checks its index, throws std::system_error if it can't be mapped or isn't a
+  // compatible pack
+  explicit RomPack(const std::string& path);
+  ~RomPack();
+
+  RomPack(const RomPack&) = delete;
+  RomPack& operator=(const RomPack&) = delete;
+
+  std::size_t size() const;
+  // By index, in rom hash order
+  Rom rom(std::size_t index) const;
+
+  // Index of the rom, size() if it's not in the pack
+  std::size_t find(uint64_t rom_hash) const;
+  std::size_t find(std::string_view name) const;
+
+private:
+  void* mapping = nullptr;
+  std::size_t mapping_size = 0;
+  const rom_pack::Entry* entries = nullptr;
+  const uint32_t* name_order = nullptr;
+  const char* names = nullptr;
+  std::size_t count = 0;
+};
+
+#endif  // _WIN32
+
+#endif  // CHIP8EMUTESTS_ROMPACK_H
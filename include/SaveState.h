@@ -0,0 +1,70 @@
+#ifndef CHIP8EMUTESTS_SAVESTATE_H
+#define CHIP8EMUTESTS_SAVESTATE_H
+
+#include <cinttypes>
+#include <cstddef>
+
+// Save state format, written by Emulator::save_state() and read by Emulator::load_state().
+//
+// Everything is little-endian and at fixed offsets, so loading is a validated bulk copy. Versions
+// only ever append fields or get a new payload layout, and every version ever written stays
+// readable.
+//
+// Header (32 bytes):
+//    0  "CH8S"
+//    4  u16 version
+//    6  u16 header size
+//    8  u32 payload size
+//   12  u32 reserved, 0
+//   16  u64 FNV-1a hash of the loaded rom
+//   24  u64 FNV-1a hash of the payload
+//
+// Payload, version 2 (6224 bytes):
+//    0  memory[4096]
+// 4096  graphic[2048], 0 or 1 each
+// 6144  V[16]
+// 6160  u16 I
+// 6162  u16 pc
+// 6164  u16 stack[16], bottom first
+// 6196  u8 stack size
+// 6197  u8 delay timer
+// 6198  u8 sound timer
+// 6199  u8 flags: 1 draw, 2 sound, 4 waiting for key
+// 6200  u8 waiting for key register
+// 6201  u16 keys, bit N set when key N is pressed
+// 6203  u8 rng engine id (Rng::id)
+// 6204  u32 reserved, 0
+// 6208  u64 rng state[2], as given by Rng::state()
+//
+// Payload, version 1 (8704 bytes), same as version 2 up to the keys, then:
+// 6203  u8 reserved, 0
+// 6204  u32 Mersenne Twister index
+// 6208  u32 Mersenne Twister words[624]
+//
+// The RNG state of version 1, and of version 2 states written with another RNG engine, can't be
+// carried over: the RNG is then seeded from a hash of the saved RNG state instead, so everything
+// but the random sequence resumes exactly, and loading the same state always gives the same
+// sequence.
+
+namespace save_state_format {
+
+constexpr uint8_t magic[4] = {'C', 'H', '8', 'S'};
+constexpr uint16_t version = 2;
+constexpr std::size_t header_size = 32;
+constexpr std::size_t payload_size_v1 = 8704;
+constexpr std::size_t payload_size_v2 = 6224;
+
+}  // namespace save_state_format
+
+enum class LoadStateResult : uint8_t {
+  Ok,
+  NotASaveState,       // Too short or wrong magic
+  UnsupportedVersion,  // Written by a newer release
+  Truncated,           // Shorter than its header says
+  ChecksumMismatch,    // Payload corrupted
+  InvalidState,        // Checksum matches but values are out of range
+};
+
+const char* to_string(LoadStateResult result);
+
+#endif  // CHIP8EMUTESTS_SAVESTATE_H
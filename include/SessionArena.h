@@ -0,0 +1,146 @@
+#ifndef CHIP8EMUTESTS_SESSIONARENA_H
+#define CHIP8EMUTESTS_SESSIONARENA_H
+
+#ifndef _WIN32
+
+#  include <cinttypes>
+#  include <cstddef>
+#  include <memory>
+#  include <new>
+#  include <utility>
+#  include <vector>
+
+// Fixed-size slots carved out of large memory-mapped slabs, for hosts creating and destroying a
+// great many emulators.
+//
+// Slabs are mapped with mmap() and never returned to the system before the allocator goes away:
+// freed slots go on a free list and are handed out again, most recently freed first while they're
+// still in the cache. Slots of a new slab are handed out in order, so its pages are only touched as
+// it fills up. Large slabs mean few page table entries for many instances, and they can be
+// backed by huge pages, either reserved ones (MAP_HUGETLB, falling back to transparent huge pages
+// when none is left) or transparent ones (madvise(MADV_HUGEPAGE)).
+//
+// An allocator isn't thread-safe, each worker thread owns one. The pages of a slab are placed by
+// the kernel on the NUMA node of the thread first touching them, which is the owner, or on
+// Config::numa_node when it's set.
+class SlabAllocator {
+public:
+  enum class Pages : uint8_t {
+    Normal,
+    Transparent,  // madvise(MADV_HUGEPAGE)
+    Huge,         // MAP_HUGETLB, slab_size must be a multiple of the huge page size
+  };
+
+  struct Config {
+    std::size_t slot_size = 0;  // Rounded up to a multiple of slot_alignment
+    std::size_t slab_size = 2 << 20;
+    Pages pages = Pages::Transparent;
+    int numa_node = -1;  // Slabs are bound to that node with mbind(), -1 to leave it to the kernel
+  };
+
+  struct Statistics {
+    uint64_t live = 0;  // Slots handed out
+    uint64_t live_bytes = 0;
+    uint64_t peak = 0;
+    uint64_t slots = 0;  // In all the slabs
+    uint64_t slabs = 0;
+    uint64_t huge_slabs = 0;  // Backed by reserved huge pages
+    uint64_t bytes = 0;       // Mapped
+    uint64_t numa_bind_failures = 0;
+
+    // Share of the mapped bytes not holding a live slot: free slots and the unusable end of slabs
+    double fragmentation() const;
+  };
+
+  static constexpr std::size_t slot_alignment = 64;
+
+  explicit SlabAllocator(const Config& config);
+  ~SlabAllocator();
+
+  SlabAllocator(const SlabAllocator&) = delete;
+  SlabAllocator& operator=(const SlabAllocator&) = delete;
+
+  // Uninitialized slot of slot_size() bytes, aligned on slot_alignment. Throws std::system_error
+  // if a new slab can't be mapped.
+  void* allocate();
+  // `slot` must come from allocate() of this allocator
+  void deallocate(void* slot);
+
+  std::size_t slot_size() const;
+  const Statistics& statistics() const;
+
+  // NUMA node of the CPU running the calling thread, 0 if unknown
+  static int current_numa_node();
+
+private:
+  struct FreeSlot {
+    FreeSlot* next;
+  };
+
+  Config config;
+  std::size_t slots_per_slab = 0;
+  std::vector<std::pair<void*, std::size_t>> slabs;  // Address and size of each mapping
+  FreeSlot* free_list = nullptr;
+  // Never handed out yet, in the last slab
+  uint8_t* fresh = nullptr;
+  uint8_t* fresh_end = nullptr;
+  Statistics stats;
+
+  void add_slab();
+};
+
+// Objects of type T in the slots of a SlabAllocator
+template <typename T> class SessionArena {
+public:
+  static_assert(alignof(T) <= SlabAllocator::slot_alignment);
+
+  class Deleter {
+  public:
+    Deleter() = default;
+    explicit Deleter(SessionArena* arena) : arena(arena) {}
+    void operator()(T* object) const { arena->destroy(object); }
+
+  private:
+    SessionArena* arena = nullptr;
+  };
+  // Must not outlive the arena
+  using Pointer = std::unique_ptr<T, Deleter>;
+
+  // `config.slot_size` is replaced by sizeof(T)
+  explicit SessionArena(const SlabAllocator::Config& config = {}) : allocator(sized(config)) {}
+
+  template <typename... Args> T* create(Args&&... args) {
+    const auto slot = allocator.allocate();
+    try {
+      return new (slot) T(std::forward<Args>(args)...);
+    } catch (...) {
+      allocator.deallocate(slot);
+      throw;
+    }
+  }
+
+  void destroy(T* object) {
+    if (object != nullptr) {
+      object->~T();
+      allocator.deallocate(object);
+    }
+  }
+
+  template <typename... Args> Pointer make(Args&&... args) {
+    return Pointer(create(std::forward<Args>(args)...), Deleter(this));
+  }
+
+  const SlabAllocator::Statistics& statistics() const { return allocator.statistics(); }
+
+private:
+  SlabAllocator allocator;
+
+  static SlabAllocator::Config sized(SlabAllocator::Config config) {
+    config.slot_size = sizeof(T);
+    return config;
+  }
+};
+
+#endif  // _WIN32
+
+#endif  // CHIP8EMUTESTS_SESSIONARENA_H
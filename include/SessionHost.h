@@ -0,0 +1,148 @@
+#ifndef CHIP8EMUTESTS_SESSIONHOST_H
+#define CHIP8EMUTESTS_SESSIONHOST_H
+
+#ifdef __linux__
+
+#  include <array>
+#  include <atomic>
+#  include <cinttypes>
+#  include <memory>
+#  include <string>
+#  include <vector>
+
+#  include "Emulator.h"
+#  include "RomPack.h"
+#  include "SessionArena.h"
+#  include "SessionProtocol.h"
+#  include "Translation.h"
+
+// Serves many emulator sessions from one thread, to local clients on a Unix socket.
+//
+// An epoll loop accepts clients, applies their key events right away, and emulates every session
+// once per frame from a timerfd. Screens are sent as described in SessionProtocol.h: deltas against
+// the last acknowledged frame, with a single frame in flight per client. That bounds what's
+// buffered for each client to one frame, and a client that falls behind only sees its frames
+// merged; one whose output still goes past max_output_buffer is disconnected. Each wakeup reads a
+// few chunks per client at most, so a flooding client can't starve the others. All sessions of a
+// rom share its Translation, built when the rom is first started, and sessions live in the slabs
+// of a SessionArena owned by the loop thread.
+//
+// Thread safety: run() and poll() must be called from one thread, stop() and statistics() from any.
+class SessionHost {
+public:
+  struct Config {
+    std::string socket_path;
+    std::vector<std::vector<uint8_t>> roms;  // Indexed by the Start message
+    // When set, the Start message indexes the roms of the pack instead, loaded straight from its
+    // mapping
+    std::shared_ptr<const RomPack> pack;
+    double frames_per_second = 60;
+    // The core ticks its timers every cycle, so one cycle is one 60 Hz frame
+    unsigned cycles_per_frame = 1;
+    unsigned max_catch_up_frames = 4;  // Late frames beyond that are skipped
+    std::size_t max_sessions = 16384;
+    std::size_t max_output_buffer = 16384;  // Bytes per client
+    // Slabs of the session arena, mapped as needed. numa_node -1 leaves their pages on the node of
+    // the thread calling run().
+    SlabAllocator::Pages arena_pages = SlabAllocator::Pages::Transparent;
+    int numa_node = -1;
+  };
+
+  struct Statistics {
+    uint64_t sessions = 0;  // Connected now
+    uint64_t accepted = 0;
+    uint64_t disconnected = 0;  // Including the ones dropped below
+    uint64_t dropped_slow = 0;  // Over max_output_buffer
+    uint64_t frames_emulated = 0;  // Host frames, each running every session
+    uint64_t frames_skipped = 0;
+    uint64_t updates_sent = 0;  // Frame messages
+    uint64_t bytes_sent = 0;
+    uint64_t keys_received = 0;
+    // Session arena
+    uint64_t arena_slabs = 0;
+    uint64_t arena_bytes = 0;       // Mapped
+    uint64_t arena_live_bytes = 0;  // In the slots of the connected sessions
+  };
+
+  // Binds the socket, throws std::system_error if it can't.
+  explicit SessionHost(const Config& config);
+  ~SessionHost();
+
+  SessionHost(const SessionHost&) = delete;
+  SessionHost& operator=(const SessionHost&) = delete;
+
+  // Serves until stop() is called
+  void run();
+  // Handles the events of one wait of at most `timeout_ms`, -1 to wait forever
+  void poll(int timeout_ms);
+  void stop();
+
+  Statistics statistics() const;
+
+private:
+  struct Session {
+    int fd = -1;
+    bool started = false;
+    bool closing = false;  // Sent an error, closed once it's flushed
+    uint32_t id = 0;
+    Emulator emulator;
+
+    // Frame 0 is the blank screen, which both sides start from
+    std::array<uint8_t, 64 * 32> acked{};  // Screen of frame acked_frame
+    std::array<uint8_t, 64 * 32> sent{};   // Screen of the frame in flight, if any
+    uint32_t acked_frame = 0;
+    uint32_t next_frame = 1;
+    bool in_flight = false;
+    bool changed = false;  // Screen drawn since the last frame sent
+
+    session_protocol::MessageReader input;
+    std::vector<uint8_t> output;
+    std::size_t output_start = 0;  // Bytes of output already written
+    bool waiting_writable = false;
+  };
+
+  Config config;
+  std::vector<std::unique_ptr<Translation>> translations;
+  int listen_fd = -1;
+  int epoll_fd = -1;
+  int timer_fd = -1;
+  int stop_fd = -1;  // eventfd
+  std::atomic<bool> stopping{false};
+
+  SessionArena<Session> arena;
+  std::vector<SessionArena<Session>::Pointer> sessions;  // By slot, nullptr when free
+  std::vector<uint32_t> free_slots;
+  uint32_t next_session_id = 1;
+
+  // Updated by the loop thread, read by statistics()
+  struct AtomicStatistics {
+    std::atomic<uint64_t> sessions{0};
+    std::atomic<uint64_t> accepted{0};
+    std::atomic<uint64_t> disconnected{0};
+    std::atomic<uint64_t> dropped_slow{0};
+    std::atomic<uint64_t> frames_emulated{0};
+    std::atomic<uint64_t> frames_skipped{0};
+    std::atomic<uint64_t> updates_sent{0};
+    std::atomic<uint64_t> bytes_sent{0};
+    std::atomic<uint64_t> keys_received{0};
+    std::atomic<uint64_t> arena_slabs{0};
+    std::atomic<uint64_t> arena_bytes{0};
+    std::atomic<uint64_t> arena_live_bytes{0};
+  } counters;
+
+  void accept_clients();
+  void tick();
+  void read_client(uint32_t slot);
+  // False to close the session, after sending an error
+  bool handle(Session& session, const session_protocol::Message& message);
+  void send_frame(Session& session);
+  // Writes as much pending output as the socket takes, false if the client is gone
+  bool flush(uint32_t slot);
+  void close_session(uint32_t slot);
+  // Copies the arena statistics to the counters
+  void update_arena_counters();
+};
+
+#endif  // __linux__
+
+#endif  // CHIP8EMUTESTS_SESSIONHOST_H
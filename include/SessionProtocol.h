@@ -0,0 +1,81 @@
+#ifndef CHIP8EMUTESTS_SESSIONPROTOCOL_H
+#define CHIP8EMUTESTS_SESSIONPROTOCOL_H
+
+#include <cinttypes>
+#include <cstddef>
+#include <vector>
+
+// Wire protocol between SessionHost and its clients, over a Unix stream socket.
+//
+// Every message is a u16 size of what follows, a u8 type, then the payload, all little-endian.
+//
+// A client sends Start once, and gets Started back (or Error, and the connection is closed). The
+// host then sends a Frame whenever the screen changed, as a DeltaCodec delta against the last frame
+// the client acknowledged (frame 0 being the blank screen). Only one frame is in flight at a time:
+// until it's acknowledged, later changes are merged into the next frame. A client that doesn't keep
+// up gets fewer frames, never a growing backlog.
+namespace session_protocol {
+
+enum class MessageType : uint8_t {
+  // Client to host
+  Start = 1,  // u16 rom index, u64 seed
+  Key = 2,    // u8 key, u8 1 when pressed and 0 when released
+  Ack = 3,    // u32 frame number, now shown by the client
+
+  // Host to client
+  Started = 64,  // u32 session id
+  Frame = 65,    // u32 frame number, u32 base frame number, u64 emulated cycles, delta
+  Error = 66,    // u8 ErrorCode
+};
+
+enum class ErrorCode : uint8_t {
+  InvalidRom = 1,       // No rom with this index
+  TooManySessions = 2,  // The host is full
+  ProtocolError = 3,    // Unexpected or malformed message
+};
+
+constexpr std::size_t header_size = 3;
+// Largest payload either side sends, a frame whose delta touches every byte
+constexpr std::size_t max_payload_size = 16 + 64 * 32 + 16;
+
+struct Message {
+  MessageType type;
+  const uint8_t* payload;  // Valid until the reader is given more data
+  std::size_t size;
+};
+
+void append_start(std::vector<uint8_t>& out, uint16_t rom, uint64_t seed);
+void append_key(std::vector<uint8_t>& out, uint8_t key, bool pressed);
+void append_ack(std::vector<uint8_t>& out, uint32_t frame);
+void append_started(std::vector<uint8_t>& out, uint32_t session);
+// Appends a Frame of `current` against `base`
+void append_frame(std::vector<uint8_t>& out, uint32_t frame, uint32_t base_frame, uint64_t cycles,
+                  const uint8_t* base, const uint8_t* current);
+void append_error(std::vector<uint8_t>& out, ErrorCode code);
+
+uint16_t load16(const uint8_t* in);
+uint32_t load32(const uint8_t* in);
+uint64_t load64(const uint8_t* in);
+
+// Splits a received byte stream into messages
+class MessageReader {
+public:
+  // Space for at least `size` more bytes, to be followed by received()
+  uint8_t* prepare(std::size_t size);
+  void received(std::size_t size);
+
+  // Takes the next complete message. Returns false if there's none yet, or if the stream is
+  // malformed, which error() then tells.
+  bool next(Message& message);
+  bool error() const;
+
+private:
+  std::vector<uint8_t> buffer;
+  std::size_t start = 0;  // Of the first message not taken yet
+  std::size_t end = 0;    // Of the received bytes
+  bool malformed = false;
+};
+
+}  // namespace session_protocol
+
+#endif  // CHIP8EMUTESTS_SESSIONPROTOCOL_H
@@ -0,0 +1,162 @@
+#ifndef CHIP8EMUTESTS_SHAREDEXPORT_H
+#define CHIP8EMUTESTS_SHAREDEXPORT_H
+
+#ifndef _WIN32
+
+#  include <array>
+#  include <atomic>
+#  include <cinttypes>
+#  include <string>
+#  include <vector>
+
+class Emulator;
+
+// Publishes an emulator to other processes through a POSIX shared memory segment, for recorders and
+// bots that would otherwise scrape the window.
+//
+// The segment holds two frame slots written alternately, each guarded by its own sequence number
+// (a seqlock). A reader takes the slot of the latest frame and checks its sequence before and
+// after: the writer is busy with the other slot meanwhile, so a reader only ever retries if it
+// takes longer than a whole frame. Neither side makes a system call after setup, and a reader can
+// work on the frame in place instead of copying it.
+//
+// Keys go the other way through a ring in the same segment, with a single producer (one reader
+// process at a time) and the exporting process consuming it.
+//
+// The layout below is the format: readers in other languages map "/dev/shm/<name>" and follow it.
+// All integers are in native byte order, checked through `byte_order`.
+
+namespace shared_export {
+
+constexpr uint8_t magic[4] = {'C', '8', 'S', 'M'};
+constexpr uint32_t version = 1;
+constexpr uint32_t byte_order = 0x01020304;
+constexpr std::size_t max_regions = 8;
+constexpr std::size_t input_capacity = 256;  // Power of two
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free);
+static_assert(std::atomic<uint32_t>::is_always_lock_free);
+
+struct Region {
+  uint16_t address = 0;
+  uint16_t size = 0;
+};
+
+// Machine state of one published frame
+struct Frame {
+  uint64_t number = 0;  // Frames published before this one plus one
+  uint64_t cycles = 0;  // Emulator::cycles()
+  std::array<uint8_t, 16> V{};
+  uint16_t I = 0;
+  uint16_t pc = 0;
+  uint8_t delay_timer = 0;
+  uint8_t sound_timer = 0;
+  uint8_t stack_size = 0;
+  uint8_t reserved = 0;
+  std::array<uint16_t, 16> stack{};  // Bottom-most first
+  uint16_t keys = 0;                 // Bit N for key N
+  uint16_t reserved2 = 0;
+  std::array<uint8_t, 64 * 32> graphic{};
+  // Only the exported regions are filled in, at their own addresses. The rest stays 0.
+  std::array<uint8_t, 4096> memory{};
+};
+
+struct alignas(64) Slot {
+  // Odd while being written, 2 * number once frame `number` is complete
+  std::atomic<uint64_t> sequence{0};
+  Frame frame;
+};
+
+// Key event: key in the low byte, 1 in the high byte when pressed
+struct alignas(64) InputRing {
+  std::atomic<uint32_t> head{0};  // Written by the producer
+  alignas(64) std::atomic<uint32_t> tail{0};  // Written by the consumer
+  alignas(64) std::array<uint16_t, input_capacity> events{};
+};
+
+struct Header {
+  uint8_t magic[4];
+  uint32_t version;
+  uint32_t segment_size;  // sizeof(Segment)
+  uint32_t byte_order;
+  std::atomic<uint64_t> published{0};  // Latest complete frame, in slot published % 2
+  uint32_t region_count = 0;
+  std::array<Region, max_regions> regions{};
+};
+
+struct Segment {
+  Header header;
+  Slot slots[2];
+  InputRing input;
+};
+
+}  // namespace shared_export
+
+// Writer side, owned by the process running the emulator
+class SharedExport {
+public:
+  struct Config {
+    std::string name;  // Shared memory object name, "/chip8" for instance
+    // Memory exported with every frame, at most max_regions. Regions going past 4 KB are clipped.
+    std::vector<shared_export::Region> regions;
+  };
+
+  // Creates the segment, replacing any left behind under the same name. Throws std::system_error
+  // if it can't.
+  explicit SharedExport(const Config& config);
+  // Unmaps and removes the segment. Readers still mapping it keep their view of the last frame.
+  ~SharedExport();
+
+  SharedExport(const SharedExport&) = delete;
+  SharedExport& operator=(const SharedExport&) = delete;
+
+  // Writes the current frame of `emulator` into the other slot and makes it the latest
+  void publish(const Emulator& emulator);
+  // Applies the key events queued by the reader, returns how many there were
+  std::size_t apply_input(Emulator& emulator);
+
+  uint64_t published() const;
+
+private:
+  std::string name;
+  shared_export::Segment* segment = nullptr;
+};
+
+// Reader side, in any other process
+class SharedExportReader {
+public:
+  // Maps an existing segment. Throws std::system_error if there's none, or if it wasn't written by
+  // a compatible build.
+  explicit SharedExportReader(const std::string& name);
+  ~SharedExportReader();
+
+  SharedExportReader(const SharedExportReader&) = delete;
+  SharedExportReader& operator=(const SharedExportReader&) = delete;
+
+  // Number of the latest frame, 0 before the first. Cheap enough to poll.
+  uint64_t published() const;
+
+  // Zero-copy access: the latest frame in place, with a ticket to check once done with it. Any
+  // data read from the frame is only meaningful if valid(ticket) is still true afterwards. Returns
+  // nullptr before the first frame, or when no complete frame could be found in a bounded number
+  // of attempts.
+  const shared_export::Frame* latest(uint64_t& ticket) const;
+  bool valid(uint64_t ticket) const;
+
+  // Copies the latest complete frame, retrying a bounded number of times if it gets overwritten.
+  // False before the first frame or once the attempts run out.
+  bool read(shared_export::Frame& frame) const;
+
+  // Queues a key event for the emulator, false if the ring is full
+  bool push_key(uint8_t key, bool pressed);
+
+  const std::vector<shared_export::Region>& regions() const;
+
+private:
+  shared_export::Segment* segment = nullptr;
+  std::vector<shared_export::Region> exported_regions;
+};
+
+#endif  // _WIN32
+
+#endif  // CHIP8EMUTESTS_SHAREDEXPORT_H
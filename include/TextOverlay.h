@@ -0,0 +1,21 @@
+#ifndef CHIP8EMUTESTS_TEXTOVERLAY_H
+#define CHIP8EMUTESTS_TEXTOVERLAY_H
+
+#include <cinttypes>
+#include <cstddef>
+#include <string>
+
+// Draws short status lines over an RGBA32 frame, such as the frame pacing statistics. Glyphs are
+// 4 * 5 pixels: the CHIP-8 font for 0-9 and A-F, plus the few letters and signs needed by status
+// text. Lowercase letters are drawn uppercase, characters without a glyph are left blank.
+
+// Draws `text` with its top left corner at (x, y), every glyph pixel being `scale` * `scale`
+// output pixels of `pixel`. Anything outside of the `width` * `height` frame is clipped.
+void draw_text(void* pixels, std::size_t pitch, unsigned width, unsigned height, unsigned x,
+               unsigned y, const std::string& text, unsigned scale, uint32_t pixel);
+
+// Size taken by `text` drawn at `scale`, in output pixels
+unsigned text_width(const std::string& text, unsigned scale);
+unsigned text_height(unsigned scale);
+
+#endif  // CHIP8EMUTESTS_TEXTOVERLAY_H
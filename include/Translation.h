@@ -0,0 +1,50 @@
+#ifndef CHIP8EMUTESTS_TRANSLATION_H
+#define CHIP8EMUTESTS_TRANSLATION_H
+
+#include <array>
+#include <cinttypes>
+#include <cstddef>
+#include <type_traits>
+
+#include "Decoder.h"
+#include "Fusion.h"
+
+// Version of the decoding and analysis in translations, bumped whenever either changes so cached
+// translations of an older core are never used.
+constexpr uint32_t translation_version = 3;
+
+// Ahead of time decoding and static analysis of a rom.
+//
+// Every address of the initial memory image (font and rom) is decoded, odd ones too since programs
+// can jump anywhere, so an emulator using the translation decodes nothing that was in the rom. The
+// analysis follows the control flow from 0x200 and flags the addresses reached as code, the jump
+// and call targets, and the starts of basic blocks. BNNN targets depend on V0 and aren't followed.
+// The superinstructions of the corpus profile and the built-in ones are fused into the code found,
+// see Fusion.h.
+//
+// It's plain data without pointers, so TranslationCache can store it as is and map it back.
+struct Translation {
+  enum Flag : uint8_t {
+    Code = 1,
+    JumpTarget = 2,
+    CallTarget = 4,
+    BlockStart = 8,
+  };
+
+  uint64_t rom_hash = 0;  // FNV-1a of the rom, as Emulator::rom_hash()
+  uint32_t code_size = 0;  // Addresses flagged as Code
+  uint32_t superinstruction_count = 0;
+  std::array<Instruction, 4096> instructions{};
+  std::array<uint8_t, 4096> flags{};  // Flag bits by address
+  // Superinstruction starting at each address, as its index in `superinstructions` plus one, 0 for
+  // none
+  std::array<uint8_t, 4096> fused{};
+  std::array<Superinstruction, max_superinstructions> superinstructions{};
+};
+
+static_assert(std::is_trivially_copyable_v<Translation>);
+
+// Translates a rom as load_rom() places it, anything that doesn't fit after 0x200 is ignored.
+void translate(const uint8_t* rom, std::size_t size, Translation& out);
+
+#endif  // CHIP8EMUTESTS_TRANSLATION_H
@@ -0,0 +1,52 @@
+#ifndef CHIP8EMUTESTS_TRANSLATIONCACHE_H
+#define CHIP8EMUTESTS_TRANSLATIONCACHE_H
+
+#ifndef _WIN32
+
+#  include <atomic>
+#  include <cinttypes>
+#  include <memory>
+#  include <string>
+
+#  include "Translation.h"
+
+// Directory of translations shared by every process starting sessions of the same roms, keyed by
+// the rom hash and translation_version.
+//
+// Cached translations are memory-mapped read-only, so a warm start does no decoding or analysis at
+// all and processes share the pages. Files are written under a temporary name and renamed into
+// place: readers only ever see complete files, and processes racing on the same rom just replace a
+// file with an identical one. A hash collision is harmless, the emulator checks every pre-decoded
+// instruction against memory before using it.
+//
+// File layout: a 32-byte header ("C8TC", u32 translation_version, u32 sizeof(Translation), u32
+// 0x01020304 in native byte order, u64 rom hash, u64 reserved), then the Translation as in memory.
+// Files written by another build or architecture don't match the header and are rebuilt.
+class TranslationCache {
+public:
+  // Creates the directory if needed, throws std::system_error if it can't.
+  explicit TranslationCache(std::string directory);
+
+  // Translation of `rom`, mapped from the cache, or built and stored on a miss. Still returns the
+  // built translation if it can't be stored. The translation stays valid while the pointer is held,
+  // even if its file is replaced or deleted.
+  std::shared_ptr<const Translation> load(const uint8_t* rom, std::size_t size);
+
+  // File of the rom with this hash
+  std::string path(uint64_t rom_hash) const;
+
+  uint64_t hits() const;
+  uint64_t misses() const;
+
+private:
+  std::string directory;
+  std::atomic<uint64_t> hit_count{0};
+  std::atomic<uint64_t> miss_count{0};
+
+  std::shared_ptr<const Translation> map(const std::string& path, uint64_t rom_hash) const;
+  bool store(const std::string& path, const Translation& translation) const;
+};
+
+#endif  // _WIN32
+
+#endif  // CHIP8EMUTESTS_TRANSLATIONCACHE_H
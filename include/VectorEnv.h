@@ -0,0 +1,113 @@
+#ifndef CHIP8EMUTESTS_VECTORENV_H
+#define CHIP8EMUTESTS_VECTORENV_H
+
+#include <cinttypes>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Emulator.h"
+
+// Batch of emulators running the same rom, stepped together for reinforcement learning loops.
+//
+// Every step() applies one action (a 16-bit key mask) per environment, advances each environment
+// by a fixed number of frames on a pool of worker threads, and writes the observations, rewards and
+// episode ends into caller-provided buffers. Nothing is allocated once constructed.
+//
+// An episode ends when the done probe matches, when the emulator faults, or after
+// max_episode_frames. Ended environments are reset right away: the observation written for them is
+// the first one of the next episode, while the reward and done flag belong to the ended one.
+class VectorEnv {
+public:
+  enum class ObservationFormat : uint8_t {
+    Bytes,  // 64 * 32 bytes per environment, one per pixel
+    Bits,   // 64 * 32 / 8 bytes per environment, 8 pixels per byte, leftmost pixel in the MSB
+  };
+
+  // Adds scale * (memory[address] after the step - memory[address] before the step) to the reward
+  struct RewardProbe {
+    uint16_t address = 0;
+    float scale = 1;
+  };
+
+  // Ends the episode when (memory[address] & mask) == value
+  struct DoneProbe {
+    bool enabled = false;
+    uint16_t address = 0;
+    uint8_t mask = 0xFF;
+    uint8_t value = 0;
+  };
+
+  struct Config {
+    std::size_t environments = 1;
+    unsigned frames_per_step = 4;
+    // The core ticks its timers every cycle, so one cycle is one 60 Hz frame as in the standalone
+    // frontend
+    unsigned cycles_per_frame = 1;
+    uint64_t max_episode_frames = 0;  // 0 for no limit
+    ObservationFormat observation_format = ObservationFormat::Bytes;
+    std::vector<RewardProbe> reward_probes;
+    DoneProbe done_probe;
+    uint64_t seed = 0;     // Environment N, episode E is seeded with seed + N + E * environments
+    unsigned threads = 0;  // 0 for one per hardware thread
+    // Pre-decoded rom shared by every environment, see TranslationCache. Must outlive the
+    // VectorEnv.
+    const Translation* translation = nullptr;
+  };
+
+  VectorEnv(const Config& config, const uint8_t* rom, std::size_t rom_size);
+  ~VectorEnv();
+
+  VectorEnv(const VectorEnv&) = delete;
+  VectorEnv& operator=(const VectorEnv&) = delete;
+
+  std::size_t size() const;
+  // Bytes of observation per environment
+  std::size_t observation_size() const;
+
+  // Starts a new episode in every environment and writes size() * observation_size() bytes of
+  // observations.
+  void reset(uint8_t* observations);
+
+  // `actions` holds size() key masks, `observations` size() * observation_size() bytes, `rewards`
+  // and `dones` size() entries each.
+  void step(const uint16_t* actions, uint8_t* observations, float* rewards, uint8_t* dones);
+
+  const Emulator& environment(std::size_t index) const;
+
+private:
+  struct Environment {
+    Emulator emulator;
+    uint64_t episode = 0;
+    uint64_t episode_frames = 0;
+  };
+
+  Config config;
+  MachineState initial_state;
+  std::vector<Environment> environments;
+
+  // Arguments of the step being run, read by the workers
+  const uint16_t* step_actions = nullptr;
+  uint8_t* step_observations = nullptr;
+  float* step_rewards = nullptr;
+  uint8_t* step_dones = nullptr;
+
+  std::vector<std::thread> workers;
+  std::mutex mutex;
+  std::condition_variable work_ready;
+  std::condition_variable work_done;
+  uint64_t generation = 0;
+  std::size_t pending_workers = 0;
+  bool stopping = false;
+
+  void worker(std::size_t index);
+  void run_in_parallel();
+  void step_range(std::size_t begin, std::size_t end);
+  void start_episode(std::size_t index);
+  void observe(std::size_t index, uint8_t* observation) const;
+  std::size_t range_begin(std::size_t worker) const;
+};
+
+#endif  // CHIP8EMUTESTS_VECTORENV_H
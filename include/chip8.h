@@ -0,0 +1,100 @@
+#ifndef CHIP8EMUTESTS_CHIP8_H
+#define CHIP8EMUTESTS_CHIP8_H
+
+// C interface to the emulator, for bindings from other languages.
+//
+// Built as the `chip8` shared library. The emulator is reached through an opaque handle, and a
+// whole frame (or any number of cycles) runs in a single call, so foreign callers cross the
+// boundary once per frame rather than once per instruction. Functions never throw and accept a
+// null handle as a no-op.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(_WIN32) && defined(CHIP8_SHARED)
+#  ifdef CHIP8_EXPORTS
+#    define CHIP8_API __declspec(dllexport)
+#  else
+#    define CHIP8_API __declspec(dllimport)
+#  endif
+#elif defined(__GNUC__)
+#  define CHIP8_API __attribute__((visibility("default")))
+#else
+#  define CHIP8_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Bumped whenever an existing function or type changes in an incompatible way
+#define CHIP8_ABI_VERSION 1
+
+#define CHIP8_SCREEN_WIDTH 64
+#define CHIP8_SCREEN_HEIGHT 32
+
+typedef struct chip8_emulator chip8_emulator;
+
+typedef enum chip8_status {
+  CHIP8_OK = 0,
+  CHIP8_FAULT = 1,             // Stopped on a fault, see chip8_last_fault()
+  CHIP8_INVALID_ARGUMENT = 2,  // Null handle or buffer
+  CHIP8_ROM_TOO_LARGE = 3,     // The rom was truncated to what fits after 0x200
+} chip8_status;
+
+// Same values as FaultKind
+typedef enum chip8_fault_kind {
+  CHIP8_FAULT_NONE = 0,
+  CHIP8_FAULT_INVALID_OPCODE = 1,
+  CHIP8_FAULT_STACK_OVERFLOW = 2,
+  CHIP8_FAULT_STACK_UNDERFLOW = 3,
+} chip8_fault_kind;
+
+typedef struct chip8_fault {
+  uint32_t kind;  // chip8_fault_kind
+  uint16_t pc;
+  uint16_t opcode;
+} chip8_fault;
+
+CHIP8_API uint32_t chip8_abi_version(void);
+
+// Returns null when out of memory.
+CHIP8_API chip8_emulator* chip8_create(void);
+CHIP8_API void chip8_destroy(chip8_emulator* emulator);
+
+// Clears the machine, including the loaded rom.
+CHIP8_API void chip8_reset(chip8_emulator* emulator);
+// Copies `size` bytes of rom at 0x200. The buffer can be freed right after the call.
+CHIP8_API chip8_status chip8_load_rom(chip8_emulator* emulator, const uint8_t* rom, size_t size);
+// Reseeds the CXNN random number generator. New emulators start from the same seed, so runs are
+// reproducible unless seeded differently.
+CHIP8_API void chip8_seed(chip8_emulator* emulator, uint64_t seed);
+
+// Cycles run by each frame of chip8_run_frames(), 1 by default. The timers tick once per cycle.
+CHIP8_API void chip8_set_cycles_per_frame(chip8_emulator* emulator, uint32_t cycles);
+
+// Runs up to `cycles` cycles, stopping early on a fault. `executed` (optional) receives the number
+// of cycles actually run.
+CHIP8_API chip8_status chip8_run_cycles(chip8_emulator* emulator, uint64_t cycles,
+                                        uint64_t* executed);
+CHIP8_API chip8_status chip8_run_frames(chip8_emulator* emulator, uint32_t frames,
+                                        uint64_t* executed);
+// Fault that stopped the last run, kind CHIP8_FAULT_NONE if it completed.
+CHIP8_API chip8_fault chip8_last_fault(const chip8_emulator* emulator);
+
+// Bit N for key N
+CHIP8_API void chip8_set_keys(chip8_emulator* emulator, uint16_t keys);
+CHIP8_API uint16_t chip8_keys(const chip8_emulator* emulator);
+
+// CHIP8_SCREEN_WIDTH * CHIP8_SCREEN_HEIGHT bytes, one per pixel row by row, 0 or 1. The pointer
+// stays valid, and is updated in place, for the lifetime of the handle.
+CHIP8_API const uint8_t* chip8_framebuffer(const chip8_emulator* emulator);
+// Whether the screen changed / the buzzer should sound since the last call, 0 or 1.
+CHIP8_API int chip8_should_draw(chip8_emulator* emulator);
+CHIP8_API int chip8_should_buzz(chip8_emulator* emulator);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // CHIP8EMUTESTS_CHIP8_H
@@ -0,0 +1,53 @@
+#include "Breakpoints.h"
+
+namespace {
+
+constexpr uint16_t address_mask = 0xFFF;
+
+uint16_t find_in(const std::bitset<4096>& bits, uint16_t address, uint16_t length) {
+  for (uint16_t i = 0; i < length; i++) {
+    const uint16_t wrapped = (address + i) & address_mask;
+    if (bits[wrapped]) {
+      return wrapped;
+    }
+  }
+  return Breakpoints::no_address;
+}
+
+}  // namespace
+
+void Breakpoints::add_breakpoint(uint16_t address) { breakpoints.set(address & address_mask); }
+void Breakpoints::remove_breakpoint(uint16_t address) { breakpoints.reset(address & address_mask); }
+bool Breakpoints::has_breakpoint(uint16_t address) const {
+  return breakpoints[address & address_mask];
+}
+
+void Breakpoints::add_read_watchpoint(uint16_t address) {
+  read_watchpoints.set(address & address_mask);
+}
+void Breakpoints::remove_read_watchpoint(uint16_t address) {
+  read_watchpoints.reset(address & address_mask);
+}
+void Breakpoints::add_write_watchpoint(uint16_t address) {
+  write_watchpoints.set(address & address_mask);
+}
+void Breakpoints::remove_write_watchpoint(uint16_t address) {
+  write_watchpoints.reset(address & address_mask);
+}
+
+uint16_t Breakpoints::find_read_watchpoint(uint16_t address, uint16_t length) const {
+  return find_in(read_watchpoints, address, length);
+}
+uint16_t Breakpoints::find_write_watchpoint(uint16_t address, uint16_t length) const {
+  return find_in(write_watchpoints, address, length);
+}
+
+bool Breakpoints::any() const {
+  return breakpoints.any() || read_watchpoints.any() || write_watchpoints.any();
+}
+
+void Breakpoints::clear() {
+  breakpoints.reset();
+  read_watchpoints.reset();
+  write_watchpoints.reset();
+}
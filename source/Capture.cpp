@@ -0,0 +1,399 @@
+#include "Capture.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <system_error>
+
+namespace {
+
+uint8_t red(uint32_t color) { return (color >> 16) & 0xFF; }
+uint8_t green(uint32_t color) { return (color >> 8) & 0xFF; }
+uint8_t blue(uint32_t color) { return color & 0xFF; }
+
+// BT.601 studio range, as expected by Y4M readers
+uint8_t luma(uint32_t color) {
+  const auto y = 66 * red(color) + 129 * green(color) + 25 * blue(color);
+  return static_cast<uint8_t>(16 + (y + 128) / 256);
+}
+uint8_t chroma_blue(uint32_t color) {
+  const auto u = -38 * red(color) - 74 * green(color) + 112 * blue(color);
+  return static_cast<uint8_t>(128 + (u + 128) / 256);
+}
+uint8_t chroma_red(uint32_t color) {
+  const auto v = 112 * red(color) - 94 * green(color) - 18 * blue(color);
+  return static_cast<uint8_t>(128 + (v + 128) / 256);
+}
+
+void append16(std::vector<uint8_t>& out, uint16_t value) {
+  out.push_back(value & 0xFF);
+  out.push_back(value >> 8);
+}
+
+// Variable length LZW of a 2 color image, as GIF image data sub-blocks
+class GifLzw {
+public:
+  explicit GifLzw(std::vector<uint8_t>& out) : out(out) {}
+
+  void encode(const uint8_t* indices, std::size_t count) {
+    out.push_back(min_code_size);
+    reset();
+    emit(clear_code);
+
+    uint16_t prefix = indices[0];
+    for (std::size_t i = 1; i < count; i++) {
+      const auto index = indices[i];
+      if (const auto code = table[prefix * alphabet + index]) {
+        prefix = code;
+        continue;
+      }
+
+      emit(prefix);
+      table[prefix * alphabet + index] = ++last_code;
+      if (last_code >= 1u << code_size) {
+        code_size++;
+      }
+      if (last_code == max_code) {
+        emit(clear_code);
+        reset();
+      }
+      prefix = index;
+    }
+    emit(prefix);
+
+    // The decoder adds one more code when it reads the last prefix, widening codes one step early
+    if (last_code + 1u >= 1u << code_size && code_size < 12) {
+      code_size++;
+    }
+    emit(end_code);
+    if (bit_count > 0) {
+      push_byte(static_cast<uint8_t>(bits));
+    }
+    if (block_size > 0) {
+      out[block_start] = block_size;
+    }
+    out.push_back(0);  // Block terminator
+  }
+
+private:
+  // GIF doesn't allow smaller codes, even for 2 colors
+  static constexpr uint8_t min_code_size = 2;
+  static constexpr uint16_t alphabet = 1 << min_code_size;
+  static constexpr uint16_t clear_code = alphabet;
+  static constexpr uint16_t end_code = alphabet + 1;
+  static constexpr uint16_t max_code = 4095;
+
+  std::vector<uint8_t>& out;
+  // Code of prefix followed by index, at prefix * alphabet + index. 0 when not in the table, which
+  // can't clash with a real entry since those all come after end_code.
+  std::array<uint16_t, (max_code + 1) * alphabet> table;
+  uint16_t last_code = end_code;
+  unsigned code_size = min_code_size + 1;
+  uint32_t bits = 0;
+  unsigned bit_count = 0;
+  std::size_t block_start = 0;
+  uint8_t block_size = 0;
+
+  void reset() {
+    table.fill(0);
+    last_code = end_code;
+    code_size = min_code_size + 1;
+  }
+
+  void emit(uint16_t code) {
+    bits |= static_cast<uint32_t>(code) << bit_count;
+    bit_count += code_size;
+    while (bit_count >= 8) {
+      push_byte(bits & 0xFF);
+      bits >>= 8;
+      bit_count -= 8;
+    }
+  }
+
+  void push_byte(uint8_t byte) {
+    if (block_size == 0) {
+      block_start = out.size();
+      out.push_back(0);
+    }
+    out.push_back(byte);
+    if (++block_size == 255) {
+      out[block_start] = block_size;
+      block_size = 0;
+    }
+  }
+};
+
+}  // namespace
+
+Capture::Capture(const Config& config, const std::string& path)
+    : config(config), file(path, std::ios::binary), out(file) {
+  if (!file) {
+    throw std::system_error(errno, std::generic_category(), "Can't create " + path);
+  }
+  start();
+}
+
+Capture::Capture(const Config& config, std::ostream& out) : config(config), out(out) { start(); }
+
+Capture::~Capture() { finish(); }
+
+void Capture::start() {
+  config.scale = std::max(config.scale, 1u);
+  config.frames_per_second = std::max(config.frames_per_second, 1u);
+  queue.resize(std::max<std::size_t>(config.queue_capacity, 1));
+
+  Renderer::Config renderer_config;
+  renderer_config.scale = config.scale;
+  renderer_config.foreground = config.foreground;
+  renderer_config.background = config.background;
+  rgba_renderer = Renderer(renderer_config);
+
+  writer = std::thread(&Capture::write, this);
+}
+
+void Capture::attach(Emulator& emulator) {
+  detach();
+  this->emulator = &emulator;
+  emulator.set_draw_listener(&Capture::on_draw, this);
+}
+
+void Capture::detach() {
+  if (emulator != nullptr) {
+    emulator->set_draw_listener(nullptr, nullptr);
+    emulator = nullptr;
+  }
+}
+
+void Capture::on_draw(void* context, const Emulator&) {
+  static_cast<Capture*>(context)->drawn = true;
+}
+
+void Capture::end_frame() {
+  const auto index = frame_count++;
+  if (!drawn || emulator == nullptr) {
+    return;
+  }
+
+  // Sprites drawn twice to blink, or redrawn in place, leave the screen as it was
+  const auto& graphic = emulator->get_graphic();
+  drawn = false;
+  if (graphic == last_queued) {
+    return;
+  }
+
+  if (!push(index, graphic)) {
+    // Retried on the next frame, the writer repeats the previous screen meanwhile
+    dropped.fetch_add(1, std::memory_order_relaxed);
+    drawn = true;
+  }
+}
+
+bool Capture::push(uint64_t index, const std::array<uint8_t, 64 * 32>& pixels) {
+  const auto tail = queue_tail.load(std::memory_order_relaxed);
+  if (tail - queue_head.load(std::memory_order_acquire) == queue.size()) {
+    return false;
+  }
+  auto& frame = queue[tail % queue.size()];
+  frame.index = index;
+  frame.pixels = pixels;
+  queue_tail.store(tail + 1, std::memory_order_release);
+  last_queued = pixels;
+  return true;
+}
+
+void Capture::finish() {
+  if (finished) {
+    return;
+  }
+  finished = true;
+
+  // The last screen is worth waiting for, a dropped one would leave the video ending on a stale
+  // frame
+  if (drawn && emulator != nullptr && frame_count > 0
+      && emulator->get_graphic() != last_queued) {
+    while (!push(frame_count - 1, emulator->get_graphic())) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  }
+  detach();
+
+  total_frames.store(frame_count, std::memory_order_relaxed);
+  finishing.store(true, std::memory_order_release);
+  writer.join();
+  out.flush();
+}
+
+uint64_t Capture::frames() const { return frame_count; }
+
+uint64_t Capture::dropped_frames() const { return dropped.load(std::memory_order_relaxed); }
+
+uint64_t Capture::written_frames() const { return written.load(std::memory_order_relaxed); }
+
+Capture::Format Capture::format_from_path(const std::string& path) {
+  const auto extension = path.substr(std::min(path.rfind('.'), path.size()));
+  if (extension == ".gif") {
+    return Format::Gif;
+  }
+  if (extension == ".rgba" || extension == ".raw") {
+    return Format::RawRGBA;
+  }
+  return Format::Y4M;
+}
+
+void Capture::write() {
+  write_header();
+
+  while (true) {
+    const auto head = queue_head.load(std::memory_order_relaxed);
+    if (head == queue_tail.load(std::memory_order_acquire)) {
+      // The queue is checked again after seeing finishing, frames may have been pushed right before
+      if (finishing.load(std::memory_order_acquire)
+          && head == queue_tail.load(std::memory_order_acquire)) {
+        break;
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      continue;
+    }
+
+    const auto& frame = queue[head % queue.size()];
+    write_frames(previous, frame.index);
+    previous = frame.pixels;
+    queue_head.store(head + 1, std::memory_order_release);
+  }
+
+  write_frames(previous, total_frames.load(std::memory_order_relaxed));
+  write_trailer();
+}
+
+void Capture::write_header() {
+  encoded.clear();
+  if (config.format == Format::Y4M) {
+    const auto header = "YUV4MPEG2 W" + std::to_string(width()) + " H" + std::to_string(height())
+                        + " F" + std::to_string(config.frames_per_second) + ":1 Ip A1:1 C444\n";
+    encoded.assign(header.begin(), header.end());
+  } else if (config.format == Format::Gif) {
+    const std::string signature = "GIF89a";
+    encoded.assign(signature.begin(), signature.end());
+    append16(encoded, static_cast<uint16_t>(width()));
+    append16(encoded, static_cast<uint16_t>(height()));
+    encoded.push_back(0x80);  // Global color table of 2 colors
+    encoded.push_back(0);     // Background color
+    encoded.push_back(0);     // Square pixels
+    for (const auto color : {config.background, config.foreground}) {
+      encoded.push_back(red(color));
+      encoded.push_back(green(color));
+      encoded.push_back(blue(color));
+    }
+
+    // Loop forever
+    const std::string loop("\x21\xFF\x0BNETSCAPE2.0\x03\x01\x00\x00\x00", 19);
+    encoded.insert(encoded.end(), loop.begin(), loop.end());
+  }
+  out.write(reinterpret_cast<const char*>(encoded.data()), encoded.size());
+}
+
+void Capture::write_frames(const std::array<uint8_t, 64 * 32>& pixels, uint64_t until) {
+  if (until <= next_index) {
+    return;
+  }
+
+  if (config.format == Format::Gif) {
+    // A GIF frame lasts until the next different one, merge identical consecutive frames
+    if (!gif_pending || pixels != gif_pixels) {
+      if (gif_pending) {
+        write_gif_frame(gif_pending_start, next_index);
+      }
+      gif_pixels = pixels;
+      scale(pixels);
+      gif_pending = true;
+      gif_pending_start = next_index;
+    }
+  } else if (config.format == Format::Y4M) {
+    scale(pixels);
+    for (auto index = next_index; index < until; index++) {
+      write_y4m_frame();
+    }
+  } else {
+    rgba_renderer.render(pixels, rgba);
+    for (auto index = next_index; index < until; index++) {
+      write_rgba_frame();
+    }
+  }
+  next_index = until;
+}
+
+void Capture::write_trailer() {
+  if (config.format == Format::Gif) {
+    if (gif_pending) {
+      write_gif_frame(gif_pending_start, next_index);
+    }
+    out.put(0x3B);
+  }
+}
+
+void Capture::write_y4m_frame() {
+  const uint8_t y[2] = {luma(config.background), luma(config.foreground)};
+  const uint8_t u[2] = {chroma_blue(config.background), chroma_blue(config.foreground)};
+  const uint8_t v[2] = {chroma_red(config.background), chroma_red(config.foreground)};
+
+  const auto size = scaled.size();
+  encoded.resize(6 + size * 3);
+  std::memcpy(encoded.data(), "FRAME\n", 6);
+  for (std::size_t i = 0; i < size; i++) {
+    const auto index = scaled[i];
+    encoded[6 + i] = y[index];
+    encoded[6 + size + i] = u[index];
+    encoded[6 + size * 2 + i] = v[index];
+  }
+  out.write(reinterpret_cast<const char*>(encoded.data()), encoded.size());
+  written.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Capture::write_rgba_frame() {
+  out.write(reinterpret_cast<const char*>(rgba.data()), rgba.size() * sizeof(uint32_t));
+  written.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Capture::write_gif_frame(uint64_t start, uint64_t end) {
+  // Delays are in hundredths of a second, rounded on the absolute times so they don't drift
+  const auto centiseconds = [this](uint64_t frame) {
+    return (frame * 100 + config.frames_per_second / 2) / config.frames_per_second;
+  };
+  const auto delay = std::min<uint64_t>(centiseconds(end) - centiseconds(start), 0xFFFF);
+
+  // Graphic control extension, with no transparent color, then the image descriptor covering the
+  // whole screen
+  std::array<uint8_t, 8 + 10> blocks{0x21, 0xF9, 0x04, 0x00, 0, 0, 0x00, 0x00, 0x2C};
+  const auto store16 = [&blocks](std::size_t offset, uint64_t value) {
+    blocks[offset] = static_cast<uint8_t>(value & 0xFF);
+    blocks[offset + 1] = static_cast<uint8_t>(value >> 8);
+  };
+  store16(4, delay);
+  store16(13, width());
+  store16(15, height());
+  encoded.resize(blocks.size());
+  std::memcpy(encoded.data(), blocks.data(), blocks.size());
+
+  GifLzw(encoded).encode(scaled.data(), scaled.size());
+  out.write(reinterpret_cast<const char*>(encoded.data()), encoded.size());
+  written.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Capture::scale(const std::array<uint8_t, 64 * 32>& pixels) {
+  scaled.resize(static_cast<std::size_t>(width()) * height());
+  auto row = scaled.begin();
+  for (std::size_t y = 0; y < 32; y++) {
+    const auto first_row = row;
+    for (std::size_t x = 0; x < 64; x++) {
+      row = std::fill_n(row, config.scale, pixels[y * 64 + x] != 0);
+    }
+    for (unsigned copy = 1; copy < config.scale; copy++) {
+      row = std::copy(first_row, first_row + width(), row);
+    }
+  }
+}
+
+unsigned Capture::width() const { return 64 * config.scale; }
+
+unsigned Capture::height() const { return 32 * config.scale; }
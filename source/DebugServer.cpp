@@ -0,0 +1,584 @@
+#include "DebugServer.h"
+
+#ifndef _WIN32
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <system_error>
+
+namespace {
+
+constexpr uint8_t signal_interrupt = 2;
+constexpr uint8_t signal_illegal_instruction = 4;
+constexpr uint8_t signal_trap = 5;
+
+constexpr auto poll_interval_ms = 10;
+
+std::system_error socket_error(const char* what) {
+  return std::system_error(errno, std::generic_category(), what);
+}
+
+#ifdef MSG_NOSIGNAL
+constexpr int send_flags = MSG_NOSIGNAL;
+#else
+constexpr int send_flags = 0;
+#endif
+
+void append_hex(std::string& out, uint8_t byte) {
+  constexpr char digits[] = "0123456789abcdef";
+  out += digits[byte >> 4];
+  out += digits[byte & 0xF];
+}
+
+void append_hex16(std::string& out, uint16_t value) {
+  append_hex(out, value & 0xFF);
+  append_hex(out, value >> 8);
+}
+
+// -1 if `c` isn't a hex digit
+int hex_digit(char c) {
+  if (c >= '0' && c <= '9') {
+    return c - '0';
+  }
+  if (c >= 'a' && c <= 'f') {
+    return c - 'a' + 10;
+  }
+  if (c >= 'A' && c <= 'F') {
+    return c - 'A' + 10;
+  }
+  return -1;
+}
+
+uint8_t checksum(const char* data, std::size_t size) {
+  uint8_t sum = 0;
+  for (std::size_t i = 0; i < size; i++) {
+    sum += static_cast<uint8_t>(data[i]);
+  }
+  return sum;
+}
+
+// Served as target.xml through qXfer:features:read, so debuggers know the registers of `g` and
+// `p` packets instead of assuming those of their host
+const std::string& target_description() {
+  static const std::string xml = [] {
+    std::string out
+        = "<?xml version=\"1.0\"?>\n"
+          "<!DOCTYPE target SYSTEM \"gdb-target.dtd\">\n"
+          "<target version=\"1.0\">\n"
+          "<feature name=\"org.chip8.core\">\n";
+    const auto add = [&](const std::string& name, int bits, const char* type) {
+      out += "<reg name=\"" + name + "\" bitsize=\"" + std::to_string(bits) + "\" type=\""
+             + type + "\"/>\n";
+    };
+    for (int number = 0; number < 16; number++) {
+      add(std::string("V") + "0123456789ABCDEF"[number], 8, "uint8");
+    }
+    add("I", 16, "uint16");
+    add("pc", 16, "code_ptr");
+    add("SP", 8, "uint8");
+    for (int level = 0; level < 16; level++) {
+      add("stack" + std::to_string(level), 16, "uint16");
+    }
+    return out + "</feature>\n</target>\n";
+  }();
+  return xml;
+}
+
+// Whether `path` is a socket, so only sockets are ever unlinked
+bool is_socket(const std::string& path, struct stat* status = nullptr) {
+  struct stat found;
+  if (lstat(path.c_str(), &found) != 0 || !S_ISSOCK(found.st_mode)) {
+    return false;
+  }
+  if (status != nullptr) {
+    *status = found;
+  }
+  return true;
+}
+
+}  // namespace
+
+DebugServer::DebugServer(const std::string& unix_socket_path) : unix_socket_path(unix_socket_path) {
+  sockaddr_un address{};
+  if (unix_socket_path.size() >= sizeof(address.sun_path)) {
+    throw std::system_error(std::make_error_code(std::errc::filename_too_long),
+                            "Debug server socket path");
+  }
+  address.sun_family = AF_UNIX;
+  std::memcpy(address.sun_path, unix_socket_path.c_str(), unix_socket_path.size() + 1);
+
+  listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (listen_fd < 0) {
+    throw socket_error("Debug server socket");
+  }
+  // A socket left by a server that didn't shut down is replaced, any other file makes bind fail
+  // with EADDRINUSE
+  if (is_socket(unix_socket_path)) {
+    unlink(unix_socket_path.c_str());
+  }
+  if (bind(listen_fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0
+      || listen(listen_fd, 1) < 0) {
+    auto error = socket_error("Debug server bind");
+    close(listen_fd);
+    throw error;
+  }
+  struct stat bound;
+  if (is_socket(unix_socket_path, &bound)) {
+    socket_device = bound.st_dev;
+    socket_inode = bound.st_ino;
+  }
+
+  start();
+}
+
+DebugServer::DebugServer(uint16_t tcp_port) {
+  sockaddr_in address{};
+  address.sin_family = AF_INET;
+  address.sin_port = htons(tcp_port);
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+  listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (listen_fd < 0) {
+    throw socket_error("Debug server socket");
+  }
+  const int reuse = 1;
+  setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+  socklen_t length = sizeof(address);
+  if (bind(listen_fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0
+      || listen(listen_fd, 1) < 0
+      || getsockname(listen_fd, reinterpret_cast<sockaddr*>(&address), &length) < 0) {
+    auto error = socket_error("Debug server bind");
+    close(listen_fd);
+    throw error;
+  }
+  this->tcp_port = ntohs(address.sin_port);
+
+  start();
+}
+
+DebugServer::~DebugServer() {
+  stopping = true;
+  thread.join();
+
+  close(listen_fd);
+  // Unless something else replaced it since
+  struct stat status;
+  if (!unix_socket_path.empty() && is_socket(unix_socket_path, &status)
+      && status.st_dev == socket_device && status.st_ino == socket_inode) {
+    unlink(unix_socket_path.c_str());
+  }
+}
+
+uint16_t DebugServer::port() const { return tcp_port; }
+
+bool DebugServer::halted() const { return is_halted; }
+
+void DebugServer::start() {
+  thread = std::thread([this]() { serve(); });
+}
+
+// Emulation thread //
+
+RunResult DebugServer::service(Emulator& emulator, uint64_t cycles) {
+  emulator.set_breakpoints(&breakpoints);
+
+  Command command;
+  while (pop(command)) {
+    apply(command, emulator);
+  }
+
+  RunResult result;
+  if (!is_halted) {
+    result = emulator.run(cycles);
+    if (result.reason == StopReason::Fault) {
+      stop(signal_illegal_instruction);
+    } else if (result.reason != StopReason::Completed) {
+      stop(signal_trap);
+    }
+  }
+
+  publish(emulator);
+  return result;
+}
+
+void DebugServer::apply(const Command& command, Emulator& emulator) {
+  switch (command.type) {
+    case CommandType::Attach:
+      stop(signal_trap);
+      break;
+    case CommandType::Interrupt:
+      stop(signal_interrupt);
+      break;
+    case CommandType::Step:
+      stop(emulator.run(1).reason == StopReason::Fault ? signal_illegal_instruction : signal_trap);
+      break;
+    case CommandType::Continue:
+      is_halted = false;
+      break;
+    case CommandType::Detach:
+      breakpoints.clear();
+      is_halted = false;
+      break;
+    case CommandType::AddBreakpoint:
+      breakpoints.add_breakpoint(command.address);
+      break;
+    case CommandType::RemoveBreakpoint:
+      breakpoints.remove_breakpoint(command.address);
+      break;
+    case CommandType::AddReadWatchpoint:
+      breakpoints.add_read_watchpoint(command.address);
+      break;
+    case CommandType::RemoveReadWatchpoint:
+      breakpoints.remove_read_watchpoint(command.address);
+      break;
+    case CommandType::AddWriteWatchpoint:
+      breakpoints.add_write_watchpoint(command.address);
+      break;
+    case CommandType::RemoveWriteWatchpoint:
+      breakpoints.remove_write_watchpoint(command.address);
+      break;
+  }
+}
+
+void DebugServer::stop(uint8_t signal) {
+  is_halted = true;
+  stop_signal = signal;
+  stop_count++;
+}
+
+void DebugServer::publish(const Emulator& emulator) {
+  auto& snapshot = snapshots[write_snapshot];
+  snapshot.state = emulator.state();
+  snapshot.halted = is_halted;
+  snapshot.signal = stop_signal;
+  snapshot.stop_count = stop_count;
+
+  write_snapshot = middle_snapshot.exchange(write_snapshot | snapshot_fresh) & 0x3;
+}
+
+bool DebugServer::pop(Command& command) {
+  const auto head = commands_head.load(std::memory_order_relaxed);
+  if (head == commands_tail.load(std::memory_order_acquire)) {
+    return false;
+  }
+  command = commands[head % commands.size()];
+  commands_head.store(head + 1, std::memory_order_release);
+  return true;
+}
+
+// Debugger thread //
+
+void DebugServer::push(CommandType type, uint16_t address) {
+  const auto tail = commands_tail.load(std::memory_order_relaxed);
+  while (tail - commands_head.load(std::memory_order_acquire) == commands.size()) {
+    if (stopping) {
+      return;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  commands[tail % commands.size()] = {type, address};
+  commands_tail.store(tail + 1, std::memory_order_release);
+}
+
+const DebugServer::Snapshot& DebugServer::latest() {
+  if (middle_snapshot.load(std::memory_order_acquire) & snapshot_fresh) {
+    read_snapshot = middle_snapshot.exchange(read_snapshot) & 0x3;
+  }
+  return snapshots[read_snapshot];
+}
+
+void DebugServer::serve() {
+  while (!stopping) {
+    pollfd listener{listen_fd, POLLIN, 0};
+    if (poll(&listener, 1, poll_interval_ms) <= 0) {
+      continue;
+    }
+
+    client_fd = accept(listen_fd, nullptr, nullptr);
+    if (client_fd < 0) {
+      continue;
+    }
+
+    serve_client();
+
+    // Let the emulator run again once the debugger is gone
+    push(CommandType::Detach);
+    close(client_fd);
+    client_fd = -1;
+  }
+}
+
+void DebugServer::serve_client() {
+  input.clear();
+
+  // Debuggers expect the target to be stopped once attached
+  const auto previous_stop_count = latest().stop_count;
+  push(CommandType::Attach);
+  wait_for_stop(previous_stop_count, false);
+
+  std::string packet;
+  while (!stopping && read_packet(packet)) {
+    if (packet == "\x03") {
+      push(CommandType::Interrupt);
+      continue;
+    }
+
+    // Kill has no reply, the connection is closed and the emulator resumes as after a detach
+    if (packet[0] == 'k') {
+      return;
+    }
+
+    const auto reply = handle_packet(packet);
+    send_packet(reply);
+
+    if (packet[0] == 'D') {
+      return;
+    }
+  }
+}
+
+// Reads the next `$data#checksum` packet or a lone 0x03 interrupt. Packets are acknowledged with
+// '+', or dropped and answered with '-' so the debugger sends them again when their checksum
+// doesn't match. Returns false once the debugger disconnected or the server is stopping.
+bool DebugServer::read_packet(std::string& packet) {
+  while (!stopping) {
+    // Drop acknowledgements and anything before the start of a packet
+    const auto start = input.find_first_of("$\x03");
+    if (start == std::string::npos) {
+      input.clear();
+    } else {
+      input.erase(0, start);
+      if (input[0] == '\x03') {
+        input.erase(0, 1);
+        packet = "\x03";
+        return true;
+      }
+      const auto end = input.find('#');
+      if (end != std::string::npos && input.size() >= end + 3) {
+        const auto high = hex_digit(input[end + 1]);
+        const auto low = hex_digit(input[end + 2]);
+        const bool valid = high >= 0 && low >= 0
+                           && checksum(input.data() + 1, end - 1) == (high << 4 | low);
+        if (valid) {
+          packet = input.substr(1, end - 1);
+        }
+        input.erase(0, end + 3);
+        if (send(client_fd, valid ? "+" : "-", 1, send_flags) != 1) {
+          return false;
+        }
+        if (valid) {
+          return true;
+        }
+        continue;
+      }
+    }
+
+    pollfd client{client_fd, POLLIN, 0};
+    if (poll(&client, 1, poll_interval_ms) <= 0) {
+      continue;
+    }
+    char buffer[1024];
+    const auto received = read(client_fd, buffer, sizeof(buffer));
+    if (received <= 0) {
+      return false;
+    }
+    input.append(buffer, received);
+  }
+  return false;
+}
+
+void DebugServer::send_packet(const std::string& data) {
+  std::string packet = "$" + data + "#";
+  append_hex(packet, checksum(data.data(), data.size()));
+
+  for (std::size_t sent = 0; sent < packet.size();) {
+    const auto written = send(client_fd, packet.data() + sent, packet.size() - sent, send_flags);
+    if (written <= 0) {
+      return;
+    }
+    sent += written;
+  }
+}
+
+std::string DebugServer::handle_packet(const std::string& packet) {
+  const auto& snapshot = latest();
+  const auto arguments = packet.c_str() + 1;
+
+  switch (packet[0]) {
+    case '?': {
+      std::string reply = "S";
+      append_hex(reply, snapshot.signal);
+      return reply;
+    }
+
+    case 'g':
+      return read_registers(snapshot.state);
+
+    case 'p': {
+      unsigned number;
+      if (std::sscanf(arguments, "%x", &number) != 1 || number > 34) {
+        return "E01";
+      }
+      return read_register(snapshot.state, number);
+    }
+
+    case 'm': {
+      unsigned address;
+      unsigned length;
+      if (std::sscanf(arguments, "%x,%x", &address, &length) != 2 || length > 0x800) {
+        return "E01";
+      }
+      std::string reply;
+      for (unsigned i = 0; i < length; i++) {
+        append_hex(reply, snapshot.state.memory[(address + i) & 0xFFF]);
+      }
+      return reply;
+    }
+
+    case 's': {
+      const auto previous_stop_count = snapshot.stop_count;
+      push(CommandType::Step);
+      return wait_for_stop(previous_stop_count, false);
+    }
+
+    case 'c': {
+      const auto previous_stop_count = snapshot.stop_count;
+      push(CommandType::Continue);
+      return wait_for_stop(previous_stop_count, true);
+    }
+
+    case 'Z':
+    case 'z': {
+      unsigned type;
+      unsigned address;
+      unsigned kind;
+      if (std::sscanf(arguments, "%u,%x,%x", &type, &address, &kind) != 3 || type > 4) {
+        return "E01";
+      }
+      const bool add = packet[0] == 'Z';
+      const auto address16 = static_cast<uint16_t>(address);
+      if (type <= 1) {
+        push(add ? CommandType::AddBreakpoint : CommandType::RemoveBreakpoint, address16);
+      }
+      if (type == 2 || type == 4) {
+        push(add ? CommandType::AddWriteWatchpoint : CommandType::RemoveWriteWatchpoint, address16);
+      }
+      if (type == 3 || type == 4) {
+        push(add ? CommandType::AddReadWatchpoint : CommandType::RemoveReadWatchpoint, address16);
+      }
+      return "OK";
+    }
+
+    case 'D':
+      return "OK";
+
+    case 'H':
+      return "OK";
+
+    case 'q':
+      if (packet.rfind("qSupported", 0) == 0) {
+        return "PacketSize=1000;qXfer:features:read+";
+      }
+      if (packet.rfind("qXfer:features:read:", 0) == 0) {
+        return read_features(packet.substr(std::strlen("qXfer:features:read:")));
+      }
+      if (packet == "qAttached") {
+        return "1";
+      }
+      return "";
+
+    default:
+      // Empty reply for unsupported packets
+      return "";
+  }
+}
+
+// Waits until the emulation thread reports a new stop and returns its stop reply. While the
+// emulator runs, a 0x03 from the debugger interrupts it.
+std::string DebugServer::wait_for_stop(uint64_t previous_stop_count, bool interruptible) {
+  while (!stopping) {
+    const auto& snapshot = latest();
+    if (snapshot.stop_count > previous_stop_count) {
+      std::string reply = "S";
+      append_hex(reply, snapshot.signal);
+      return reply;
+    }
+
+    if (interruptible) {
+      pollfd client{client_fd, POLLIN, 0};
+      if (poll(&client, 1, 0) > 0) {
+        char buffer[256];
+        const auto received = read(client_fd, buffer, sizeof(buffer));
+        if (received <= 0) {
+          return "";
+        }
+        input.append(buffer, received);
+        const auto interrupt = input.find('\x03');
+        if (interrupt != std::string::npos) {
+          input.erase(interrupt, 1);
+          push(CommandType::Interrupt);
+        }
+      }
+    }
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  return "";
+}
+
+// `annex:offset,length` of qXfer:features:read, answered with 'm' and a part of the document or
+// 'l' and its last part
+std::string DebugServer::read_features(const std::string& arguments) const {
+  constexpr char annex[] = "target.xml:";
+  unsigned offset;
+  unsigned length;
+  if (arguments.rfind(annex, 0) != 0) {
+    return "E00";
+  }
+  if (std::sscanf(arguments.c_str() + std::strlen(annex), "%x,%x", &offset, &length) != 2) {
+    return "E01";
+  }
+  const auto& xml = target_description();
+  if (offset >= xml.size()) {
+    return "l";
+  }
+  const auto part = xml.substr(offset, length);
+  return (offset + part.size() < xml.size() ? "m" : "l") + part;
+}
+
+std::string DebugServer::read_registers(const MachineState& state) const {
+  std::string reply;
+  for (unsigned number = 0; number <= 34; number++) {
+    reply += read_register(state, number);
+  }
+  return reply;
+}
+
+std::string DebugServer::read_register(const MachineState& state, unsigned number) const {
+  std::string reply;
+  if (number < 16) {
+    append_hex(reply, state.V[number]);
+  } else if (number == 16) {
+    append_hex16(reply, state.I);
+  } else if (number == 17) {
+    append_hex16(reply, state.pc);
+  } else if (number == 18) {
+    append_hex(reply, static_cast<uint8_t>(state.stack.size()));
+  } else {
+    const auto level = number - 19;
+    append_hex16(reply, level < state.stack.size() ? state.stack[level] : 0);
+  }
+  return reply;
+}
+
+#endif  // _WIN32
@@ -0,0 +1,74 @@
+#include "DeltaCodec.h"
+
+namespace {
+
+void write_varint(std::size_t value, std::vector<uint8_t>& out) {
+  while (value >= 0x80) {
+    out.push_back(static_cast<uint8_t>(value | 0x80));
+    value >>= 7;
+  }
+  out.push_back(static_cast<uint8_t>(value));
+}
+
+bool read_varint(const uint8_t*& data, const uint8_t* end, std::size_t& value) {
+  value = 0;
+  for (unsigned shift = 0; data != end && shift < 64; shift += 7) {
+    const auto byte = *data++;
+    value |= static_cast<std::size_t>(byte & 0x7F) << shift;
+    if ((byte & 0x80) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+}  // namespace
+
+void delta_encode(const uint8_t* base, const uint8_t* current, std::size_t size,
+                  std::vector<uint8_t>& out) {
+  std::size_t i = 0;
+  while (i < size) {
+    const auto unchanged_start = i;
+    while (i < size && base[i] == current[i]) {
+      i++;
+    }
+    if (i == size) {
+      break;
+    }
+
+    // A changed run ends at the first pair of unchanged bytes, so a single equal byte in the middle
+    // of changes doesn't cost a new run
+    const auto changed_start = i;
+    while (i < size && (base[i] != current[i] || (i + 1 < size && base[i + 1] != current[i + 1]))) {
+      i++;
+    }
+
+    write_varint(changed_start - unchanged_start, out);
+    write_varint(i - changed_start, out);
+    for (auto j = changed_start; j < i; j++) {
+      out.push_back(base[j] ^ current[j]);
+    }
+  }
+}
+
+bool delta_apply(const uint8_t* delta, std::size_t delta_size, uint8_t* target, std::size_t size) {
+  const auto end = delta + delta_size;
+  std::size_t position = 0;
+
+  while (delta != end) {
+    std::size_t unchanged;
+    std::size_t changed;
+    if (!read_varint(delta, end, unchanged) || !read_varint(delta, end, changed)
+        || unchanged > size - position || changed > size - position - unchanged
+        || changed > static_cast<std::size_t>(end - delta)) {
+      return false;
+    }
+
+    position += unchanged;
+    for (std::size_t i = 0; i < changed; i++) {
+      target[position++] ^= *delta++;
+    }
+  }
+
+  return true;
+}
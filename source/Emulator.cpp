@@ -1,400 +1,297 @@
 #include "Emulator.h"
 
 #include <algorithm>
-#include <cassert>
+#include <utility>
 
-#include "Font.h"
+#include "Hash.h"
+#include "Profiler.h"
+#include "Recompiler.h"
 
-Emulator::Emulator() : rng_engine(std::random_device()()), rng_distribution(0, 255) { reset(); }
+void Emulator::load_rom(std::istream& rom) {
+  // Only keep the bytes that were actually read, and never more than what fits after 0x200
+  std::array<uint8_t, 4096 - 0x200> buffer;
+  rom.read(reinterpret_cast<char*>(buffer.data()), buffer.size());
+  load_rom(buffer.data(), static_cast<std::size_t>(rom.gcount()));
+}
 
-void Emulator::reset() {
-  pc = 0x200;  // Program counter starts at 0x200
+RunResult Emulator::run(uint64_t cycles) {
+  if (has_breakpoints()) {
+    return run_loop<true>(cycles);
+  }
+  // Recompiled code doesn't report instructions to the profiler
+#ifdef CHIP8_PROFILER
+  const bool native = native_program != nullptr && profiler == nullptr;
+#else
+  const bool native = native_program != nullptr;
+#endif
+  if (native && native_program->rom_hash == loaded_rom_hash) {
+    Fault fault;
+    const auto done = native_program->run(*this, cycles, fault);
+    if (fault) {
+      return {StopReason::Fault, fault.pc, done, fault};
+    }
+    return {StopReason::Completed, 0, done, {}};
+  }
+  return run_loop<false>(cycles);
+}
 
-  // Reset registers to 0
-  V.fill(0);
-  I = 0;
+void Emulator::set_breakpoints(const Breakpoints* breakpoints) { this->breakpoints = breakpoints; }
 
-  // Empty the stack
-  while (!stack.empty()) {
-    stack.pop();
-  }
+bool Emulator::has_breakpoints() const { return breakpoints != nullptr && breakpoints->any(); }
 
-  // Clear memory
-  memory.fill(0);
+void Emulator::set_translation(const Translation* translation) { this->translation = translation; }
 
-  // Clear graphics
-  graphic.fill(0);
+void Emulator::set_native_program(const NativeProgram* program) { native_program = program; }
 
-  // Load font into memory (starting from address 0)
-  std::copy(chip8_font.begin(), chip8_font.end(), memory.begin());
+void Emulator::set_profiler(Profiler* profiler) {
+#ifdef CHIP8_PROFILER
+  this->profiler = profiler;
+#else
+  (void)profiler;
+#endif
+}
 
-  // Reset timers
-  sound_timer = 0;
-  delay_timer = 0;
+void Emulator::set_draw_listener(DrawListener listener, void* context) {
+  draw_listener = listener;
+  draw_listener_context = context;
 }
 
-void Emulator::load_rom(std::istream& rom) {
-  for (auto i = 0x200; !rom.eof(); i++) {
-    char buffer;
-    rom.read(&buffer, 1);
-    memory[i] = buffer;
+template <bool debug> RunResult Emulator::run_loop(uint64_t cycles) {
+  for (uint64_t cycle = 0; cycle < cycles; cycle++) {
+    if constexpr (debug) {
+      if (cycle > 0 && !waiting_for_key) {
+        const uint16_t opcode = memory[pc & address_mask] << 8 | memory[(pc + 1) & address_mask];
+        if (auto hit = check_breakpoints(opcode); hit.reason != StopReason::Completed) {
+          hit.cycles = cycle;
+          return hit;
+        }
+      }
+    } else if (translation != nullptr) {
+      Fault fault;
+#ifdef CHIP8_PROFILER
+      // The profiler is told about every instruction, so nothing is fused
+      const auto fused = profiler == nullptr ? run_fused(cycles - cycle, fault) : 0;
+#else
+      const auto fused = run_fused(cycles - cycle, fault);
+#endif
+      if (fault) {
+        return {StopReason::Fault, fault.pc, cycle + fused, fault};
+      }
+      if (fused > 0) {
+        cycle += fused - 1;
+        continue;
+      }
+    }
+
+    if (auto result = emulate_cycle()) {
+      return {StopReason::Fault, result.pc, cycle, result};
+    }
   }
+
+  return {StopReason::Completed, 0, cycles, {}};
+}
+
+namespace {
+
+// Whether the program counter can end up anywhere but on the next instruction after `operation`
+constexpr bool branches(Operation operation) {
+  switch (operation) {
+    case Operation::I00EE:
+    case Operation::I1NNN:
+    case Operation::I2NNN:
+    case Operation::I3XNN:
+    case Operation::I4XNN:
+    case Operation::I5XY0:
+    case Operation::I9XY0:
+    case Operation::IBNNN:
+    case Operation::IEX9E:
+    case Operation::IEXA1:
+      return true;
+    default:
+      return false;
+  }
+}
+
+// Calls `step` with each index of `steps`, as an std::integral_constant, while it returns true
+template <typename Step, std::size_t... steps>
+constexpr void run_steps(const Step& step, std::index_sequence<steps...>) {
+  (step(std::integral_constant<std::size_t, steps>()) && ...);
 }
 
-void Emulator::emulate_cycle() {
-  if (!waiting_for_key) {
-    // Fetch opcode
-    uint16_t opcode = memory[pc] << 8 | memory[pc + 1];
+}  // namespace
 
-    execute_opcode(opcode);
+template <FusionKind kind>
+uint64_t Emulator::run_superinstruction(const Instruction* instructions, Fault& fault) {
+  const auto start = pc;
+  uint64_t done = 0;
+  run_steps(
+      [&](auto index) {
+        constexpr auto operation = fused_sequence(kind).operations[index];
+        if constexpr (operation == Operation::I00EE || operation == Operation::I2NNN) {
+          if ((fault = execute<operation>(instructions[2 * index]))) {
+            return false;
+          }
+        } else {
+          execute<operation>(instructions[2 * index]);
+        }
+        end_cycle();
+        done++;
+        // Until a skip or a jump leaves the sequence
+        return !branches(operation) || pc == start + 2 * done;
+      },
+      std::make_index_sequence<fused_sequence(kind).length>());
+  return done;
+}
+
+uint64_t Emulator::run_fused(uint64_t cycles, Fault& fault) {
+  const auto index = translation->fused[pc & address_mask];
+  if (index == 0 || pc > address_mask || waiting_for_key) {
+    return 0;
   }
-  // Tick timers
-  if (delay_timer > 0) {
-    delay_timer--;
+  const auto& fused = translation->superinstructions[index - 1];
+  const auto* instructions = &translation->instructions[pc];
+  if (cycles < fused.length) {
+    return 0;
   }
-  if (sound_timer > 0) {
-    sound_timer--;
-
-    if (sound_timer == 0) {
-      sound_flag = true;
+  for (std::size_t i = 0; i < fused.length; i++) {
+    const auto address = pc + 2 * i;
+    if ((memory[address] << 8 | memory[address + 1]) != instructions[2 * i].opcode) {
+      return 0;
     }
   }
-}
 
-void Emulator::execute_opcode(uint16_t opcode) {
-  switch (opcode & 0xF000) {
-    case 0x0000: {
-      switch (opcode & 0x000F) {
-        case 0x0000:
-          instruction_00E0();
-          break;
-        case 0x000E:
-          instruction_00EE();
+  uint64_t done = 0;
+  switch (fused.kind) {
+    case FusionKind::TimerPoll: {
+      // FX07 3X00 1NNN back to the FX07, as long as the delay timer isn't 0
+      const auto start = pc;
+      const auto reg = instructions[0].x;
+      while (cycles - done >= 3) {
+        instruction_FX07(reg);
+        end_cycle();
+        instruction_3XNN(reg, 0);
+        end_cycle();
+        done += 2;
+        if (pc != start + 4) {
           break;
+        }
+        instruction_1NNN(start);
+        end_cycle();
+        done++;
       }
       break;
     }
 
-    case 0x1000:
-      instruction_1NNN(opcode & 0x0FFF);
+    case FusionKind::DrawAt:
+      done = run_superinstruction<FusionKind::DrawAt>(instructions, fault);
       break;
-
-    case 0x2000:
-      instruction_2NNN(opcode & 0x0FFF);
+    case FusionKind::CountLoop:
+      done = run_superinstruction<FusionKind::CountLoop>(instructions, fault);
       break;
-
-    case 0x3000:
-      instruction_3XNN((opcode & 0x0F00) >> 8, opcode & 0x00FF);
+    case FusionKind::SkipJump:
+      done = run_superinstruction<FusionKind::SkipJump>(instructions, fault);
       break;
-
-    case 0x4000:
-      instruction_4XNN((opcode & 0x0F00) >> 8, opcode & 0x00FF);
+    case FusionKind::KeyReleased:
+      done = run_superinstruction<FusionKind::KeyReleased>(instructions, fault);
       break;
-
-    case 0x5000:
-      instruction_5XY0((opcode & 0x0F00) >> 8, (opcode & 0x00F0) >> 4);
+    case FusionKind::KeyJump:
+      done = run_superinstruction<FusionKind::KeyJump>(instructions, fault);
       break;
-
-    case 0x6000:
-      instruction_6XNN((opcode & 0x0F00) >> 8, opcode & 0x00FF);
+    case FusionKind::AddSkip:
+      done = run_superinstruction<FusionKind::AddSkip>(instructions, fault);
       break;
-
-    case 0x7000:
-      instruction_7XNN((opcode & 0x0F00) >> 8, opcode & 0x00FF);
+    case FusionKind::DrawSprite:
+      done = run_superinstruction<FusionKind::DrawSprite>(instructions, fault);
       break;
-
-    case 0x8000: {
-      const uint8_t x = (opcode & 0x0F00) >> 8;
-      const uint8_t y = (opcode & 0x00F0) >> 4;
-
-      switch (opcode & 0x000F) {
-        case 0x0000:
-          instruction_8XY0(x, y);
-          break;
-        case 0x0001:
-          instruction_8XY1(x, y);
-          break;
-        case 0x0002:
-          instruction_8XY2(x, y);
-          break;
-        case 0x0003:
-          instruction_8XY3(x, y);
-          break;
-        case 0x0004:
-          instruction_8XY4(x, y);
-          break;
-        case 0x0005:
-          instruction_8XY5(x, y);
-          break;
-        case 0x0006:
-          instruction_8XY6(x);
-          break;
-        case 0x0007:
-          instruction_8XY7(x, y);
-          break;
-        case 0x000E:
-          instruction_8XYE(x);
-          break;
-      }
+    case FusionKind::ReadTimer:
+      done = run_superinstruction<FusionKind::ReadTimer>(instructions, fault);
       break;
-    }
-
-    case 0x9000:
-      instruction_9XY0((opcode & 0x0F00) >> 8, (opcode & 0x00F0) >> 4);
+    case FusionKind::LoadMask:
+      done = run_superinstruction<FusionKind::LoadMask>(instructions, fault);
       break;
-
-    case 0xA000:
-      instruction_ANNN((opcode & 0x0FFF));
+    case FusionKind::DrawMove:
+      done = run_superinstruction<FusionKind::DrawMove>(instructions, fault);
       break;
-
-    case 0xB000:
-      instruction_BNNN((opcode & 0x0FFF));
+    case FusionKind::KeyPoll:
+      done = run_superinstruction<FusionKind::KeyPoll>(instructions, fault);
       break;
-
-    case 0xC000:
-      instruction_CXNN((opcode & 0x0F00) >> 8, opcode & 0x00FF);
+    case FusionKind::TableLoad:
+      done = run_superinstruction<FusionKind::TableLoad>(instructions, fault);
       break;
-
-    case 0xD000:
-      instruction_DXYN((opcode & 0x0F00) >> 8, (opcode & 0x00F0) >> 4, opcode & 0x000F);
+    case FusionKind::TableIndex:
+      done = run_superinstruction<FusionKind::TableIndex>(instructions, fault);
       break;
-
-    case 0xE000: {
-      switch (opcode & 0x000F) {
-        case 0x000E:
-          instruction_EX9E((opcode & 0x0F00) >> 8);
-          break;
-        case 0x0001:
-          instruction_EXA1((opcode & 0x0F00) >> 8);
-          break;
-      }
+    case FusionKind::DrawReturn:
+      done = run_superinstruction<FusionKind::DrawReturn>(instructions, fault);
       break;
-    }
-
-    case 0xF000: {
-      const uint8_t reg = (opcode & 0x0F00) >> 8;
-
-      switch (opcode & 0x00FF) {
-        case 0x0007:
-          instruction_FX07(reg);
-          break;
-
-        case 0x000A:
-          instruction_FX0A(reg);
-          break;
-
-        case 0x0015:
-          instruction_FX15(reg);
-          break;
-
-        case 0x0018:
-          instruction_FX18(reg);
-          break;
-
-        case 0x001E:
-          instruction_FX1E(reg);
-          break;
-
-        case 0x0029:
-          instruction_FX29(reg);
-          break;
-
-        case 0x0033:
-          instruction_FX33(reg);
-          break;
-
-        case 0x0055:
-          instruction_FX55(reg);
-          break;
-
-        case 0x0065:
-          instruction_FX65(reg);
-          break;
-      }
+    case FusionKind::SaveAt:
+      done = run_superinstruction<FusionKind::SaveAt>(instructions, fault);
+      break;
+    case FusionKind::LoadAt:
+      done = run_superinstruction<FusionKind::LoadAt>(instructions, fault);
+      break;
+    case FusionKind::AddSkipUnless:
+      done = run_superinstruction<FusionKind::AddSkipUnless>(instructions, fault);
+      break;
+    case FusionKind::DrawSkip:
+      done = run_superinstruction<FusionKind::DrawSkip>(instructions, fault);
       break;
-    }
-
-    default:
-      throw std::runtime_error("Invalid opcode");
-  }
-}
-
-void Emulator::press_key(uint8_t key) {
-  assert(key <= 0xF);
-
-  keys[key] = true;
-  if (waiting_for_key) {
-    V[waiting_for_key_register] = key;
-    waiting_for_key = false;
   }
-}
-void Emulator::release_key(uint8_t key) {
-  assert(key <= 0xF);
-
-  keys[key] = false;
-}
-
-bool Emulator::should_draw() {
-  auto result = draw_flag;
-
-  draw_flag = false;
-
-  return result;
-}
-bool Emulator::should_buzz() {
-  auto result = sound_flag;
-
-  sound_flag = false;
 
-  return result;
+  fusion_stats.superinstructions++;
+  fusion_stats.instructions += done;
+  return done;
 }
 
-const std::array<uint8_t, 64 * 32>& Emulator::get_graphic() const { return graphic; }
+RunResult Emulator::check_breakpoints(uint16_t opcode) const {
+  if (breakpoints->has_breakpoint(pc)) {
+    return {StopReason::Breakpoint, static_cast<uint16_t>(pc & address_mask), 0, {}};
+  }
 
-void Emulator::instruction_00E0() {
-  graphic.fill(0);
-  draw_flag = true;
-  pc += 2;
-}
-void Emulator::instruction_00EE() {
-  pc = stack.top();
-  stack.pop();
-}
-void Emulator::instruction_1NNN(uint16_t jump_address) { pc = jump_address; }
-void Emulator::instruction_2NNN(uint16_t subroutine_address) {
-  stack.push(pc + 2);
-  pc = subroutine_address;
-}
-void Emulator::instruction_3XNN(uint8_t reg, uint8_t number) { pc += V[reg] == number ? 4 : 2; }
-void Emulator::instruction_4XNN(uint8_t reg, uint8_t number) { pc += V[reg] != number ? 4 : 2; }
-void Emulator::instruction_5XY0(uint8_t reg1, uint8_t reg2) { pc += V[reg1] == V[reg2] ? 4 : 2; }
-void Emulator::instruction_6XNN(uint8_t reg, uint8_t value) {
-  V[reg] = value;
-  pc += 2;
-}
-void Emulator::instruction_7XNN(uint8_t reg, uint8_t value) {
-  V[reg] += value;
-  pc += 2;
-}
-void Emulator::instruction_8XY0(uint8_t reg1, uint8_t reg2) {
-  V[reg1] = V[reg2];
-  pc += 2;
-}
-void Emulator::instruction_8XY1(uint8_t reg1, uint8_t reg2) {
-  V[reg1] |= V[reg2];
-  pc += 2;
-}
-void Emulator::instruction_8XY2(uint8_t reg1, uint8_t reg2) {
-  V[reg1] &= V[reg2];
-  pc += 2;
-}
-void Emulator::instruction_8XY3(uint8_t reg1, uint8_t reg2) {
-  V[reg1] ^= V[reg2];
-  pc += 2;
-}
-void Emulator::instruction_8XY4(uint8_t reg1, uint8_t reg2) {
-  // Carry if overflow
-  V[0xF] = V[reg2] > std::numeric_limits<uint8_t>::max() - V[reg1] ? 1 : 0;
-  V[reg1] += V[reg2];
-  pc += 2;
-}
-void Emulator::instruction_8XY5(uint8_t reg1, uint8_t reg2) {
-  // Borrow
-  V[0xF] = V[reg1] > V[reg2] ? 1 : 0;
-  V[reg1] -= V[reg2];
-  pc += 2;
-}
-void Emulator::instruction_8XY6(uint8_t reg) {
-  V[0xF] = V[reg] & 0x1;
-  V[reg] >>= 1;
-  pc += 2;
-}
-void Emulator::instruction_8XY7(uint8_t reg1, uint8_t reg2) {
-  // Borrow
-  V[0xF] = V[reg2] > V[reg1] ? 1 : 0;
-  V[reg1] = V[reg2] - V[reg1];
-  pc += 2;
-}
-void Emulator::instruction_8XYE(uint8_t reg) {
-  V[0xF] = V[reg] >> 7;
-  V[reg] <<= 1;
-  pc += 2;
-}
-void Emulator::instruction_9XY0(uint8_t reg1, uint8_t reg2) { pc += V[reg1] != V[reg2] ? 4 : 2; }
-void Emulator::instruction_ANNN(uint16_t value) {
-  I = value;
-  pc += 2;
-}
-void Emulator::instruction_BNNN(uint16_t jump_address) { pc = V[0] + jump_address; }
-void Emulator::instruction_CXNN(uint8_t reg, uint8_t value) {
-  V[reg] = rng_distribution(rng_engine) & value;
-  pc += 2;
-}
-void Emulator::instruction_DXYN(uint8_t reg1, uint8_t reg2, uint8_t height) {
-  const auto x = V[reg1];
-  const auto y = V[reg2];
-  V[0xF] = 0;
+  // Memory range touched by the instruction
+  const uint8_t x = (opcode & 0x0F00) >> 8;
+  uint16_t address = Breakpoints::no_address;
+  bool write = false;
+  if ((opcode & 0xF000) == 0xD000) {
+    address = breakpoints->find_read_watchpoint(I, opcode & 0x000F);
+  } else if ((opcode & 0xF0FF) == 0xF033) {
+    address = breakpoints->find_write_watchpoint(I, 3);
+    write = true;
+  } else if ((opcode & 0xF0FF) == 0xF055) {
+    address = breakpoints->find_write_watchpoint(I, x + 1);
+    write = true;
+  } else if ((opcode & 0xF0FF) == 0xF065) {
+    address = breakpoints->find_read_watchpoint(I, x + 1);
+  }
 
-  for (int yline = 0; yline < height; yline++) {
-    const auto pixel = memory[I + yline];
-    for (int xline = 0; xline < 8; xline++) {
-      // Check if xlineTH bit of pixel is set to 1
-      if ((pixel & (0b10000000 >> xline)) != 0) {
-        const auto position = ((x + xline) % 64) + (((y + yline) % 32) * 64);
-        // Set the flag to 1 in case of collision
-        if (graphic[position] == 1) {
-          V[0xF] = 1;
-        }
-        graphic[position] ^= 1;
-      }
-    }
+  if (address == Breakpoints::no_address) {
+    return {};
   }
-  draw_flag = true;
-  pc += 2;
-}
-void Emulator::instruction_EX9E(uint8_t key) { pc += keys[key] ? 4 : 2; }
-void Emulator::instruction_EXA1(uint8_t key) { pc += keys[key] ? 2 : 4; }
-void Emulator::instruction_FX07(uint8_t reg) {
-  V[reg] = delay_timer;
-  pc += 2;
-}
-void Emulator::instruction_FX0A(uint8_t reg) {
-  waiting_for_key = true;
-  waiting_for_key_register = reg;
-  pc += 2;
-}
-void Emulator::instruction_FX15(uint8_t reg) {
-  delay_timer = V[reg];
-  pc += 2;
-}
-void Emulator::instruction_FX18(uint8_t reg) {
-  sound_timer = V[reg];
-  pc += 2;
-}
-void Emulator::instruction_FX1E(uint8_t reg) {
-  I += V[reg];
-  V[0xF] = I > 0xFFF ? 1 : 0;
-  pc += 2;
-}
-void Emulator::instruction_FX29(uint8_t reg) {
-  I = V[reg] * 5;  // Font is loader in memory at address 0 and each character is 5 ints
-  pc += 2;
-}
-void Emulator::instruction_FX33(uint8_t reg) {
-  memory[I] = V[reg] / 100;
-  memory[I + 1] = (V[reg] / 10) % 10;
-  memory[I + 2] = (V[reg] % 100) % 10;
-  pc += 2;
-}
-void Emulator::instruction_FX55(uint8_t reg) {
-  for (auto i = 0; i <= reg; i++) {
-    memory[I + i] = V[i];
+  return {write ? StopReason::WriteWatchpoint : StopReason::ReadWatchpoint, address, 0, {}};
+}
+
+const char* to_string(FaultKind kind) {
+  switch (kind) {
+    case FaultKind::None:
+      return "none";
+    case FaultKind::InvalidOpcode:
+      return "invalid opcode";
+    case FaultKind::StackOverflow:
+      return "stack overflow";
+    case FaultKind::StackUnderflow:
+      return "stack underflow";
   }
-  pc += 2;
+  return "unknown";
 }
-void Emulator::instruction_FX65(uint8_t reg) {
-  for (auto i = 0; i <= reg; i++) {
-    V[i] = memory[I + i];
+
+const FusionStatistics& Emulator::fusion_statistics() const { return fusion_stats; }
+
+bool Emulator::pop_input_latency(InputLatencySample& sample) {
+  if (input_samples_count == 0) {
+    return false;
   }
-  pc += 2;
+  sample = input_samples[input_samples_head];
+  input_samples_head = (input_samples_head + 1) % input_samples.size();
+  input_samples_count--;
+  return true;
 }
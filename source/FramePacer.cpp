@@ -0,0 +1,147 @@
+#include "FramePacer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+namespace {
+
+double milliseconds(FramePacer::clock::duration duration) {
+  return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+}  // namespace
+
+FramePacer::FramePacer() : FramePacer(Config{}) {}
+
+FramePacer::FramePacer(const Config& config)
+    : config(config),
+      frame_period(std::chrono::duration_cast<clock::duration>(
+          std::chrono::duration<double>(1 / std::max(config.frames_per_second, 1.0)))),
+      records(std::max<std::size_t>(config.statistics_window, 1)) {
+  start();
+}
+
+void FramePacer::start() { start(clock::now()); }
+
+void FramePacer::start(clock::time_point now) {
+  origin = config.vsync ? now - frame_period / 2 : now;
+  scheduled_frames = 0;
+  has_previous_frame = false;
+  next_record = 0;
+  record_count = 0;
+}
+
+unsigned FramePacer::frames_due() { return frames_due(clock::now()); }
+
+unsigned FramePacer::frames_due(clock::time_point now) {
+  // A frame lasts from one call to the next
+  if (has_previous_frame) {
+    current.frame = now - frame_start;
+    records[next_record] = current;
+    next_record = (next_record + 1) % records.size();
+    record_count = std::min(record_count + 1, records.size());
+  }
+  has_previous_frame = true;
+  frame_start = now;
+  emulate_end = now;
+  current = {};
+
+  const auto started_frames = static_cast<uint64_t>((now - origin) / frame_period) + 1;
+  uint64_t due = started_frames > scheduled_frames ? started_frames - scheduled_frames : 0;
+  if (due > 1) {
+    const uint64_t limit
+        = config.policy == Policy::CatchUp ? std::max(config.max_catch_up_frames, 1u) : 1;
+    if (due > limit) {
+      // Give up on the frames that can't be caught up, keeping the phase of the schedule
+      skipped_frames += due - limit;
+      origin += frame_period * static_cast<clock::rep>(due - limit);
+      due = limit;
+    }
+    late_frames += due - 1;
+  }
+
+  scheduled_frames += due;
+  current.frames_emulated = static_cast<unsigned>(due);
+  return current.frames_emulated;
+}
+
+void FramePacer::emulated() { emulated(clock::now()); }
+
+void FramePacer::emulated(clock::time_point now) {
+  current.emulate = now - frame_start;
+  emulate_end = now;
+}
+
+void FramePacer::presented() { presented(clock::now()); }
+
+void FramePacer::presented(clock::time_point now) { current.present = now - emulate_end; }
+
+void FramePacer::wait() {
+  if (config.vsync) {
+    return;
+  }
+
+  const auto deadline = next_deadline();
+  auto now = clock::now();
+  while (deadline - now > config.spin_threshold) {
+    std::this_thread::sleep_for(deadline - now - config.spin_threshold);
+    now = clock::now();
+  }
+  while (now < deadline) {
+    std::this_thread::yield();
+    now = clock::now();
+  }
+  current.overshoot = now - deadline;
+}
+
+FramePacer::clock::duration FramePacer::period() const { return frame_period; }
+
+FramePacer::Statistics FramePacer::statistics() const {
+  Statistics statistics;
+  statistics.frames = record_count;
+  statistics.late_frames = late_frames;
+  statistics.skipped_frames = skipped_frames;
+  if (record_count == 0) {
+    return statistics;
+  }
+
+  double total_frame = 0;
+  for (std::size_t i = 0; i < record_count; i++) {
+    const auto& record = records[i];
+    const auto frame = milliseconds(record.frame);
+    total_frame += frame;
+    statistics.max_frame_ms = std::max(statistics.max_frame_ms, frame);
+    statistics.average_emulate_ms += milliseconds(record.emulate);
+    statistics.average_present_ms += milliseconds(record.present);
+    statistics.average_overshoot_ms += milliseconds(record.overshoot);
+  }
+  const auto count = static_cast<double>(record_count);
+  statistics.average_frame_ms = total_frame / count;
+  statistics.average_emulate_ms /= count;
+  statistics.average_present_ms /= count;
+  statistics.average_overshoot_ms /= count;
+
+  double variance = 0;
+  for (std::size_t i = 0; i < record_count; i++) {
+    const auto deviation = milliseconds(records[i].frame) - statistics.average_frame_ms;
+    variance += deviation * deviation;
+  }
+  statistics.jitter_ms = std::sqrt(variance / count);
+  return statistics;
+}
+
+void FramePacer::dump(std::ostream& out) const {
+  out << "frame_ms,emulate_ms,present_ms,overshoot_ms,frames_emulated\n";
+  const auto first = record_count < records.size() ? 0 : next_record;
+  for (std::size_t i = 0; i < record_count; i++) {
+    const auto& record = records[(first + i) % records.size()];
+    out << milliseconds(record.frame) << ',' << milliseconds(record.emulate) << ','
+        << milliseconds(record.present) << ',' << milliseconds(record.overshoot) << ','
+        << record.frames_emulated << '\n';
+  }
+}
+
+FramePacer::clock::time_point FramePacer::next_deadline() const {
+  return origin + frame_period * static_cast<clock::rep>(scheduled_frames);
+}
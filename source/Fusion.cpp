@@ -0,0 +1,242 @@
+#include "Fusion.h"
+
+#include <algorithm>
+#include <functional>
+#include <iterator>
+
+#include "Emulator.h"
+#include "Translation.h"
+
+namespace {
+
+// Generated by the corpus test of test/source/Fusion.cpp
+constexpr FusionKind corpus_kinds[] = {
+#include "CorpusFusion.inc"
+};
+
+bool writes_memory(Operation operation) {
+  return operation == Operation::IFX33 || operation == Operation::IFX55;
+}
+
+// Whether a sequence of these operations can be fused at all
+bool fusable(const Superinstruction& superinstruction) {
+  if (superinstruction.length < 2 || superinstruction.length > max_fused_length) {
+    return false;
+  }
+  for (uint8_t i = 0; i < superinstruction.length; i++) {
+    const auto operation = superinstruction.operations[i];
+    if (operation == Operation::Invalid || operation == Operation::IFX0A
+        || (writes_memory(operation) && i + 1 < superinstruction.length)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Whether the handler of its kind runs these operations
+bool handled(const Superinstruction& superinstruction) {
+  if (static_cast<std::size_t>(superinstruction.kind) >= fusion_kinds) {
+    return false;
+  }
+  const auto& sequence = fused_sequence(superinstruction.kind);
+  return superinstruction.length == sequence.length
+         && std::equal(sequence.operations.begin(), sequence.operations.begin() + sequence.length,
+                       superinstruction.operations.begin());
+}
+
+// Whether `superinstruction` starts at `address`, with the operands its kind requires
+bool matches(const Superinstruction& superinstruction, const Translation& translation,
+             uint16_t address) {
+  if (static_cast<std::size_t>(address + 2 * superinstruction.length)
+      > translation.instructions.size()) {
+    return false;
+  }
+  const auto* instructions = &translation.instructions[address];
+  for (uint8_t i = 0; i < superinstruction.length; i++) {
+    if (instructions[2 * i].operation != superinstruction.operations[i]) {
+      return false;
+    }
+  }
+  switch (superinstruction.kind) {
+    case FusionKind::TimerPoll:
+      return instructions[0].x == instructions[2].x && instructions[2].nn == 0
+             && instructions[4].nnn == address;
+    default:
+      return true;
+  }
+}
+
+uint32_t pack(const Superinstruction& superinstruction) {
+  uint32_t key = 0;
+  for (uint8_t i = 0; i < superinstruction.length; i++) {
+    key |= static_cast<uint32_t>(superinstruction.operations[i]) << (8 * i);
+  }
+  return key;
+}
+
+Superinstruction unpack(uint32_t key) {
+  Superinstruction superinstruction;
+  for (; key != 0; key >>= 8) {
+    superinstruction.operations[superinstruction.length++] = static_cast<Operation>(key & 0xFF);
+  }
+  return superinstruction;
+}
+
+// The kind running the sequence packed in `key`, fusion_kinds if there is none
+std::size_t kind_of(uint32_t key) {
+  for (std::size_t kind = 0; kind < fusion_kinds; kind++) {
+    if (pack(make_superinstruction(static_cast<FusionKind>(kind))) == key) {
+      return kind;
+    }
+  }
+  return fusion_kinds;
+}
+
+// Named after the opcode it comes from, as the Operation enumerators
+const char* name(Operation operation) {
+  static constexpr const char* names[] = {
+      "????", "00E0", "00EE", "1NNN", "2NNN", "3XNN", "4XNN", "5XY0", "6XNN", "7XNN",
+      "8XY0", "8XY1", "8XY2", "8XY3", "8XY4", "8XY5", "8XY6", "8XY7", "8XYE", "9XY0",
+      "ANNN", "BNNN", "CXNN", "DXYN", "EX9E", "EXA1", "FX07", "FX0A", "FX15", "FX18",
+      "FX1E", "FX29", "FX33", "FX55", "FX65",
+  };
+  static_assert(std::size(names) == static_cast<std::size_t>(Operation::IFX65) + 1);
+  return names[static_cast<std::size_t>(operation)];
+}
+
+}  // namespace
+
+const char* to_string(FusionKind kind) {
+  static constexpr const char* names[] = {
+      "DrawAt",     "TimerPoll",  "CountLoop", "SkipJump", "KeyReleased",   "KeyJump",  "AddSkip",
+      "DrawSprite", "ReadTimer",  "LoadMask",  "DrawMove", "KeyPoll",       "TableLoad",
+      "TableIndex", "DrawReturn", "SaveAt",    "LoadAt",   "AddSkipUnless", "DrawSkip",
+  };
+  static_assert(std::size(names) == fusion_kinds);
+  return names[static_cast<std::size_t>(kind)];
+}
+
+Superinstruction make_superinstruction(FusionKind kind) {
+  const auto& sequence = fused_sequence(kind);
+  Superinstruction superinstruction;
+  superinstruction.kind = kind;
+  superinstruction.length = sequence.length;
+  superinstruction.operations = sequence.operations;
+  return superinstruction;
+}
+
+const std::vector<Superinstruction>& builtin_superinstructions() {
+  static const std::vector<Superinstruction> superinstructions = {
+      make_superinstruction(FusionKind::DrawAt), make_superinstruction(FusionKind::TimerPoll),
+      make_superinstruction(FusionKind::SaveAt), make_superinstruction(FusionKind::LoadAt),
+      make_superinstruction(FusionKind::AddSkip),
+  };
+  return superinstructions;
+}
+
+const std::vector<Superinstruction>& corpus_superinstructions() {
+  static const std::vector<Superinstruction> superinstructions = [] {
+    std::vector<Superinstruction> out;
+    for (const auto kind : corpus_kinds) {
+      out.push_back(make_superinstruction(kind));
+    }
+    return out;
+  }();
+  return superinstructions;
+}
+
+std::size_t fuse(Translation& translation,
+                 const std::vector<Superinstruction>& superinstructions) {
+  std::size_t added = 0;
+  for (const auto& superinstruction : superinstructions) {
+    if (translation.superinstruction_count == max_superinstructions) {
+      break;
+    }
+    if (!fusable(superinstruction) || !handled(superinstruction)) {
+      continue;
+    }
+    const auto index = translation.superinstruction_count;
+    const auto duplicate = std::any_of(
+        translation.superinstructions.begin(), translation.superinstructions.begin() + index,
+        [&](const Superinstruction& fused) { return fused.kind == superinstruction.kind; });
+    if (duplicate) {
+      continue;
+    }
+
+    for (uint16_t address = 0; address < translation.instructions.size(); address++) {
+      if ((translation.flags[address] & Translation::Code) != 0 && translation.fused[address] == 0
+          && matches(superinstruction, translation, address)) {
+        translation.fused[address] = static_cast<uint8_t>(index + 1);
+      }
+    }
+    // Kept even when nothing matched, so fusing the same list twice adds nothing
+    translation.superinstructions[index] = superinstruction;
+    translation.superinstruction_count++;
+    added++;
+  }
+  return added;
+}
+
+void FusionProfile::record(uint16_t address, const Instruction& instruction) {
+  std::rotate(window.begin(), window.begin() + 1, window.end());
+  window.back() = {static_cast<uint16_t>(address & 0xFFF), instruction.operation};
+  recorded = instruction.operation == Operation::Invalid ? 0 : recorded + 1;
+
+  // Every sequence of consecutive addresses ending with this instruction
+  Superinstruction sequence;
+  for (std::size_t length = 1; length <= std::min(recorded, max_fused_length); length++) {
+    const auto& executed = window[window.size() - length];
+    if (length > 1 && executed.address + 2 != window[window.size() - length + 1].address) {
+      break;
+    }
+    std::rotate(sequence.operations.rbegin(), sequence.operations.rbegin() + 1,
+                sequence.operations.rend());
+    sequence.operations[0] = executed.operation;
+    sequence.length++;
+    if (length > 1) {
+      counts[pack(sequence)]++;
+    }
+  }
+}
+
+Fault FusionProfile::step(Emulator& emulator) {
+  const auto& state = emulator.state();
+  if (!state.waiting_for_key) {
+    const auto address = state.pc & 0xFFF;
+    record(address, decode(state.memory[address] << 8 | state.memory[(address + 1) & 0xFFF]));
+  }
+  return emulator.emulate_cycle();
+}
+
+std::vector<Superinstruction> FusionProfile::superinstructions(std::size_t count) const {
+  // Fusing a sequence of n instructions saves n - 1 dispatches each time it runs
+  std::vector<std::pair<uint64_t, std::size_t>> ranked;
+  for (const auto& [key, executed] : counts) {
+    const auto kind = kind_of(key);
+    if (kind < fusion_kinds) {
+      ranked.emplace_back(executed * (fused_sequences[kind].length - 1), kind);
+    }
+  }
+  std::sort(ranked.begin(), ranked.end(), std::greater<>());
+
+  std::vector<Superinstruction> out;
+  for (std::size_t i = 0; i < ranked.size() && i < count; i++) {
+    out.push_back(make_superinstruction(static_cast<FusionKind>(ranked[i].second)));
+  }
+  return out;
+}
+
+void FusionProfile::write(std::ostream& out) const {
+  std::vector<std::pair<uint64_t, uint32_t>> sorted;
+  for (const auto& [key, executed] : counts) {
+    sorted.emplace_back(executed, key);
+  }
+  std::sort(sorted.begin(), sorted.end(), std::greater<>());
+  for (const auto& [executed, key] : sorted) {
+    const auto sequence = unpack(key);
+    for (uint8_t i = 0; i < sequence.length; i++) {
+      out << name(sequence.operations[i]) << ' ';
+    }
+    out << executed << '\n';
+  }
+}
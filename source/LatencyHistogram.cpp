@@ -0,0 +1,62 @@
+#include "LatencyHistogram.h"
+
+#include <algorithm>
+#include <cmath>
+
+void LatencyHistogram::record(uint64_t microseconds) {
+  buckets[bucket(microseconds)]++;
+  samples++;
+  largest = std::max(largest, microseconds);
+  sum += microseconds;
+}
+
+void LatencyHistogram::clear() { *this = LatencyHistogram{}; }
+
+uint64_t LatencyHistogram::count() const { return samples; }
+
+uint64_t LatencyHistogram::max() const { return largest; }
+
+double LatencyHistogram::mean() const {
+  return samples == 0 ? 0 : static_cast<double>(sum) / static_cast<double>(samples);
+}
+
+uint64_t LatencyHistogram::percentile(double percentile) const {
+  if (samples == 0) {
+    return 0;
+  }
+
+  const auto rank = std::max<uint64_t>(
+      1, static_cast<uint64_t>(std::ceil(std::clamp(percentile, 0.0, 100.0) / 100 * samples)));
+  uint64_t seen = 0;
+  for (std::size_t index = 0; index < buckets.size(); index++) {
+    seen += buckets[index];
+    if (seen >= rank) {
+      return std::min(bucket_upper_bound(index), largest);
+    }
+  }
+  return largest;
+}
+
+std::size_t LatencyHistogram::bucket(uint64_t value) {
+  if (value < sub_buckets) {
+    return static_cast<std::size_t>(value);
+  }
+
+  // Position of the highest set bit, 4 or more here
+  unsigned magnitude = 63;
+  while ((value >> magnitude) == 0) {
+    magnitude--;
+  }
+  const auto shift = magnitude - 4;
+  return (shift + 1) * sub_buckets + static_cast<std::size_t>((value >> shift) - sub_buckets);
+}
+
+uint64_t LatencyHistogram::bucket_upper_bound(std::size_t bucket) {
+  if (bucket < sub_buckets) {
+    return bucket;
+  }
+
+  const auto shift = static_cast<unsigned>(bucket / sub_buckets - 1);
+  const auto top = static_cast<uint64_t>(bucket % sub_buckets + sub_buckets);
+  return ((top + 1) << shift) - 1;
+}
@@ -0,0 +1,135 @@
+#include "Netplay.h"
+
+#include <algorithm>
+
+#include "SessionProtocol.h"
+
+using session_protocol::load16;
+using session_protocol::load32;
+
+namespace {
+
+void append16(std::vector<uint8_t>& out, uint16_t value) {
+  out.push_back(value & 0xFF);
+  out.push_back(value >> 8);
+}
+
+void append32(std::vector<uint8_t>& out, uint32_t value) {
+  for (int shift = 0; shift < 32; shift += 8) {
+    out.push_back((value >> shift) & 0xFF);
+  }
+}
+
+}  // namespace
+
+Netplay::Netplay(Emulator& emulator, const Config& config)
+    : emulator(emulator), config(config), remote_player(config.player == 0 ? 1 : 0) {
+  this->config.max_rollback = std::clamp<std::size_t>(config.max_rollback, 1, input_history / 2);
+  snapshots.resize(this->config.max_rollback + 1);
+}
+
+bool Netplay::advance(uint16_t local_keys) {
+  synchronize();
+  // The remote peer can be ahead, by up to max_rollback frames itself
+  const auto ahead = current_frame > remote_received ? current_frame - remote_received : 0;
+  if (ahead >= config.max_rollback || current_frame - local_acked >= input_history) {
+    stats.stalls++;
+    return false;
+  }
+
+  local_inputs[current_frame % input_history] = local_keys & config.player_keys[config.player];
+  run_frame();
+  return true;
+}
+
+void Netplay::synchronize() {
+  if (!rollback_pending) {
+    return;
+  }
+  rollback_pending = false;
+
+  const auto frames = current_frame - rollback_frame;
+  stats.rollbacks++;
+  stats.resimulated_frames += frames;
+  stats.max_rollback = std::max<uint64_t>(stats.max_rollback, frames);
+
+  emulator.restore(snapshots[rollback_frame % snapshots.size()]);
+  current_frame = rollback_frame;
+  for (uint32_t frame = 0; frame < frames; frame++) {
+    run_frame();
+  }
+}
+
+void Netplay::write_packet(std::vector<uint8_t>& out) const {
+  const auto count = current_frame - local_acked;
+  out.push_back(packet_version);
+  append32(out, local_acked);
+  out.push_back(static_cast<uint8_t>(count));
+  append32(out, remote_received);
+  for (auto frame = local_acked; frame != current_frame; frame++) {
+    append16(out, local_inputs[frame % input_history]);
+  }
+}
+
+bool Netplay::read_packet(const uint8_t* data, std::size_t size) {
+  if (size < 10 || data[0] != packet_version) {
+    return false;
+  }
+  const auto first = load32(data + 1);
+  const std::size_t count = data[5];
+  const auto acked = load32(data + 6);
+  if (size != 10 + 2 * count || count > input_history) {
+    return false;
+  }
+  stats.packets_received++;
+
+  // Acknowledgements only move forward, and never past what was sent
+  if (acked - local_acked <= current_frame - local_acked) {
+    local_acked = acked;
+  }
+
+  // Only inputs continuing the received prefix are taken, the others were seen already or come
+  // after a gap that a later packet fills
+  const auto end = first + static_cast<uint32_t>(count);
+  if (first > remote_received || end <= remote_received) {
+    stats.stale_packets++;
+    return true;
+  }
+  for (auto frame = remote_received; frame != end; frame++) {
+    const auto keys = load16(data + 10 + 2 * (frame - first)) & config.player_keys[remote_player];
+    remote_inputs[frame % input_history] = keys;
+    if (frame < current_frame && keys != predicted_inputs[frame % input_history]) {
+      if (!rollback_pending || frame < rollback_frame) {
+        rollback_frame = frame;
+      }
+      rollback_pending = true;
+    }
+  }
+  remote_received = end;
+  return true;
+}
+
+uint32_t Netplay::frame() const { return current_frame; }
+
+uint32_t Netplay::confirmed_frame() const { return std::min(current_frame, remote_received); }
+
+uint32_t Netplay::acknowledged_frame() const { return local_acked; }
+
+const Netplay::Statistics& Netplay::statistics() const { return stats; }
+
+uint16_t Netplay::remote_input(uint32_t frame) const {
+  if (frame < remote_received) {
+    return remote_inputs[frame % input_history];
+  }
+  // Predicted: the remote player keeps holding the keys of their last known input
+  return remote_received > 0 ? remote_inputs[(remote_received - 1) % input_history] : 0;
+}
+
+void Netplay::run_frame() {
+  const auto slot = current_frame % input_history;
+  snapshots[current_frame % snapshots.size()] = emulator.state();
+  predicted_inputs[slot] = remote_input(current_frame);
+  emulator.set_keys(local_inputs[slot] | predicted_inputs[slot]);
+  emulator.emulate_cycle();
+  current_frame++;
+}
@@ -0,0 +1,102 @@
+#include "NetplaySocket.h"
+
+#ifndef _WIN32
+
+#  include <arpa/inet.h>
+#  include <fcntl.h>
+#  include <netinet/in.h>
+#  include <sys/socket.h>
+#  include <unistd.h>
+
+#  include <algorithm>
+#  include <cerrno>
+#  include <system_error>
+
+NetplaySocket::NetplaySocket(const Config& config) : config(config), random(config.seed) {
+  fd = ::socket(AF_INET, SOCK_DGRAM, 0);
+  if (fd < 0) {
+    throw std::system_error(errno, std::generic_category(), "Can't create netplay socket");
+  }
+  ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+  ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+  sockaddr_in address{};
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_ANY);
+  address.sin_port = htons(config.local_port);
+  socklen_t length = sizeof(address);
+  if (::bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0
+      || ::getsockname(fd, reinterpret_cast<sockaddr*>(&address), &length) != 0) {
+    const auto error = errno;
+    ::close(fd);
+    throw std::system_error(error, std::generic_category(),
+                            "Can't bind netplay port " + std::to_string(config.local_port));
+  }
+  bound_port = ntohs(address.sin_port);
+}
+
+NetplaySocket::~NetplaySocket() { ::close(fd); }
+
+void NetplaySocket::send(const Netplay& netplay) {
+  packet.clear();
+  netplay.write_packet(packet);
+
+  // Uniform in [0, 1) from the top 53 bits
+  if (config.loss > 0 && static_cast<double>(random.next64() >> 11) * 0x1.0p-53 < config.loss) {
+    stats.dropped++;
+    return;
+  }
+  if (config.delay_ms == 0 && config.jitter_ms == 0) {
+    send_now(packet);
+    return;
+  }
+  const auto jitter = config.jitter_ms > 0 ? random.next64() % (config.jitter_ms + 1) : 0;
+  delayed.push_back({Clock::now() + std::chrono::milliseconds(config.delay_ms + jitter), packet});
+}
+
+void NetplaySocket::poll(Netplay& netplay) {
+  if (!delayed.empty()) {
+    const auto now = Clock::now();
+    const auto due
+        = std::stable_partition(delayed.begin(), delayed.end(),
+                                [now](const Delayed& entry) { return entry.due <= now; });
+    for (auto entry = delayed.begin(); entry != due; entry++) {
+      send_now(entry->packet);
+    }
+    delayed.erase(delayed.begin(), due);
+  }
+
+  uint8_t buffer[Netplay::max_packet_size + 1];
+  while (true) {
+    const auto size = ::recv(fd, buffer, sizeof(buffer), 0);
+    if (size < 0) {
+      // An ICMP error from a peer not started yet is no reason to stop reading
+      if (errno == ECONNREFUSED || errno == EINTR) {
+        continue;
+      }
+      break;
+    }
+    stats.received++;
+    if (!netplay.read_packet(buffer, static_cast<std::size_t>(size))) {
+      stats.malformed++;
+    }
+  }
+}
+
+uint16_t NetplaySocket::local_port() const { return bound_port; }
+
+void NetplaySocket::set_remote_port(uint16_t port) { config.remote_port = port; }
+
+const NetplaySocket::Statistics& NetplaySocket::statistics() const { return stats; }
+
+void NetplaySocket::send_now(const std::vector<uint8_t>& bytes) {
+  sockaddr_in address{};
+  address.sin_family = AF_INET;
+  address.sin_port = htons(config.remote_port);
+  ::inet_pton(AF_INET, config.remote_host.c_str(), &address.sin_addr);
+  ::sendto(fd, bytes.data(), bytes.size(), 0, reinterpret_cast<sockaddr*>(&address),
+           sizeof(address));
+  stats.sent++;
+}
+
+#endif  // _WIN32
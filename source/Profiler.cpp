@@ -0,0 +1,70 @@
+#include "Profiler.h"
+
+#include <cstdio>
+#include <numeric>
+#include <string>
+
+Profiler::Profiler() { clear(); }
+
+void Profiler::clear() {
+  address_counts.fill(0);
+  nodes.assign(1, Node{});
+  current = 0;
+}
+
+uint64_t Profiler::instructions() const {
+  return std::accumulate(address_counts.begin(), address_counts.end(), uint64_t{0});
+}
+
+const std::array<uint64_t, 4096>& Profiler::heat() const { return address_counts; }
+
+void Profiler::enter(uint16_t address) {
+  auto child = nodes[current].first_child;
+  while (child != 0 && nodes[child].address != address) {
+    child = nodes[child].next_sibling;
+  }
+
+  if (child == 0) {
+    Node node;
+    node.address = address;
+    node.parent = current;
+    node.next_sibling = nodes[current].first_child;
+    child = static_cast<uint32_t>(nodes.size());
+    nodes[current].first_child = child;
+    nodes.push_back(node);
+  }
+  current = child;
+}
+
+void Profiler::write_folded(std::ostream& out) const {
+  // Parents always come before their children, so names can be built in one pass
+  std::vector<std::string> names(nodes.size());
+  names[0] = "main";
+  for (std::size_t index = 1; index < nodes.size(); index++) {
+    char name[16];
+    std::snprintf(name, sizeof(name), ";sub_%03x", static_cast<unsigned>(nodes[index].address));
+    names[index] = names[nodes[index].parent] + name;
+  }
+
+  for (std::size_t index = 0; index < nodes.size(); index++) {
+    if (nodes[index].count > 0) {
+      out << names[index] << ' ' << nodes[index].count << '\n';
+    }
+  }
+}
+
+void Profiler::write_heat_map(std::ostream& out) const {
+  const auto total = instructions();
+  out << "address,count,percent\n";
+  for (std::size_t address = 0; address < address_counts.size(); address++) {
+    if (address_counts[address] == 0) {
+      continue;
+    }
+    char line[64];
+    const auto count = address_counts[address];
+    std::snprintf(line, sizeof(line), "0x%03x,%llu,%.3f\n", static_cast<unsigned>(address),
+                  static_cast<unsigned long long>(count),
+                  100.0 * static_cast<double>(count) / static_cast<double>(total));
+    out << line;
+  }
+}
@@ -0,0 +1,353 @@
+#include "Recompiler.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <iterator>
+#include <memory>
+#include <set>
+
+#include "Translation.h"
+
+namespace {
+
+std::vector<const NativeProgram*>& native_programs() {
+  static std::vector<const NativeProgram*> programs;
+  return programs;
+}
+
+// Name of the Emulator member running an operation, and the operands it takes
+struct OperationInfo {
+  const char* name;
+  enum Operands : uint8_t { None, NNN, XNN, XY, X, XYN } operands;
+};
+
+// By Operation, in the order of its enumerators
+constexpr OperationInfo operations[] = {
+    {nullptr, OperationInfo::None},
+    {"00E0", OperationInfo::None},
+    {"00EE", OperationInfo::None},
+    {"1NNN", OperationInfo::NNN},
+    {"2NNN", OperationInfo::NNN},
+    {"3XNN", OperationInfo::XNN},
+    {"4XNN", OperationInfo::XNN},
+    {"5XY0", OperationInfo::XY},
+    {"6XNN", OperationInfo::XNN},
+    {"7XNN", OperationInfo::XNN},
+    {"8XY0", OperationInfo::XY},
+    {"8XY1", OperationInfo::XY},
+    {"8XY2", OperationInfo::XY},
+    {"8XY3", OperationInfo::XY},
+    {"8XY4", OperationInfo::XY},
+    {"8XY5", OperationInfo::XY},
+    {"8XY6", OperationInfo::X},
+    {"8XY7", OperationInfo::XY},
+    {"8XYE", OperationInfo::X},
+    {"9XY0", OperationInfo::XY},
+    {"ANNN", OperationInfo::NNN},
+    {"BNNN", OperationInfo::NNN},
+    {"CXNN", OperationInfo::XNN},
+    {"DXYN", OperationInfo::XYN},
+    {"EX9E", OperationInfo::X},
+    {"EXA1", OperationInfo::X},
+    {"FX07", OperationInfo::X},
+    {"FX0A", OperationInfo::X},
+    {"FX15", OperationInfo::X},
+    {"FX18", OperationInfo::X},
+    {"FX1E", OperationInfo::X},
+    {"FX29", OperationInfo::X},
+    {"FX33", OperationInfo::X},
+    {"FX55", OperationInfo::X},
+    {"FX65", OperationInfo::X},
+};
+static_assert(std::size(operations) == static_cast<std::size_t>(Operation::IFX65) + 1);
+
+OperationInfo info(Operation operation) { return operations[static_cast<std::size_t>(operation)]; }
+
+bool is_skip(Operation operation) {
+  switch (operation) {
+    case Operation::I3XNN:
+    case Operation::I4XNN:
+    case Operation::I5XY0:
+    case Operation::I9XY0:
+    case Operation::IEX9E:
+    case Operation::IEXA1:
+      return true;
+    default:
+      return false;
+  }
+}
+
+// Instructions after which the block ends even though execution goes on to the next address: the
+// memory writes, so the next block checks its bytes again, and FX0A, since the next cycles wait
+bool ends_straight_block(Operation operation) {
+  return operation == Operation::IFX33 || operation == Operation::IFX55
+         || operation == Operation::IFX0A;
+}
+
+bool ends_block(Operation operation) {
+  return is_skip(operation) || ends_straight_block(operation) || operation == Operation::I1NNN
+         || operation == Operation::I2NNN || operation == Operation::I00EE
+         || operation == Operation::IBNNN;
+}
+
+std::string hex(unsigned value, int digits) {
+  char text[16];
+  std::snprintf(text, sizeof(text), "0x%0*X", digits, value);
+  return text;
+}
+
+std::string quoted(const std::string& text) {
+  std::string out = "\"";
+  for (const auto c : text) {
+    if (c == '"' || c == '\\') {
+      out += '\\';
+      out += c;
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      out += '?';
+    } else {
+      out += c;
+    }
+  }
+  return out + '"';
+}
+
+std::string call(const Instruction& instruction) {
+  const auto operation = info(instruction.operation);
+  std::string out = std::string("e.instruction_") + operation.name + "(";
+  switch (operation.operands) {
+    case OperationInfo::None:
+      break;
+    case OperationInfo::NNN:
+      out += hex(instruction.nnn, 3);
+      break;
+    case OperationInfo::XNN:
+      out += hex(instruction.x, 1) + ", " + hex(instruction.nn, 2);
+      break;
+    case OperationInfo::XY:
+      out += hex(instruction.x, 1) + ", " + hex(instruction.y, 1);
+      break;
+    case OperationInfo::X:
+      out += hex(instruction.x, 1);
+      break;
+    case OperationInfo::XYN:
+      out += hex(instruction.x, 1) + ", " + hex(instruction.y, 1) + ", "
+             + hex(instruction.n(), 1);
+      break;
+  }
+  return out + ");";
+}
+
+class Generator {
+public:
+  Generator(const RecompilerRom& rom, std::ostream& out, RecompilerStatistics& stats)
+      : rom(rom), out(out), stats(stats), translation(std::make_unique<Translation>()) {
+    size = std::min<std::size_t>(rom.data.size(), 4096 - 0x200);
+    translate(rom.data.data(), size, *translation);
+  }
+
+  uint64_t hash() const { return translation->rom_hash; }
+
+  void write() {
+    find_blocks();
+
+    out << "\n// " << quoted(rom.name) << ": " << blocks.size() << " blocks\n";
+    out << "template <> struct NativeCode<" << type_argument() << "> {\n";
+    out << "  static constexpr uint8_t rom[] = {";
+    for (std::size_t i = 0; i < size; i++) {
+      out << (i % 16 == 0 ? "\n      " : " ") << hex(rom.data[i], 2) << ",";
+    }
+    out << "\n  };\n\n";
+
+    out << "  static uint64_t run(Emulator& e, uint64_t cycles, Fault& fault) {\n";
+    out << "    uint64_t done = 0;\n";
+    out << "  dispatch:\n";
+    out << "    if (!e.waiting_for_key) {\n";
+    out << "      switch (e.pc) {\n";
+    for (const auto start : blocks) {
+      out << "        case " << hex(start, 3) << ": goto " << label(start) << ";\n";
+    }
+    out << "        default: break;\n";
+    out << "      }\n";
+    out << "    }\n";
+    out << "  interpret:\n";
+    out << "    if (done == cycles) {\n";
+    out << "      return done;\n";
+    out << "    }\n";
+    out << "    fault = e.emulate_cycle();\n";
+    out << "    if (fault) {\n";
+    out << "      return done;\n";
+    out << "    }\n";
+    out << "    done++;\n";
+    out << "    goto dispatch;\n";
+    for (const auto start : blocks) {
+      write_block(start);
+    }
+    out << "  }\n";
+    out << "};\n";
+  }
+
+  std::string type_argument() const { return hex64(hash()); }
+
+private:
+  const RecompilerRom& rom;
+  std::ostream& out;
+  RecompilerStatistics& stats;
+  std::unique_ptr<Translation> translation;
+  std::size_t size = 0;
+  std::set<uint16_t> blocks;
+
+  static std::string hex64(uint64_t value) {
+    char text[32];
+    std::snprintf(text, sizeof(text), "0x%016llXull", static_cast<unsigned long long>(value));
+    return text;
+  }
+
+  // Only instructions entirely in the rom are recompiled, the font and the memory after the rom
+  // are left to the interpreter
+  bool recompiled(uint16_t address) const {
+    return address >= 0x200 && address + 1u < 0x200 + size
+           && (translation->flags[address] & Translation::Code) != 0
+           && info(translation->instructions[address].operation).name != nullptr;
+  }
+
+  static std::string label(uint16_t address) { return "block_" + hex(address, 3).substr(2); }
+
+  void find_blocks() {
+    for (uint16_t address = 0x200; address < 0x200 + size; address++) {
+      if (!recompiled(address)) {
+        continue;
+      }
+      if (translation->flags[address] & Translation::BlockStart) {
+        blocks.insert(address);
+      }
+      if (ends_straight_block(translation->instructions[address].operation)
+          && recompiled(address + 2)) {
+        blocks.insert(address + 2);
+      }
+    }
+  }
+
+  // Label of the block at `address`, or the dispatcher when there isn't one
+  std::string target(unsigned address) const {
+    return address < 4096 && blocks.count(static_cast<uint16_t>(address)) != 0
+               ? label(static_cast<uint16_t>(address))
+               : std::string("dispatch");
+  }
+
+  void write_block(uint16_t start) {
+    std::vector<uint16_t> addresses;
+    auto address = start;
+    while (true) {
+      addresses.push_back(address);
+      const auto operation = translation->instructions[address].operation;
+      address += 2;
+      if (ends_block(operation) || !recompiled(address) || blocks.count(address) != 0) {
+        break;
+      }
+    }
+    stats.blocks++;
+    stats.instructions += addresses.size();
+
+    const auto count = addresses.size();
+    out << "  " << label(start) << ":\n";
+    out << "    if (cycles - done < " << count << " || std::memcmp(e.memory.data() + "
+        << hex(start, 3) << ", rom + " << hex(start - 0x200, 3) << ", " << 2 * count
+        << ") != 0) {\n";
+    out << "      goto interpret;\n";
+    out << "    }\n";
+
+    for (std::size_t i = 0; i < count; i++) {
+      const auto& instruction = translation->instructions[addresses[i]];
+      const auto operation = instruction.operation;
+      // The faults are reported by the interpreter, running the instruction again
+      if (operation == Operation::I2NNN || operation == Operation::I00EE) {
+        out << "    if (e.stack." << (operation == Operation::I2NNN ? "full" : "empty")
+            << "()) {\n";
+        if (i > 0) {
+          out << "      done += " << i << ";\n";
+        }
+        out << "      goto interpret;\n";
+        out << "    }\n";
+      }
+      out << "    " << call(instruction) << "  // " << hex(addresses[i], 3) << ": "
+          << hex(instruction.opcode, 4).substr(2) << "\n";
+      out << "    e.end_cycle();\n";
+    }
+    out << "    done += " << count << ";\n";
+
+    const auto last = addresses.back();
+    const auto& instruction = translation->instructions[last];
+    switch (instruction.operation) {
+      case Operation::I1NNN:
+      case Operation::I2NNN:
+        out << "    goto " << target(instruction.nnn) << ";\n";
+        break;
+      case Operation::I00EE:
+      case Operation::IBNNN:
+      case Operation::IFX0A:
+        out << "    goto dispatch;\n";
+        break;
+      default:
+        if (is_skip(instruction.operation)) {
+          out << "    if (e.pc == " << hex(last + 4, 3) << ") {\n";
+          out << "      goto " << target(last + 4) << ";\n";
+          out << "    }\n";
+        }
+        out << "    goto " << target(last + 2) << ";\n";
+        break;
+    }
+  }
+};
+
+}  // namespace
+
+bool register_native_programs(const NativeProgram* programs, std::size_t count) {
+  for (std::size_t i = 0; i < count; i++) {
+    native_programs().push_back(&programs[i]);
+  }
+  return true;
+}
+
+const NativeProgram* find_native_program(uint64_t rom_hash) {
+  for (const auto program : native_programs()) {
+    if (program->rom_hash == rom_hash) {
+      return program;
+    }
+  }
+  return nullptr;
+}
+
+RecompilerStatistics recompile(const std::vector<RecompilerRom>& roms, std::ostream& out) {
+  RecompilerStatistics stats;
+  out << "// Generated by chip8-recompile, do not edit\n\n";
+  out << "#include <cstring>\n\n";
+  out << "#include \"Emulator.h\"\n";
+  out << "#include \"Recompiler.h\"\n";
+
+  // (hash, name) of every program written
+  std::vector<std::pair<std::string, std::string>> programs;
+  std::set<uint64_t> hashes;
+  for (const auto& rom : roms) {
+    Generator generator(rom, out, stats);
+    if (!hashes.insert(generator.hash()).second) {
+      continue;
+    }
+    generator.write();
+    programs.emplace_back(generator.type_argument(), rom.name);
+    stats.programs++;
+  }
+
+  out << "\nnamespace {\n\n";
+  out << "const NativeProgram native_programs[] = {\n";
+  for (const auto& [hash, name] : programs) {
+    out << "    {" << hash << ", " << quoted(name) << ", &NativeCode<" << hash << ">::run},\n";
+  }
+  if (programs.empty()) {
+    out << "    {},\n";
+  }
+  out << "};\n\n";
+  out << "[[maybe_unused]] const bool registered\n";
+  out << "    = register_native_programs(native_programs, " << programs.size() << ");\n\n";
+  out << "}  // namespace\n";
+  return stats;
+}
@@ -0,0 +1,278 @@
+#include "Renderer.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64) || (defined(__i386__) && defined(__SSE2__))
+#  define CHIP8_RENDERER_X86 1
+#  include <immintrin.h>
+#  ifdef _MSC_VER
+#    include <intrin.h>
+#  endif
+#endif
+
+#if defined(CHIP8_RENDERER_X86) && (defined(__GNUC__) || defined(__clang__))
+#  define CHIP8_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#  define CHIP8_TARGET_AVX2
+#endif
+
+namespace {
+
+// Fills `scale` pixels per index, indices are 0 for the background and anything else for the
+// foreground.
+void expand_scalar(const uint8_t* indices, std::size_t count, unsigned scale, uint32_t background,
+                   uint32_t foreground, uint32_t* out) {
+  for (std::size_t i = 0; i < count; i++) {
+    out = std::fill_n(out, scale, indices[i] ? foreground : background);
+  }
+}
+
+#ifdef CHIP8_RENDERER_X86
+
+// Foreground where the 32-bit lane is non zero, background elsewhere
+inline __m128i select_sse2(__m128i lanes, __m128i background, __m128i foreground) {
+  const auto is_background = _mm_cmpeq_epi32(lanes, _mm_setzero_si128());
+  return _mm_or_si128(_mm_and_si128(is_background, background),
+                      _mm_andnot_si128(is_background, foreground));
+}
+
+void expand_sse2(const uint8_t* indices, std::size_t count, unsigned scale, uint32_t background,
+                 uint32_t foreground, uint32_t* out) {
+  const auto background_lanes = _mm_set1_epi32(static_cast<int>(background));
+  const auto foreground_lanes = _mm_set1_epi32(static_cast<int>(foreground));
+  std::size_t i = 0;
+
+  if (scale <= 2) {
+    // 4 indices at a time, widened to 32-bit lanes
+    for (; i + 4 <= count; i += 4) {
+      int packed;
+      std::memcpy(&packed, indices + i, 4);
+      auto lanes = _mm_unpacklo_epi8(_mm_cvtsi32_si128(packed), _mm_setzero_si128());
+      lanes = _mm_unpacklo_epi16(lanes, _mm_setzero_si128());
+      const auto pixels = select_sse2(lanes, background_lanes, foreground_lanes);
+      if (scale == 1) {
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out), pixels);
+        out += 4;
+      } else {
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_unpacklo_epi32(pixels, pixels));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 4), _mm_unpackhi_epi32(pixels, pixels));
+        out += 8;
+      }
+    }
+  } else {
+    for (; i < count; i++) {
+      const auto pixels = indices[i] ? foreground_lanes : background_lanes;
+      unsigned x = 0;
+      for (; x + 4 <= scale; x += 4) {
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + x), pixels);
+      }
+      std::fill(out + x, out + scale, indices[i] ? foreground : background);
+      out += scale;
+    }
+  }
+
+  expand_scalar(indices + i, count - i, scale, background, foreground, out);
+}
+
+CHIP8_TARGET_AVX2 void expand_avx2(const uint8_t* indices, std::size_t count, unsigned scale,
+                                   uint32_t background, uint32_t foreground, uint32_t* out) {
+  if (scale >= 2 && scale < 8) {
+    expand_sse2(indices, count, scale, background, foreground, out);
+    return;
+  }
+
+  const auto background_lanes = _mm256_set1_epi32(static_cast<int>(background));
+  const auto foreground_lanes = _mm256_set1_epi32(static_cast<int>(foreground));
+  std::size_t i = 0;
+
+  if (scale == 1) {
+    // 8 indices at a time, widened to 32-bit lanes
+    for (; i + 8 <= count; i += 8) {
+      const auto lanes
+          = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(indices + i)));
+      const auto is_background = _mm256_cmpeq_epi32(lanes, _mm256_setzero_si256());
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(out),
+                          _mm256_blendv_epi8(foreground_lanes, background_lanes, is_background));
+      out += 8;
+    }
+  } else {
+    for (; i < count; i++) {
+      const auto pixels = indices[i] ? foreground_lanes : background_lanes;
+      unsigned x = 0;
+      for (; x + 8 <= scale; x += 8) {
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + x), pixels);
+      }
+      std::fill(out + x, out + scale, indices[i] ? foreground : background);
+      out += scale;
+    }
+  }
+
+  expand_scalar(indices + i, count - i, scale, background, foreground, out);
+}
+
+#endif  // CHIP8_RENDERER_X86
+
+bool supported(Renderer::Kernel kernel) {
+  switch (kernel) {
+    case Renderer::Kernel::Scalar:
+      return true;
+    case Renderer::Kernel::SSE2:
+#ifdef CHIP8_RENDERER_X86
+      return true;
+#else
+      return false;
+#endif
+    case Renderer::Kernel::AVX2:
+      return Renderer::best_kernel() == Renderer::Kernel::AVX2;
+  }
+  return false;
+}
+
+uint32_t darken(uint32_t color, uint8_t brightness) {
+  uint32_t result = 0;
+  for (auto shift : {0, 8, 16}) {
+    result |= (((color >> shift) & 0xFF) * brightness / 255) << shift;
+  }
+  return result;
+}
+
+// Scale2x (EPX): every pixel becomes 2 * 2, taking the color of neighbours along diagonal edges
+void scale2x(const std::array<uint8_t, 64 * 32>& graphic, uint8_t* out) {
+  for (int y = 0; y < 32; y++) {
+    for (int x = 0; x < 64; x++) {
+      const auto p = graphic[y * 64 + x] != 0;
+      const auto a = graphic[std::max(y - 1, 0) * 64 + x] != 0;
+      const auto b = graphic[y * 64 + std::min(x + 1, 63)] != 0;
+      const auto c = graphic[y * 64 + std::max(x - 1, 0)] != 0;
+      const auto d = graphic[std::min(y + 1, 31) * 64 + x] != 0;
+
+      auto top = out + y * 2 * 128 + x * 2;
+      auto bottom = top + 128;
+      top[0] = c == a && c != d && a != b ? a : p;
+      top[1] = a == b && a != c && b != d ? b : p;
+      bottom[0] = d == c && d != b && c != a ? c : p;
+      bottom[1] = b == d && b != a && d != c ? d : p;
+    }
+  }
+}
+
+}  // namespace
+
+Renderer::Renderer() : Renderer(Config{}) {}
+
+Renderer::Renderer(const Config& config) : Renderer(config, best_kernel()) {}
+
+Renderer::Renderer(const Config& config, Kernel kernel)
+    : config(config), selected_kernel(supported(kernel) ? kernel : best_kernel()) {
+  this->config.scale = std::max(this->config.scale, 1u);
+  if (this->config.scale % 2 != 0) {
+    this->config.smoothing = Smoothing::None;  // Scale2x output can't be split in odd blocks
+  }
+  block_scale = this->config.smoothing == Smoothing::Scale2x ? this->config.scale / 2
+                                                              : this->config.scale;
+
+  palette = {rgba(config.background), rgba(config.foreground)};
+  scanline_palette = {rgba(darken(config.background, config.scanline_brightness)),
+                      rgba(darken(config.foreground, config.scanline_brightness))};
+  grid_pixel = rgba(config.grid_color);
+}
+
+unsigned Renderer::width() const { return 64 * config.scale; }
+
+unsigned Renderer::height() const { return 32 * config.scale; }
+
+Renderer::Smoothing Renderer::smoothing() const { return config.smoothing; }
+
+Renderer::Kernel Renderer::kernel() const { return selected_kernel; }
+
+void Renderer::render(const std::array<uint8_t, 64 * 32>& graphic, void* out,
+                      std::size_t pitch) const {
+  // Source rows, smoothed or not
+  std::array<uint8_t, 128 * 64> smoothed;
+  auto source = graphic.data();
+  std::size_t source_width = 64;
+  if (config.smoothing == Smoothing::Scale2x) {
+    scale2x(graphic, smoothed.data());
+    source = smoothed.data();
+    source_width = 128;
+  }
+
+  const auto scale = config.scale;
+  const auto effects = scale >= 2 && (config.scanlines || config.grid);
+  const uint32_t* copy_from = nullptr;  // Last plain row, copied while the source row is the same
+  std::size_t copy_source_row = 0;
+
+  for (std::size_t y = 0; y < height(); y++) {
+    auto row = reinterpret_cast<uint32_t*>(static_cast<uint8_t*>(out) + y * pitch);
+    const auto source_row = y / block_scale;
+    const auto last_row = effects && y % scale == scale - 1;
+
+    if (last_row && config.grid) {
+      std::fill_n(row, width(), grid_pixel);
+      continue;
+    }
+    if (copy_from != nullptr && copy_source_row == source_row && !last_row) {
+      std::memcpy(row, copy_from, width() * sizeof(uint32_t));
+      continue;
+    }
+
+    expand_row(source + source_row * source_width, source_width,
+               last_row ? scanline_palette.data() : palette.data(), row);
+    if (effects && config.grid) {
+      for (auto x = scale - 1; x < width(); x += scale) {
+        row[x] = grid_pixel;
+      }
+    }
+    if (!last_row) {
+      copy_from = row;
+      copy_source_row = source_row;
+    }
+  }
+}
+
+void Renderer::render(const std::array<uint8_t, 64 * 32>& graphic,
+                      std::vector<uint32_t>& out) const {
+  out.resize(static_cast<std::size_t>(width()) * height());
+  render(graphic, out.data(), width() * sizeof(uint32_t));
+}
+
+void Renderer::expand_row(const uint8_t* indices, std::size_t count, const uint32_t* colors,
+                          uint32_t* out) const {
+  switch (selected_kernel) {
+#ifdef CHIP8_RENDERER_X86
+    case Kernel::AVX2:
+      expand_avx2(indices, count, block_scale, colors[0], colors[1], out);
+      return;
+    case Kernel::SSE2:
+      expand_sse2(indices, count, block_scale, colors[0], colors[1], out);
+      return;
+#endif
+    default:
+      expand_scalar(indices, count, block_scale, colors[0], colors[1], out);
+      return;
+  }
+}
+
+Renderer::Kernel Renderer::best_kernel() {
+#if defined(CHIP8_RENDERER_X86) && (defined(__GNUC__) || defined(__clang__))
+  return __builtin_cpu_supports("avx2") ? Kernel::AVX2 : Kernel::SSE2;
+#elif defined(CHIP8_RENDERER_X86) && defined(_MSC_VER)
+  // AVX2 needs both the CPU feature and the OS saving the YMM registers
+  int registers[4];
+  __cpuid(registers, 1);
+  const auto os_saves_ymm = (registers[2] & (1 << 27)) != 0 && (_xgetbv(0) & 6) == 6;
+  __cpuidex(registers, 7, 0);
+  return os_saves_ymm && (registers[1] & (1 << 5)) != 0 ? Kernel::AVX2 : Kernel::SSE2;
+#else
+  return Kernel::Scalar;
+#endif
+}
+
+uint32_t Renderer::rgba(uint32_t color, uint8_t alpha) {
+  const uint8_t bytes[4] = {static_cast<uint8_t>(color >> 16), static_cast<uint8_t>(color >> 8),
+                            static_cast<uint8_t>(color), alpha};
+  uint32_t pixel;
+  std::memcpy(&pixel, bytes, sizeof(pixel));
+  return pixel;
+}
@@ -0,0 +1,124 @@
+#include "Rewind.h"
+
+#include <algorithm>
+
+#include "DeltaCodec.h"
+
+Rewind::Rewind() : Rewind(Config{}) {}
+
+Rewind::Rewind(const Config& config) : config(config) {
+  this->config.keyframe_interval = std::max<std::size_t>(this->config.keyframe_interval, 1);
+}
+
+void Rewind::record(const Emulator& emulator) {
+  const auto& state = emulator.state();
+
+  if (groups.empty() || groups.back().frames() == config.keyframe_interval) {
+    new_group().keyframe = state;
+    bytes += sizeof(MachineState);
+  } else {
+    auto& group = groups.back();
+    const auto previous_size = group.deltas.size();
+    delta_encode(reinterpret_cast<const uint8_t*>(&group.keyframe),
+                 reinterpret_cast<const uint8_t*>(&state), sizeof(MachineState), group.deltas);
+    group.delta_ends.push_back(group.deltas.size());
+    bytes += group.deltas.size() - previous_size + sizeof(std::size_t);
+  }
+  frames++;
+
+  // Always keep the group being recorded
+  while (bytes > config.memory_budget && groups.size() > 1) {
+    drop_oldest_group();
+  }
+}
+
+std::size_t Rewind::rewind(Emulator& emulator, std::size_t frames) {
+  if (this->frames == 0) {
+    return 0;
+  }
+  frames = std::min(frames, this->frames - 1);
+
+  // Frames to drop from the end of the recording, down to the restored one
+  auto remaining = frames;
+  while (remaining >= groups.back().frames()) {
+    remaining -= groups.back().frames();
+    bytes -= group_bytes(groups.back());
+    recycle(std::move(groups.back()));
+    groups.pop_back();
+  }
+
+  auto& group = groups.back();
+  const auto index = group.frames() - 1 - remaining;
+
+  MachineState state = group.keyframe;
+  if (index > 0) {
+    const auto begin = index == 1 ? 0 : group.delta_ends[index - 2];
+    const auto end = group.delta_ends[index - 1];
+    delta_apply(group.deltas.data() + begin, end - begin, reinterpret_cast<uint8_t*>(&state),
+                sizeof(MachineState));
+  }
+  emulator.restore(state);
+
+  // Forget the frames recorded after the restored one
+  bytes -= group_bytes(group);
+  group.delta_ends.resize(index);
+  group.deltas.resize(index == 0 ? 0 : group.delta_ends.back());
+  bytes += group_bytes(group);
+
+  this->frames -= frames;
+  return frames;
+}
+
+std::size_t Rewind::rewind_seconds(Emulator& emulator, double seconds) {
+  return rewind(emulator, static_cast<std::size_t>(seconds * config.frames_per_second));
+}
+
+void Rewind::clear() {
+  while (!groups.empty()) {
+    recycle(std::move(groups.back()));
+    groups.pop_back();
+  }
+  frames = 0;
+  bytes = 0;
+}
+
+std::size_t Rewind::recorded_frames() const { return frames; }
+
+std::size_t Rewind::memory_used() const { return bytes; }
+
+std::size_t Rewind::bytes_per_minute() const {
+  if (frames == 0) {
+    return 0;
+  }
+  return bytes * config.frames_per_second * 60 / frames;
+}
+
+Rewind::Group& Rewind::new_group() {
+  if (spare_groups.empty()) {
+    groups.emplace_back();
+  } else {
+    groups.push_back(std::move(spare_groups.back()));
+    spare_groups.pop_back();
+    groups.back().deltas.clear();
+    groups.back().delta_ends.clear();
+  }
+  return groups.back();
+}
+
+void Rewind::drop_oldest_group() {
+  frames -= groups.front().frames();
+  bytes -= group_bytes(groups.front());
+  recycle(std::move(groups.front()));
+  groups.pop_front();
+}
+
+void Rewind::recycle(Group&& group) {
+  if (spare_groups.size() < max_spare_groups) {
+    spare_groups.push_back(std::move(group));
+  }
+}
+
+std::size_t Rewind::group_bytes(const Group& group) const {
+  return sizeof(MachineState) + group.deltas.size()
+         + group.delta_ends.size() * sizeof(std::size_t);
+}
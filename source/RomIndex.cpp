@@ -0,0 +1,367 @@
+#include "RomIndex.h"
+
+#ifndef _WIN32
+
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <unistd.h>
+
+#  include <algorithm>
+#  include <atomic>
+#  include <cerrno>
+#  include <cstdio>
+#  include <cstring>
+#  include <filesystem>
+#  include <fstream>
+#  include <iterator>
+#  include <memory>
+#  include <system_error>
+#  include <thread>
+#  include <unordered_set>
+
+#  include "Translation.h"
+
+namespace {
+
+namespace fs = std::filesystem;
+
+bool superchip_opcode(uint16_t opcode) {
+  switch (opcode & 0xF000) {
+    case 0x0000:
+      return (opcode >= 0x00FB && opcode <= 0x00FF) || (opcode & 0xFFF0) == 0x00C0;
+    case 0xD000:
+      return (opcode & 0x000F) == 0;
+    case 0xF000:
+      return (opcode & 0x00FF) == 0x30 || (opcode & 0x00FF) == 0x75 || (opcode & 0x00FF) == 0x85;
+    default:
+      return false;
+  }
+}
+
+bool xochip_opcode(uint16_t opcode) {
+  switch (opcode & 0xF000) {
+    case 0x5000:
+      return (opcode & 0x000F) == 2 || (opcode & 0x000F) == 3;
+    case 0xF000:
+      return opcode == 0xF000 || opcode == 0xF002 || (opcode & 0x00FF) == 0x01
+             || (opcode & 0x00FF) == 0x3A;
+    default:
+      return false;
+  }
+}
+
+bool is_code(const Translation& translation, uint32_t address) {
+  return (translation.flags[address & 0xFFF] & Translation::Code) != 0;
+}
+
+// Follows the basic block starting at `start` with what it knows of I, for the quirks and
+// self-modification depending on it
+void scan_block(const Translation& translation, uint16_t start, RomInfo& info) {
+  int32_t index = -1;  // Value of I, -1 when unknown
+  bool stored = false;  // FX55 or FX65 ran since I was last set
+  auto address = start;
+  for (auto steps = 0; steps < 2048; steps++) {
+    const auto& instruction = translation.instructions[address];
+    const auto uses_index = [&]() {
+      if (stored) {
+        info.quirks |= IncrementsI;
+      }
+    };
+    switch (instruction.operation) {
+      case Operation::IANNN:
+        index = instruction.nnn;
+        stored = false;
+        break;
+      case Operation::IFX29:
+        index = -1;
+        stored = false;
+        break;
+      case Operation::IFX1E:
+        uses_index();
+        index = -1;
+        stored = false;
+        break;
+      case Operation::IDXYN:
+        uses_index();
+        stored = false;
+        break;
+      case Operation::IFX33:
+      case Operation::IFX55: {
+        uses_index();
+        const auto written = instruction.operation == Operation::IFX33 ? 3 : instruction.x + 1;
+        for (auto byte = index; index >= 0 && byte < index + written; byte++) {
+          // Either byte of an instruction, the one before wrapping around to 0xFFF
+          if (is_code(translation, byte) || is_code(translation, byte + 0xFFF)) {
+            info.self_modifying = true;
+          }
+        }
+        stored = instruction.operation == Operation::IFX55;
+        break;
+      }
+      case Operation::IFX65:
+        uses_index();
+        stored = true;
+        break;
+      case Operation::Invalid:
+      case Operation::I00EE:
+      case Operation::I1NNN:
+      case Operation::I2NNN:
+      case Operation::IBNNN:
+        return;
+      default:
+        break;
+    }
+    address = (address + 2) & 0xFFF;
+    if ((translation.flags[address] & Translation::BlockStart) != 0
+        || !is_code(translation, address)) {
+      return;
+    }
+  }
+}
+
+std::vector<uint8_t> read_file(const fs::path& path, bool& ok) {
+  std::ifstream file(path, std::ios::binary);
+  std::vector<uint8_t> data{std::istreambuf_iterator<char>(file),
+                            std::istreambuf_iterator<char>()};
+  ok = static_cast<bool>(file) || file.eof();
+  return data;
+}
+
+}  // namespace
+
+const char* platform_name(RomPlatform platform) {
+  switch (platform) {
+    case RomPlatform::Chip8:
+      return "CHIP-8";
+    case RomPlatform::Chip8Hires:
+      return "CHIP-8 hires";
+    case RomPlatform::SuperChip:
+      return "SuperChip";
+    case RomPlatform::XoChip:
+      return "XO-CHIP";
+  }
+  return "unknown";
+}
+
+bool rom_file_name(const std::string& name) {
+  const auto extension = fs::path(name).extension().string();
+  return extension == ".ch8" || extension == ".c8" || extension == ".sc8" || extension == ".xo8";
+}
+
+RomInfo analyze_rom(const uint8_t* rom, std::size_t size, Translation& scratch) {
+  translate(rom, size, scratch);
+
+  RomInfo info;
+  info.rom_hash = scratch.rom_hash;
+  info.size = static_cast<uint32_t>(size);
+  info.code_size = scratch.code_size;
+
+  bool superchip = false;
+  bool xochip = false;
+  bool hires = scratch.instructions[0x200].opcode == 0x1260;
+  bool jumps = false;
+  for (uint16_t address = 0; address < scratch.instructions.size(); address++) {
+    if (!is_code(scratch, address)) {
+      continue;
+    }
+    const auto& instruction = scratch.instructions[address];
+    superchip |= superchip_opcode(instruction.opcode);
+    xochip |= xochip_opcode(instruction.opcode);
+    hires |= instruction.opcode == 0x0230;
+    jumps |= instruction.operation == Operation::IBNNN;
+    if ((instruction.operation == Operation::I8XY6 || instruction.operation == Operation::I8XYE)
+        && instruction.x != instruction.y) {
+      info.quirks |= ShiftsVY;
+    }
+    if ((scratch.flags[address] & Translation::BlockStart) != 0) {
+      scan_block(scratch, address, info);
+    }
+  }
+
+  // XO-CHIP extends SuperChip, so it wins
+  info.platform = xochip      ? RomPlatform::XoChip
+                  : superchip ? RomPlatform::SuperChip
+                  : hires     ? RomPlatform::Chip8Hires
+                              : RomPlatform::Chip8;
+  if (jumps && info.platform == RomPlatform::SuperChip) {
+    info.quirks |= JumpsWithVX;
+  }
+  return info;
+}
+
+std::vector<IndexedRom> scan_rom_directory(const std::string& directory, unsigned threads,
+                                           RomIndexStatistics* statistics) {
+  // Listing is cheap next to reading and scanning, which the threads share
+  std::vector<fs::path> files;
+  for (const auto& entry : fs::recursive_directory_iterator(directory)) {
+    if (entry.is_regular_file() && rom_file_name(entry.path().filename().string())) {
+      files.push_back(entry.path());
+    }
+  }
+  std::sort(files.begin(), files.end());
+
+  std::vector<IndexedRom> roms(files.size());
+  std::vector<uint8_t> read(files.size());
+  std::atomic<std::size_t> next{0};
+  const auto work = [&]() {
+    auto scratch = std::make_unique<Translation>();
+    for (auto index = next++; index < files.size(); index = next++) {
+      bool ok;
+      const auto data = read_file(files[index], ok);
+      if (!ok) {
+        continue;
+      }
+      roms[index].path = files[index].lexically_relative(directory).generic_string();
+      roms[index].info = analyze_rom(data.data(), data.size(), *scratch);
+      read[index] = true;
+    }
+  };
+
+  threads = threads != 0 ? threads : std::thread::hardware_concurrency();
+  threads = static_cast<unsigned>(
+      std::clamp<std::size_t>(threads, 1, std::max<std::size_t>(files.size(), 1)));
+  // The calling thread is one of them
+  std::vector<std::thread> workers;
+  for (unsigned worker = 1; worker < threads; worker++) {
+    workers.emplace_back(work);
+  }
+  work();
+  for (auto& worker : workers) {
+    worker.join();
+  }
+
+  RomIndexStatistics stats;
+  std::vector<IndexedRom> out;
+  std::unordered_set<uint64_t> hashes;
+  for (std::size_t index = 0; index < roms.size(); index++) {
+    if (!read[index]) {
+      stats.unreadable++;
+      continue;
+    }
+    stats.files++;
+    stats.bytes += roms[index].info.size;
+    stats.duplicates += !hashes.insert(roms[index].info.rom_hash).second;
+    out.push_back(std::move(roms[index]));
+  }
+  if (statistics != nullptr) {
+    *statistics = stats;
+  }
+  return out;
+}
+
+void write_rom_index(const std::vector<IndexedRom>& roms, const std::string& path) {
+  uint32_t slot_count = 2;
+  while (slot_count < 2 * roms.size()) {
+    slot_count *= 2;
+  }
+  std::vector<rom_index::Slot> slots(slot_count);
+  std::string paths;
+  uint32_t rom_count = 0;
+  for (const auto& rom : roms) {
+    auto slot = static_cast<uint32_t>(rom.info.rom_hash) & (slot_count - 1);
+    while (slots[slot].path_size != 0 && slots[slot].info.rom_hash != rom.info.rom_hash) {
+      slot = (slot + 1) & (slot_count - 1);
+    }
+    if (slots[slot].path_size != 0 || rom.path.empty()) {
+      continue;
+    }
+    slots[slot].info = rom.info;
+    slots[slot].path_offset = static_cast<uint32_t>(paths.size());
+    slots[slot].path_size = static_cast<uint32_t>(rom.path.size());
+    paths += rom.path;
+    rom_count++;
+  }
+
+  rom_index::Header header{};
+  std::memcpy(header.magic, rom_index::magic, sizeof(rom_index::magic));
+  header.version = rom_index::version;
+  header.byte_order = rom_index::byte_order;
+  header.slot_count = slot_count;
+  header.rom_count = rom_count;
+  header.paths_size = static_cast<uint32_t>(paths.size());
+
+  // Loaders only ever see complete indexes
+  const auto temporary = path + ".tmp." + std::to_string(::getpid());
+  std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+  out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  out.write(reinterpret_cast<const char*>(slots.data()),
+            static_cast<std::streamsize>(slots.size() * sizeof(rom_index::Slot)));
+  out.write(paths.data(), static_cast<std::streamsize>(paths.size()));
+  out.close();
+  if (!out) {
+    std::remove(temporary.c_str());
+    throw std::system_error(std::make_error_code(std::errc::io_error),
+                            "Can't write rom index " + path);
+  }
+  if (::rename(temporary.c_str(), path.c_str()) != 0) {
+    const auto error = errno;
+    std::remove(temporary.c_str());
+    throw std::system_error(error, std::generic_category(), "Can't write rom index " + path);
+  }
+}
+
+RomIndex::RomIndex(const std::string& path) {
+  const auto fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    throw std::system_error(errno, std::generic_category(), "Can't open rom index " + path);
+  }
+  struct stat status;
+  if (::fstat(fd, &status) == 0
+      && static_cast<std::size_t>(status.st_size) >= sizeof(rom_index::Header)) {
+    mapping_size = static_cast<std::size_t>(status.st_size);
+    mapping = ::mmap(nullptr, mapping_size, PROT_READ, MAP_SHARED, fd, 0);
+  }
+  ::close(fd);
+  if (mapping == nullptr || mapping == MAP_FAILED) {
+    mapping = nullptr;
+    throw std::system_error(std::make_error_code(std::errc::invalid_argument),
+                            path + " is not a rom index");
+  }
+
+  rom_index::Header header;
+  std::memcpy(&header, mapping, sizeof(header));
+  const auto slot_count = static_cast<std::size_t>(header.slot_count);
+  if (std::memcmp(header.magic, rom_index::magic, sizeof(rom_index::magic)) != 0
+      || header.version != rom_index::version || header.byte_order != rom_index::byte_order
+      || slot_count == 0 || (slot_count & (slot_count - 1)) != 0
+      || mapping_size
+             != sizeof(header) + slot_count * sizeof(rom_index::Slot) + header.paths_size) {
+    ::munmap(mapping, mapping_size);
+    throw std::system_error(std::make_error_code(std::errc::invalid_argument),
+                            path + " is not a compatible rom index");
+  }
+
+  const auto bytes = static_cast<const uint8_t*>(mapping);
+  slots = reinterpret_cast<const rom_index::Slot*>(bytes + sizeof(header));
+  paths = reinterpret_cast<const char*>(bytes + sizeof(header)
+                                        + slot_count * sizeof(rom_index::Slot));
+  paths_size = header.paths_size;
+  slot_mask = header.slot_count - 1;
+  rom_count = header.rom_count;
+}
+
+RomIndex::~RomIndex() { ::munmap(mapping, mapping_size); }
+
+const RomInfo* RomIndex::find(uint64_t rom_hash) const {
+  for (auto slot = static_cast<uint32_t>(rom_hash) & slot_mask, probes = 0u;
+       slots[slot].path_size != 0 && probes <= slot_mask; slot = (slot + 1) & slot_mask, probes++) {
+    if (slots[slot].info.rom_hash == rom_hash) {
+      return &slots[slot].info;
+    }
+  }
+  return nullptr;
+}
+
+std::string_view RomIndex::path(const RomInfo& info) const {
+  // The info is the first member of its slot
+  const auto& slot = reinterpret_cast<const rom_index::Slot&>(info);
+  if (static_cast<uint64_t>(slot.path_offset) + slot.path_size > paths_size) {
+    return {};
+  }
+  return {paths + slot.path_offset, slot.path_size};
+}
+
+std::size_t RomIndex::size() const { return rom_count; }
+
+#endif  // _WIN32
@@ -0,0 +1,197 @@
+#include "RomPack.h"
+
+#ifndef _WIN32
+
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <unistd.h>
+
+#  include <algorithm>
+#  include <cerrno>
+#  include <cstdio>
+#  include <cstring>
+#  include <fstream>
+#  include <memory>
+#  include <numeric>
+#  include <system_error>
+
+#  include "Translation.h"
+
+namespace {
+
+uint64_t align(uint64_t offset) {
+  return (offset + rom_pack::image_alignment - 1) / rom_pack::image_alignment
+         * rom_pack::image_alignment;
+}
+
+[[noreturn]] void invalid(const std::string& path) {
+  throw std::system_error(std::make_error_code(std::errc::invalid_argument),
+                          path + " is not a compatible rom pack");
+}
+
+}  // namespace
+
+void write_rom_pack(const std::vector<PackedRom>& roms, const std::string& path) {
+  // Metadata of each distinct rom, in hash order
+  std::vector<std::pair<RomInfo, const PackedRom*>> packed;
+  auto scratch = std::make_unique<Translation>();
+  for (const auto& rom : roms) {
+    packed.emplace_back(analyze_rom(rom.data.data(), rom.data.size(), *scratch), &rom);
+  }
+  std::stable_sort(packed.begin(), packed.end(), [](const auto& a, const auto& b) {
+    return a.first.rom_hash < b.first.rom_hash;
+  });
+  packed.erase(std::unique(packed.begin(), packed.end(),
+                           [](const auto& a, const auto& b) {
+                             return a.first.rom_hash == b.first.rom_hash;
+                           }),
+               packed.end());
+  const auto count = packed.size();
+
+  std::vector<uint32_t> name_order(count);
+  std::iota(name_order.begin(), name_order.end(), 0);
+  std::stable_sort(name_order.begin(), name_order.end(), [&](uint32_t a, uint32_t b) {
+    return packed[a].second->name < packed[b].second->name;
+  });
+
+  std::vector<rom_pack::Entry> entries(count);
+  std::string names;
+  for (std::size_t index = 0; index < count; index++) {
+    entries[index].info = packed[index].first;
+    entries[index].name_offset = static_cast<uint32_t>(names.size());
+    entries[index].name_size = static_cast<uint32_t>(packed[index].second->name.size());
+    names += packed[index].second->name;
+  }
+
+  rom_pack::Header header{};
+  std::memcpy(header.magic, rom_pack::magic, sizeof(rom_pack::magic));
+  header.version = rom_pack::version;
+  header.byte_order = rom_pack::byte_order;
+  header.rom_count = static_cast<uint32_t>(count);
+  header.names_offset = static_cast<uint32_t>(sizeof(header) + count * sizeof(rom_pack::Entry)
+                                              + count * sizeof(uint32_t));
+  header.names_size = static_cast<uint32_t>(names.size());
+  header.data_offset = align(header.names_offset + names.size());
+  auto offset = header.data_offset;
+  for (std::size_t index = 0; index < count; index++) {
+    entries[index].offset = offset;
+    offset = align(offset + packed[index].second->data.size());
+  }
+
+  // Loaders only ever see complete packs
+  const auto temporary = path + ".tmp." + std::to_string(::getpid());
+  std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+  const auto write = [&](const void* data, std::size_t size) {
+    out.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+  };
+  write(&header, sizeof(header));
+  write(entries.data(), entries.size() * sizeof(rom_pack::Entry));
+  write(name_order.data(), name_order.size() * sizeof(uint32_t));
+  write(names.data(), names.size());
+  const char padding[rom_pack::image_alignment] = {};
+  write(padding, header.data_offset - header.names_offset - names.size());
+  for (std::size_t index = 0; index < count; index++) {
+    const auto& data = packed[index].second->data;
+    write(data.data(), data.size());
+    write(padding, align(data.size()) - data.size());
+  }
+  out.close();
+  if (!out) {
+    std::remove(temporary.c_str());
+    throw std::system_error(std::make_error_code(std::errc::io_error),
+                            "Can't write rom pack " + path);
+  }
+  if (::rename(temporary.c_str(), path.c_str()) != 0) {
+    const auto error = errno;
+    std::remove(temporary.c_str());
+    throw std::system_error(error, std::generic_category(), "Can't write rom pack " + path);
+  }
+}
+
+RomPack::RomPack(const std::string& path) {
+  const auto fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    throw std::system_error(errno, std::generic_category(), "Can't open rom pack " + path);
+  }
+  struct stat status;
+  if (::fstat(fd, &status) == 0
+      && static_cast<std::size_t>(status.st_size) >= sizeof(rom_pack::Header)) {
+    mapping_size = static_cast<std::size_t>(status.st_size);
+    mapping = ::mmap(nullptr, mapping_size, PROT_READ, MAP_SHARED, fd, 0);
+  }
+  ::close(fd);
+  if (mapping == nullptr || mapping == MAP_FAILED) {
+    mapping = nullptr;
+    invalid(path);
+  }
+
+  // Everything a lookup relies on is checked once here
+  const auto bytes = static_cast<const uint8_t*>(mapping);
+  rom_pack::Header header;
+  std::memcpy(&header, bytes, sizeof(header));
+  count = header.rom_count;
+  const auto index_end
+      = sizeof(header) + count * (sizeof(rom_pack::Entry) + sizeof(uint32_t));
+  bool valid = std::memcmp(header.magic, rom_pack::magic, sizeof(rom_pack::magic)) == 0
+               && header.version == rom_pack::version && header.byte_order == rom_pack::byte_order
+               && header.names_offset == index_end
+               && static_cast<uint64_t>(header.names_offset) + header.names_size
+                      <= header.data_offset
+               && header.data_offset <= mapping_size;
+  if (valid) {
+    entries = reinterpret_cast<const rom_pack::Entry*>(bytes + sizeof(header));
+    name_order = reinterpret_cast<const uint32_t*>(bytes + sizeof(header)
+                                                   + count * sizeof(rom_pack::Entry));
+    names = reinterpret_cast<const char*>(bytes + header.names_offset);
+  }
+  for (std::size_t index = 0; valid && index < count; index++) {
+    const auto& entry = entries[index];
+    valid = entry.offset >= header.data_offset && entry.offset <= mapping_size
+            && entry.info.size <= mapping_size - entry.offset
+            && static_cast<uint64_t>(entry.name_offset) + entry.name_size <= header.names_size
+            && name_order[index] < count
+            && (index == 0 || entries[index - 1].info.rom_hash < entry.info.rom_hash);
+  }
+  if (!valid) {
+    ::munmap(mapping, mapping_size);
+    invalid(path);
+  }
+}
+
+RomPack::~RomPack() { ::munmap(mapping, mapping_size); }
+
+std::size_t RomPack::size() const { return count; }
+
+RomPack::Rom RomPack::rom(std::size_t index) const {
+  const auto& entry = entries[index];
+  Rom rom;
+  rom.data = static_cast<const uint8_t*>(mapping) + entry.offset;
+  rom.size = entry.info.size;
+  rom.name = {names + entry.name_offset, entry.name_size};
+  rom.info = &entry.info;
+  return rom;
+}
+
+std::size_t RomPack::find(uint64_t rom_hash) const {
+  const auto end = entries + count;
+  const auto entry = std::lower_bound(entries, end, rom_hash,
+                                      [](const rom_pack::Entry& entry, uint64_t rom_hash) {
+                                        return entry.info.rom_hash < rom_hash;
+                                      });
+  return entry != end && entry->info.rom_hash == rom_hash ? entry - entries : count;
+}
+
+std::size_t RomPack::find(std::string_view name) const {
+  const auto name_of = [&](uint32_t index) {
+    return std::string_view(names + entries[index].name_offset, entries[index].name_size);
+  };
+  const auto end = name_order + count;
+  const auto index = std::lower_bound(
+      name_order, end, name, [&](uint32_t index, std::string_view name) {
+        return name_of(index) < name;
+      });
+  return index != end && name_of(*index) == name ? *index : count;
+}
+
+#endif  // _WIN32
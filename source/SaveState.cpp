@@ -0,0 +1,199 @@
+#include "SaveState.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+#include "Emulator.h"
+#include "Hash.h"
+
+namespace {
+
+// Payload offsets, version 2 and 1
+constexpr std::size_t memory_offset = 0;
+constexpr std::size_t graphic_offset = 4096;
+constexpr std::size_t registers_offset = 6144;
+constexpr std::size_t I_offset = 6160;
+constexpr std::size_t pc_offset = 6162;
+constexpr std::size_t stack_offset = 6164;
+constexpr std::size_t stack_size_offset = 6196;
+constexpr std::size_t delay_timer_offset = 6197;
+constexpr std::size_t sound_timer_offset = 6198;
+constexpr std::size_t flags_offset = 6199;
+constexpr std::size_t waiting_register_offset = 6200;
+constexpr std::size_t keys_offset = 6201;
+constexpr std::size_t rng_id_offset = 6203;
+constexpr std::size_t rng_state_offset = 6208;
+// Version 1 only
+constexpr std::size_t mt19937_index_offset = 6204;
+constexpr std::size_t mt19937_words_offset = 6208;
+constexpr uint32_t mt19937_state_size = 624;
+
+constexpr uint8_t flag_draw = 1;
+constexpr uint8_t flag_sound = 2;
+constexpr uint8_t flag_waiting_for_key = 4;
+
+void store16(uint8_t* out, uint16_t value) {
+  out[0] = value & 0xFF;
+  out[1] = value >> 8;
+}
+void store32(uint8_t* out, uint32_t value) {
+  for (auto i = 0; i < 4; i++) {
+    out[i] = (value >> (i * 8)) & 0xFF;
+  }
+}
+void store64(uint8_t* out, uint64_t value) {
+  for (auto i = 0; i < 8; i++) {
+    out[i] = (value >> (i * 8)) & 0xFF;
+  }
+}
+
+uint16_t load16(const uint8_t* in) { return in[0] | in[1] << 8; }
+uint32_t load32(const uint8_t* in) {
+  return in[0] | in[1] << 8 | in[2] << 16 | static_cast<uint32_t>(in[3]) << 24;
+}
+uint64_t load64(const uint8_t* in) {
+  return load32(in) | static_cast<uint64_t>(load32(in + 4)) << 32;
+}
+
+}  // namespace
+
+void Emulator::save_state(std::vector<uint8_t>& out) const {
+  out.assign(save_state_format::header_size + save_state_format::payload_size_v2, 0);
+  auto header = out.data();
+  auto payload = header + save_state_format::header_size;
+
+  std::memcpy(payload + memory_offset, memory.data(), memory.size());
+  std::memcpy(payload + graphic_offset, graphic.data(), graphic.size());
+  std::memcpy(payload + registers_offset, V.data(), V.size());
+  store16(payload + I_offset, I);
+  store16(payload + pc_offset, pc);
+  for (std::size_t level = 0; level < stack.size(); level++) {
+    store16(payload + stack_offset + level * 2, stack[level]);
+  }
+  payload[stack_size_offset] = static_cast<uint8_t>(stack.size());
+  payload[delay_timer_offset] = delay_timer;
+  payload[sound_timer_offset] = sound_timer;
+  payload[flags_offset] = (draw_flag ? flag_draw : 0) | (sound_flag ? flag_sound : 0)
+                          | (waiting_for_key ? flag_waiting_for_key : 0);
+  payload[waiting_register_offset] = waiting_for_key_register;
+
+  uint16_t pressed_keys = 0;
+  for (auto key = 0; key < 16; key++) {
+    pressed_keys |= keys[key] ? 1 << key : 0;
+  }
+  store16(payload + keys_offset, pressed_keys);
+
+  payload[rng_id_offset] = Rng::id;
+  const auto rng_state = rng_engine.state();
+  for (std::size_t i = 0; i < rng_state.size(); i++) {
+    store64(payload + rng_state_offset + i * 8, rng_state[i]);
+  }
+
+  std::memcpy(header, save_state_format::magic, sizeof(save_state_format::magic));
+  store16(header + 4, save_state_format::version);
+  store16(header + 6, save_state_format::header_size);
+  store32(header + 8, save_state_format::payload_size_v2);
+  store64(header + 16, loaded_rom_hash);
+  store64(header + 24, fnv1a64(payload, save_state_format::payload_size_v2));
+}
+
+LoadStateResult Emulator::load_state(const uint8_t* data, std::size_t size) {
+  if (size < save_state_format::header_size
+      || std::memcmp(data, save_state_format::magic, sizeof(save_state_format::magic)) != 0) {
+    return LoadStateResult::NotASaveState;
+  }
+
+  const auto version = load16(data + 4);
+  const auto header_size = load16(data + 6);
+  const auto payload_size = load32(data + 8);
+  const auto expected_payload_size = version == 1   ? save_state_format::payload_size_v1
+                                     : version == 2 ? save_state_format::payload_size_v2
+                                                    : 0;
+  if (expected_payload_size == 0 || header_size != save_state_format::header_size
+      || payload_size != expected_payload_size) {
+    return LoadStateResult::UnsupportedVersion;
+  }
+  if (size < header_size + payload_size) {
+    return LoadStateResult::Truncated;
+  }
+
+  const auto payload = data + header_size;
+  if (fnv1a64(payload, payload_size) != load64(data + 24)) {
+    return LoadStateResult::ChecksumMismatch;
+  }
+
+  const auto stack_size = payload[stack_size_offset];
+  const auto pixels = payload + graphic_offset;
+  if (stack_size > CallStack::capacity || payload[waiting_register_offset] > 0xF
+      || std::any_of(pixels, pixels + graphic.size(), [](uint8_t pixel) { return pixel > 1; })) {
+    return LoadStateResult::InvalidState;
+  }
+
+  Rng rng;
+  if (version == 1) {
+    if (load32(payload + mt19937_index_offset) > mt19937_state_size) {
+      return LoadStateResult::InvalidState;
+    }
+    rng.seed(fnv1a64(payload + mt19937_index_offset, 4 + mt19937_state_size * 4));
+  } else if (payload[rng_id_offset] == Rng::id) {
+    std::array<uint64_t, 2> rng_state;
+    for (std::size_t i = 0; i < rng_state.size(); i++) {
+      rng_state[i] = load64(payload + rng_state_offset + i * 8);
+    }
+    if (!rng.set_state(rng_state)) {
+      return LoadStateResult::InvalidState;
+    }
+  } else {
+    rng.seed(fnv1a64(payload + rng_state_offset, 16));
+  }
+
+  std::memcpy(memory.data(), payload + memory_offset, memory.size());
+  std::memcpy(graphic.data(), payload + graphic_offset, graphic.size());
+  std::memcpy(V.data(), payload + registers_offset, V.size());
+  refresh_fingerprints();
+  I = load16(payload + I_offset);
+  pc = load16(payload + pc_offset);
+  stack.clear();
+  for (std::size_t level = 0; level < stack_size; level++) {
+    stack.push(load16(payload + stack_offset + level * 2));
+  }
+  delay_timer = payload[delay_timer_offset];
+  sound_timer = payload[sound_timer_offset];
+
+  const auto flags = payload[flags_offset];
+  draw_flag = (flags & flag_draw) != 0;
+  sound_flag = (flags & flag_sound) != 0;
+  waiting_for_key = (flags & flag_waiting_for_key) != 0;
+  waiting_for_key_register = payload[waiting_register_offset];
+
+  const auto pressed_keys = load16(payload + keys_offset);
+  for (auto key = 0; key < 16; key++) {
+    keys[key] = (pressed_keys >> key) & 1;
+  }
+
+  rng_engine = rng;
+
+  loaded_rom_hash = load64(data + 16);
+  return LoadStateResult::Ok;
+}
+
+uint64_t Emulator::rom_hash() const { return loaded_rom_hash; }
+
+const char* to_string(LoadStateResult result) {
+  switch (result) {
+    case LoadStateResult::Ok:
+      return "ok";
+    case LoadStateResult::NotASaveState:
+      return "not a save state";
+    case LoadStateResult::UnsupportedVersion:
+      return "unsupported version";
+    case LoadStateResult::Truncated:
+      return "truncated";
+    case LoadStateResult::ChecksumMismatch:
+      return "checksum mismatch";
+    case LoadStateResult::InvalidState:
+      return "invalid state";
+  }
+  return "unknown";
+}
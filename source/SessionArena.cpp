@@ -0,0 +1,127 @@
+#include "SessionArena.h"
+
+#ifndef _WIN32
+
+#  include <sys/mman.h>
+#  include <unistd.h>
+
+#  include <algorithm>
+#  include <cerrno>
+#  include <system_error>
+
+#  ifdef __linux__
+#    include <linux/mempolicy.h>
+#    include <sys/syscall.h>
+#  endif
+
+double SlabAllocator::Statistics::fragmentation() const {
+  return bytes == 0 ? 0 : 1 - static_cast<double>(live_bytes) / bytes;
+}
+
+SlabAllocator::SlabAllocator(const Config& config) : config(config) {
+  this->config.slot_size
+      = std::max(sizeof(FreeSlot), (config.slot_size + slot_alignment - 1) / slot_alignment
+                                       * slot_alignment);
+  // A slab holds at least one slot
+  const auto page = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+  this->config.slab_size = std::max(config.slab_size, this->config.slot_size);
+  this->config.slab_size = (this->config.slab_size + page - 1) / page * page;
+  slots_per_slab = this->config.slab_size / this->config.slot_size;
+}
+
+SlabAllocator::~SlabAllocator() {
+  for (const auto& [address, size] : slabs) {
+    munmap(address, size);
+  }
+}
+
+void* SlabAllocator::allocate() {
+  void* slot;
+  if (free_list != nullptr) {
+    slot = free_list;
+    free_list = free_list->next;
+  } else {
+    if (fresh == fresh_end) {
+      add_slab();
+    }
+    slot = fresh;
+    fresh += config.slot_size;
+  }
+  stats.live++;
+  stats.live_bytes += config.slot_size;
+  stats.peak = std::max(stats.peak, stats.live);
+  return slot;
+}
+
+void SlabAllocator::deallocate(void* slot) {
+  const auto free_slot = static_cast<FreeSlot*>(slot);
+  free_slot->next = free_list;
+  free_list = free_slot;
+  stats.live--;
+  stats.live_bytes -= config.slot_size;
+}
+
+std::size_t SlabAllocator::slot_size() const { return config.slot_size; }
+
+const SlabAllocator::Statistics& SlabAllocator::statistics() const { return stats; }
+
+int SlabAllocator::current_numa_node() {
+#  ifdef SYS_getcpu
+  unsigned cpu = 0;
+  unsigned node = 0;
+  if (syscall(SYS_getcpu, &cpu, &node, nullptr) == 0) {
+    return static_cast<int>(node);
+  }
+#  endif
+  return 0;
+}
+
+void SlabAllocator::add_slab() {
+  const auto size = config.slab_size;
+  void* address = MAP_FAILED;
+  bool huge = false;
+#  ifdef MAP_HUGETLB
+  if (config.pages == Pages::Huge) {
+    // Fails when no huge page is reserved, or the size isn't a multiple of theirs
+    address = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB,
+                   -1, 0);
+    huge = address != MAP_FAILED;
+  }
+#  endif
+  if (address == MAP_FAILED) {
+    address = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (address == MAP_FAILED) {
+      throw std::system_error(errno, std::generic_category(), "Can't map a session slab");
+    }
+#  ifdef MADV_HUGEPAGE
+    if (config.pages != Pages::Normal) {
+      madvise(address, size, MADV_HUGEPAGE);
+    }
+#  endif
+  }
+
+#  ifdef __linux__
+  // Before any page is touched, so they're all placed on the node
+  if (config.numa_node >= 0) {
+    const auto bits = 8 * sizeof(unsigned long);
+    std::vector<unsigned long> mask(config.numa_node / bits + 1);
+    mask[config.numa_node / bits] = 1ul << (config.numa_node % bits);
+    if (syscall(SYS_mbind, address, size, MPOL_PREFERRED, mask.data(), mask.size() * bits + 1, 0)
+        != 0) {
+      stats.numa_bind_failures++;
+    }
+  }
+#  endif
+
+  slabs.emplace_back(address, size);
+  stats.slabs++;
+  stats.huge_slabs += huge;
+  stats.bytes += size;
+  stats.slots += slots_per_slab;
+
+  // Handed out front to back, so pages are only touched once used
+  fresh = static_cast<uint8_t*>(address);
+  fresh_end = fresh + slots_per_slab * config.slot_size;
+}
+
+#endif  // _WIN32
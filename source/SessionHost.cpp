@@ -0,0 +1,430 @@
+#include "SessionHost.h"
+
+#ifdef __linux__
+
+#  include <sys/epoll.h>
+#  include <sys/eventfd.h>
+#  include <sys/socket.h>
+#  include <sys/timerfd.h>
+#  include <sys/un.h>
+#  include <unistd.h>
+
+#  include <algorithm>
+#  include <cerrno>
+#  include <cmath>
+#  include <cstring>
+#  include <system_error>
+
+namespace {
+
+using namespace session_protocol;
+
+// epoll data of the host's own descriptors, clients use their slot and session id
+constexpr uint64_t listen_event = ~uint64_t{0};
+constexpr uint64_t timer_event = ~uint64_t{0} - 1;
+constexpr uint64_t stop_event = ~uint64_t{0} - 2;
+
+constexpr std::size_t read_chunk = 4096;
+// Clients are level-triggered, so one flooding the socket is read again on the next wakeup instead
+// of starving the others and the frame timer
+constexpr int max_reads_per_wakeup = 4;
+constexpr int max_events = 256;
+
+#  ifdef MSG_NOSIGNAL
+constexpr int send_flags = MSG_NOSIGNAL;
+#  else
+constexpr int send_flags = 0;
+#  endif
+
+std::system_error host_error(const char* what) {
+  return std::system_error(errno, std::generic_category(), what);
+}
+
+SlabAllocator::Config arena_config(const SessionHost::Config& config) {
+  SlabAllocator::Config arena;
+  arena.pages = config.arena_pages;
+  arena.numa_node = config.numa_node;
+  return arena;
+}
+
+uint64_t client_event(uint32_t slot, uint32_t id) { return static_cast<uint64_t>(id) << 32 | slot; }
+
+}  // namespace
+
+SessionHost::SessionHost(const Config& config) : config(config), arena(arena_config(config)) {
+  this->config.cycles_per_frame = std::max(this->config.cycles_per_frame, 1u);
+  this->config.max_catch_up_frames = std::max(this->config.max_catch_up_frames, 1u);
+
+  translations.resize(config.pack != nullptr ? config.pack->size() : config.roms.size());
+
+  sockaddr_un address{};
+  if (config.socket_path.size() >= sizeof(address.sun_path)) {
+    throw std::system_error(std::make_error_code(std::errc::filename_too_long),
+                            "Session host socket path");
+  }
+  address.sun_family = AF_UNIX;
+  std::memcpy(address.sun_path, config.socket_path.c_str(), config.socket_path.size() + 1);
+
+  const auto cleanup = [this]() {
+    for (auto fd : {listen_fd, epoll_fd, timer_fd, stop_fd}) {
+      if (fd >= 0) {
+        close(fd);
+      }
+    }
+  };
+
+  listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  stop_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (listen_fd < 0 || epoll_fd < 0 || timer_fd < 0 || stop_fd < 0) {
+    auto error = host_error("Session host setup");
+    cleanup();
+    throw error;
+  }
+
+  unlink(config.socket_path.c_str());
+  if (bind(listen_fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0
+      || listen(listen_fd, SOMAXCONN) < 0) {
+    auto error = host_error("Session host bind");
+    cleanup();
+    throw error;
+  }
+
+  const auto period_ns = static_cast<long>(1e9 / std::max(config.frames_per_second, 1.0));
+  itimerspec period{};
+  period.it_interval.tv_sec = period_ns / 1000000000;
+  period.it_interval.tv_nsec = period_ns % 1000000000;
+  period.it_value = period.it_interval;
+  timerfd_settime(timer_fd, 0, &period, nullptr);
+
+  for (auto [fd, data] : {std::pair{listen_fd, listen_event}, std::pair{timer_fd, timer_event},
+                          std::pair{stop_fd, stop_event}}) {
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.u64 = data;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event);
+  }
+}
+
+SessionHost::~SessionHost() {
+  for (uint32_t slot = 0; slot < sessions.size(); slot++) {
+    if (sessions[slot]) {
+      close(sessions[slot]->fd);
+    }
+  }
+  close(listen_fd);
+  close(epoll_fd);
+  close(timer_fd);
+  close(stop_fd);
+  unlink(config.socket_path.c_str());
+}
+
+void SessionHost::run() {
+  while (!stopping) {
+    poll(-1);
+  }
+}
+
+void SessionHost::stop() {
+  stopping = true;
+  const uint64_t one = 1;
+  [[maybe_unused]] const auto written = write(stop_fd, &one, sizeof(one));
+}
+
+SessionHost::Statistics SessionHost::statistics() const {
+  Statistics statistics;
+  statistics.sessions = counters.sessions;
+  statistics.accepted = counters.accepted;
+  statistics.disconnected = counters.disconnected;
+  statistics.dropped_slow = counters.dropped_slow;
+  statistics.frames_emulated = counters.frames_emulated;
+  statistics.frames_skipped = counters.frames_skipped;
+  statistics.updates_sent = counters.updates_sent;
+  statistics.bytes_sent = counters.bytes_sent;
+  statistics.keys_received = counters.keys_received;
+  statistics.arena_slabs = counters.arena_slabs;
+  statistics.arena_bytes = counters.arena_bytes;
+  statistics.arena_live_bytes = counters.arena_live_bytes;
+  return statistics;
+}
+
+void SessionHost::poll(int timeout_ms) {
+  epoll_event events[max_events];
+  const auto count = epoll_wait(epoll_fd, events, max_events, timeout_ms);
+
+  for (int i = 0; i < count; i++) {
+    const auto data = events[i].data.u64;
+    if (data == listen_event) {
+      accept_clients();
+    } else if (data == timer_event) {
+      tick();
+    } else if (data == stop_event) {
+      uint64_t value;
+      [[maybe_unused]] const auto read_size = read(stop_fd, &value, sizeof(value));
+    } else {
+      // Events of a client closed earlier in this batch don't match its slot anymore
+      const auto slot = static_cast<uint32_t>(data);
+      if (slot >= sessions.size() || !sessions[slot]
+          || sessions[slot]->id != static_cast<uint32_t>(data >> 32)) {
+        continue;
+      }
+      if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+        close_session(slot);
+        continue;
+      }
+      if ((events[i].events & EPOLLOUT) && !flush(slot)) {
+        continue;
+      }
+      if (events[i].events & EPOLLIN) {
+        read_client(slot);
+      }
+    }
+  }
+}
+
+void SessionHost::accept_clients() {
+  while (true) {
+    const auto fd = accept4(listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) {
+      return;
+    }
+    if (counters.sessions >= config.max_sessions) {
+      std::vector<uint8_t> error;
+      append_error(error, ErrorCode::TooManySessions);
+      [[maybe_unused]] const auto written = send(fd, error.data(), error.size(), send_flags);
+      close(fd);
+      continue;
+    }
+
+    uint32_t slot;
+    if (!free_slots.empty()) {
+      slot = free_slots.back();
+      free_slots.pop_back();
+    } else {
+      slot = static_cast<uint32_t>(sessions.size());
+      sessions.emplace_back();
+    }
+    auto session = arena.make();
+    session->fd = fd;
+    session->id = next_session_id++;
+    if (next_session_id == 0) {
+      next_session_id = 1;
+    }
+
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.u64 = client_event(slot, session->id);
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event);
+    sessions[slot] = std::move(session);
+    counters.accepted++;
+    counters.sessions++;
+    update_arena_counters();
+  }
+}
+
+void SessionHost::tick() {
+  uint64_t expirations = 0;
+  if (read(timer_fd, &expirations, sizeof(expirations)) != sizeof(expirations)) {
+    return;
+  }
+  const auto frames = std::min<uint64_t>(expirations, config.max_catch_up_frames);
+  counters.frames_skipped += expirations - frames;
+  counters.frames_emulated += frames;
+
+  for (uint32_t slot = 0; slot < sessions.size(); slot++) {
+    auto& session = sessions[slot];
+    if (!session || !session->started) {
+      continue;
+    }
+
+    // A faulted session keeps its last screen until the client leaves
+    session->emulator.run(frames * config.cycles_per_frame);
+    session->changed |= session->emulator.should_draw();
+    if (session->changed && !session->in_flight) {
+      send_frame(*session);
+      flush(slot);
+    }
+  }
+}
+
+void SessionHost::read_client(uint32_t slot) {
+  auto& session = *sessions[slot];
+  for (auto read = 0; read < max_reads_per_wakeup; read++) {
+    const auto received = recv(session.fd, session.input.prepare(read_chunk), read_chunk, 0);
+    if (received == 0
+        || (received < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+      close_session(slot);
+      return;
+    }
+    if (received < 0) {
+      break;
+    }
+    session.input.received(static_cast<std::size_t>(received));
+
+    Message message;
+    while (session.input.next(message)) {
+      if (!handle(session, message)) {
+        if (!session.closing) {
+          append_error(session.output, ErrorCode::ProtocolError);
+        }
+        // Best effort, the client may not be reading
+        flush(slot);
+        close_session(slot);
+        return;
+      }
+    }
+    if (session.input.error()) {
+      close_session(slot);
+      return;
+    }
+  }
+
+  flush(slot);
+}
+
+bool SessionHost::handle(Session& session, const Message& message) {
+  switch (message.type) {
+    case MessageType::Start: {
+      if (session.started || message.size != 10) {
+        return false;
+      }
+      const auto rom = load16(message.payload);
+      if (rom >= translations.size()) {
+        append_error(session.output, ErrorCode::InvalidRom);
+        session.closing = true;
+        return false;
+      }
+      const uint8_t* data = nullptr;
+      std::size_t size = 0;
+      if (config.pack != nullptr) {
+        const auto packed = config.pack->rom(rom);
+        data = packed.data;
+        size = packed.size;
+      } else {
+        data = config.roms[rom].data();
+        size = config.roms[rom].size();
+      }
+      auto& translation = translations[rom];
+      if (translation == nullptr) {
+        translation = std::make_unique<Translation>();
+        translate(data, size, *translation);
+      }
+      session.emulator.load_rom(data, size);
+      session.emulator.set_translation(translation.get());
+      session.emulator.seed(load64(message.payload + 2));
+      session.started = true;
+      append_started(session.output, session.id);
+      return true;
+    }
+
+    case MessageType::Key: {
+      if (!session.started || message.size != 2 || message.payload[0] > 0xF) {
+        return false;
+      }
+      if (message.payload[1] != 0) {
+        session.emulator.press_key(message.payload[0]);
+      } else {
+        session.emulator.release_key(message.payload[0]);
+      }
+      counters.keys_received++;
+      return true;
+    }
+
+    case MessageType::Ack: {
+      if (!session.started || message.size != 4 || !session.in_flight
+          || load32(message.payload) != session.next_frame - 1) {
+        return false;
+      }
+      session.acked = session.sent;
+      session.acked_frame = session.next_frame - 1;
+      session.in_flight = false;
+      // Changes made while the frame was in flight go out right away
+      if (session.changed) {
+        send_frame(session);
+      }
+      return true;
+    }
+
+    default:
+      return false;
+  }
+}
+
+void SessionHost::send_frame(Session& session) {
+  const auto& graphic = session.emulator.get_graphic();
+  session.changed = false;
+  // Drawn back to what the client already shows, like a sprite erased in the same frame
+  if (graphic == session.acked) {
+    return;
+  }
+
+  const auto size_before = session.output.size();
+  append_frame(session.output, session.next_frame, session.acked_frame,
+               session.emulator.cycles(), session.acked.data(), graphic.data());
+  session.sent = graphic;
+  session.next_frame++;
+  session.in_flight = true;
+  counters.updates_sent++;
+  counters.bytes_sent += session.output.size() - size_before;
+}
+
+bool SessionHost::flush(uint32_t slot) {
+  auto& session = *sessions[slot];
+  while (session.output_start < session.output.size()) {
+    const auto written = send(session.fd, session.output.data() + session.output_start,
+                              session.output.size() - session.output_start, send_flags);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        close_session(slot);
+        return false;
+      }
+      break;
+    }
+    session.output_start += static_cast<std::size_t>(written);
+  }
+
+  const auto pending = session.output.size() - session.output_start;
+  if (pending == 0) {
+    session.output.clear();
+    session.output_start = 0;
+  } else if (pending > config.max_output_buffer) {
+    counters.dropped_slow++;
+    close_session(slot);
+    return false;
+  }
+
+  // Only wait for the socket to be writable while output is pending
+  if ((pending > 0) != session.waiting_writable) {
+    session.waiting_writable = pending > 0;
+    epoll_event event{};
+    event.events = session.waiting_writable ? EPOLLIN | EPOLLOUT : EPOLLIN;
+    event.data.u64 = client_event(slot, session.id);
+    epoll_ctl(epoll_fd, EPOLL_CTL_MOD, session.fd, &event);
+  }
+  return true;
+}
+
+void SessionHost::close_session(uint32_t slot) {
+  if (!sessions[slot]) {
+    return;
+  }
+  close(sessions[slot]->fd);  // Also removes it from the epoll set
+  sessions[slot].reset();
+  free_slots.push_back(slot);
+  counters.sessions--;
+  counters.disconnected++;
+  update_arena_counters();
+}
+
+void SessionHost::update_arena_counters() {
+  const auto& arena_statistics = arena.statistics();
+  counters.arena_slabs = arena_statistics.slabs;
+  counters.arena_bytes = arena_statistics.bytes;
+  counters.arena_live_bytes = arena_statistics.live_bytes;
+}
+
+#endif  // __linux__
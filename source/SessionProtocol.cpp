@@ -0,0 +1,120 @@
+#include "SessionProtocol.h"
+
+#include <cstring>
+
+#include "DeltaCodec.h"
+
+namespace session_protocol {
+
+namespace {
+
+void store(std::vector<uint8_t>& out, uint64_t value, std::size_t bytes) {
+  for (std::size_t i = 0; i < bytes; i++) {
+    out.push_back(static_cast<uint8_t>(value >> (i * 8)));
+  }
+}
+
+// Starts a message, its size is filled in by end_message()
+std::size_t begin_message(std::vector<uint8_t>& out, MessageType type) {
+  const auto start = out.size();
+  store(out, 0, 2);
+  out.push_back(static_cast<uint8_t>(type));
+  return start;
+}
+
+void end_message(std::vector<uint8_t>& out, std::size_t start) {
+  const auto size = out.size() - start - 2;
+  out[start] = static_cast<uint8_t>(size);
+  out[start + 1] = static_cast<uint8_t>(size >> 8);
+}
+
+}  // namespace
+
+void append_start(std::vector<uint8_t>& out, uint16_t rom, uint64_t seed) {
+  const auto start = begin_message(out, MessageType::Start);
+  store(out, rom, 2);
+  store(out, seed, 8);
+  end_message(out, start);
+}
+
+void append_key(std::vector<uint8_t>& out, uint8_t key, bool pressed) {
+  const auto start = begin_message(out, MessageType::Key);
+  out.push_back(key);
+  out.push_back(pressed ? 1 : 0);
+  end_message(out, start);
+}
+
+void append_ack(std::vector<uint8_t>& out, uint32_t frame) {
+  const auto start = begin_message(out, MessageType::Ack);
+  store(out, frame, 4);
+  end_message(out, start);
+}
+
+void append_started(std::vector<uint8_t>& out, uint32_t session) {
+  const auto start = begin_message(out, MessageType::Started);
+  store(out, session, 4);
+  end_message(out, start);
+}
+
+void append_frame(std::vector<uint8_t>& out, uint32_t frame, uint32_t base_frame, uint64_t cycles,
+                  const uint8_t* base, const uint8_t* current) {
+  const auto start = begin_message(out, MessageType::Frame);
+  store(out, frame, 4);
+  store(out, base_frame, 4);
+  store(out, cycles, 8);
+  delta_encode(base, current, 64 * 32, out);
+  end_message(out, start);
+}
+
+void append_error(std::vector<uint8_t>& out, ErrorCode code) {
+  const auto start = begin_message(out, MessageType::Error);
+  out.push_back(static_cast<uint8_t>(code));
+  end_message(out, start);
+}
+
+uint16_t load16(const uint8_t* in) { return static_cast<uint16_t>(in[0] | in[1] << 8); }
+uint32_t load32(const uint8_t* in) {
+  return in[0] | in[1] << 8 | in[2] << 16 | static_cast<uint32_t>(in[3]) << 24;
+}
+uint64_t load64(const uint8_t* in) {
+  return load32(in) | static_cast<uint64_t>(load32(in + 4)) << 32;
+}
+
+uint8_t* MessageReader::prepare(std::size_t size) {
+  // Drop the messages already taken before growing
+  if (start > 0) {
+    std::memmove(buffer.data(), buffer.data() + start, end - start);
+    end -= start;
+    start = 0;
+  }
+  if (buffer.size() < end + size) {
+    buffer.resize(end + size);
+  }
+  return buffer.data() + end;
+}
+
+void MessageReader::received(std::size_t size) { end += size; }
+
+bool MessageReader::next(Message& message) {
+  if (malformed || end - start < header_size) {
+    return false;
+  }
+  const std::size_t size = load16(buffer.data() + start);
+  if (size < 1 || size - 1 > max_payload_size) {
+    malformed = true;
+    return false;
+  }
+  if (end - start < 2 + size) {
+    return false;
+  }
+
+  message.type = static_cast<MessageType>(buffer[start + 2]);
+  message.payload = buffer.data() + start + header_size;
+  message.size = size - 1;
+  start += 2 + size;
+  return true;
+}
+
+bool MessageReader::error() const { return malformed; }
+
+}  // namespace session_protocol
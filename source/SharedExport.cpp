@@ -0,0 +1,218 @@
+#include "SharedExport.h"
+
+#ifndef _WIN32
+
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <unistd.h>
+
+#  include <algorithm>
+#  include <cerrno>
+#  include <cstring>
+#  include <new>
+#  include <system_error>
+
+#  include "Emulator.h"
+
+using namespace shared_export;
+
+namespace {
+
+constexpr std::size_t segment_size = sizeof(Segment);
+
+// A reader only retries when the writer reused the slot meanwhile, more than a few times in a row
+// means a writer lapping it every time or one that died in the middle of a frame
+constexpr int max_read_attempts = 64;
+
+Segment* map_segment(int fd) {
+  const auto mapping = ::mmap(nullptr, segment_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  return mapping == MAP_FAILED ? nullptr : static_cast<Segment*>(mapping);
+}
+
+}  // namespace
+
+SharedExport::SharedExport(const Config& config) : name(config.name) {
+  // A segment left behind by a crashed process is replaced, not reused
+  ::shm_unlink(name.c_str());
+  const auto fd = ::shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+  if (fd < 0) {
+    throw std::system_error(errno, std::generic_category(), "Can't create shared memory " + name);
+  }
+  if (::ftruncate(fd, segment_size) != 0 || (segment = map_segment(fd)) == nullptr) {
+    const auto error = errno;
+    ::close(fd);
+    ::shm_unlink(name.c_str());
+    throw std::system_error(error, std::generic_category(), "Can't map shared memory " + name);
+  }
+  ::close(fd);
+
+  new (segment) Segment();
+  auto& header = segment->header;
+  std::memcpy(header.magic, magic, sizeof(magic));
+  header.version = version;
+  header.segment_size = segment_size;
+  header.byte_order = byte_order;
+  for (const auto& region : config.regions) {
+    if (header.region_count == max_regions) {
+      break;
+    }
+    if (region.address < 4096 && region.size > 0) {
+      const auto size = std::min<std::size_t>(region.size, 4096 - region.address);
+      header.regions[header.region_count++] = {region.address, static_cast<uint16_t>(size)};
+    }
+  }
+  header.published.store(0, std::memory_order_release);
+}
+
+SharedExport::~SharedExport() {
+  ::munmap(segment, segment_size);
+  ::shm_unlink(name.c_str());
+}
+
+void SharedExport::publish(const Emulator& emulator) {
+  auto& header = segment->header;
+  const auto number = header.published.load(std::memory_order_relaxed) + 1;
+  auto& slot = segment->slots[number % 2];
+
+  slot.sequence.store(number * 2 - 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  const auto& state = emulator.state();
+  auto& frame = slot.frame;
+  frame.number = number;
+  frame.cycles = emulator.cycles();
+  frame.V = state.V;
+  frame.I = state.I;
+  frame.pc = state.pc;
+  frame.delay_timer = state.delay_timer;
+  frame.sound_timer = state.sound_timer;
+  frame.stack_size = static_cast<uint8_t>(state.stack.size());
+  for (std::size_t level = 0; level < frame.stack.size(); level++) {
+    frame.stack[level] = level < state.stack.size() ? state.stack[level] : 0;
+  }
+  uint16_t keys = 0;
+  for (std::size_t key = 0; key < state.keys.size(); key++) {
+    keys |= static_cast<uint16_t>(state.keys[key]) << key;
+  }
+  frame.keys = keys;
+  frame.graphic = state.graphic;
+  for (uint32_t region = 0; region < header.region_count; region++) {
+    const auto [address, size] = header.regions[region];
+    std::memcpy(frame.memory.data() + address, state.memory.data() + address, size);
+  }
+
+  slot.sequence.store(number * 2, std::memory_order_release);
+  header.published.store(number, std::memory_order_release);
+}
+
+std::size_t SharedExport::apply_input(Emulator& emulator) {
+  auto& input = segment->input;
+  auto tail = input.tail.load(std::memory_order_relaxed);
+  const auto head = input.head.load(std::memory_order_acquire);
+  // A producer can't have written more than the capacity, anything else is a corrupted ring
+  if (head - tail > input_capacity) {
+    input.tail.store(head, std::memory_order_release);
+    return 0;
+  }
+
+  const std::size_t count = head - tail;
+  for (; tail != head; tail++) {
+    const auto event = input.events[tail % input_capacity];
+    const uint8_t key = event & 0x0F;
+    if (event >> 8) {
+      emulator.press_key(key);
+    } else {
+      emulator.release_key(key);
+    }
+  }
+  input.tail.store(head, std::memory_order_release);
+  return count;
+}
+
+uint64_t SharedExport::published() const {
+  return segment->header.published.load(std::memory_order_relaxed);
+}
+
+SharedExportReader::SharedExportReader(const std::string& name) {
+  const auto fd = ::shm_open(name.c_str(), O_RDWR | O_CLOEXEC, 0);
+  if (fd < 0) {
+    throw std::system_error(errno, std::generic_category(), "Can't open shared memory " + name);
+  }
+  struct stat status;
+  if (::fstat(fd, &status) != 0 || static_cast<std::size_t>(status.st_size) != segment_size
+      || (segment = map_segment(fd)) == nullptr) {
+    ::close(fd);
+    throw std::system_error(std::make_error_code(std::errc::invalid_argument),
+                            name + " is not a compatible chip8 export");
+  }
+  ::close(fd);
+
+  const auto& header = segment->header;
+  if (std::memcmp(header.magic, magic, sizeof(magic)) != 0 || header.version != version
+      || header.segment_size != segment_size || header.byte_order != byte_order
+      || header.region_count > max_regions) {
+    ::munmap(segment, segment_size);
+    throw std::system_error(std::make_error_code(std::errc::invalid_argument),
+                            name + " is not a compatible chip8 export");
+  }
+  exported_regions.assign(header.regions.begin(), header.regions.begin() + header.region_count);
+}
+
+SharedExportReader::~SharedExportReader() { ::munmap(segment, segment_size); }
+
+uint64_t SharedExportReader::published() const {
+  return segment->header.published.load(std::memory_order_acquire);
+}
+
+const Frame* SharedExportReader::latest(uint64_t& ticket) const {
+  for (auto attempt = 0; attempt < max_read_attempts; attempt++) {
+    const auto number = published();
+    if (number == 0) {
+      return nullptr;
+    }
+    // Otherwise the writer already came back to this slot, and a newer frame is published
+    const auto& slot = segment->slots[number % 2];
+    if (slot.sequence.load(std::memory_order_acquire) == number * 2) {
+      ticket = number;
+      return &slot.frame;
+    }
+  }
+  return nullptr;
+}
+
+bool SharedExportReader::valid(uint64_t ticket) const {
+  std::atomic_thread_fence(std::memory_order_acquire);
+  return segment->slots[ticket % 2].sequence.load(std::memory_order_relaxed) == ticket * 2;
+}
+
+bool SharedExportReader::read(Frame& frame) const {
+  uint64_t ticket;
+  for (auto attempt = 0; attempt < max_read_attempts; attempt++) {
+    const auto latest_frame = latest(ticket);
+    if (latest_frame == nullptr) {
+      return false;
+    }
+    std::memcpy(&frame, latest_frame, sizeof(Frame));
+    if (valid(ticket)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool SharedExportReader::push_key(uint8_t key, bool pressed) {
+  auto& input = segment->input;
+  const auto head = input.head.load(std::memory_order_relaxed);
+  if (head - input.tail.load(std::memory_order_acquire) >= input_capacity) {
+    return false;
+  }
+  input.events[head % input_capacity]
+      = static_cast<uint16_t>((key & 0x0F) | (pressed ? 0x100 : 0));
+  input.head.store(head + 1, std::memory_order_release);
+  return true;
+}
+
+const std::vector<Region>& SharedExportReader::regions() const { return exported_regions; }
+
+#endif  // _WIN32
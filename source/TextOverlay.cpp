@@ -0,0 +1,94 @@
+#include "TextOverlay.h"
+
+#include <array>
+#include <cctype>
+
+#include "Font.h"
+
+namespace {
+
+constexpr unsigned glyph_width = 4;
+constexpr unsigned glyph_height = 5;
+constexpr unsigned glyph_advance = glyph_width + 1;
+
+struct ExtraGlyph {
+  char character;
+  std::array<uint8_t, glyph_height> rows;  // Leftmost pixel in the MSB, as in the CHIP-8 font
+};
+
+constexpr std::array<ExtraGlyph, 17> extra_glyphs{{
+    {'.', {0x00, 0x00, 0x00, 0x00, 0x40}},
+    {':', {0x00, 0x40, 0x00, 0x40, 0x00}},
+    {'-', {0x00, 0x00, 0xF0, 0x00, 0x00}},
+    {'/', {0x10, 0x10, 0x20, 0x40, 0x80}},
+    {'%', {0x90, 0x10, 0x20, 0x40, 0x90}},
+    {'I', {0xE0, 0x40, 0x40, 0x40, 0xE0}},
+    {'J', {0x10, 0x10, 0x10, 0x90, 0x60}},
+    {'K', {0x90, 0xA0, 0xC0, 0xA0, 0x90}},
+    {'L', {0x80, 0x80, 0x80, 0x80, 0xF0}},
+    {'M', {0x90, 0xF0, 0xF0, 0x90, 0x90}},
+    {'N', {0x90, 0xD0, 0xB0, 0x90, 0x90}},
+    {'P', {0xE0, 0x90, 0xE0, 0x80, 0x80}},
+    {'R', {0xE0, 0x90, 0xE0, 0xA0, 0x90}},
+    {'T', {0xF0, 0x40, 0x40, 0x40, 0x40}},
+    {'U', {0x90, 0x90, 0x90, 0x90, 0xF0}},
+    {'V', {0x90, 0x90, 0x90, 0xA0, 0x40}},
+    {'X', {0x90, 0x90, 0x60, 0x90, 0x90}},
+}};
+
+// Rows of the glyph for `character`, nullptr if there's none
+const uint8_t* glyph(char character) {
+  character = static_cast<char>(std::toupper(static_cast<unsigned char>(character)));
+  if (character >= '0' && character <= '9') {
+    return chip8_font.data() + (character - '0') * glyph_height;
+  }
+  if (character >= 'A' && character <= 'F') {
+    return chip8_font.data() + (character - 'A' + 10) * glyph_height;
+  }
+  // Letters that look like digits
+  if (character == 'O') {
+    return glyph('0');
+  }
+  if (character == 'S') {
+    return glyph('5');
+  }
+  for (const auto& extra : extra_glyphs) {
+    if (extra.character == character) {
+      return extra.rows.data();
+    }
+  }
+  return nullptr;
+}
+
+}  // namespace
+
+void draw_text(void* pixels, std::size_t pitch, unsigned width, unsigned height, unsigned x,
+               unsigned y, const std::string& text, unsigned scale, uint32_t pixel) {
+  for (std::size_t index = 0; index < text.size(); index++) {
+    const auto rows = glyph(text[index]);
+    if (rows == nullptr) {
+      continue;
+    }
+
+    const auto left = x + static_cast<unsigned>(index) * glyph_advance * scale;
+    for (unsigned row = 0; row < glyph_height * scale; row++) {
+      const auto out_y = y + row;
+      if (out_y >= height) {
+        break;
+      }
+      auto line = reinterpret_cast<uint32_t*>(static_cast<uint8_t*>(pixels) + out_y * pitch);
+      for (unsigned column = 0; column < glyph_width * scale; column++) {
+        const auto out_x = left + column;
+        if (out_x < width && (rows[row / scale] & (0x80 >> (column / scale))) != 0) {
+          line[out_x] = pixel;
+        }
+      }
+    }
+  }
+}
+
+unsigned text_width(const std::string& text, unsigned scale) {
+  return text.empty() ? 0 : (static_cast<unsigned>(text.size()) * glyph_advance - 1) * scale;
+}
+
+unsigned text_height(unsigned scale) { return glyph_height * scale; }
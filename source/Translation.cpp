@@ -0,0 +1,74 @@
+#include "Translation.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "Font.h"
+#include "Hash.h"
+
+void translate(const uint8_t* rom, std::size_t size, Translation& out) {
+  std::array<uint8_t, 4096> memory{};
+  std::copy(chip8_font.begin(), chip8_font.end(), memory.begin());
+  size = std::min(size, memory.size() - 0x200);
+  std::copy(rom, rom + size, memory.begin() + 0x200);
+
+  out = {};
+  out.rom_hash = fnv1a64(rom, size);
+  for (std::size_t address = 0; address < memory.size(); address++) {
+    out.instructions[address] = decode(memory[address] << 8 | memory[(address + 1) & 0xFFF]);
+  }
+
+  // Depth first walk of the control flow
+  std::vector<uint16_t> pending{0x200};
+  out.flags[0x200] |= Translation::BlockStart;
+  const auto branch = [&](uint16_t address, uint8_t flags) {
+    address &= 0xFFF;
+    out.flags[address] |= flags | Translation::BlockStart;
+    pending.push_back(address);
+  };
+
+  while (!pending.empty()) {
+    const auto address = pending.back();
+    pending.pop_back();
+    if (out.flags[address] & Translation::Code) {
+      continue;
+    }
+    out.flags[address] |= Translation::Code;
+    out.code_size++;
+
+    const auto& instruction = out.instructions[address];
+    const auto next = static_cast<uint16_t>((address + 2) & 0xFFF);
+    switch (instruction.operation) {
+      case Operation::Invalid:
+      case Operation::I00EE:
+      case Operation::IBNNN:
+        break;
+
+      case Operation::I1NNN:
+        branch(instruction.nnn, Translation::JumpTarget);
+        break;
+
+      case Operation::I2NNN:
+        branch(instruction.nnn, Translation::CallTarget);
+        branch(next, 0);
+        break;
+
+      case Operation::I3XNN:
+      case Operation::I4XNN:
+      case Operation::I5XY0:
+      case Operation::I9XY0:
+      case Operation::IEX9E:
+      case Operation::IEXA1:
+        branch(next, 0);
+        branch(next + 2, 0);
+        break;
+
+      default:
+        pending.push_back(next);
+        break;
+    }
+  }
+
+  fuse(out, corpus_superinstructions());
+  fuse(out, builtin_superinstructions());
+}
@@ -0,0 +1,146 @@
+#include "TranslationCache.h"
+
+#ifndef _WIN32
+
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <unistd.h>
+
+#  include <algorithm>
+#  include <cerrno>
+#  include <cstdio>
+#  include <cstring>
+#  include <system_error>
+
+#  include "Hash.h"
+
+namespace {
+
+constexpr uint8_t magic[4] = {'C', '8', 'T', 'C'};
+constexpr std::size_t header_size = 32;
+constexpr std::size_t file_size = header_size + sizeof(Translation);
+constexpr uint32_t byte_order = 0x01020304;
+
+struct Header {
+  uint8_t magic[4];
+  uint32_t version;
+  uint32_t translation_size;
+  uint32_t byte_order;
+  uint64_t rom_hash;
+  uint64_t reserved;
+};
+
+static_assert(sizeof(Header) == header_size);
+
+Header make_header(uint64_t rom_hash) {
+  Header header{};
+  std::memcpy(header.magic, magic, sizeof(magic));
+  header.version = translation_version;
+  header.translation_size = sizeof(Translation);
+  header.byte_order = byte_order;
+  header.rom_hash = rom_hash;
+  return header;
+}
+
+bool write_all(int fd, const void* data, std::size_t size) {
+  auto bytes = static_cast<const uint8_t*>(data);
+  while (size > 0) {
+    const auto written = ::write(fd, bytes, size);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    bytes += written;
+    size -= static_cast<std::size_t>(written);
+  }
+  return true;
+}
+
+}  // namespace
+
+TranslationCache::TranslationCache(std::string directory) : directory(std::move(directory)) {
+  if (::mkdir(this->directory.c_str(), 0755) != 0 && errno != EEXIST) {
+    throw std::system_error(errno, std::generic_category(),
+                            "Can't create translation cache " + this->directory);
+  }
+}
+
+std::shared_ptr<const Translation> TranslationCache::load(const uint8_t* rom, std::size_t size) {
+  const auto rom_hash = fnv1a64(rom, std::min<std::size_t>(size, 4096 - 0x200));
+  const auto file = path(rom_hash);
+  if (auto translation = map(file, rom_hash)) {
+    hit_count++;
+    return translation;
+  }
+
+  miss_count++;
+  auto translation = std::make_shared<Translation>();
+  translate(rom, size, *translation);
+  store(file, *translation);
+  return translation;
+}
+
+std::string TranslationCache::path(uint64_t rom_hash) const {
+  char name[48];
+  std::snprintf(name, sizeof(name), "/%016llx-v%u.c8t", static_cast<unsigned long long>(rom_hash),
+                static_cast<unsigned>(translation_version));
+  return directory + name;
+}
+
+uint64_t TranslationCache::hits() const { return hit_count; }
+
+uint64_t TranslationCache::misses() const { return miss_count; }
+
+std::shared_ptr<const Translation> TranslationCache::map(const std::string& path,
+                                                         uint64_t rom_hash) const {
+  const auto fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return nullptr;
+  }
+  struct stat status;
+  void* mapping = MAP_FAILED;
+  if (::fstat(fd, &status) == 0 && static_cast<std::size_t>(status.st_size) == file_size) {
+    mapping = ::mmap(nullptr, file_size, PROT_READ, MAP_SHARED, fd, 0);
+  }
+  ::close(fd);
+  if (mapping == MAP_FAILED) {
+    return nullptr;
+  }
+
+  const auto expected = make_header(rom_hash);
+  const auto bytes = static_cast<const uint8_t*>(mapping);
+  const auto translation = reinterpret_cast<const Translation*>(bytes + header_size);
+  if (std::memcmp(bytes, &expected, header_size) != 0 || translation->rom_hash != rom_hash) {
+    ::munmap(mapping, file_size);
+    return nullptr;
+  }
+
+  // The mapping lives as long as any pointer to the translation
+  std::shared_ptr<void> owner(mapping, [](void* mapping) { ::munmap(mapping, file_size); });
+  return {owner, translation};
+}
+
+bool TranslationCache::store(const std::string& path, const Translation& translation) const {
+  // Unique in the directory, even across processes sharing it
+  static std::atomic<uint64_t> counter{0};
+  const auto temporary = path + ".tmp." + std::to_string(::getpid()) + "."
+                         + std::to_string(counter.fetch_add(1));
+
+  const auto fd = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    return false;
+  }
+  const auto header = make_header(translation.rom_hash);
+  const auto written = write_all(fd, &header, sizeof(header))
+                       && write_all(fd, &translation, sizeof(translation));
+  if (::close(fd) != 0 || !written || ::rename(temporary.c_str(), path.c_str()) != 0) {
+    ::unlink(temporary.c_str());
+    return false;
+  }
+  return true;
+}
+
+#endif  // _WIN32
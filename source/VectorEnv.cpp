@@ -0,0 +1,177 @@
+#include "VectorEnv.h"
+
+#include <algorithm>
+
+namespace {
+
+constexpr std::size_t pixels = 64 * 32;
+
+}  // namespace
+
+VectorEnv::VectorEnv(const Config& config, const uint8_t* rom, std::size_t rom_size)
+    : config(config), environments(std::max<std::size_t>(config.environments, 1)) {
+  this->config.environments = environments.size();
+  this->config.frames_per_step = std::max(this->config.frames_per_step, 1u);
+  this->config.cycles_per_frame = std::max(this->config.cycles_per_frame, 1u);
+
+  Emulator emulator;
+  emulator.load_rom(rom, rom_size);
+  initial_state = emulator.state();
+  for (std::size_t index = 0; index < environments.size(); index++) {
+    environments[index].emulator.load_rom(rom, rom_size);
+    environments[index].emulator.set_translation(config.translation);
+    start_episode(index);
+  }
+
+  auto threads = config.threads != 0 ? config.threads : std::thread::hardware_concurrency();
+  threads = std::clamp<std::size_t>(threads, 1, environments.size());
+  // The calling thread takes the first range itself
+  workers.reserve(threads - 1);
+  for (std::size_t worker = 1; worker < threads; worker++) {
+    workers.emplace_back(&VectorEnv::worker, this, worker);
+  }
+}
+
+VectorEnv::~VectorEnv() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  work_ready.notify_all();
+  for (auto& thread : workers) {
+    thread.join();
+  }
+}
+
+std::size_t VectorEnv::size() const { return environments.size(); }
+
+std::size_t VectorEnv::observation_size() const {
+  return config.observation_format == ObservationFormat::Bits ? pixels / 8 : pixels;
+}
+
+const Emulator& VectorEnv::environment(std::size_t index) const {
+  return environments[index].emulator;
+}
+
+void VectorEnv::reset(uint8_t* observations) {
+  for (std::size_t index = 0; index < environments.size(); index++) {
+    start_episode(index);
+    observe(index, observations + index * observation_size());
+  }
+}
+
+void VectorEnv::step(const uint16_t* actions, uint8_t* observations, float* rewards,
+                     uint8_t* dones) {
+  step_actions = actions;
+  step_observations = observations;
+  step_rewards = rewards;
+  step_dones = dones;
+  run_in_parallel();
+}
+
+void VectorEnv::run_in_parallel() {
+  if (!workers.empty()) {
+    std::lock_guard<std::mutex> lock(mutex);
+    generation++;
+    pending_workers = workers.size();
+  }
+  work_ready.notify_all();
+
+  step_range(range_begin(0), range_begin(1));
+
+  if (!workers.empty()) {
+    std::unique_lock<std::mutex> lock(mutex);
+    work_done.wait(lock, [this]() { return pending_workers == 0; });
+  }
+}
+
+void VectorEnv::worker(std::size_t index) {
+  uint64_t seen_generation = 0;
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      work_ready.wait(lock, [&]() { return stopping || generation != seen_generation; });
+      if (stopping) {
+        return;
+      }
+      seen_generation = generation;
+    }
+
+    step_range(range_begin(index), range_begin(index + 1));
+
+    bool last;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      last = --pending_workers == 0;
+    }
+    if (last) {
+      work_done.notify_one();
+    }
+  }
+}
+
+std::size_t VectorEnv::range_begin(std::size_t worker) const {
+  // Static partition, contiguous so that each thread writes its own part of the output buffers
+  return environments.size() * worker / (workers.size() + 1);
+}
+
+void VectorEnv::step_range(std::size_t begin, std::size_t end) {
+  for (auto index = begin; index < end; index++) {
+    auto& environment = environments[index];
+    auto& emulator = environment.emulator;
+    const auto& memory = emulator.state().memory;
+
+    float reward = 0;
+    for (const auto& probe : config.reward_probes) {
+      reward -= probe.scale * memory[probe.address & 0xFFF];
+    }
+
+    emulator.set_keys(step_actions[index]);
+    bool done = false;
+    for (unsigned frame = 0; frame < config.frames_per_step && !done; frame++) {
+      done = static_cast<bool>(emulator.run(config.cycles_per_frame).fault);
+      environment.episode_frames++;
+
+      const auto& probe = config.done_probe;
+      done = done || (probe.enabled && (memory[probe.address & 0xFFF] & probe.mask) == probe.value);
+      done = done
+             || (config.max_episode_frames != 0
+                 && environment.episode_frames >= config.max_episode_frames);
+    }
+
+    for (const auto& probe : config.reward_probes) {
+      reward += probe.scale * memory[probe.address & 0xFFF];
+    }
+    step_rewards[index] = reward;
+    step_dones[index] = done;
+
+    if (done) {
+      environment.episode++;
+      start_episode(index);
+    }
+    observe(index, step_observations + index * observation_size());
+  }
+}
+
+void VectorEnv::start_episode(std::size_t index) {
+  auto& environment = environments[index];
+  environment.emulator.restore(initial_state);
+  environment.emulator.seed(config.seed + index + environment.episode * environments.size());
+  environment.episode_frames = 0;
+}
+
+void VectorEnv::observe(std::size_t index, uint8_t* observation) const {
+  const auto& graphic = environments[index].emulator.get_graphic();
+  if (config.observation_format == ObservationFormat::Bytes) {
+    std::copy(graphic.begin(), graphic.end(), observation);
+    return;
+  }
+
+  for (std::size_t byte = 0; byte < pixels / 8; byte++) {
+    uint8_t packed = 0;
+    for (std::size_t bit = 0; bit < 8; bit++) {
+      packed = static_cast<uint8_t>(packed << 1 | (graphic[byte * 8 + bit] != 0));
+    }
+    observation[byte] = packed;
+  }
+}
@@ -0,0 +1,113 @@
+#include "chip8.h"
+
+#include <new>
+
+#include "Emulator.h"
+
+struct chip8_emulator {
+  Emulator emulator;
+  uint32_t cycles_per_frame = 1;
+  Fault last_fault;
+};
+
+namespace {
+
+chip8_status run(chip8_emulator* emulator, uint64_t cycles, uint64_t* executed) {
+  if (executed) {
+    *executed = 0;
+  }
+  if (!emulator) {
+    return CHIP8_INVALID_ARGUMENT;
+  }
+
+  const auto result = emulator->emulator.run(cycles);
+  emulator->last_fault = result.fault;
+  if (executed) {
+    *executed = result.cycles;
+  }
+  return result.fault ? CHIP8_FAULT : CHIP8_OK;
+}
+
+}  // namespace
+
+uint32_t chip8_abi_version(void) { return CHIP8_ABI_VERSION; }
+
+chip8_emulator* chip8_create(void) { return new (std::nothrow) chip8_emulator; }
+
+void chip8_destroy(chip8_emulator* emulator) { delete emulator; }
+
+void chip8_reset(chip8_emulator* emulator) {
+  if (emulator) {
+    emulator->emulator.reset();
+    emulator->last_fault = {};
+  }
+}
+
+chip8_status chip8_load_rom(chip8_emulator* emulator, const uint8_t* rom, size_t size) {
+  if (!emulator || (!rom && size != 0)) {
+    return CHIP8_INVALID_ARGUMENT;
+  }
+
+  emulator->emulator.load_rom(rom, size);
+  return size > 4096 - 0x200 ? CHIP8_ROM_TOO_LARGE : CHIP8_OK;
+}
+
+void chip8_seed(chip8_emulator* emulator, uint64_t seed) {
+  if (emulator) {
+    emulator->emulator.seed(seed);
+  }
+}
+
+void chip8_set_cycles_per_frame(chip8_emulator* emulator, uint32_t cycles) {
+  if (emulator) {
+    emulator->cycles_per_frame = cycles;
+  }
+}
+
+chip8_status chip8_run_cycles(chip8_emulator* emulator, uint64_t cycles, uint64_t* executed) {
+  return run(emulator, cycles, executed);
+}
+
+chip8_status chip8_run_frames(chip8_emulator* emulator, uint32_t frames, uint64_t* executed) {
+  return run(emulator, emulator ? static_cast<uint64_t>(frames) * emulator->cycles_per_frame : 0,
+             executed);
+}
+
+chip8_fault chip8_last_fault(const chip8_emulator* emulator) {
+  if (!emulator) {
+    return {};
+  }
+  const auto& fault = emulator->last_fault;
+  return {static_cast<uint32_t>(fault.kind), fault.pc, fault.opcode};
+}
+
+void chip8_set_keys(chip8_emulator* emulator, uint16_t keys) {
+  if (emulator) {
+    emulator->emulator.set_keys(keys);
+  }
+}
+
+uint16_t chip8_keys(const chip8_emulator* emulator) {
+  if (!emulator) {
+    return 0;
+  }
+
+  uint16_t keys = 0;
+  const auto& state = emulator->emulator.state();
+  for (auto key = 0; key < 16; key++) {
+    keys |= state.keys[key] ? 1 << key : 0;
+  }
+  return keys;
+}
+
+const uint8_t* chip8_framebuffer(const chip8_emulator* emulator) {
+  return emulator ? emulator->emulator.get_graphic().data() : nullptr;
+}
+
+int chip8_should_draw(chip8_emulator* emulator) {
+  return emulator && emulator->emulator.should_draw() ? 1 : 0;
+}
+
+int chip8_should_buzz(chip8_emulator* emulator) {
+  return emulator && emulator->emulator.should_buzz() ? 1 : 0;
+}
@@ -1,12 +1,26 @@
 #include <SDL.h>
 
+#include <algorithm>
+#include <array>
 #include <chrono>
+#include <cstdio>
+#include <cstdlib>
 #include <filesystem>
 #include <fstream>
 #include <iostream>
-#include <thread>
+#include <memory>
+#include <random>
+#include <vector>
 
+#include "Capture.h"
 #include "Emulator.h"
+#include "FramePacer.h"
+#include "LatencyHistogram.h"
+#include "Profiler.h"
+#include "Renderer.h"
+#include "RomIndex.h"
+#include "SharedExport.h"
+#include "TextOverlay.h"
 
 constexpr uint8_t NO_KEY_MATCHED = 255;
 
@@ -72,31 +86,121 @@ uint8_t scancode_to_chip8_key(SDL_Scancode scancode) {
 
 constexpr int PIXEL_SIZE = 16;
 
-void draw(SDL_Renderer *renderer, const std::array<uint8_t, 64 * 32> &graphics) {
-  SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);  // Black
-  SDL_RenderClear(renderer);
+uint64_t now_ns() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
 
-  SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);  // White
+// Host time of an SDL event. SDL only stamps events in milliseconds on its own clock, so the age of
+// the event is taken from that and subtracted from the current steady_clock time.
+uint64_t event_time_ns(uint32_t event_ticks) {
+  const auto now = now_ns();
+  const uint64_t age_ns = static_cast<uint64_t>(SDL_GetTicks() - event_ticks) * 1000000;
+  return now > age_ns ? now - age_ns : 0;
+}
 
-  for (auto y = 0; y < 32; y++) {
-    for (auto x = 0; x < 64; x++) {
-      // Only draw white if pixel is equal to 1
-      if (graphics[x + y * 64] == 1) {
-        SDL_Rect pixel;
-        pixel.x = x * PIXEL_SIZE;
-        pixel.y = y * PIXEL_SIZE;
-        pixel.w = PIXEL_SIZE;
-        pixel.h = PIXEL_SIZE;
+// Input latency, from the key event to the program seeing the key, then to the first frame drawn
+// after that being presented
+struct InputLatency {
+  LatencyHistogram event_to_observe;
+  LatencyHistogram observe_to_present;
+  LatencyHistogram event_to_present;
+  // Host time at the end of every cycle, by cycle number modulo the size
+  std::array<uint64_t, 256> cycle_times{};
+
+  void cycle_done(const Emulator &emulator) {
+    cycle_times[(emulator.cycles() - 1) % cycle_times.size()] = now_ns();
+  }
 
-        SDL_RenderFillRect(renderer, &pixel);
+  void presented(Emulator &emulator, uint64_t present_time) {
+    InputLatencySample sample;
+    while (emulator.pop_input_latency(sample)) {
+      // Samples older than the cycle times kept can't be timed
+      if (emulator.cycles() - sample.observe_cycle > cycle_times.size()) {
+        continue;
       }
+      const auto observe_time
+          = std::max(cycle_times[sample.observe_cycle % cycle_times.size()], sample.timestamp);
+      event_to_observe.record((observe_time - sample.timestamp) / 1000);
+      observe_to_present.record((present_time - observe_time) / 1000);
+      event_to_present.record((present_time - sample.timestamp) / 1000);
     }
   }
 
-  SDL_RenderPresent(renderer);
+  void report(std::ostream &out) const {
+    if (event_to_present.count() == 0) {
+      return;
+    }
+    out << std::dec << "Input latency over " << event_to_present.count() << " presses (us):\n";
+    const std::pair<const char *, const LatencyHistogram *> histograms[] = {
+        {"event -> observe", &event_to_observe},
+        {"observe -> present", &observe_to_present},
+        {"event -> present", &event_to_present},
+    };
+    for (const auto &[name, histogram] : histograms) {
+      out << "  " << name << ": p50 " << histogram->percentile(50) << ", p99 "
+          << histogram->percentile(99) << ", max " << histogram->max() << '\n';
+    }
+  }
+};
+
+#ifndef _WIN32
+// "0x300:16,0xF00:256" into memory regions, as address:size pairs
+std::vector<shared_export::Region> parse_regions(const char *text) {
+  std::vector<shared_export::Region> regions;
+  while (text != nullptr && *text != '\0') {
+    char *end;
+    const auto address = std::strtoul(text, &end, 0);
+    if (*end != ':') {
+      break;
+    }
+    const auto size = std::strtoul(end + 1, &end, 0);
+    regions.push_back({static_cast<uint16_t>(address & 0xFFF), static_cast<uint16_t>(size)});
+    text = *end == ',' ? end + 1 : end;
+  }
+  return regions;
+}
+#endif
+
+// Frame pacing statistics, drawn over the screen
+void draw_overlay(void *pixels, std::size_t pitch, const Renderer &screen_renderer,
+                  const FramePacer::Statistics &statistics) {
+  char lines[4][48];
+  std::snprintf(lines[0], sizeof(lines[0]), "FT %.2f MS", statistics.average_frame_ms);
+  std::snprintf(lines[1], sizeof(lines[1]), "J %.2f MAX %.2f", statistics.jitter_ms,
+                statistics.max_frame_ms);
+  std::snprintf(lines[2], sizeof(lines[2]), "EMU %.2f PRE %.2f", statistics.average_emulate_ms,
+                statistics.average_present_ms);
+  std::snprintf(lines[3], sizeof(lines[3]), "LATE %llu SKIP %llu",
+                static_cast<unsigned long long>(statistics.late_frames),
+                static_cast<unsigned long long>(statistics.skipped_frames));
+
+  constexpr unsigned scale = 3;
+  for (unsigned line = 0; line < 4; line++) {
+    draw_text(pixels, pitch, screen_renderer.width(), screen_renderer.height(), scale * 2,
+              scale * 2 + line * (text_height(scale) + scale * 2), lines[line], scale,
+              Renderer::rgba(0xFFFF00));
+  }
 }
 
-constexpr auto milliseconds_per_frame = std::chrono::milliseconds(1000 / 60);
+void draw(SDL_Renderer *renderer, SDL_Texture *texture, const Renderer &screen_renderer,
+          const std::array<uint8_t, 64 * 32> &graphics, const FramePacer *overlay_pacer) {
+  // Expand straight into the streaming texture
+  void *pixels;
+  int pitch;
+  if (SDL_LockTexture(texture, nullptr, &pixels, &pitch) == 0) {
+    screen_renderer.render(graphics, pixels, static_cast<std::size_t>(pitch));
+    if (overlay_pacer != nullptr) {
+      draw_overlay(pixels, static_cast<std::size_t>(pitch), screen_renderer,
+                   overlay_pacer->statistics());
+    }
+    SDL_UnlockTexture(texture);
+  }
+
+  SDL_RenderCopy(renderer, texture, nullptr, nullptr);
+  SDL_RenderPresent(renderer);
+}
 
 int main(int argc, char **argv) {
   // Check if rom exist
@@ -116,16 +220,82 @@ int main(int argc, char **argv) {
   SDL_Renderer *renderer;
   SDL_CreateWindowAndRenderer(64 * PIXEL_SIZE, 32 * PIXEL_SIZE, 0, &window, &renderer);
 
+  Renderer::Config screen_config;
+  screen_config.scale = PIXEL_SIZE;
+  const Renderer screen_renderer(screen_config);
+  SDL_Texture *texture
+      = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_STREAMING,
+                          screen_renderer.width(), screen_renderer.height());
+
   // Emulator and rom setup
   Emulator emulator;
+  // The emulator is deterministic by default, games get a different random sequence every run
+  emulator.seed(std::random_device()());
 
   std::ifstream rom(argv[1], std::ios::binary);
   emulator.load_rom(rom);
 
+#ifndef _WIN32
+  // With CHIP8_ROM_INDEX=file, from chip8-index, warns about roms this core won't run as intended
+  if (const char *index_path = std::getenv("CHIP8_ROM_INDEX")) {
+    const RomIndex index(index_path);
+    if (const auto info = index.find(emulator.rom_hash())) {
+      if (info->platform != RomPlatform::Chip8) {
+        std::cerr << "Rom made for " << platform_name(info->platform)
+                  << ", only CHIP-8 is supported\n";
+      }
+      if (info->quirks & (ShiftsVY | IncrementsI)) {
+        std::cerr << "Rom relies on COSMAC VIP shifts or FX55/FX65 moving I, which this core "
+                     "doesn't do\n";
+      }
+    }
+  }
+#endif
+
+  // Optional capture of the screen, the format is picked from the extension (.y4m, .rgba, .gif)
+  std::unique_ptr<Capture> capture;
+  if (argc >= 3) {
+    Capture::Config config;
+    config.format = Capture::format_from_path(argv[2]);
+    capture = std::make_unique<Capture>(config, argv[2]);
+    capture->attach(emulator);
+  }
+
+  // With CHIP8_PROFILE=name, writes name.folded (for flamegraph.pl) and name.csv at exit
+  const char *profile_name = std::getenv("CHIP8_PROFILE");
+  std::unique_ptr<Profiler> profiler;
+  if (profile_name != nullptr) {
+    if (Profiler::compiled_in) {
+      profiler = std::make_unique<Profiler>();
+      emulator.set_profiler(profiler.get());
+    } else {
+      std::cerr << "CHIP8_PROFILE ignored, built without CHIP8EMU_PROFILER\n";
+    }
+  }
+
+#ifndef _WIN32
+  // With CHIP8_SHM=/name, every frame is published to that shared memory segment and keys are taken
+  // from it, see SharedExport.h. CHIP8_SHM_RAM=0x300:16,... adds memory regions to the frames.
+  std::unique_ptr<SharedExport> shared;
+  if (const char *shared_name = std::getenv("CHIP8_SHM")) {
+    SharedExport::Config config;
+    config.name = shared_name;
+    config.regions = parse_regions(std::getenv("CHIP8_SHM_RAM"));
+    shared = std::make_unique<SharedExport>(config);
+  }
+#endif
+
+  // F1 toggles the pacing statistics overlay, F2 dumps them to frame_stats.csv
+  FramePacer pacer;
+  bool show_overlay = false;
+
+  // Reported at exit
+  InputLatency input_latency;
+
   SDL_Event event;
   // Emulation loop
   while (true) {
-    auto start_of_frame = std::chrono::system_clock::now();
+    const auto frames = pacer.frames_due();
 
     // Handle quit and key press/release events
     while (SDL_PollEvent(&event)) {
@@ -134,9 +304,17 @@ int main(int argc, char **argv) {
           goto quit;
 
         case SDL_KEYDOWN: {
+          if (event.key.keysym.scancode == SDL_SCANCODE_F1) {
+            show_overlay = !show_overlay;
+          } else if (event.key.keysym.scancode == SDL_SCANCODE_F2) {
+            std::ofstream stats("frame_stats.csv");
+            pacer.dump(stats);
+            std::cerr << "Frame statistics written to frame_stats.csv\n";
+          }
+
           auto key = scancode_to_chip8_key(event.key.keysym.scancode);
           if (key != NO_KEY_MATCHED) {
-            emulator.press_key(key);
+            emulator.press_key(key, event_time_ns(event.key.timestamp));
           }
 
           break;
@@ -153,26 +331,61 @@ int main(int argc, char **argv) {
       }
     }
 
-    try {
-      emulator.emulate_cycle();
-    } catch (std::exception e) {
-      std::cerr << e.what();
-      goto quit;
+#ifndef _WIN32
+    if (shared) {
+      shared->apply_input(emulator);
     }
-
-    if (emulator.should_draw()) {
-      draw(renderer, emulator.get_graphic());
+#endif
+
+    // One cycle per frame, more when catching up on late frames
+    for (unsigned frame = 0; frame < frames; frame++) {
+      if (auto fault = emulator.emulate_cycle()) {
+        std::cerr << "Emulation stopped: " << to_string(fault.kind) << " 0x" << std::hex
+                  << fault.opcode << " at 0x" << fault.pc;
+        goto quit;
+      }
+      input_latency.cycle_done(emulator);
+      if (capture) {
+        capture->end_frame();
+      }
+#ifndef _WIN32
+      if (shared) {
+        shared->publish(emulator);
+      }
+#endif
     }
+    pacer.emulated();
 
-    // Frame cap
-    auto time_elapsed = std::chrono::system_clock::now() - start_of_frame;
-    if (time_elapsed < milliseconds_per_frame) {
-      std::this_thread::sleep_for(milliseconds_per_frame - time_elapsed);
+    // The overlay is redrawn every frame to keep its numbers live
+    if (emulator.should_draw() || show_overlay) {
+      draw(renderer, texture, screen_renderer, emulator.get_graphic(),
+           show_overlay ? &pacer : nullptr);
+      input_latency.presented(emulator, now_ns());
     }
+    pacer.presented();
+
+    pacer.wait();
   }
 
 quit:
+  input_latency.report(std::cerr);
+
+  if (profiler) {
+    std::ofstream folded(std::string(profile_name) + ".folded");
+    profiler->write_folded(folded);
+    std::ofstream heat_map(std::string(profile_name) + ".csv");
+    profiler->write_heat_map(heat_map);
+  }
+
+  if (capture) {
+    capture->finish();
+    if (capture->dropped_frames() > 0) {
+      std::cerr << std::dec << "Capture dropped " << capture->dropped_frames() << " frames\n";
+    }
+  }
+
   // Window cleanup
+  SDL_DestroyTexture(texture);
   SDL_DestroyRenderer(renderer);
   SDL_DestroyWindow(window);
 
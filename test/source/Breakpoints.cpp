@@ -0,0 +1,119 @@
+#include "Breakpoints.h"
+
+#include <doctest/doctest.h>
+
+#include <sstream>
+#include <string>
+
+#include "Emulator.h"
+
+namespace {
+
+// 0x200: 6005  V0 = 5
+// 0x202: A300  I = 0x300
+// 0x204: F055  memory[0x300] = V0
+// 0x206: F065  V0 = memory[0x300]
+// 0x208: D001  draw memory[0x300]
+// 0x20A: 120A  loop forever
+void load_program(Emulator& emulator) {
+  const std::string program{"\x60\x05\xA3\x00\xF0\x55\xF0\x65\xD0\x01\x12\x0A", 12};
+  std::istringstream rom(program);
+  emulator.load_rom(rom);
+}
+
+}  // namespace
+
+TEST_CASE("Breakpoints stop a batched run") {
+  Emulator emulator;
+  Breakpoints breakpoints;
+  load_program(emulator);
+  emulator.set_breakpoints(&breakpoints);
+
+  SUBCASE("Without any breakpoint all cycles are executed") {
+    auto result = emulator.run(100);
+
+    CHECK(result.reason == StopReason::Completed);
+    CHECK(result.cycles == 100);
+  }
+
+  SUBCASE("A program counter breakpoint stops before the instruction with the cycle count") {
+    breakpoints.add_breakpoint(0x204);
+
+    auto result = emulator.run(100);
+
+    CHECK(result.reason == StopReason::Breakpoint);
+    CHECK(result.address == 0x204);
+    CHECK(result.cycles == 2);
+  }
+
+  SUBCASE("A stopped run resumes past its breakpoint") {
+    breakpoints.add_breakpoint(0x20A);
+
+    CHECK(emulator.run(100).cycles == 5);
+
+    auto result = emulator.run(100);
+
+    CHECK(result.reason == StopReason::Breakpoint);
+    CHECK(result.address == 0x20A);
+    CHECK(result.cycles == 1);
+  }
+
+  SUBCASE("A write watchpoint stops before FX55 writes the watched address") {
+    breakpoints.add_write_watchpoint(0x300);
+
+    auto result = emulator.run(100);
+
+    CHECK(result.reason == StopReason::WriteWatchpoint);
+    CHECK(result.address == 0x300);
+    CHECK(result.cycles == 2);
+  }
+
+  SUBCASE("A read watchpoint stops before FX65 and then before DXYN read the watched address") {
+    breakpoints.add_read_watchpoint(0x300);
+
+    auto result = emulator.run(100);
+    CHECK(result.reason == StopReason::ReadWatchpoint);
+    CHECK(result.cycles == 3);
+
+    result = emulator.run(100);
+    CHECK(result.reason == StopReason::ReadWatchpoint);
+    CHECK(result.address == 0x300);
+    CHECK(result.cycles == 1);
+  }
+
+  SUBCASE("Removing the last breakpoint goes back to the plain loop") {
+    breakpoints.add_breakpoint(0x204);
+    CHECK(emulator.has_breakpoints());
+    breakpoints.remove_breakpoint(0x204);
+
+    CHECK(!breakpoints.any());
+    CHECK(!emulator.has_breakpoints());
+    CHECK(emulator.run(100).reason == StopReason::Completed);
+
+    emulator.set_breakpoints(nullptr);
+    CHECK(!emulator.has_breakpoints());
+  }
+}
+
+TEST_CASE("A fault stops a batched run") {
+  Emulator emulator;
+  const std::string program{"\x60\x05\xFF\xFF", 4};
+  std::istringstream rom(program);
+  emulator.load_rom(rom);
+
+  auto result = emulator.run(100);
+
+  CHECK(result.reason == StopReason::Fault);
+  CHECK(result.cycles == 1);
+  CHECK(result.fault.kind == FaultKind::InvalidOpcode);
+  CHECK(result.address == 0x202);
+}
+
+TEST_CASE("Watchpoint ranges wrap around the address space") {
+  Breakpoints breakpoints;
+  breakpoints.add_write_watchpoint(0x001);
+
+  CHECK(breakpoints.find_write_watchpoint(0xFFE, 4) == 0x001);
+  CHECK(breakpoints.find_write_watchpoint(0xFFE, 3) == Breakpoints::no_address);
+  CHECK(breakpoints.find_read_watchpoint(0xFFE, 4) == Breakpoints::no_address);
+}
@@ -0,0 +1,242 @@
+#include "Capture.h"
+
+#include <doctest/doctest.h>
+
+#include <atomic>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Emulator.h"
+
+namespace {
+
+// 0x200: 00E0  clear the screen
+// 0x202: A000  I = font sprite 0
+// 0x204: 6008  V0 = 8
+// 0x206: D005  draw it
+// 0x208: D005  draw it again, erasing it
+// 0x20A: 7001  V0 += 1
+// 0x20C: 1206  start over, one pixel to the right
+const std::vector<uint8_t> moving_sprite{0x00, 0xE0, 0xA0, 0x00, 0x60, 0x08, 0xD0,
+                                         0x05, 0xD0, 0x05, 0x70, 0x01, 0x12, 0x06};
+
+// Frames of a GIF, decoded the way GIF readers do
+struct GifFrame {
+  uint16_t delay;
+  std::vector<uint8_t> indices;
+};
+
+std::vector<uint8_t> decode_lzw(const std::string& gif, std::size_t& position) {
+  const auto min_code_size = static_cast<uint8_t>(gif[position++]);
+  std::string data;
+  while (const auto block_size = static_cast<uint8_t>(gif[position++])) {
+    data += gif.substr(position, block_size);
+    position += block_size;
+  }
+
+  const unsigned clear_code = 1u << min_code_size;
+  std::vector<std::vector<uint8_t>> table;
+  std::vector<uint8_t> output;
+  unsigned code_size = min_code_size + 1;
+  int previous = -1;
+  std::size_t bit = 0;
+  while (bit + code_size <= data.size() * 8) {
+    unsigned code = 0;
+    for (unsigned i = 0; i < code_size; i++, bit++) {
+      code |= ((static_cast<uint8_t>(data[bit / 8]) >> (bit % 8)) & 1) << i;
+    }
+
+    if (code == clear_code) {
+      table.clear();
+      for (unsigned i = 0; i < clear_code + 2; i++) {
+        table.push_back({static_cast<uint8_t>(i)});
+      }
+      code_size = min_code_size + 1;
+      previous = -1;
+      continue;
+    }
+    if (code == clear_code + 1) {
+      break;
+    }
+
+    std::vector<uint8_t> entry;
+    if (code < table.size()) {
+      entry = table[code];
+    } else {
+      entry = table[previous];
+      entry.push_back(table[previous][0]);
+    }
+    if (previous != -1) {
+      if (table.size() < 4096) {
+        auto added = table[previous];
+        added.push_back(entry[0]);
+        table.push_back(added);
+      }
+      if (table.size() >= (1u << code_size) && code_size < 12) {
+        code_size++;
+      }
+    }
+    output.insert(output.end(), entry.begin(), entry.end());
+    previous = static_cast<int>(code);
+  }
+  return output;
+}
+
+std::vector<GifFrame> decode_gif(const std::string& gif) {
+  std::vector<GifFrame> frames;
+  std::size_t position = 13 + 6 + 19;  // Header, color table and loop extension
+  uint16_t delay = 0;
+  while (position < gif.size() && gif[position] != '\x3B') {
+    if (gif[position] == '\x21' && gif[position + 1] == '\xF9') {
+      delay = static_cast<uint8_t>(gif[position + 4])
+              | static_cast<uint8_t>(gif[position + 5]) << 8;
+      position += 8;
+    } else if (gif[position] == '\x2C') {
+      position += 10;
+      frames.push_back({delay, decode_lzw(gif, position)});
+    } else {
+      FAIL("Unexpected GIF block");
+      break;
+    }
+  }
+  return frames;
+}
+
+// Output that can be held up, to stall the writer thread
+class BlockingBuffer : public std::stringbuf {
+public:
+  std::atomic<bool> blocked{true};
+
+protected:
+  std::streamsize xsputn(const char* data, std::streamsize count) override {
+    while (blocked) {
+      std::this_thread::yield();
+    }
+    return std::stringbuf::xsputn(data, count);
+  }
+};
+
+void run_frames(Emulator& emulator, Capture& capture, unsigned frames, uint64_t cycles) {
+  for (unsigned frame = 0; frame < frames; frame++) {
+    emulator.run(cycles);
+    capture.end_frame();
+  }
+}
+
+}  // namespace
+
+TEST_CASE("Capture writes uncompressed video streams") {
+  Emulator emulator;
+  emulator.load_rom(moving_sprite.data(), moving_sprite.size());
+
+  Capture::Config config;
+  config.scale = 2;
+  config.foreground = 0xFF0000;
+  std::ostringstream out;
+
+  SUBCASE("Y4M") {
+    Capture capture(config, out);
+    capture.attach(emulator);
+    run_frames(emulator, capture, 10, 4);
+    capture.finish();
+
+    const auto video = out.str();
+    const std::string header = "YUV4MPEG2 W128 H64 F60:1 Ip A1:1 C444\n";
+    REQUIRE(video.compare(0, header.size(), header) == 0);
+    CHECK(video.size() == header.size() + 10 * (6 + 128 * 64 * 3));
+    CHECK(capture.written_frames() == 10);
+    CHECK(capture.dropped_frames() == 0);
+
+    // First frame: the sprite drawn at (8, 8), the top left of the 0 lit in red
+    const auto frame = header.size();
+    CHECK(video.compare(frame, 6, "FRAME\n") == 0);
+    CHECK(static_cast<uint8_t>(video[frame + 6 + 16 * 128 + 16]) == 82);
+    CHECK(static_cast<uint8_t>(video[frame + 6 + 128 * 64 * 2 + 16 * 128 + 16]) == 240);
+    CHECK(static_cast<uint8_t>(video[frame + 6]) == 16);
+
+    // Second frame: moved to (9, 9)
+    const auto next_frame = frame + 6 + 128 * 64 * 3;
+    CHECK(static_cast<uint8_t>(video[next_frame + 6 + 16 * 128 + 16]) == 16);
+    CHECK(static_cast<uint8_t>(video[next_frame + 6 + 18 * 128 + 18]) == 82);
+  }
+
+  SUBCASE("Raw RGBA") {
+    config.format = Capture::Format::RawRGBA;
+    Capture capture(config, out);
+    capture.attach(emulator);
+    run_frames(emulator, capture, 4, 4);
+    capture.finish();
+
+    const auto video = out.str();
+    REQUIRE(video.size() == 4 * 128 * 64 * 4);
+    const auto pixel = 3 * 128 * 64 * 4 + (22 * 128 + 23) * 4;
+    CHECK(video.substr(pixel, 4) == std::string("\xFF\x00\x00\xFF", 4));
+    CHECK(video.substr(pixel - 128 * 4, 4) == std::string("\x00\x00\x00\xFF", 4));
+  }
+}
+
+TEST_CASE("Capture merges identical frames into GIF frames") {
+  Emulator emulator;
+  emulator.load_rom(moving_sprite.data(), moving_sprite.size());
+
+  Capture::Config config;
+  config.format = Capture::Format::Gif;
+  config.scale = 3;
+  std::ostringstream out;
+  Capture capture(config, out);
+  capture.attach(emulator);
+
+  // One cycle per frame: the screen stays blank for three frames, then every sprite is on screen
+  // for one frame followed by three blank frames
+  run_frames(emulator, capture, 19, 1);
+  capture.finish();
+
+  const auto gif = out.str();
+  REQUIRE(gif.compare(0, 6, "GIF89a") == 0);
+  CHECK(gif.back() == '\x3B');
+
+  const auto frames = decode_gif(gif);
+  REQUIRE(frames.size() == 9);
+  CHECK(capture.written_frames() == 9);
+
+  uint64_t duration = 0;
+  for (const auto& frame : frames) {
+    REQUIRE(frame.indices.size() == 192 * 96);
+    duration += frame.delay;
+  }
+  CHECK(duration == 32);  // 19 frames at 60 fps
+
+  CHECK(frames[0].delay == 5);
+  CHECK(frames[1].delay == 2);
+  CHECK(frames[0].indices[24 * 192 + 24] == 0);
+  CHECK(frames[1].indices[24 * 192 + 24] == 1);
+  CHECK(frames[1].indices[24 * 192 + 36] == 0);
+  CHECK(frames[2].indices[24 * 192 + 24] == 0);
+  CHECK(frames[3].indices[27 * 192 + 27] == 1);
+}
+
+TEST_CASE("Capture drops frames instead of blocking emulation") {
+  Emulator emulator;
+  emulator.load_rom(moving_sprite.data(), moving_sprite.size());
+
+  Capture::Config config;
+  config.format = Capture::Format::RawRGBA;
+  config.scale = 1;
+  config.queue_capacity = 2;
+  BlockingBuffer buffer;
+  std::ostream out(&buffer);
+  Capture capture(config, out);
+  capture.attach(emulator);
+
+  // Every frame changes the screen while the writer is stuck
+  run_frames(emulator, capture, 40, 1);
+  CHECK(capture.dropped_frames() > 0);
+
+  buffer.blocked = false;
+  capture.finish();
+  CHECK(capture.frames() == 40);
+  CHECK(capture.written_frames() == 40);
+  CHECK(buffer.str().size() == 40 * 64 * 32 * 4);
+}
@@ -0,0 +1,273 @@
+#ifndef _WIN32
+
+#include "DebugServer.h"
+
+#include <doctest/doctest.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <sstream>
+#include <string>
+#include <system_error>
+#include <thread>
+
+#include "Emulator.h"
+
+namespace {
+
+#ifdef MSG_NOSIGNAL
+constexpr int send_flags = MSG_NOSIGNAL;
+#else
+constexpr int send_flags = 0;
+#endif
+
+// 0x200: 6005  V0 = 5
+// 0x202: A300  I = 0x300
+// 0x204: F055  memory[0x300] = V0
+// 0x206: F065  V0 = memory[0x300]
+// 0x208: D001  draw memory[0x300]
+// 0x20A: 1200  start over
+const std::string program{"\x60\x05\xA3\x00\xF0\x55\xF0\x65\xD0\x01\x12\x00", 12};
+
+// Runs an emulator through the debug server on a thread of its own, like a frontend would
+class EmulationThread {
+public:
+  explicit EmulationThread(DebugServer& server) {
+    std::istringstream rom(program);
+    emulator.load_rom(rom);
+
+    thread = std::thread([this, &server]() {
+      while (!done) {
+        server.service(emulator, 10);
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+    });
+  }
+  ~EmulationThread() {
+    done = true;
+    thread.join();
+  }
+
+private:
+  Emulator emulator;
+  std::atomic<bool> done{false};
+  std::thread thread;
+};
+
+// Scripted remote protocol client
+class Client {
+public:
+  explicit Client(const std::string& unix_socket_path) {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    std::strcpy(address.sun_path, unix_socket_path.c_str());
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    connected = connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0;
+  }
+  explicit Client(uint16_t tcp_port) {
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(tcp_port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    connected = connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0;
+  }
+  ~Client() { close(fd); }
+
+  std::string request(const std::string& data) {
+    uint8_t checksum = 0;
+    for (auto c : data) {
+      checksum += static_cast<uint8_t>(c);
+    }
+    char trailer[4];
+    std::snprintf(trailer, sizeof(trailer), "#%02x", checksum);
+    const auto packet = "$" + data + trailer;
+    if (send(fd, packet.data(), packet.size(), send_flags) != static_cast<ssize_t>(packet.size())) {
+      return "send failed";
+    }
+
+    // Skip the acknowledgement, then read up to the checksum
+    std::string reply;
+    char c;
+    while (recv(fd, &c, 1, 0) == 1) {
+      if (reply.empty() && c == '+') {
+        continue;
+      }
+      reply += c;
+      if (reply.size() >= 3 && reply[reply.size() - 3] == '#') {
+        send(fd, "+", 1, send_flags);
+        return reply.substr(1, reply.size() - 4);
+      }
+    }
+    return "disconnected";
+  }
+
+  // Sends `bytes` as they are and returns the first byte received back
+  char send_raw(const std::string& bytes) {
+    char c = 0;
+    if (send(fd, bytes.data(), bytes.size(), send_flags) == static_cast<ssize_t>(bytes.size())) {
+      recv(fd, &c, 1, 0);
+    }
+    return c;
+  }
+
+  bool connected = false;
+
+private:
+  int fd = -1;
+};
+
+}  // namespace
+
+TEST_CASE("Debug server serves the remote protocol over a Unix socket") {
+  const auto path = (std::filesystem::temp_directory_path()
+                     / ("chip8-debug-" + std::to_string(getpid()) + ".sock"))
+                        .string();
+  DebugServer server(path);
+  EmulationThread emulation(server);
+
+  Client client(path);
+  REQUIRE(client.connected);
+
+  // Attaching halts the emulator
+  CHECK(client.request("?") == "S05");
+  CHECK(client.request("qSupported:swbreak+") == "PacketSize=1000;qXfer:features:read+");
+
+  // Breakpoint, then continue until it's hit
+  CHECK(client.request("Z0,204,2") == "OK");
+  CHECK(client.request("c") == "S05");
+  CHECK(client.request("p11") == "0402");
+  CHECK(client.request("p10") == "0003");
+  CHECK(client.request("p0") == "05");
+
+  // Step over FX55 and read the memory it wrote
+  CHECK(client.request("s") == "S05");
+  CHECK(client.request("p11") == "0602");
+  CHECK(client.request("m300,2") == "0500");
+
+  // All registers: V0-VF, I, pc, SP and the 16 stack entries
+  const auto registers = client.request("g");
+  CHECK(registers.size() == (16 + 2 + 2 + 1 + 16 * 2) * 2);
+  CHECK(registers.substr(0, 2) == "05");
+  CHECK(registers.substr(32, 8) == "00030602");
+
+  // Watchpoint on the sprite read by DXYN
+  CHECK(client.request("z0,204,2") == "OK");
+  CHECK(client.request("Z3,300,1") == "OK");
+  CHECK(client.request("c") == "S05");
+  CHECK(client.request("p11") == "0802");
+
+  CHECK(client.request("D") == "OK");
+}
+
+TEST_CASE("Debug server serves the remote protocol over loopback TCP") {
+  DebugServer server(static_cast<uint16_t>(0));
+  EmulationThread emulation(server);
+
+  Client client(server.port());
+  REQUIRE(client.connected);
+
+  CHECK(client.request("?") == "S05");
+  CHECK(client.request("s") == "S05");
+  CHECK(client.request("vMustReplyEmpty") == "");
+
+  // A corrupted packet is rejected and the next one is served as usual
+  CHECK(client.send_raw("$?#00") == '-');
+  CHECK(client.send_raw("$?#zz") == '-');
+  CHECK(client.request("?") == "S05");
+
+  // Kill closes the connection without a reply
+  CHECK(client.request("k") == "disconnected");
+}
+
+TEST_CASE("Debug server describes its registers to debuggers") {
+  DebugServer server(static_cast<uint16_t>(0));
+  EmulationThread emulation(server);
+
+  Client client(server.port());
+  REQUIRE(client.connected);
+  CHECK(client.request("?") == "S05");
+
+  // Read in parts like gdb does, until the last one
+  std::string xml;
+  for (;;) {
+    std::ostringstream packet;
+    packet << "qXfer:features:read:target.xml:" << std::hex << xml.size() << ",80";
+    const auto reply = client.request(packet.str());
+    REQUIRE(!reply.empty());
+    REQUIRE((reply[0] == 'm' || reply[0] == 'l'));
+    xml += reply.substr(1);
+    if (reply[0] == 'l') {
+      break;
+    }
+    CHECK(reply.size() == 0x81);
+  }
+
+  // In the order of `p` packets, with their sizes
+  std::size_t position = 0;
+  const auto next_register = [&](const std::string& name, int bits) {
+    const auto found
+        = xml.find("<reg name=\"" + name + "\" bitsize=\"" + std::to_string(bits) + "\"", position);
+    INFO(name);
+    CHECK(found != std::string::npos);
+    position = found == std::string::npos ? position : found;
+  };
+  for (const char* name : {"V0", "V1", "V2", "V3", "V4", "V5", "V6", "V7", "V8", "V9", "VA", "VB",
+                           "VC", "VD", "VE", "VF"}) {
+    next_register(name, 8);
+  }
+  next_register("I", 16);
+  next_register("pc", 16);
+  next_register("SP", 8);
+  for (int level = 0; level < 16; level++) {
+    next_register("stack" + std::to_string(level), 16);
+  }
+  CHECK(xml.rfind("</target>") != std::string::npos);
+
+  CHECK(client.request("qXfer:features:read:target.xml:10000,80") == "l");
+  CHECK(client.request("qXfer:features:read:other.xml:0,80") == "E00");
+  CHECK(client.request("D") == "OK");
+}
+
+TEST_CASE("Debug server only replaces stale sockets") {
+  const auto path = std::filesystem::temp_directory_path()
+                    / ("chip8-debug-file-" + std::to_string(getpid()) + ".sock");
+
+  // Any other file at the path is kept and the server fails to start
+  std::FILE* file = std::fopen(path.string().c_str(), "w");
+  REQUIRE(file != nullptr);
+  std::fputs("not a socket", file);
+  std::fclose(file);
+  try {
+    DebugServer server(path.string());
+    FAIL("A regular file was replaced");
+  } catch (const std::system_error& error) {
+    CHECK(error.code() == std::errc::address_in_use);
+  }
+  CHECK(std::filesystem::is_regular_file(path));
+  std::filesystem::remove(path);
+
+  // A socket left behind is replaced, and removed on shutdown
+  {
+    int stale = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    std::strncpy(address.sun_path, path.string().c_str(), sizeof(address.sun_path) - 1);
+    REQUIRE(bind(stale, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0);
+    close(stale);
+    CHECK(std::filesystem::is_socket(path));
+
+    DebugServer server(path.string());
+    CHECK(std::filesystem::is_socket(path));
+  }
+  CHECK(!std::filesystem::exists(path));
+}
+
+#endif  // _WIN32
@@ -0,0 +1,59 @@
+#include "DeltaCodec.h"
+
+#include <doctest/doctest.h>
+
+#include <array>
+#include <vector>
+
+TEST_CASE("Delta codec round trips XOR + run-length deltas") {
+  std::array<uint8_t, 1000> base{};
+  std::array<uint8_t, 1000> current{};
+  for (std::size_t i = 0; i < base.size(); i++) {
+    base[i] = static_cast<uint8_t>(i * 7);
+  }
+  current = base;
+
+  std::vector<uint8_t> delta;
+
+  SUBCASE("Identical buffers encode to nothing") {
+    delta_encode(base.data(), current.data(), base.size(), delta);
+
+    CHECK(delta.empty());
+  }
+
+  SUBCASE("Scattered changes encode to a few bytes and apply back") {
+    current[0] = 1;
+    current[500] ^= 0xFF;
+    current[501] ^= 0x0F;
+    current[999] = 42;
+
+    delta_encode(base.data(), current.data(), base.size(), delta);
+    CHECK(delta.size() < 20);
+
+    auto target = base;
+    CHECK(delta_apply(delta.data(), delta.size(), target.data(), target.size()));
+    CHECK(target == current);
+
+    // Applying the same delta again goes back to the base
+    CHECK(delta_apply(delta.data(), delta.size(), target.data(), target.size()));
+    CHECK(target == base);
+  }
+
+  SUBCASE("A delta running past the end of the target is rejected") {
+    current[999] = 42;
+    delta_encode(base.data(), current.data(), base.size(), delta);
+
+    std::array<uint8_t, 500> target{};
+    CHECK(!delta_apply(delta.data(), delta.size(), target.data(), target.size()));
+  }
+
+  SUBCASE("A truncated delta is rejected") {
+    current[10] = 1;
+    current[11] = 2;
+    delta_encode(base.data(), current.data(), base.size(), delta);
+    delta.pop_back();
+
+    auto target = base;
+    CHECK(!delta_apply(delta.data(), delta.size(), target.data(), target.size()));
+  }
+}
@@ -4,6 +4,7 @@
 
 #include <istream>
 #include <streambuf>
+#include <vector>
 
 #include "Font.h"
 
@@ -16,7 +17,6 @@ public:
   using Emulator::keys;
   using Emulator::memory;
   using Emulator::pc;
-  using Emulator::rng_distribution;
   using Emulator::rng_engine;
   using Emulator::sound_flag;
   using Emulator::sound_timer;
@@ -99,6 +99,15 @@ TEST_CASE("Emulator can load a rom") {
   CHECK(emulator.memory[0x200 + 1] == 0xE0);
   CHECK(emulator.memory[0x200 + 2] == 0x61);
   CHECK(emulator.memory[0x200 + 3] == 0x04);
+
+  SUBCASE("from memory, ignoring what doesn't fit") {
+    std::vector<uint8_t> image(4096, 0xAB);
+    emulator.load_rom(image.data(), image.size());
+
+    CHECK(emulator.memory[0x200] == 0xAB);
+    CHECK(emulator.memory[0xFFF] == 0xAB);
+    CHECK(emulator.memory[0x1FF] != 0xAB);
+  }
 }
 
 TEST_CASE("Emulator can handle key presses") {
@@ -138,6 +147,73 @@ TEST_CASE("Emulator can handle key presses") {
 
     CHECK(!emulator.keys[1]);
   }
+
+  SUBCASE("Setting all keys from a mask") {
+    emulator.keys[2] = true;
+    emulator.waiting_for_key = true;
+    emulator.waiting_for_key_register = 5;
+
+    emulator.set_keys(1 << 0xA | 1 << 3);
+
+    CHECK(emulator.keys[0xA]);
+    CHECK(emulator.keys[3]);
+    CHECK(!emulator.keys[2]);
+    CHECK(!emulator.waiting_for_key);
+    CHECK(emulator.V[5] == 3);
+  }
+}
+
+TEST_CASE("Emulator follows key presses until the next draw") {
+  // Waits for key 1 with EX9E, then clears the screen
+  const uint8_t rom[] = {0xE1, 0x9E, 0x12, 0x00, 0x00, 0xE0, 0x12, 0x06};
+  Emulator emulator;
+  emulator.load_rom(rom, sizeof(rom));
+  emulator.run(3);
+  REQUIRE(emulator.cycles() == 3);
+  InputLatencySample sample;
+
+  SUBCASE("A press records when it was observed and drawn") {
+    emulator.press_key(1, 42);
+    emulator.run(3);
+
+    REQUIRE(emulator.pop_input_latency(sample));
+    CHECK(sample.timestamp == 42);
+    CHECK(sample.key == 1);
+    CHECK(sample.press_cycle == 3);
+    CHECK(sample.observe_cycle == 4);
+    CHECK(sample.draw_cycle == 5);
+    CHECK(!emulator.pop_input_latency(sample));
+  }
+
+  SUBCASE("A press released before being observed is dropped") {
+    emulator.press_key(1, 42);
+    emulator.release_key(1);
+    emulator.run(10);
+
+    CHECK(!emulator.pop_input_latency(sample));
+  }
+
+  SUBCASE("Presses of other keys are never observed") {
+    emulator.press_key(2, 42);
+    emulator.run(10);
+
+    CHECK(!emulator.pop_input_latency(sample));
+  }
+
+  SUBCASE("FX0A observes the key as it's pressed") {
+    const uint8_t wait_rom[] = {0xF3, 0x0A, 0x00, 0xE0, 0x12, 0x04};
+    emulator.reset();
+    emulator.load_rom(wait_rom, sizeof(wait_rom));
+    emulator.run(5);
+    emulator.press_key(7, 9);
+    emulator.run(1);
+
+    REQUIRE(emulator.pop_input_latency(sample));
+    CHECK(sample.key == 7);
+    CHECK(sample.press_cycle == 5);
+    CHECK(sample.observe_cycle == 5);
+    CHECK(sample.draw_cycle == 5);
+  }
 }
 
 TEST_CASE("Emulator can execute opcodes") {
@@ -487,7 +563,7 @@ TEST_CASE("Emulator can execute opcodes") {
     emulator.V[1] = 1;
 
     emulator.rng_engine.seed(145);
-    auto random = emulator.rng_distribution(emulator.rng_engine);
+    auto random = emulator.rng_engine() >> 24;
     emulator.rng_engine.seed(145);
 
     emulator.execute_opcode(0xC10F);
@@ -816,3 +892,177 @@ TEST_CASE("Emulator has flags") {
     CHECK(!emulator.should_buzz());
   }
 }
+
+TEST_CASE("Emulator reports faults instead of executing them") {
+  EmulatorTest emulator;
+  emulator.pc = 0x300;
+
+  SUBCASE("An unknown opcode is reported as invalid and leaves the program counter untouched") {
+    auto fault = emulator.execute_opcode(0x8128);
+
+    CHECK(fault);
+    CHECK(fault.kind == FaultKind::InvalidOpcode);
+    CHECK(fault.pc == 0x300);
+    CHECK(fault.opcode == 0x8128);
+    CHECK(emulator.pc == 0x300);
+  }
+
+  SUBCASE("Unknown sub-opcodes of every instruction group are reported as invalid") {
+    CHECK(emulator.execute_opcode(0x0123).kind == FaultKind::InvalidOpcode);
+    CHECK(emulator.execute_opcode(0x5121).kind == FaultKind::InvalidOpcode);
+    CHECK(emulator.execute_opcode(0x9121).kind == FaultKind::InvalidOpcode);
+    CHECK(emulator.execute_opcode(0xE1AE).kind == FaultKind::InvalidOpcode);
+    CHECK(emulator.execute_opcode(0xF1FF).kind == FaultKind::InvalidOpcode);
+  }
+
+  SUBCASE("A valid opcode reports no fault") { CHECK(!emulator.execute_opcode(0x6101)); }
+
+  SUBCASE("00EE with an empty stack is a stack underflow") {
+    auto fault = emulator.execute_opcode(0x00EE);
+
+    CHECK(fault.kind == FaultKind::StackUnderflow);
+    CHECK(emulator.pc == 0x300);
+  }
+
+  SUBCASE("2NNN with a full stack is a stack overflow") {
+    for (std::size_t i = 0; i < CallStack::capacity; i++) {
+      CHECK(!emulator.execute_opcode(0x2300));
+    }
+
+    auto fault = emulator.execute_opcode(0x2300);
+
+    CHECK(fault.kind == FaultKind::StackOverflow);
+    CHECK(emulator.stack.size() == CallStack::capacity);
+  }
+
+  SUBCASE("emulate_cycle returns the fault of the fetched opcode without ticking the timers") {
+    emulator.memory[0x300] = 0xFF;
+    emulator.memory[0x301] = 0xFF;
+    emulator.delay_timer = 10;
+
+    auto fault = emulator.emulate_cycle();
+
+    CHECK(fault.kind == FaultKind::InvalidOpcode);
+    CHECK(fault.opcode == 0xFFFF);
+    CHECK(emulator.delay_timer == 10);
+  }
+}
+
+TEST_CASE("Emulator wraps memory accesses around the 4 KB address space") {
+  EmulatorTest emulator;
+  emulator.pc = 10;
+
+  SUBCASE("FX55 past 0xFFF wraps to the start of memory") {
+    emulator.I = 0xFFE;
+    emulator.V[0] = 1;
+    emulator.V[1] = 2;
+    emulator.V[2] = 3;
+
+    emulator.execute_opcode(0xF255);
+
+    CHECK(emulator.memory[0xFFE] == 1);
+    CHECK(emulator.memory[0xFFF] == 2);
+    CHECK(emulator.memory[0x000] == 3);
+  }
+
+  SUBCASE("FX65 with I grown past 0xFFF by FX1E reads the wrapped address") {
+    emulator.I = 0xFFE;
+    emulator.V[0] = 0x10;
+    emulator.memory[0x00E] = 42;
+
+    emulator.execute_opcode(0xF01E);
+    emulator.execute_opcode(0xF065);
+
+    CHECK(emulator.I == 0x100E);
+    CHECK(emulator.V[0] == 42);
+  }
+
+  SUBCASE("FX33 at the end of memory wraps its last digits") {
+    emulator.I = 0xFFF;
+    emulator.V[0] = 254;
+
+    emulator.execute_opcode(0xF033);
+
+    CHECK(emulator.memory[0xFFF] == 2);
+    CHECK(emulator.memory[0x000] == 5);
+    CHECK(emulator.memory[0x001] == 4);
+  }
+
+  SUBCASE("The opcode fetch wraps when the program counter is at 0xFFF") {
+    emulator.pc = 0xFFF;
+    emulator.memory[0xFFF] = 0x61;
+    emulator.memory[0x000] = 0x07;
+
+    CHECK(!emulator.emulate_cycle());
+    CHECK(emulator.V[1] == 0x07);
+  }
+}
+
+namespace {
+
+// Runs a program to its end at compile time, one instruction per cycle
+template <std::size_t size>
+constexpr MachineState run_program(const std::array<uint8_t, size>& program) {
+  return boot(program, size / 2).state();
+}
+
+constexpr Fault execute_alone(uint16_t opcode) {
+  Emulator emulator;
+  return emulator.execute_opcode(opcode);
+}
+
+// V0 = 200, V1 = 100, V0 += V1 (carry), V2 = V0 (44)
+constexpr auto carry
+    = run_program(std::array<uint8_t, 8>{0x60, 0xC8, 0x61, 0x64, 0x80, 0x14, 0x82, 0x00});
+static_assert(carry.V[0] == 44 && carry.V[2] == 44 && carry.V[0xF] == 1);
+
+// V0 = 5, V1 = 10, V0 -= V1 (borrow)
+constexpr auto borrow = run_program(std::array<uint8_t, 6>{0x60, 0x05, 0x61, 0x0A, 0x80, 0x15});
+static_assert(borrow.V[0] == 251 && borrow.V[0xF] == 0);
+
+// V0 = 254, I = 0x300, BCD of V0 at I, read back into V0 to V2
+constexpr auto bcd
+    = run_program(std::array<uint8_t, 8>{0x60, 0xFE, 0xA3, 0x00, 0xF0, 0x33, 0xF2, 0x65});
+static_assert(bcd.memory[0x300] == 2 && bcd.V[0] == 2 && bcd.V[1] == 5 && bcd.V[2] == 4);
+
+// 0x200: call 0x204, 0x202: (never reached), 0x204: V3 = 7, 0x206: return
+constexpr auto call
+    = run_program(std::array<uint8_t, 8>{0x22, 0x04, 0x00, 0x00, 0x63, 0x07, 0x00, 0xEE});
+static_assert(call.V[3] == 7 && call.pc == 0x202 && call.stack.empty());
+
+// Digit 0 of the font drawn twice at (0, 0): set pixels, then erased with a collision
+constexpr auto sprite = run_program(std::array<uint8_t, 4>{0xD0, 0x05, 0xD0, 0x05});
+constexpr auto sprite_once = boot(std::array<uint8_t, 2>{0xD0, 0x05}, 1).state();
+static_assert(sprite_once.graphic[0] == 1 && sprite_once.graphic[4] == 0
+              && sprite_once.V[0xF] == 0);
+static_assert(sprite.graphic[0] == 0 && sprite.V[0xF] == 1);
+
+static_assert(execute_alone(0x8128).kind == FaultKind::InvalidOpcode);
+static_assert(execute_alone(0x00EE).kind == FaultKind::StackUnderflow);
+static_assert(!execute_alone(0x6101));
+
+// A loop counting V0 up to 100 then stopping on itself, as an init sequence would
+constexpr std::array<uint8_t, 8> init_code{0x70, 0x01, 0x30, 0x64, 0x12, 0x00, 0x12, 0x06};
+constexpr auto baked = boot(init_code, 400);
+static_assert(baked.state().V[0] == 100 && baked.state().pc == 0x206);
+
+}  // namespace
+
+TEST_CASE("Emulator runs in constant expressions") {
+  // Everything above is checked by the compiler, this compares with the same runs at run time
+  Emulator emulator;
+  emulator.load_rom(init_code.data(), init_code.size());
+  for (int cycle = 0; cycle < 400; cycle++) {
+    REQUIRE(!emulator.emulate_cycle());
+  }
+
+  std::vector<uint8_t> runtime_state;
+  emulator.save_state(runtime_state);
+  // A session can start from the baked image and carry on as usual
+  Emulator session = baked;
+  std::vector<uint8_t> baked_state;
+  session.save_state(baked_state);
+  CHECK(baked_state == runtime_state);
+  CHECK(session.cycles() == 400);
+  CHECK(!session.emulate_cycle());
+}
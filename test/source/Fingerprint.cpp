@@ -0,0 +1,233 @@
+#include "Fingerprint.h"
+
+#include <doctest/doctest.h>
+
+#include <chrono>
+#include <filesystem>
+#include <unordered_map>
+#include <vector>
+
+#include "Emulator.h"
+#include "Hash.h"
+#include "TestUtilities.h"
+
+namespace {
+
+// Fingerprint of `state` computed from scratch, by an emulator that never ran
+Fingerprint fresh_fingerprint(const MachineState& state) {
+  Emulator emulator;
+  emulator.restore(state);
+  return emulator.fingerprint();
+}
+
+// 200: 6000 A300        V0 = 0, I = 300
+// 204: 7001 F033 F055  count, store its digits and the registers
+// 20A: F029 00E0 D005  draw the digit of V0
+// 210: 1202            and again from I = 300
+const std::vector<uint8_t> counter = {
+    0x60, 0x00, 0xA3, 0x00, 0x70, 0x01, 0xF0, 0x33, 0xF0,
+    0x55, 0xF0, 0x29, 0x00, 0xE0, 0xD0, 0x05, 0x12, 0x02,
+};
+
+}  // namespace
+
+TEST_CASE("Fingerprints are kept up to date as instructions run") {
+  Emulator emulator;
+  emulator.load_rom(counter.data(), counter.size());
+  for (auto i = 0; i < 300; i++) {
+    REQUIRE(!emulator.emulate_cycle());
+    if (i % 37 == 0) {
+      CHECK(emulator.fingerprint() == fresh_fingerprint(emulator.state()));
+    }
+  }
+
+  SUBCASE("After a restore") {
+    Emulator other;
+    other.load_rom(counter.data(), counter.size());
+    for (auto i = 0; i < 50; i++) {
+      REQUIRE(!other.emulate_cycle());
+    }
+    auto state = other.state();
+    state.graphic[5] = 7;  // Not a pixel DXYN draws, but restore() accepts it
+    emulator.restore(state);
+    CHECK(emulator.fingerprint() == fresh_fingerprint(state));
+    for (auto i = 0; i < 50; i++) {
+      REQUIRE(!emulator.emulate_cycle());
+    }
+    CHECK(emulator.fingerprint() == fresh_fingerprint(emulator.state()));
+  }
+
+  SUBCASE("Enabled before running") {
+    Emulator enabled;
+    enabled.enable_fingerprint();
+    enabled.load_rom(counter.data(), counter.size());
+    for (auto i = 0; i < 300; i++) {
+      REQUIRE(!enabled.emulate_cycle());
+    }
+    CHECK(enabled.fingerprint() == emulator.fingerprint());
+  }
+
+  SUBCASE("After a reset") {
+    emulator.reset();
+    CHECK(emulator.fingerprint() == Emulator().fingerprint());
+  }
+}
+
+TEST_CASE("Fingerprints tell states apart") {
+  Emulator emulator;
+  emulator.load_rom(counter.data(), counter.size());
+  const auto initial = emulator.fingerprint();
+
+  Emulator same;
+  same.load_rom(counter.data(), counter.size());
+  CHECK(same.fingerprint() == initial);
+
+  // The cycle count and the draw flag don't decide what happens next
+  auto state = emulator.state();
+  state.draw_flag = true;
+  same.restore(state);
+  CHECK(same.fingerprint() == initial);
+
+  const auto differs = [&](auto change) {
+    auto changed = emulator.state();
+    change(changed);
+    Emulator other;
+    other.restore(changed);
+    return other.fingerprint() != initial;
+  };
+  CHECK(differs([](MachineState& s) { s.memory[0xFFF] = 1; }));
+  CHECK(differs([](MachineState& s) { s.graphic[2047] = 1; }));
+  CHECK(differs([](MachineState& s) { s.V[0xF] = 1; }));
+  CHECK(differs([](MachineState& s) { s.I = 1; }));
+  CHECK(differs([](MachineState& s) { s.pc += 2; }));
+  CHECK(differs([](MachineState& s) { s.stack.push(0x200); }));
+  CHECK(differs([](MachineState& s) { s.delay_timer = 1; }));
+  CHECK(differs([](MachineState& s) { s.keys[3] = true; }));
+  CHECK(differs([](MachineState& s) { s.waiting_for_key = true; }));
+  CHECK(differs([](MachineState& s) { s.rng_engine.seed(1); }));
+
+  // The same value somewhere else
+  CHECK(fingerprint_key(0x300, 1) != fingerprint_key(0x301, 1));
+  CHECK(fingerprint_key(0x300, 1) != fingerprint_key(0x300, 2));
+}
+
+TEST_CASE("Loop detection finds when a program repeats") {
+  SUBCASE("Known sequences") {
+    for (uint64_t tail : {0, 1, 5, 100}) {
+      for (uint64_t length : {1, 2, 3, 17, 64, 1000}) {
+        CAPTURE(tail);
+        CAPTURE(length);
+        LoopDetector detector;
+        uint64_t steps = 0;
+        for (uint64_t i = 0; !detector.add({i < tail ? i : tail + (i - tail) % length, 0}); i++) {
+          steps++;
+          REQUIRE(steps < 3 * (tail + length) + 2);
+        }
+        CHECK(detector.loop_length() == length);
+      }
+    }
+  }
+
+  SUBCASE("A program spinning on itself") {
+    // 200: 6005 7001 3008 1202 1208  count V0 up to 8, then 1208 forever
+    const std::vector<uint8_t> rom = {0x60, 0x05, 0x70, 0x01, 0x30, 0x08, 0x12, 0x02, 0x12, 0x08};
+    Emulator emulator;
+    emulator.load_rom(rom.data(), rom.size());
+    LoopDetector detector;
+    uint64_t cycles = 0;
+    while (!detector.add(emulator.fingerprint())) {
+      REQUIRE(!emulator.emulate_cycle());
+      REQUIRE(++cycles < 100);
+    }
+    CHECK(detector.loop_length() == 1);
+    CHECK(emulator.state().pc == 0x208);
+  }
+
+  SUBCASE("The counter loops with V0") {
+    Emulator emulator;
+    emulator.load_rom(counter.data(), counter.size());
+    LoopDetector detector;
+    uint64_t cycles = 0;
+    while (!detector.add(emulator.fingerprint())) {
+      REQUIRE(!emulator.emulate_cycle());
+      REQUIRE(++cycles < 10000);
+    }
+    // 8 instructions per count, 256 counts
+    CHECK(detector.loop_length() == 8 * 256);
+  }
+}
+
+TEST_CASE("Fingerprints key transposition tables") {
+  // States reached by exploring every key press from the start of a game, each explored once
+  const auto rom = read_rom(CHIP8_ROMS_DIR "/games/Tetris [Fran Dachille, 1991].ch8");
+  REQUIRE(!rom.empty());
+  Emulator start;
+  start.seed(0xC8);
+  start.load_rom(rom.data(), rom.size());
+
+  std::unordered_map<Fingerprint, MachineState, FingerprintHash> seen;
+  std::vector<MachineState> frontier{start.state()};
+  uint64_t explored = 0;
+  for (auto depth = 0; depth < 3; depth++) {
+    std::vector<MachineState> next;
+    for (const auto& state : frontier) {
+      for (uint16_t keys : {0, 1 << 4, 1 << 6, 1 << 0xF}) {
+        Emulator emulator;
+        emulator.restore(state);
+        emulator.set_keys(keys);
+        REQUIRE(!emulator.run(20).fault);
+        emulator.set_keys(0);
+        explored++;
+        if (seen.emplace(emulator.fingerprint(), emulator.state()).second) {
+          next.push_back(emulator.state());
+        }
+      }
+    }
+    frontier = std::move(next);
+  }
+  // Tetris ignores key F, which leads to the same states as pressing nothing
+  CHECK(seen.size() < explored);
+  for (const auto& [fingerprint, state] : seen) {
+    CHECK(fingerprint == fresh_fingerprint(state));
+  }
+}
+
+TEST_CASE("Fingerprint benchmark" * doctest::test_suite("benchmark") * doctest::skip()) {
+  const auto rom = read_rom(CHIP8_ROMS_DIR "/games/Tetris [Fran Dachille, 1991].ch8");
+  REQUIRE(!rom.empty());
+  Emulator emulator;
+  emulator.load_rom(rom.data(), rom.size());
+  REQUIRE(!emulator.run(1000).fault);
+
+  constexpr auto iterations = 100'000;
+  const auto time = [&](auto hash) {
+    uint64_t sink = 0;
+    bool faulted = false;
+    const auto start = std::chrono::steady_clock::now();
+    for (auto i = 0; i < iterations; i++) {
+      faulted |= static_cast<bool>(emulator.emulate_cycle());
+      sink += hash();
+    }
+    const std::chrono::duration<double, std::nano> elapsed
+        = std::chrono::steady_clock::now() - start;
+    CHECK(!faulted);
+    CHECK(sink != 0);
+    return elapsed.count() / iterations;
+  };
+  const auto plain = time([] { return uint64_t{1}; });
+  const auto fingerprinted = time([&] { return emulator.fingerprint().low; });
+  const auto full = time([&] {
+    const auto& state = emulator.state();
+    return fnv1a64(state.memory.data(), state.memory.size())
+           ^ fnv1a64(state.graphic.data(), state.graphic.size());
+  });
+  const auto scratch = time([&] {
+    const auto& state = emulator.state();
+    return (fingerprint_memory(state.memory) ^= fingerprint_screen(state.graphic)).low;
+  });
+  MESSAGE("Fingerprint: " << plain << " ns/cycle alone, " << fingerprinted
+                          << " ns/cycle with fingerprint(), " << scratch
+                          << " ns/cycle fingerprinting from scratch, " << full
+                          << " ns/cycle hashing memory and screen");
+  CHECK(scratch < full);
+}
@@ -0,0 +1,133 @@
+#include "FramePacer.h"
+
+#include <doctest/doctest.h>
+
+#include <sstream>
+#include <string>
+
+using namespace std::chrono_literals;
+
+TEST_CASE("Frame pacer hands out frames on schedule") {
+  FramePacer::Config config;
+  config.frames_per_second = 100;  // 10 ms frames
+  FramePacer pacer(config);
+
+  const auto start = FramePacer::clock::time_point{} + 1s;
+  pacer.start(start);
+
+  SUBCASE("One frame per period") {
+    CHECK(pacer.frames_due(start) == 1);
+    CHECK(pacer.frames_due(start + 5ms) == 0);
+    CHECK(pacer.frames_due(start + 10ms) == 1);
+    CHECK(pacer.frames_due(start + 21ms) == 1);
+    CHECK(pacer.statistics().late_frames == 0);
+  }
+
+  SUBCASE("Catching up on late frames") {
+    CHECK(pacer.frames_due(start) == 1);
+    CHECK(pacer.frames_due(start + 35ms) == 3);
+    CHECK(pacer.frames_due(start + 40ms) == 1);
+    CHECK(pacer.statistics().late_frames == 2);
+
+    // Too late to catch up, the extra frames are skipped and the schedule moves on
+    CHECK(pacer.frames_due(start + 200ms) == 4);
+    CHECK(pacer.statistics().skipped_frames == 12);
+    CHECK(pacer.frames_due(start + 205ms) == 0);
+    CHECK(pacer.frames_due(start + 210ms) == 1);
+  }
+
+  SUBCASE("Skipping late frames") {
+    FramePacer::Config skip = config;
+    skip.policy = FramePacer::Policy::Skip;
+    FramePacer skipping(skip);
+    skipping.start(start);
+
+    CHECK(skipping.frames_due(start) == 1);
+    CHECK(skipping.frames_due(start + 35ms) == 1);
+    CHECK(skipping.statistics().skipped_frames == 2);
+    CHECK(skipping.frames_due(start + 39ms) == 0);
+    CHECK(skipping.frames_due(start + 40ms) == 1);
+  }
+}
+
+TEST_CASE("Frame pacer lines vsync refreshes up with the middle of frame slots") {
+  FramePacer::Config config;
+  config.frames_per_second = 100;
+  config.vsync = true;
+  FramePacer pacer(config);
+
+  const auto start = FramePacer::clock::time_point{} + 1s;
+  pacer.start(start);
+
+  // Refreshes jittering by a millisecond around a 10 ms period still get one frame each
+  CHECK(pacer.frames_due(start) == 1);
+  CHECK(pacer.frames_due(start + 11ms) == 1);
+  CHECK(pacer.frames_due(start + 19ms) == 1);
+  CHECK(pacer.frames_due(start + 31ms) == 1);
+  CHECK(pacer.frames_due(start + 39ms) == 1);
+
+  // While a schedule starting on the first refresh alternates between 0 and 2
+  config.vsync = false;
+  FramePacer unaligned(config);
+  unaligned.start(start);
+  CHECK(unaligned.frames_due(start) == 1);
+  CHECK(unaligned.frames_due(start + 11ms) == 1);
+  CHECK(unaligned.frames_due(start + 19ms) == 0);
+  CHECK(unaligned.frames_due(start + 31ms) == 2);
+}
+
+TEST_CASE("Frame pacer keeps rolling statistics") {
+  FramePacer::Config config;
+  config.frames_per_second = 100;
+  config.statistics_window = 4;
+  FramePacer pacer(config);
+
+  auto now = FramePacer::clock::time_point{} + 1s;
+  pacer.start(now);
+  for (auto frame = 0; frame < 6; frame++) {
+    pacer.frames_due(now);
+    pacer.emulated(now + 1ms);
+    pacer.presented(now + 3ms);
+    // Alternating 8 and 12 ms frames
+    now += frame % 2 == 0 ? 8ms : 12ms;
+  }
+  pacer.frames_due(now);
+
+  const auto statistics = pacer.statistics();
+  CHECK(statistics.frames == 4);
+  CHECK(statistics.average_frame_ms == doctest::Approx(10));
+  CHECK(statistics.jitter_ms == doctest::Approx(2));
+  CHECK(statistics.max_frame_ms == doctest::Approx(12));
+  CHECK(statistics.average_emulate_ms == doctest::Approx(1));
+  CHECK(statistics.average_present_ms == doctest::Approx(2));
+
+  std::ostringstream csv;
+  pacer.dump(csv);
+  std::istringstream lines(csv.str());
+  std::string line;
+  std::getline(lines, line);
+  CHECK(line == "frame_ms,emulate_ms,present_ms,overshoot_ms,frames_emulated");
+  std::getline(lines, line);
+  CHECK(line == "8,1,2,0,2");
+  std::getline(lines, line);
+  CHECK(line == "12,1,2,0,0");
+}
+
+TEST_CASE("Frame pacer waits until the next deadline") {
+  FramePacer::Config config;
+  config.frames_per_second = 250;
+  FramePacer pacer(config);
+
+  const auto start = FramePacer::clock::now();
+  pacer.start(start);
+  for (auto frame = 0; frame < 25; frame++) {
+    pacer.frames_due();
+    pacer.wait();
+  }
+  const auto elapsed = FramePacer::clock::now() - start;
+
+  // 25 frames of 4 ms, never early
+  CHECK(elapsed >= 100ms);
+  CHECK(pacer.statistics().average_overshoot_ms >= 0);
+  MESSAGE("Average wait overshoot " << pacer.statistics().average_overshoot_ms << " ms");
+}
@@ -0,0 +1,246 @@
+#include "Fusion.h"
+
+#include <doctest/doctest.h>
+
+#include <array>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "Emulator.h"
+#include "Translation.h"
+#include "TestUtilities.h"
+
+namespace {
+
+namespace fs = std::filesystem;
+
+// The kinds the first cycles of every rom of the corpus would rather have fused
+std::vector<Superinstruction> profile_corpus(const std::vector<fs::path>& roms) {
+  constexpr uint64_t profile_cycles = 3000;
+  FusionProfile profile;
+  for (const auto& path : roms) {
+    const auto rom = read_rom(path);
+    Emulator emulator;
+    emulator.load_rom(rom.data(), rom.size());
+    for (uint64_t cycle = 0; cycle < profile_cycles && !profile.step(emulator); cycle++) {
+    }
+  }
+  return profile.superinstructions(16);
+}
+
+// Runs `fused` with run() in chunks of varying length and `plain` one cycle at a time, both with
+// the same keys, and checks they stay identical
+void check_same_runs(Emulator& fused, Emulator& plain, uint64_t cycles) {
+  constexpr std::array<uint64_t, 5> chunks{1, 2, 7, 64, 500};
+  for (std::size_t i = 0; plain.cycles() < cycles; i++) {
+    const auto key = static_cast<uint8_t>(i / 4 % 16);
+    for (auto emulator : {&fused, &plain}) {
+      if (i % 4 == 0) {
+        emulator->press_key(key);
+      } else if (i % 4 == 2) {
+        emulator->release_key(key);
+      }
+    }
+
+    const auto result = fused.run(chunks[i % chunks.size()]);
+    Fault fault;
+    for (uint64_t cycle = 0; cycle < chunks[i % chunks.size()] && !fault; cycle++) {
+      fault = plain.emulate_cycle();
+    }
+    REQUIRE(static_cast<bool>(result.fault) == static_cast<bool>(fault));
+    REQUIRE(fused.cycles() == plain.cycles());
+    REQUIRE(saved(fused) == saved(plain));
+    if (fault) {
+      break;
+    }
+  }
+}
+
+// 200: 6005 A300 F055     V0 = 5, save it at 300 (ANNN FX55)
+// 206: 6004 6101 A000 D015  draw the font's 0 at (4, 1) (DrawAt)
+// 20E: 601E F015          delay timer = 30
+// 212: F007 3000 1212     poll the timer (TimerPoll)
+// 218: 6203 72FF 3200 121A  count V2 down to 0 (7XNN 3XNN)
+// 220: A300 F065 1200    restore V0 (ANNN FX65) and start over
+const std::vector<uint8_t> idioms = {
+    0x60, 0x05, 0xA3, 0x00, 0xF0, 0x55,              // 200
+    0x60, 0x04, 0x61, 0x01, 0xA0, 0x00, 0xD0, 0x15,  // 206
+    0x60, 0x1E, 0xF0, 0x15,                          // 20E
+    0xF0, 0x07, 0x30, 0x00, 0x12, 0x12,              // 212
+    0x62, 0x03, 0x72, 0xFF, 0x32, 0x00, 0x12, 0x1A,  // 218
+    0xA3, 0x00, 0xF0, 0x65, 0x12, 0x00,              // 220
+};
+
+}  // namespace
+
+TEST_CASE("Translations fuse the built-in idioms") {
+  Translation translation;
+  translate(idioms.data(), idioms.size(), translation);
+
+  const auto kind = [&](uint16_t address) {
+    REQUIRE(translation.fused[address] != 0);
+    return translation.superinstructions[translation.fused[address] - 1].kind;
+  };
+  CHECK(kind(0x202) == FusionKind::SaveAt);
+  CHECK(kind(0x206) == FusionKind::DrawAt);
+  CHECK(kind(0x212) == FusionKind::TimerPoll);
+  CHECK(kind(0x21A) == FusionKind::CountLoop);
+  CHECK(kind(0x21C) == FusionKind::SkipJump);  // The skip lands here when V2 isn't 0 yet
+  CHECK(kind(0x220) == FusionKind::LoadAt);
+  CHECK(translation.fused[0x200] == 0);
+
+  // Fusing the same ones again adds nothing
+  const auto count = translation.superinstruction_count;
+  CHECK(fuse(translation, corpus_superinstructions()) == 0);
+  CHECK(fuse(translation, builtin_superinstructions()) == 0);
+  CHECK(translation.superinstruction_count == count);
+
+  // Sequences without a handler of their kind aren't fused
+  auto unhandled = make_superinstruction(FusionKind::SaveAt);
+  unhandled.operations[1] = Operation::IFX65;
+  Translation other;
+  translate(idioms.data(), idioms.size(), other);
+  CHECK(fuse(other, {unhandled}) == 0);
+}
+
+TEST_CASE("Every kind of superinstruction has a name") {
+  CHECK(std::string(to_string(FusionKind::DrawAt)) == "DrawAt");
+  CHECK(std::string(to_string(FusionKind::DrawSkip)) == "DrawSkip");
+}
+
+TEST_CASE("Superinstructions keep the semantics of the instructions they fuse") {
+  Translation translation;
+  translate(idioms.data(), idioms.size(), translation);
+
+  Emulator fused;
+  Emulator plain;
+  for (auto emulator : {&fused, &plain}) {
+    emulator->load_rom(idioms.data(), idioms.size());
+  }
+  fused.set_translation(&translation);
+  check_same_runs(fused, plain, 2000);
+
+  const auto& stats = fused.fusion_statistics();
+  CHECK(stats.superinstructions > 0);
+  // The timer poll alone spins for 30 frames at each pass
+  CHECK(stats.instructions > 2 * stats.superinstructions);
+
+  SUBCASE("Modified code is no longer fused") {
+    auto state = fused.state();
+    state.memory[0x215] = 0x02;  // 3002: the poll now stops when it reads 2 from the timer
+    state.pc = 0x20E;
+    fused.restore(state);
+    plain.restore(state);
+    const auto before = fused.fusion_statistics().superinstructions;
+    check_same_runs(fused, plain, plain.cycles() + 200);
+    CHECK(fused.fusion_statistics().superinstructions > before);  // The others still are
+  }
+}
+
+TEST_CASE("Fusion profiles count the sequences executed") {
+  Emulator emulator;
+  emulator.load_rom(idioms.data(), idioms.size());
+  FusionProfile profile;
+  for (auto i = 0; i < 500; i++) {
+    REQUIRE(!profile.step(emulator));
+  }
+
+  // The timer poll runs the most, once per frame
+  const auto superinstructions = profile.superinstructions(3);
+  REQUIRE(superinstructions.size() == 3);
+  CHECK(superinstructions[0].length >= 2);
+  CHECK(superinstructions[0].operations[0] != Operation::Invalid);
+
+  std::ostringstream out;
+  profile.write(out);
+  CHECK(out.str().find("FX07 3XNN 1NNN ") != std::string::npos);
+}
+
+// The profile translate() fuses is checked in as source/CorpusFusion.inc. Set the
+// CHIP8_UPDATE_FUSION_PROFILE environment variable to rewrite it from the corpus.
+TEST_CASE("The corpus fusion profile is up to date") {
+  const auto profiled = profile_corpus(corpus_files());
+  REQUIRE(!profiled.empty());
+
+  if (std::getenv("CHIP8_UPDATE_FUSION_PROFILE") != nullptr) {
+    std::ofstream out(CHIP8_FUSION_PROFILE_FILE);
+    out << "// Generated by test/source/Fusion.cpp, most dispatches saved first\n";
+    for (const auto& superinstruction : profiled) {
+      out << "FusionKind::" << to_string(superinstruction.kind) << ",\n";
+    }
+    REQUIRE(out);
+    MESSAGE("Fusion profile updated: " << CHIP8_FUSION_PROFILE_FILE);
+    return;
+  }
+
+  const auto& checked_in = corpus_superinstructions();
+  REQUIRE(checked_in.size() == profiled.size());
+  for (std::size_t i = 0; i < profiled.size(); i++) {
+    CHECK(to_string(checked_in[i].kind) == std::string(to_string(profiled[i].kind)));
+  }
+}
+
+TEST_CASE("Fusing the profile of the corpus keeps every rom identical") {
+  constexpr uint64_t checked_cycles = 6000;
+  const auto roms = corpus_files();
+  REQUIRE(!roms.empty());
+
+  FusionStatistics total;
+  uint64_t cycles = 0;
+  for (const auto& path : roms) {
+    CAPTURE(path.filename().string());
+    const auto rom = read_rom(path);
+    auto translation = std::make_unique<Translation>();
+    translate(rom.data(), rom.size(), *translation);
+
+    Emulator fused;
+    Emulator plain;
+    for (auto emulator : {&fused, &plain}) {
+      emulator->seed(0xC8C8);
+      emulator->load_rom(rom.data(), rom.size());
+    }
+    fused.set_translation(translation.get());
+    check_same_runs(fused, plain, checked_cycles);
+
+    total.superinstructions += fused.fusion_statistics().superinstructions;
+    total.instructions += fused.fusion_statistics().instructions;
+    cycles += fused.cycles();
+  }
+
+  CHECK(total.instructions > 0);
+  MESSAGE("Fusion: " << total.instructions << " of " << cycles << " instructions fused ("
+                     << 100.0 * total.instructions / cycles << "%) in "
+                     << total.superinstructions << " superinstructions");
+}
+
+TEST_CASE("Fusion benchmark" * doctest::test_suite("benchmark") * doctest::skip()) {
+  const auto rom = read_rom(CHIP8_ROMS_DIR "/games/Tetris [Fran Dachille, 1991].ch8");
+  REQUIRE(!rom.empty());
+  constexpr uint64_t cycles = 2'000'000;
+
+  auto fused = std::make_unique<Translation>();
+  translate(rom.data(), rom.size(), *fused);
+  auto unfused = std::make_unique<Translation>(*fused);
+  unfused->fused = {};
+
+  const auto time = [&](const Translation& translation) {
+    Emulator emulator;
+    emulator.load_rom(rom.data(), rom.size());
+    emulator.set_translation(&translation);
+    const auto start = std::chrono::steady_clock::now();
+    emulator.run(cycles);
+    const std::chrono::duration<double, std::nano> elapsed
+        = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / cycles;
+  };
+  const auto plain = time(*unfused);
+  const auto superinstructions = time(*fused);
+  MESSAGE("Fusion: " << plain << " ns/cycle translated, " << superinstructions
+                     << " ns/cycle with superinstructions");
+}
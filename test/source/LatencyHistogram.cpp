@@ -0,0 +1,66 @@
+#include "LatencyHistogram.h"
+
+#include <doctest/doctest.h>
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+TEST_CASE("LatencyHistogram is empty at first") {
+  LatencyHistogram histogram;
+  CHECK(histogram.count() == 0);
+  CHECK(histogram.max() == 0);
+  CHECK(histogram.mean() == 0);
+  CHECK(histogram.percentile(50) == 0);
+}
+
+TEST_CASE("LatencyHistogram keeps small values exact") {
+  LatencyHistogram histogram;
+  for (uint64_t value = 1; value <= 10; value++) {
+    histogram.record(value);
+  }
+
+  CHECK(histogram.count() == 10);
+  CHECK(histogram.max() == 10);
+  CHECK(histogram.mean() == doctest::Approx(5.5));
+  CHECK(histogram.percentile(0) == 1);
+  CHECK(histogram.percentile(50) == 5);
+  CHECK(histogram.percentile(90) == 9);
+  CHECK(histogram.percentile(100) == 10);
+
+  histogram.clear();
+  CHECK(histogram.count() == 0);
+  CHECK(histogram.percentile(50) == 0);
+}
+
+TEST_CASE("LatencyHistogram percentiles stay within a bucket of the exact value") {
+  std::mt19937_64 random(7);
+  std::lognormal_distribution<double> distribution(9, 1.5);
+  std::vector<uint64_t> values;
+  LatencyHistogram histogram;
+  for (auto i = 0; i < 20000; i++) {
+    const auto value = static_cast<uint64_t>(distribution(random));
+    values.push_back(value);
+    histogram.record(value);
+  }
+  std::sort(values.begin(), values.end());
+
+  CHECK(histogram.max() == values.back());
+  for (auto percentile : {1.0, 25.0, 50.0, 90.0, 99.0, 99.9}) {
+    const auto exact = values[static_cast<std::size_t>(percentile / 100 * values.size()) - 1];
+    const auto estimate = histogram.percentile(percentile);
+    INFO("p" << percentile << ": " << estimate << " for " << exact);
+    CHECK(estimate >= exact);
+    CHECK(estimate <= exact + exact / 16 + 1);
+  }
+}
+
+TEST_CASE("LatencyHistogram handles the full 64-bit range") {
+  LatencyHistogram histogram;
+  histogram.record(UINT64_MAX);
+  histogram.record(uint64_t{1} << 40);
+
+  CHECK(histogram.percentile(50) >= uint64_t{1} << 40);
+  CHECK(histogram.percentile(50) < (uint64_t{1} << 40) + (uint64_t{1} << 36));
+  CHECK(histogram.percentile(100) == UINT64_MAX);
+}
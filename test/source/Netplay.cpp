@@ -0,0 +1,253 @@
+#include "Netplay.h"
+
+#include <doctest/doctest.h>
+
+#include <chrono>
+#include <deque>
+#include <thread>
+#include <vector>
+
+#include "Emulator.h"
+#include "NetplaySocket.h"
+#include "Rng.h"
+#include "TestUtilities.h"
+
+namespace {
+
+const char* const pong = CHIP8_ROMS_DIR "/games/Pong [Paul Vervalin, 1990].ch8";
+
+// Keys held by `player` in `frame`, changing every few frames
+uint16_t scripted_keys(uint8_t player, uint32_t frame) {
+  return static_cast<uint16_t>(SplitMix64(player * 1000003u + frame / 7).next64());
+}
+
+// Both players' keys applied in lockstep, what rollback must end up with
+std::vector<uint8_t> lockstep(const std::vector<uint8_t>& rom, const Netplay::Config& config,
+                              uint32_t frames) {
+  Emulator emulator;
+  emulator.load_rom(rom.data(), rom.size());
+  for (uint32_t frame = 0; frame < frames; frame++) {
+    emulator.set_keys((scripted_keys(0, frame) & config.player_keys[0])
+                      | (scripted_keys(1, frame) & config.player_keys[1]));
+    emulator.emulate_cycle();
+  }
+  return saved(emulator);
+}
+
+// Datagrams between the two peers, delayed by a number of ticks and dropped at random
+class Link {
+public:
+  Link(unsigned delay, unsigned loss_percent) : delay(delay), loss_percent(loss_percent) {}
+
+  void send(const Netplay& from, uint64_t tick) {
+    std::vector<uint8_t> packet;
+    from.write_packet(packet);
+    if (random.next64() % 100 >= loss_percent) {
+      in_flight.push_back({tick + delay + random.next64() % 3, packet});
+    }
+  }
+
+  void deliver(Netplay& to, uint64_t tick) {
+    for (auto entry = in_flight.begin(); entry != in_flight.end();) {
+      if (entry->first <= tick) {
+        CHECK(to.read_packet(entry->second.data(), entry->second.size()));
+        entry = in_flight.erase(entry);
+      } else {
+        entry++;
+      }
+    }
+  }
+
+private:
+  unsigned delay;
+  unsigned loss_percent;
+  SplitMix64 random{42};
+  std::deque<std::pair<uint64_t, std::vector<uint8_t>>> in_flight;
+};
+
+}  // namespace
+
+TEST_CASE("Rollback netplay converges to the lockstep run") {
+  const auto rom = read_rom(pong);
+  REQUIRE(!rom.empty());
+  constexpr uint32_t frames = 2000;
+
+  Netplay::Config configs[2];
+  configs[1].player = 1;
+  Emulator emulators[2];
+  std::vector<Netplay> peers;
+  peers.reserve(2);
+  for (uint8_t player = 0; player < 2; player++) {
+    emulators[player].load_rom(rom.data(), rom.size());
+    peers.emplace_back(emulators[player], configs[player]);
+  }
+
+  unsigned delay = 0;
+  unsigned loss = 0;
+  SUBCASE("Perfect link") {}
+  SUBCASE("Latency") { delay = 4; }
+  SUBCASE("Latency and loss") {
+    delay = 3;
+    loss = 30;
+  }
+  Link links[2] = {{delay, loss}, {delay, loss}};  // From player 0, from player 1
+
+  uint64_t tick = 0;
+  while (peers[0].confirmed_frame() < frames || peers[1].confirmed_frame() < frames) {
+    REQUIRE(tick < frames * 4);
+    for (uint8_t player = 0; player < 2; player++) {
+      auto& peer = peers[player];
+      links[1 - player].deliver(peer, tick);
+      if (peer.frame() < frames) {
+        peer.advance(scripted_keys(player, peer.frame()));
+      }
+      links[player].send(peer, tick);
+    }
+    tick++;
+  }
+  peers[0].synchronize();
+  peers[1].synchronize();
+
+  const auto expected = lockstep(rom, configs[0], frames);
+  CHECK(saved(emulators[0]) == expected);
+  CHECK(saved(emulators[1]) == expected);
+  for (const auto& peer : peers) {
+    CHECK(peer.statistics().max_rollback <= configs[0].max_rollback);
+    CHECK(peer.statistics().rollbacks > 0);
+  }
+}
+
+TEST_CASE("Rollback netplay stalls past the rollback window") {
+  Emulator emulator;
+  Netplay::Config config;
+  config.max_rollback = 4;
+  Netplay netplay(emulator, config);
+
+  for (int frame = 0; frame < 4; frame++) {
+    CHECK(netplay.advance(0));
+  }
+  CHECK(!netplay.advance(0));
+  CHECK(netplay.statistics().stalls == 1);
+  CHECK(netplay.frame() == 4);
+
+  // The remote inputs of the first frame let it go one frame further
+  Emulator remote_emulator;
+  Netplay::Config remote_config;
+  remote_config.player = 1;
+  Netplay remote(remote_emulator, remote_config);
+  REQUIRE(remote.advance(0));
+  std::vector<uint8_t> packet;
+  remote.write_packet(packet);
+  CHECK(netplay.read_packet(packet.data(), packet.size()));
+  CHECK(netplay.confirmed_frame() == 1);
+  CHECK(netplay.advance(0));
+  CHECK(!netplay.advance(0));
+}
+
+TEST_CASE("Rollback netplay refuses malformed packets") {
+  Emulator emulator;
+  Netplay netplay(emulator, Netplay::Config{});
+  std::vector<uint8_t> packet;
+  netplay.write_packet(packet);
+  CHECK(netplay.read_packet(packet.data(), packet.size()));
+
+  packet[0] = Netplay::packet_version + 1;
+  CHECK(!netplay.read_packet(packet.data(), packet.size()));
+  packet[0] = Netplay::packet_version;
+  packet[5] = 3;  // More inputs than the packet holds
+  CHECK(!netplay.read_packet(packet.data(), packet.size()));
+  CHECK(!netplay.read_packet(packet.data(), 4));
+}
+
+TEST_CASE("Benchmark: rollback re-simulation" * doctest::test_suite("benchmark")
+          * doctest::skip()) {
+  const auto rom = read_rom(pong);
+  Emulator emulator;
+  emulator.load_rom(rom.data(), rom.size());
+  Netplay::Config config;
+  Netplay netplay(emulator, config);
+
+  // The remote player holds a key every frame, while the prediction says they hold nothing
+  Emulator remote_emulator;
+  Netplay::Config remote_config;
+  remote_config.player = 1;
+  Netplay remote(remote_emulator, remote_config);
+
+  constexpr int rounds = 2000;
+  std::vector<uint8_t> packet;
+  double seconds = 0;
+  for (int round = 0; round < rounds; round++) {
+    for (std::size_t frame = 0; frame < config.max_rollback - 1; frame++) {
+      REQUIRE(netplay.advance(0));
+      REQUIRE(remote.advance(round % 2 == 0 ? 0xF000 : 0));
+    }
+    packet.clear();
+    remote.write_packet(packet);
+    netplay.read_packet(packet.data(), packet.size());
+    packet.clear();
+    netplay.write_packet(packet);
+    remote.read_packet(packet.data(), packet.size());
+
+    const auto start = std::chrono::steady_clock::now();
+    netplay.synchronize();
+    seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    remote.synchronize();
+  }
+  CHECK(netplay.statistics().rollbacks == rounds);
+  MESSAGE("Rollback of " << config.max_rollback - 1 << " frames: " << seconds / rounds * 1e6
+                         << " us");
+}
+
+#ifndef _WIN32
+
+TEST_CASE("Rollback netplay over loopback UDP") {
+  const auto rom = read_rom(pong);
+  REQUIRE(!rom.empty());
+  constexpr uint32_t frames = 300;
+
+  // Both sockets bind any free port, so parallel test runs don't collide
+  Netplay::Config configs[2];
+  configs[1].player = 1;
+  NetplaySocket::Config socket_configs[2];
+  for (int player = 0; player < 2; player++) {
+    socket_configs[player].delay_ms = 5;
+    socket_configs[player].jitter_ms = 3;
+    socket_configs[player].loss = 0.2;
+    socket_configs[player].seed = player + 1;
+  }
+
+  Emulator emulators[2];
+  std::vector<Netplay> peers;
+  peers.reserve(2);
+  for (uint8_t player = 0; player < 2; player++) {
+    emulators[player].load_rom(rom.data(), rom.size());
+    peers.emplace_back(emulators[player], configs[player]);
+  }
+  NetplaySocket sockets[2] = {NetplaySocket(socket_configs[0]), NetplaySocket(socket_configs[1])};
+  REQUIRE(sockets[0].local_port() != 0);
+  REQUIRE(sockets[1].local_port() != 0);
+  sockets[0].set_remote_port(sockets[1].local_port());
+  sockets[1].set_remote_port(sockets[0].local_port());
+
+  const auto give_up = std::chrono::steady_clock::now() + std::chrono::seconds(20);
+  while (peers[0].confirmed_frame() < frames || peers[1].confirmed_frame() < frames) {
+    REQUIRE(std::chrono::steady_clock::now() < give_up);
+    for (uint8_t player = 0; player < 2; player++) {
+      sockets[player].poll(peers[player]);
+      if (peers[player].frame() < frames) {
+        peers[player].advance(scripted_keys(player, peers[player].frame()));
+      }
+      sockets[player].send(peers[player]);
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  peers[0].synchronize();
+  peers[1].synchronize();
+
+  const auto expected = lockstep(rom, configs[0], frames);
+  CHECK(saved(emulators[0]) == expected);
+  CHECK(saved(emulators[1]) == expected);
+  CHECK(sockets[0].statistics().dropped > 0);
+}
+
+#endif  // _WIN32
@@ -0,0 +1,108 @@
+#include "Profiler.h"
+
+#include <doctest/doctest.h>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+
+#include "Emulator.h"
+
+TEST_CASE("Profiler folds call stacks") {
+  Profiler profiler;
+  // main calls 300 twice, 300 calls 400 once
+  profiler.record(0x200, decode(0x6001));
+  profiler.record(0x202, decode(0x2300));
+  profiler.record(0x300, decode(0x2400));
+  profiler.record(0x400, decode(0x7001));
+  profiler.record(0x402, decode(0x00EE));
+  profiler.record(0x302, decode(0x00EE));
+  profiler.record(0x204, decode(0x2300));
+  profiler.record(0x300, decode(0x7001));
+  profiler.record(0x302, decode(0x00EE));
+  // Return without a recorded call
+  profiler.record(0x206, decode(0x00EE));
+  profiler.record(0x208, decode(0x1208));
+
+  CHECK(profiler.instructions() == 11);
+  CHECK(profiler.heat()[0x300] == 2);
+  CHECK(profiler.heat()[0x302] == 2);
+  CHECK(profiler.heat()[0x400] == 1);
+
+  std::ostringstream folded;
+  profiler.write_folded(folded);
+  CHECK(folded.str() == "main 5\nmain;sub_300 4\nmain;sub_300;sub_400 2\n");
+
+  std::ostringstream heat_map;
+  profiler.write_heat_map(heat_map);
+  CHECK(heat_map.str().rfind("address,count,percent\n0x200,1,9.091\n0x202,1,9.091\n", 0) == 0);
+
+  profiler.clear();
+  CHECK(profiler.instructions() == 0);
+  std::ostringstream empty;
+  profiler.write_folded(empty);
+  CHECK(empty.str().empty());
+}
+
+#ifdef CHIP8_PROFILER
+
+TEST_CASE("Emulators report executed instructions to their profiler") {
+  // 200: 2206  call 206
+  // 202: 1202  jump 202
+  // 206: 7001  V0 += 1
+  // 208: 00EE  return
+  const uint8_t rom[] = {0x22, 0x06, 0x12, 0x02, 0x00, 0x00, 0x70, 0x01, 0x00, 0xEE};
+  Emulator emulator;
+  emulator.load_rom(rom, sizeof(rom));
+  Profiler profiler;
+  emulator.set_profiler(&profiler);
+
+  emulator.run(13);
+  CHECK(profiler.instructions() == 13);
+  CHECK(profiler.heat()[0x202] == 10);
+
+  std::ostringstream folded;
+  profiler.write_folded(folded);
+  CHECK(folded.str() == "main 11\nmain;sub_206 2\n");
+
+  // Detached, nothing more is counted
+  emulator.set_profiler(nullptr);
+  emulator.run(10);
+  CHECK(profiler.instructions() == 13);
+}
+
+// Timing is only meaningful on an optimized build of a quiet machine, hence the benchmark suite
+TEST_CASE("Profiler overhead" * doctest::test_suite("benchmark") * doctest::skip()) {
+  std::ifstream rom(CHIP8_ROMS_DIR "/demos/Particle Demo [zeroZshadow, 2008].ch8",
+                    std::ios::binary);
+  Emulator emulator;
+  emulator.load_rom(rom);
+  const auto initial = emulator.state();
+  Profiler profiler;
+
+  constexpr uint64_t cycles = 2000000;
+  const auto measure = [&](Profiler* attached) {
+    emulator.restore(initial);
+    emulator.set_profiler(attached);
+    const auto start = std::chrono::steady_clock::now();
+    emulator.run(cycles);
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start)
+        .count();
+  };
+  // Best of a few runs each, so a preempted run doesn't count
+  measure(nullptr);
+  auto plain = measure(nullptr);
+  auto profiled = measure(&profiler);
+  for (auto run = 0; run < 4; run++) {
+    plain = std::min(plain, measure(nullptr));
+    profiled = std::min(profiled, measure(&profiler));
+  }
+
+  MESSAGE("Profiler overhead: " << plain << " ms without, " << profiled << " ms with, "
+                                << (profiled / plain - 1) * 100 << "%");
+  CHECK(profiler.instructions() > 0);
+  CHECK(profiled < plain * 1.1);
+}
+
+#endif  // CHIP8_PROFILER
@@ -0,0 +1,170 @@
+#include "Recompiler.h"
+
+#include <doctest/doctest.h>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <filesystem>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "Emulator.h"
+#include "Hash.h"
+#include "TestUtilities.h"
+
+namespace {
+
+std::size_t count(const std::string& text, const std::string& pattern) {
+  std::size_t found = 0;
+  for (auto position = text.find(pattern); position != std::string::npos;
+       position = text.find(pattern, position + 1)) {
+    found++;
+  }
+  return found;
+}
+
+}  // namespace
+
+TEST_CASE("Recompiling emits one program per distinct rom") {
+  const std::vector<uint8_t> pong = {0x60, 0x05, 0x12, 0x00};
+  const std::vector<uint8_t> other = {0x00, 0xE0, 0x12, 0x00};
+  std::ostringstream out;
+  const auto stats = recompile({{"pong", pong}, {"pong copy", pong}, {"other", other}}, out);
+
+  CHECK(stats.programs == 2);
+  const auto source = out.str();
+  CHECK(count(source, "template <> struct NativeCode<") == 2);
+  CHECK(count(source, "\"pong\"") == 2);
+  CHECK(count(source, "\"pong copy\"") == 0);
+  CHECK(count(source, "register_native_programs(native_programs, 2)") == 1);
+}
+
+TEST_CASE("Recompiled blocks end at control flow and memory writes") {
+  // 6005 A300 F033 1200: the BCD write ends the first block, the jump is a block of its own
+  const std::vector<uint8_t> rom = {0x60, 0x05, 0xA3, 0x00, 0xF0, 0x33, 0x12, 0x00};
+  std::ostringstream out;
+  const auto stats = recompile({{"bcd", rom}}, out);
+
+  CHECK(stats.blocks == 2);
+  CHECK(stats.instructions == 4);
+  const auto source = out.str();
+  CHECK(count(source, "block_200:") == 1);
+  CHECK(count(source, "block_206:") == 1);
+  CHECK(count(source, "e.instruction_FX33(0x0);") == 1);
+  CHECK(count(source, "goto block_200;") == 2);  // From the dispatcher and the jump
+}
+
+#ifdef CHIP8_RECOMPILED_GAMES
+
+namespace {
+
+namespace fs = std::filesystem;
+
+}  // namespace
+
+TEST_CASE("Recompiled games run like the interpreter") {
+  // Runs of varying length, so blocks get cut at every point by the end of a run
+  constexpr std::array<uint64_t, 6> chunks{1, 3, 17, 60, 250, 1000};
+
+  // CHIP8_RECOMPILED_GAMES is the number of games built in, all of them or only a few
+  int recompiled = 0;
+  for (const auto& entry : fs::directory_iterator(CHIP8_ROMS_DIR "/games")) {
+    if (entry.path().extension() != ".ch8") {
+      continue;
+    }
+    const auto rom = read_rom(entry.path());
+    CAPTURE(entry.path().filename().string());
+    const auto program = find_native_program(fnv1a64(rom.data(), rom.size()));
+    if (program == nullptr) {
+      continue;
+    }
+    recompiled++;
+
+    Emulator interpreted;
+    Emulator native;
+    for (auto emulator : {&interpreted, &native}) {
+      emulator->seed(0xC8C8);
+      emulator->load_rom(rom.data(), rom.size());
+    }
+    native.set_native_program(program);
+
+    for (std::size_t i = 0; interpreted.cycles() < 20000; i++) {
+      // Every key in turn, held for 4 runs out of 8
+      const auto key = static_cast<uint8_t>(i / 8 % 16);
+      for (auto emulator : {&interpreted, &native}) {
+        if (i % 8 == 0) {
+          emulator->press_key(key);
+        } else if (i % 8 == 4) {
+          emulator->release_key(key);
+        }
+      }
+
+      const auto cycles = chunks[i % chunks.size()];
+      const auto expected = interpreted.run(cycles);
+      const auto result = native.run(cycles);
+      REQUIRE(result.reason == expected.reason);
+      REQUIRE(result.cycles == expected.cycles);
+      REQUIRE(native.cycles() == interpreted.cycles());
+      REQUIRE(saved(native) == saved(interpreted));
+      if (expected.reason == StopReason::Fault) {
+        CHECK(result.fault.pc == expected.fault.pc);
+        break;
+      }
+    }
+  }
+  CHECK(recompiled == CHIP8_RECOMPILED_GAMES);
+}
+
+TEST_CASE("Recompiled games fall back to the interpreter for modified code") {
+  const auto rom = read_rom(CHIP8_ROMS_DIR "/games/Pong [Paul Vervalin, 1990].ch8");
+  REQUIRE(!rom.empty());
+  Emulator interpreted;
+  Emulator native;
+  for (auto emulator : {&interpreted, &native}) {
+    emulator->load_rom(rom.data(), rom.size());
+    emulator->run(500);
+  }
+  native.set_native_program(find_native_program(native.rom_hash()));
+  REQUIRE(saved(native) == saved(interpreted));
+
+  // Draw the font's 0 at the top left and loop on 1NNN, over the code at 0x200
+  auto state = interpreted.state();
+  const uint8_t patch[] = {0x00, 0xE0, 0x60, 0x00, 0xA0, 0x00, 0xD0, 0x05, 0x12, 0x08};
+  std::copy(std::begin(patch), std::end(patch), state.memory.begin() + 0x200);
+  state.pc = 0x200;
+  interpreted.restore(state);
+  native.restore(state);
+
+  CHECK(native.run(100).cycles == 100);
+  interpreted.run(100);
+  CHECK(saved(native) == saved(interpreted));
+  CHECK(native.get_graphic()[0] == 1);
+}
+
+TEST_CASE("Recompiled games benchmark" * doctest::test_suite("benchmark") * doctest::skip()) {
+  const auto rom = read_rom(CHIP8_ROMS_DIR "/games/Tetris [Fran Dachille, 1991].ch8");
+  REQUIRE(!rom.empty());
+  constexpr uint64_t cycles = 2'000'000;
+
+  const auto time = [&](bool recompiled) {
+    Emulator emulator;
+    emulator.load_rom(rom.data(), rom.size());
+    if (recompiled) {
+      emulator.set_native_program(find_native_program(emulator.rom_hash()));
+    }
+    const auto start = std::chrono::steady_clock::now();
+    emulator.run(cycles);
+    const std::chrono::duration<double, std::nano> elapsed
+        = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / cycles;
+  };
+  const auto interpreted = time(false);
+  const auto native = time(true);
+  MESSAGE("Recompiler: " << interpreted << " ns/cycle interpreted, " << native
+                         << " ns/cycle recompiled");
+}
+
+#endif  // CHIP8_RECOMPILED_GAMES
@@ -0,0 +1,203 @@
+#include "Renderer.h"
+
+#include <doctest/doctest.h>
+
+#include <chrono>
+#include <cstring>
+#include <random>
+#include <vector>
+
+namespace {
+
+std::array<uint8_t, 64 * 32> random_screen(uint32_t seed) {
+  std::mt19937 random(seed);
+  std::array<uint8_t, 64 * 32> graphic;
+  for (auto& pixel : graphic) {
+    pixel = random() % 3 == 0;
+  }
+  return graphic;
+}
+
+const char* kernel_name(Renderer::Kernel kernel) {
+  switch (kernel) {
+    case Renderer::Kernel::Scalar:
+      return "scalar";
+    case Renderer::Kernel::SSE2:
+      return "SSE2";
+    case Renderer::Kernel::AVX2:
+      return "AVX2";
+  }
+  return "unknown";
+}
+
+}  // namespace
+
+TEST_CASE("Renderer expands the screen to scaled RGBA") {
+  std::array<uint8_t, 64 * 32> graphic{};
+  graphic[1 * 64 + 2] = 1;
+
+  Renderer::Config config;
+  config.scale = 3;
+  config.foreground = 0x102030;
+  config.background = 0x405060;
+  Renderer renderer(config);
+  CHECK(renderer.width() == 192);
+  CHECK(renderer.height() == 96);
+
+  std::vector<uint32_t> pixels;
+  renderer.render(graphic, pixels);
+  REQUIRE(pixels.size() == 192 * 96);
+
+  const auto bytes = reinterpret_cast<const uint8_t*>(pixels.data());
+  const auto lit = (4 * 192 + 7) * 4;
+  CHECK(bytes[lit] == 0x10);
+  CHECK(bytes[lit + 1] == 0x20);
+  CHECK(bytes[lit + 2] == 0x30);
+  CHECK(bytes[lit + 3] == 0xFF);
+  CHECK(pixels[3 * 192 + 6] == Renderer::rgba(0x102030));
+  CHECK(pixels[5 * 192 + 8] == Renderer::rgba(0x102030));
+  CHECK(pixels[6 * 192 + 6] == Renderer::rgba(0x405060));
+  CHECK(pixels[3 * 192 + 9] == Renderer::rgba(0x405060));
+}
+
+TEST_CASE("Renderer kernels all produce the same pixels") {
+  const auto graphic = random_screen(1);
+
+  for (unsigned scale = 1; scale <= 17; scale++) {
+    for (auto effects = 0; effects < 8; effects++) {
+      Renderer::Config config;
+      config.scale = scale;
+      config.scanlines = effects & 1;
+      config.grid = effects & 2;
+      config.smoothing = effects & 4 ? Renderer::Smoothing::Scale2x : Renderer::Smoothing::None;
+
+      std::vector<uint32_t> expected;
+      Renderer(config, Renderer::Kernel::Scalar).render(graphic, expected);
+
+      for (auto kernel : {Renderer::Kernel::SSE2, Renderer::Kernel::AVX2}) {
+        Renderer renderer(config, kernel);
+        std::vector<uint32_t> pixels;
+        renderer.render(graphic, pixels);
+        INFO("scale " << scale << ", effects " << effects << ", "
+                      << kernel_name(renderer.kernel()));
+        REQUIRE(pixels == expected);
+      }
+    }
+  }
+}
+
+TEST_CASE("Renderer writes rows at the given pitch") {
+  const auto graphic = random_screen(2);
+  Renderer::Config config;
+  config.scale = 2;
+  Renderer renderer(config);
+
+  // 8 bytes of padding after every row
+  const std::size_t pitch = 128 * 4 + 8;
+  std::vector<uint8_t> texture(pitch * 64, 0xAB);
+  renderer.render(graphic, texture.data(), pitch);
+
+  std::vector<uint32_t> packed;
+  renderer.render(graphic, packed);
+  for (std::size_t y = 0; y < 64; y++) {
+    REQUIRE(std::memcmp(texture.data() + y * pitch, packed.data() + y * 128, 128 * 4) == 0);
+    CHECK(texture[y * pitch + 128 * 4] == 0xAB);
+    CHECK(texture[y * pitch + pitch - 1] == 0xAB);
+  }
+}
+
+TEST_CASE("Renderer effects") {
+  std::array<uint8_t, 64 * 32> graphic{};
+  Renderer::Config config;
+  config.scale = 4;
+  config.foreground = 0xFFFFFF;
+  const auto white = Renderer::rgba(0xFFFFFF);
+  const auto black = Renderer::rgba(0x000000);
+  std::vector<uint32_t> pixels;
+
+  SUBCASE("Scanlines darken the last row of every pixel") {
+    graphic[0] = 1;
+    config.scanlines = true;
+    config.scanline_brightness = 0x80;
+    Renderer(config).render(graphic, pixels);
+
+    CHECK(pixels[2 * 256] == white);
+    CHECK(pixels[3 * 256] == Renderer::rgba(0x808080));
+    CHECK(pixels[3 * 256 + 4] == black);
+  }
+
+  SUBCASE("The grid outlines every pixel") {
+    graphic[0] = 1;
+    config.grid = true;
+    config.grid_color = 0x00FF00;
+    Renderer(config).render(graphic, pixels);
+
+    const auto green = Renderer::rgba(0x00FF00);
+    CHECK(pixels[0] == white);
+    CHECK(pixels[3] == green);
+    CHECK(pixels[2 * 256 + 3] == green);
+    CHECK(pixels[3 * 256 + 1] == green);
+    CHECK(pixels[4 * 256] == black);
+  }
+
+  SUBCASE("Scale2x rounds diagonal edges and leaves isolated pixels") {
+    // Staircase going down to the right, and a lone pixel
+    graphic[0 * 64 + 0] = 1;
+    graphic[1 * 64 + 1] = 1;
+    graphic[10 * 64 + 10] = 1;
+    config.smoothing = Renderer::Smoothing::Scale2x;
+    const Renderer renderer(config);
+    CHECK(renderer.smoothing() == Renderer::Smoothing::Scale2x);
+    renderer.render(graphic, pixels);
+
+    // The bottom left quarter of (1, 0) fills the step between the two pixels
+    CHECK(pixels[0 * 256 + 4] == black);
+    CHECK(pixels[2 * 256 + 4] == white);
+    CHECK(pixels[2 * 256 + 6] == black);
+    CHECK(pixels[0 * 256 + 2] == white);
+
+    // Lone pixel, all 4 * 4 lit
+    for (auto y = 40; y < 44; y++) {
+      for (auto x = 40; x < 44; x++) {
+        CHECK(pixels[y * 256 + x] == white);
+      }
+    }
+    CHECK(pixels[44 * 256 + 40] == black);
+  }
+
+  SUBCASE("Scale2x is skipped for odd scales") {
+    graphic[0] = 1;
+    graphic[65] = 1;
+    config.scale = 3;
+    config.smoothing = Renderer::Smoothing::Scale2x;
+    const Renderer renderer(config);
+    CHECK(renderer.smoothing() == Renderer::Smoothing::None);
+    renderer.render(graphic, pixels);
+
+    CHECK(pixels[3 * 192 + 2] == black);
+  }
+}
+
+TEST_CASE("Renderer throughput at 1024 * 512") {
+  const auto graphic = random_screen(3);
+  Renderer::Config config;
+  config.scale = 16;
+  std::vector<uint32_t> pixels(1024 * 512);
+
+  for (auto kernel : {Renderer::Kernel::Scalar, Renderer::Kernel::SSE2, Renderer::Kernel::AVX2}) {
+    Renderer renderer(config, kernel);
+    if (renderer.kernel() != kernel) {
+      continue;
+    }
+
+    constexpr auto frames = 200;
+    const auto start = std::chrono::steady_clock::now();
+    for (auto frame = 0; frame < frames; frame++) {
+      renderer.render(graphic, pixels.data(), 1024 * 4);
+    }
+    const std::chrono::duration<double, std::micro> elapsed
+        = std::chrono::steady_clock::now() - start;
+    MESSAGE(kernel_name(kernel) << ": " << elapsed.count() / frames << " us per frame");
+  }
+  CHECK(pixels[0] != 0);
+}
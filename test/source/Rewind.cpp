@@ -0,0 +1,106 @@
+#include "Rewind.h"
+
+#include <doctest/doctest.h>
+
+#include <fstream>
+#include <vector>
+
+#include "Emulator.h"
+
+namespace {
+
+constexpr uint64_t cycles_per_frame = 10;
+
+bool same_state(const MachineState& a, const MachineState& b) {
+  return a.memory == b.memory && a.graphic == b.graphic && a.V == b.V && a.I == b.I
+         && a.pc == b.pc && a.stack.size() == b.stack.size() && a.delay_timer == b.delay_timer
+         && a.sound_timer == b.sound_timer && a.rng_engine == b.rng_engine;
+}
+
+// Random numbers and sprites, so every part of the state keeps changing
+void load_particle_demo(Emulator& emulator) {
+  std::ifstream rom(CHIP8_ROMS_DIR "/demos/Particle Demo [zeroZshadow, 2008].ch8",
+                    std::ios::binary);
+  emulator.load_rom(rom);
+  emulator.seed(1);
+}
+
+}  // namespace
+
+TEST_CASE("Rewind restores previously recorded frames") {
+  Emulator emulator;
+  load_particle_demo(emulator);
+
+  Rewind::Config config;
+  config.keyframe_interval = 16;
+  Rewind rewind(config);
+
+  std::vector<MachineState> history;
+  for (auto frame = 0; frame < 100; frame++) {
+    emulator.run(cycles_per_frame);
+    rewind.record(emulator);
+    history.push_back(emulator.state());
+  }
+  REQUIRE(rewind.recorded_frames() == 100);
+
+  SUBCASE("Rewinding 0 frames restores the last recorded frame") {
+    emulator.run(cycles_per_frame);
+
+    CHECK(rewind.rewind(emulator, 0) == 0);
+    CHECK(same_state(emulator.state(), history[99]));
+  }
+
+  SUBCASE("Any frame, keyframe or delta, can be restored") {
+    CHECK(rewind.rewind(emulator, 37) == 37);
+    CHECK(same_state(emulator.state(), history[62]));
+    CHECK(rewind.recorded_frames() == 63);
+
+    CHECK(rewind.rewind(emulator, 14) == 14);
+    CHECK(same_state(emulator.state(), history[48]));
+  }
+
+  SUBCASE("Rewinding too far stops at the oldest frame") {
+    CHECK(rewind.rewind(emulator, 1000) == 99);
+    CHECK(same_state(emulator.state(), history[0]));
+  }
+
+  SUBCASE("Recording after a rewind continues from the restored frame") {
+    rewind.rewind(emulator, 50);
+    for (auto frame = 0; frame < 30; frame++) {
+      emulator.run(cycles_per_frame);
+      rewind.record(emulator);
+    }
+
+    CHECK(rewind.recorded_frames() == 80);
+    CHECK(rewind.rewind(emulator, 30) == 30);
+    CHECK(same_state(emulator.state(), history[49]));
+  }
+
+  SUBCASE("Rewinding by seconds uses the frame rate") {
+    CHECK(rewind.rewind_seconds(emulator, 0.5) == 30);
+    CHECK(same_state(emulator.state(), history[69]));
+  }
+}
+
+TEST_CASE("Rewind stays within its memory budget") {
+  Emulator emulator;
+  load_particle_demo(emulator);
+
+  Rewind::Config config;
+  config.keyframe_interval = 30;
+  config.memory_budget = 4 * sizeof(MachineState);
+  Rewind rewind(config);
+
+  for (auto frame = 0; frame < 1000; frame++) {
+    emulator.run(cycles_per_frame);
+    rewind.record(emulator);
+  }
+
+  CHECK(rewind.memory_used() <= config.memory_budget);
+  CHECK(rewind.recorded_frames() < 1000);
+  CHECK(rewind.recorded_frames() >= config.keyframe_interval);
+  CHECK(rewind.bytes_per_minute() > 0);
+
+  // Deltas are much smaller than full copies
+  CHECK(rewind.memory_used() < rewind.recorded_frames() * sizeof(MachineState) / 4);
+}
@@ -0,0 +1,122 @@
+#include "Rng.h"
+
+#include <doctest/doctest.h>
+
+#include <array>
+#include <chrono>
+
+#include "Emulator.h"
+
+namespace {
+
+template <typename Engine> uint32_t checksum(Engine engine, int count) {
+  uint32_t sum = 0;
+  for (auto i = 0; i < count; i++) {
+    sum = sum * 31 + engine();
+  }
+  return sum;
+}
+
+template <typename Engine> void check_engine() {
+  Engine a(12345);
+  Engine b;
+  b.seed(12345);
+  CHECK(a == b);
+  CHECK(checksum(a, 100) == checksum(b, 100));
+  CHECK(checksum(Engine(1), 100) != checksum(Engine(2), 100));
+
+  // The raw state round trips
+  a();
+  Engine copy;
+  REQUIRE(copy.set_state(a.state()));
+  CHECK(copy == a);
+  CHECK(copy() == a());
+
+  // The top 8 bits, as used by CXNN, cover every byte value evenly
+  std::array<int, 256> counts{};
+  for (auto i = 0; i < 256 * 1000; i++) {
+    counts[a() >> 24]++;
+  }
+  for (auto count : counts) {
+    CHECK(count > 850);
+    CHECK(count < 1150);
+  }
+}
+
+}  // namespace
+
+TEST_CASE("RNG engines match their reference implementations") {
+  // From the reference SplitMix64, seed 0
+  SplitMix64 splitmix(0);
+  CHECK(splitmix.next64() == 0xE220A8397B1DCDAFu);
+  CHECK(splitmix.next64() == 0x6E789E6AA1B965F4u);
+  CHECK(splitmix.next64() == 0x06C45D188009454Fu);
+
+  // From the reference xorshift64* (shifts 12, 25, 27), state 1, top 32 bits of each output
+  Xorshift64Star xorshift;
+  REQUIRE(xorshift.set_state({1, 0}));
+  for (uint32_t expected : {0x47E4CE4Bu, 0xABCFA6A8u, 0xB9D10D8Fu, 0x4DB418A0u, 0x0E6199B0u,
+                            0xC8674BCBu}) {
+    CHECK(xorshift() == expected);
+  }
+
+  // From pcg32-demo, pcg32_srandom_r(42, 54)
+  Pcg32 pcg(42, 54);
+  for (uint32_t expected : {0xA15C02B7u, 0x7B47F409u, 0xBA1D3330u, 0x83D2F293u, 0xBFA4784Bu,
+                            0xCBED606Eu}) {
+    CHECK(pcg() == expected);
+  }
+}
+
+TEST_CASE("RNG engines are deterministic and round trip their state") {
+  SUBCASE("SplitMix64") { check_engine<SplitMix64>(); }
+  SUBCASE("Xorshift64*") { check_engine<Xorshift64Star>(); }
+  SUBCASE("PCG32") { check_engine<Pcg32>(); }
+}
+
+TEST_CASE("RNG engines reject impossible states") {
+  CHECK(!Xorshift64Star().set_state({0, 0}));
+  CHECK(!Pcg32().set_state({1, 2}));
+}
+
+TEST_CASE("Emulators start from the same random sequence") {
+  // CXNN into V0, 16 times
+  std::array<uint8_t, 32> rom;
+  for (std::size_t i = 0; i < rom.size(); i += 2) {
+    rom[i] = 0xC0;
+    rom[i + 1] = 0xFF;
+  }
+  const auto run = [&rom](Emulator& emulator) {
+    emulator.load_rom(rom.data(), rom.size());
+    uint64_t values = 0;
+    for (auto i = 0; i < 16; i++) {
+      emulator.emulate_cycle();
+      values = values * 257 + emulator.state().V[0];
+    }
+    return values;
+  };
+
+  Emulator a;
+  Emulator b;
+  CHECK(run(a) == run(b));
+
+  Emulator c;
+  c.seed(1);
+  CHECK(run(c) != run(b));
+}
+
+TEST_CASE("RNG throughput") {
+  constexpr auto count = 10000000;
+  const auto measure = [](const char* name, auto engine) {
+    const auto start = std::chrono::steady_clock::now();
+    const auto sum = checksum(engine, count);
+    const std::chrono::duration<double, std::nano> elapsed
+        = std::chrono::steady_clock::now() - start;
+    MESSAGE(name << ": " << elapsed.count() / count << " ns per number, " << sizeof(engine)
+                 << " bytes of state (" << sum << ")");
+  };
+  measure("SplitMix64", SplitMix64(1));
+  measure("Xorshift64*", Xorshift64Star(1));
+  measure("PCG32", Pcg32(1));
+  CHECK(sizeof(Rng) <= 16);
+}
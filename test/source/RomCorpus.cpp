@@ -0,0 +1,220 @@
+#include <doctest/doctest.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Emulator.h"
+#include "Hash.h"
+
+// Golden framebuffer regression over every ROM in roms/.
+//
+// Each ROM runs headlessly with a fixed seed and a scripted key sequence, and the framebuffer is
+// hashed at a few cycle checkpoints. CXNN makes the hashes depend on the RNG engine built in, so
+// they are compared against the golden file of that engine, roms.<engine>.golden in
+// CHIP8_GOLDEN_DIR. Set the CHIP8_UPDATE_GOLDEN environment variable to rewrite the golden file
+// instead of checking it.
+// Mismatching framebuffers are dumped as PBM images in CHIP8_GOLDEN_FAILURES_DIR, golden_failures/
+// in the build directory, or in the temporary directory when it isn't defined.
+
+namespace {
+
+namespace fs = std::filesystem;
+
+constexpr std::array<uint64_t, 4> checkpoints{600, 3000, 15000, 60000};
+constexpr uint32_t corpus_seed = 0xC8C8;
+
+// Key script: every 256 cycles the next key (0 to F) is pressed and held for 128 cycles
+constexpr uint64_t key_period = 256;
+constexpr uint64_t key_hold = 128;
+
+struct RomResult {
+  std::array<uint64_t, checkpoints.size()> hashes{};
+  std::array<std::array<uint8_t, 64 * 32>, checkpoints.size()> frames{};
+  Fault fault;
+};
+
+RomResult run_rom(const fs::path& path) {
+  RomResult result;
+
+  Emulator emulator;
+  emulator.seed(corpus_seed);
+
+  std::ifstream rom(path, std::ios::binary);
+  emulator.load_rom(rom);
+
+  std::size_t checkpoint = 0;
+  for (uint64_t cycle = 0; checkpoint < checkpoints.size(); cycle++) {
+    const auto key = static_cast<uint8_t>((cycle / key_period) % 16);
+    if (cycle % key_period == 0) {
+      emulator.press_key(key);
+    } else if (cycle % key_period == key_hold) {
+      emulator.release_key(key);
+    }
+
+    // A faulting ROM keeps its last framebuffer for the remaining checkpoints
+    if (!result.fault) {
+      result.fault = emulator.emulate_cycle();
+    }
+
+    if (cycle + 1 == checkpoints[checkpoint]) {
+      const auto& graphic = emulator.get_graphic();
+      result.hashes[checkpoint] = fnv1a64(graphic.data(), graphic.size());
+      result.frames[checkpoint] = graphic;
+      checkpoint++;
+    }
+  }
+
+  return result;
+}
+
+std::vector<fs::path> find_roms(const fs::path& directory) {
+  std::vector<fs::path> roms;
+  for (const auto& entry : fs::recursive_directory_iterator(directory)) {
+    if (entry.is_regular_file() && entry.path().extension() == ".ch8") {
+      roms.push_back(entry.path());
+    }
+  }
+  std::sort(roms.begin(), roms.end());
+  return roms;
+}
+
+std::vector<RomResult> run_roms_in_parallel(const std::vector<fs::path>& roms) {
+  std::vector<RomResult> results(roms.size());
+  std::atomic<std::size_t> next{0};
+
+  auto worker = [&]() {
+    for (auto i = next++; i < roms.size(); i = next++) {
+      results[i] = run_rom(roms[i]);
+    }
+  };
+
+  const auto thread_count = std::max(1u, std::thread::hardware_concurrency());
+  std::vector<std::thread> threads;
+  for (unsigned i = 0; i < thread_count; i++) {
+    threads.emplace_back(worker);
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  return results;
+}
+
+// Golden file lines are "<hash> <hash> <hash> <hash> <path relative to roms/>"
+std::map<std::string, std::array<uint64_t, checkpoints.size()>> read_golden(const fs::path& path) {
+  std::map<std::string, std::array<uint64_t, checkpoints.size()>> golden;
+
+  std::ifstream file(path);
+  std::string line;
+  while (std::getline(file, line)) {
+    if (line.empty() || line[0] == '#') {
+      continue;
+    }
+    std::istringstream stream(line);
+    std::array<uint64_t, checkpoints.size()> hashes{};
+    for (auto& hash : hashes) {
+      stream >> std::hex >> hash;
+    }
+    std::string name;
+    stream >> std::ws;
+    std::getline(stream, name);
+    golden[name] = hashes;
+  }
+
+  return golden;
+}
+
+void write_golden(const fs::path& path, const std::vector<std::string>& names,
+                  const std::vector<RomResult>& results) {
+  std::ofstream file(path);
+  file << "# Framebuffer FNV-1a hashes at cycles";
+  for (auto checkpoint : checkpoints) {
+    file << ' ' << checkpoint;
+  }
+  file << ", seed 0x" << std::hex << corpus_seed << ", " << Rng::name << " engine\n";
+
+  for (std::size_t i = 0; i < names.size(); i++) {
+    for (auto hash : results[i].hashes) {
+      file << std::hex << std::setw(16) << std::setfill('0') << hash << ' ';
+    }
+    file << names[i] << '\n';
+  }
+}
+
+void write_pbm(const fs::path& path, const std::array<uint8_t, 64 * 32>& graphic) {
+  std::ofstream file(path);
+  file << "P1\n64 32\n";
+  for (auto y = 0; y < 32; y++) {
+    for (auto x = 0; x < 64; x++) {
+      file << (graphic[x + y * 64] ? '1' : '0') << (x == 63 ? '\n' : ' ');
+    }
+  }
+}
+
+}  // namespace
+
+TEST_CASE("Every rom in the corpus renders its golden framebuffers") {
+  const fs::path roms_directory = CHIP8_ROMS_DIR;
+  const auto golden_path
+      = fs::path(CHIP8_GOLDEN_DIR) / ("roms." + std::string(Rng::name) + ".golden");
+
+  const auto roms = find_roms(roms_directory);
+  REQUIRE(!roms.empty());
+
+  std::vector<std::string> names;
+  for (const auto& rom : roms) {
+    names.push_back(rom.lexically_relative(roms_directory).generic_string());
+  }
+
+  const auto results = run_roms_in_parallel(roms);
+
+  if (std::getenv("CHIP8_UPDATE_GOLDEN") != nullptr) {
+    write_golden(golden_path, names, results);
+    MESSAGE("Golden file updated: " << golden_path.string());
+    return;
+  }
+
+  const auto golden = read_golden(golden_path);
+  REQUIRE(!golden.empty());
+
+#ifdef CHIP8_GOLDEN_FAILURES_DIR
+  const fs::path failures_directory = CHIP8_GOLDEN_FAILURES_DIR;
+#else
+  const auto failures_directory = fs::temp_directory_path() / "chip8-golden-failures";
+#endif
+  for (std::size_t i = 0; i < roms.size(); i++) {
+    INFO("rom: " << names[i]);
+    INFO("fault: " << to_string(results[i].fault.kind));
+
+    const auto expected = golden.find(names[i]);
+    CHECK(expected != golden.end());
+    if (expected == golden.end()) {
+      continue;
+    }
+
+    for (std::size_t checkpoint = 0; checkpoint < checkpoints.size(); checkpoint++) {
+      INFO("cycle: " << checkpoints[checkpoint]);
+      const auto matches = results[i].hashes[checkpoint] == expected->second[checkpoint];
+      CHECK(matches);
+
+      if (!matches) {
+        fs::create_directories(failures_directory);
+        auto file_name = names[i];
+        std::replace(file_name.begin(), file_name.end(), '/', '_');
+        write_pbm(failures_directory
+                      / (file_name + "." + std::to_string(checkpoints[checkpoint]) + ".pbm"),
+                  results[i].frames[checkpoint]);
+      }
+    }
+  }
+}
@@ -0,0 +1,154 @@
+#ifndef _WIN32
+
+#  include "RomIndex.h"
+
+#  include <doctest/doctest.h>
+
+#  include <chrono>
+#  include <filesystem>
+#  include <fstream>
+#  include <memory>
+#  include <system_error>
+#  include <vector>
+
+#  include "Hash.h"
+#  include "Translation.h"
+#  include "TestUtilities.h"
+
+namespace {
+
+namespace fs = std::filesystem;
+
+RomInfo analyze(const std::vector<uint8_t>& rom) {
+  auto scratch = std::make_unique<Translation>();
+  return analyze_rom(rom.data(), rom.size(), *scratch);
+}
+
+}  // namespace
+
+TEST_CASE("Rom analysis tells the platforms apart") {
+  // 200: 00E0 6000 1204  plain CHIP-8, then spin
+  CHECK(analyze({0x00, 0xE0, 0x60, 0x00, 0x12, 0x04}).platform == RomPlatform::Chip8);
+  // 200: 1260           the VIP hires entry
+  CHECK(analyze({0x12, 0x60}).platform == RomPlatform::Chip8Hires);
+  // 200: 00FF 1202       SuperChip hires mode
+  CHECK(analyze({0x00, 0xFF, 0x12, 0x02}).platform == RomPlatform::SuperChip);
+  // 200: 6000 D000 1200  16x16 sprite
+  CHECK(analyze({0x60, 0x00, 0xD0, 0x00, 0x12, 0x00}).platform == RomPlatform::SuperChip);
+  // 200: F000 0300 1200  XO-CHIP long load
+  CHECK(analyze({0xF0, 0x00, 0x03, 0x00, 0x12, 0x00}).platform == RomPlatform::XoChip);
+
+  // 200: 1206 00FF 0000  the SuperChip opcode is data nothing jumps to
+  // 206: 1206
+  const auto data = analyze({0x12, 0x06, 0x00, 0xFF, 0x00, 0x00, 0x12, 0x06});
+  CHECK(data.platform == RomPlatform::Chip8);
+  CHECK(data.code_size == 2);
+}
+
+TEST_CASE("Rom analysis finds the quirks code depends on") {
+  // 200: 8016 1202  shifts V1 into V0 on the VIP
+  CHECK(analyze({0x80, 0x16, 0x12, 0x02}).quirks == ShiftsVY);
+  // 200: 8006 1202  shifts V0 in place everywhere
+  CHECK(analyze({0x80, 0x06, 0x12, 0x02}).quirks == 0);
+  // 200: A300 F165 F165 1206  the second load reads past the first on the VIP
+  CHECK(analyze({0xA3, 0x00, 0xF1, 0x65, 0xF1, 0x65, 0x12, 0x06}).quirks == IncrementsI);
+  // 200: A300 F165 A302 F165 1208  I set again
+  CHECK(analyze({0xA3, 0x00, 0xF1, 0x65, 0xA3, 0x02, 0xF1, 0x65, 0x12, 0x08}).quirks == 0);
+  // 200: D000 B300  jumps to 300 + V3 on SuperChip
+  CHECK(analyze({0xD0, 0x00, 0xB3, 0x00}).quirks == JumpsWithVX);
+  // 200: B300       jumps to 300 + V0 on CHIP-8
+  CHECK(analyze({0xB3, 0x00}).quirks == 0);
+}
+
+TEST_CASE("Rom analysis finds self-modifying code") {
+  // 200: A206 F055 1204  writes to 206, which never runs
+  // 206: 1206
+  CHECK(analyze({0xA2, 0x06, 0xF0, 0x55, 0x12, 0x04, 0x12, 0x06}).self_modifying == false);
+  // 200: A205 F155 1200  V0 overwrites the second byte of the jump at 204
+  CHECK(analyze({0xA2, 0x05, 0xF1, 0x55, 0x12, 0x00}).self_modifying);
+  // 200: A300 F033 1200  BCD to data
+  CHECK(!analyze({0xA3, 0x00, 0xF0, 0x33, 0x12, 0x00}).self_modifying);
+}
+
+TEST_CASE("Rom index of the corpus") {
+  RomIndexStatistics statistics;
+  const auto roms = scan_rom_directory(CHIP8_ROMS_DIR, 4, &statistics);
+  REQUIRE(!roms.empty());
+  CHECK(statistics.files == roms.size());
+  CHECK(statistics.unreadable == 0);
+
+  for (const auto& rom : roms) {
+    CAPTURE(rom.path);
+    // The folder of the VIP hires roms agrees with the scan
+    CHECK((rom.path.rfind("hires/", 0) == 0) == (rom.info.platform == RomPlatform::Chip8Hires));
+    std::ifstream file(fs::path(CHIP8_ROMS_DIR) / rom.path, std::ios::binary);
+    const std::vector<uint8_t> data{std::istreambuf_iterator<char>(file),
+                                    std::istreambuf_iterator<char>()};
+    CHECK(rom.info.rom_hash == fnv1a64(data.data(), data.size()));
+  }
+
+  TemporaryDirectory directory("chip8-rom-index-");
+  const auto file = (directory.path / "roms.c8i").string();
+  write_rom_index(roms, file);
+  const RomIndex index(file);
+  CHECK(index.size() == roms.size() - statistics.duplicates);
+  for (const auto& rom : roms) {
+    CAPTURE(rom.path);
+    const auto info = index.find(rom.info.rom_hash);
+    REQUIRE(info != nullptr);
+    CHECK(info->platform == rom.info.platform);
+    CHECK(info->quirks == rom.info.quirks);
+    CHECK(info->self_modifying == rom.info.self_modifying);
+    // Duplicates are indexed under their first path
+    CHECK(index.path(*info) <= rom.path);
+  }
+  CHECK(index.find(0) == nullptr);
+
+  SUBCASE("Files that aren't indexes are rejected") {
+    std::ofstream(file, std::ios::binary | std::ios::trunc) << "C8RI but not an index";
+    CHECK_THROWS_AS(RomIndex{file}, std::system_error);
+    CHECK_THROWS_AS(RomIndex{(directory.path / "missing").string()}, std::system_error);
+  }
+}
+
+TEST_CASE("Rom index benchmark" * doctest::test_suite("benchmark") * doctest::skip()) {
+  // The corpus copied until there are thousands of roms, each made unique
+  TemporaryDirectory directory("chip8-rom-index-");
+  const auto corpus = scan_rom_directory(CHIP8_ROMS_DIR);
+  REQUIRE(!corpus.empty());
+  constexpr std::size_t copies = 5000;
+  for (std::size_t copy = 0; copy < copies; copy++) {
+    const auto& rom = corpus[copy % corpus.size()];
+    std::ifstream in(fs::path(CHIP8_ROMS_DIR) / rom.path, std::ios::binary);
+    std::vector<char> data{std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>()};
+    data.push_back(static_cast<char>(copy));
+    data.push_back(static_cast<char>(copy >> 8));
+    const auto folder = directory.path / std::to_string(copy % 64);
+    fs::create_directories(folder);
+    std::ofstream(folder / (std::to_string(copy) + ".ch8"), std::ios::binary)
+        .write(data.data(), static_cast<std::streamsize>(data.size()));
+  }
+
+  const auto start = std::chrono::steady_clock::now();
+  RomIndexStatistics statistics;
+  const auto roms = scan_rom_directory(directory.path.string(), 0, &statistics);
+  const auto file = (directory.path / "roms.c8i").string();
+  write_rom_index(roms, file);
+  const std::chrono::duration<double, std::milli> elapsed
+      = std::chrono::steady_clock::now() - start;
+  CHECK(statistics.files == copies);
+
+  const RomIndex index(file);
+  const auto lookups_start = std::chrono::steady_clock::now();
+  std::size_t found = 0;
+  for (const auto& rom : roms) {
+    found += index.find(rom.info.rom_hash) != nullptr;
+  }
+  const std::chrono::duration<double, std::nano> lookups
+      = std::chrono::steady_clock::now() - lookups_start;
+  CHECK(found == roms.size());
+  MESSAGE("Rom index: " << copies << " roms indexed in " << elapsed.count() << " ms, "
+                        << lookups.count() / roms.size() << " ns per lookup");
+}
+
+#endif  // _WIN32
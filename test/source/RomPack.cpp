@@ -0,0 +1,149 @@
+#ifndef _WIN32
+
+#  include "RomPack.h"
+
+#  include <doctest/doctest.h>
+
+#  include <algorithm>
+#  include <chrono>
+#  include <cstdint>
+#  include <cstring>
+#  include <filesystem>
+#  include <fstream>
+#  include <memory>
+#  include <system_error>
+#  include <vector>
+
+#  include "Emulator.h"
+#  include "Translation.h"
+#  include "TestUtilities.h"
+
+namespace {
+
+namespace fs = std::filesystem;
+
+// Every rom of the corpus, named by its path in it
+std::vector<PackedRom> corpus() {
+  std::vector<PackedRom> roms;
+  for (const auto& file : corpus_files()) {
+    roms.push_back({file.lexically_relative(CHIP8_ROMS_DIR).generic_string(), read_rom(file)});
+  }
+  return roms;
+}
+
+}  // namespace
+
+TEST_CASE("Rom packs hold every rom of the corpus") {
+  const auto roms = corpus();
+  REQUIRE(!roms.empty());
+  TemporaryFile file("chip8-pack-");
+  write_rom_pack(roms, file.path);
+  const RomPack pack(file.path);
+
+  auto scratch = std::make_unique<Translation>();
+  std::size_t found_by_name = 0;
+  for (const auto& rom : roms) {
+    CAPTURE(rom.name);
+    Emulator expected;
+    expected.load_rom(rom.data.data(), rom.data.size());
+    const auto index = pack.find(expected.rom_hash());
+    REQUIRE(index < pack.size());
+
+    const auto packed = pack.rom(index);
+    CHECK(reinterpret_cast<uintptr_t>(packed.data) % rom_pack::image_alignment == 0);
+    CHECK(std::equal(rom.data.begin(), rom.data.end(), packed.data, packed.data + packed.size));
+    const auto info = analyze_rom(rom.data.data(), rom.data.size(), *scratch);
+    CHECK(packed.info->platform == info.platform);
+    CHECK(packed.info->quirks == info.quirks);
+
+    Emulator emulator;
+    emulator.load_rom(packed.data, packed.size);
+    CHECK(emulator.state().memory == expected.state().memory);
+
+    // Duplicates are only packed under their first name
+    if (packed.name == rom.name) {
+      CHECK(pack.find(rom.name) == index);
+      found_by_name++;
+    }
+  }
+  CHECK(found_by_name == pack.size());
+  CHECK(pack.size() < roms.size());  // The corpus has a duplicate
+  CHECK(pack.find("games/Missing.ch8") == pack.size());
+  CHECK(pack.find(uint64_t{0}) == pack.size());
+}
+
+TEST_CASE("Rom packs reject files that aren't packs") {
+  TemporaryFile file("chip8-pack-");
+  write_rom_pack({}, file.path);
+  CHECK(RomPack(file.path).size() == 0);
+
+  write_rom_pack({{"a", {0x12, 0x00}}, {"b", {0x00, 0xE0}}}, file.path);
+  auto bytes = read_rom(file.path);
+  const auto write = [&](const std::vector<uint8_t>& data) {
+    std::ofstream(file.path, std::ios::binary | std::ios::trunc)
+        .write(reinterpret_cast<const char*>(data.data()),
+               static_cast<std::streamsize>(data.size()));
+  };
+
+  SUBCASE("Truncated") {
+    bytes.resize(bytes.size() - rom_pack::image_alignment);  // Into the last image
+    write(bytes);
+    CHECK_THROWS_AS(RomPack{file.path}, std::system_error);
+  }
+  SUBCASE("An image past the end") {
+    rom_pack::Entry entry;
+    std::memcpy(&entry, bytes.data() + sizeof(rom_pack::Header), sizeof(entry));
+    entry.offset = bytes.size();
+    std::memcpy(bytes.data() + sizeof(rom_pack::Header), &entry, sizeof(entry));
+    write(bytes);
+    CHECK_THROWS_AS(RomPack{file.path}, std::system_error);
+  }
+  SUBCASE("Another format") {
+    bytes[0] = 'X';
+    write(bytes);
+    CHECK_THROWS_AS(RomPack{file.path}, std::system_error);
+  }
+  CHECK_THROWS_AS(RomPack{file.path + ".missing"}, std::system_error);
+}
+
+TEST_CASE("Rom pack benchmark" * doctest::test_suite("benchmark") * doctest::skip()) {
+  const auto roms = corpus();
+  TemporaryFile file("chip8-pack-");
+  write_rom_pack(roms, file.path);
+
+  // Session starts of every rom, by path from loose files or by name from the pack
+  constexpr auto rounds = 20;
+  Emulator emulator;
+  const auto loose_start = std::chrono::steady_clock::now();
+  for (auto round = 0; round < rounds; round++) {
+    for (const auto& rom : roms) {
+      std::ifstream in(fs::path(CHIP8_ROMS_DIR) / rom.name, std::ios::binary);
+      emulator.reset();
+      emulator.load_rom(in);
+    }
+  }
+  const std::chrono::duration<double, std::micro> loose
+      = std::chrono::steady_clock::now() - loose_start;
+
+  const auto packed_start = std::chrono::steady_clock::now();
+  const RomPack pack(file.path);
+  std::size_t loaded = 0;
+  for (auto round = 0; round < rounds; round++) {
+    for (const auto& rom : roms) {
+      const auto index = pack.find(rom.name);
+      if (index < pack.size()) {
+        const auto packed = pack.rom(index);
+        emulator.reset();
+        emulator.load_rom(packed.data, packed.size);
+        loaded++;
+      }
+    }
+  }
+  const std::chrono::duration<double, std::micro> packed
+      = std::chrono::steady_clock::now() - packed_start;
+  CHECK(loaded > 0);
+  MESSAGE("Rom pack: " << loose.count() / (rounds * roms.size()) << " us per rom from files, "
+                       << packed.count() / loaded << " us from the pack");
+}
+
+#endif  // _WIN32
@@ -0,0 +1,185 @@
+#include "SaveState.h"
+
+#include <doctest/doctest.h>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <vector>
+
+#include "Emulator.h"
+#include "Hash.h"
+
+namespace {
+
+bool same_machine(const MachineState& a, const MachineState& b) {
+  return a.memory == b.memory && a.graphic == b.graphic && a.V == b.V && a.I == b.I
+         && a.pc == b.pc && a.stack.size() == b.stack.size() && a.delay_timer == b.delay_timer
+         && a.sound_timer == b.sound_timer && a.keys == b.keys
+         && a.waiting_for_key == b.waiting_for_key
+         && a.waiting_for_key_register == b.waiting_for_key_register;
+}
+
+bool same_state(const MachineState& a, const MachineState& b) {
+  return same_machine(a, b) && a.rng_engine == b.rng_engine;
+}
+
+void store(std::vector<uint8_t>& data, std::size_t offset, uint64_t value, std::size_t bytes) {
+  for (std::size_t i = 0; i < bytes; i++) {
+    data[offset + i] = static_cast<uint8_t>(value >> (i * 8));
+  }
+}
+
+// Recomputes the payload checksum after editing a save state
+void rehash(std::vector<uint8_t>& saved) {
+  const auto header_size = save_state_format::header_size;
+  store(saved, 24, fnv1a64(saved.data() + header_size, saved.size() - header_size), 8);
+}
+
+// Same state in the version 1 layout, with a Mersenne Twister state of the given index
+std::vector<uint8_t> to_version1(const std::vector<uint8_t>& saved, uint32_t rng_index) {
+  const auto header_size = save_state_format::header_size;
+  std::vector<uint8_t> old(saved.begin(), saved.begin() + header_size + 6203);
+  old.resize(header_size + save_state_format::payload_size_v1, 0);
+  store(old, 4, 1, 2);
+  store(old, 8, save_state_format::payload_size_v1, 4);
+  store(old, header_size + 6204, rng_index, 4);
+  for (uint32_t i = 0; i < 624; i++) {
+    store(old, header_size + 6208 + i * 4, i * 2654435761u, 4);
+  }
+  rehash(old);
+  return old;
+}
+
+void load_particle_demo(Emulator& emulator) {
+  std::ifstream rom(CHIP8_ROMS_DIR "/demos/Particle Demo [zeroZshadow, 2008].ch8",
+                    std::ios::binary);
+  emulator.load_rom(rom);
+  emulator.seed(3);
+}
+
+}  // namespace
+
+TEST_CASE("Save states restore the whole machine") {
+  Emulator emulator;
+  load_particle_demo(emulator);
+  emulator.run(500);
+  emulator.press_key(0xA);
+
+  std::vector<uint8_t> saved;
+  emulator.save_state(saved);
+  const auto saved_state = emulator.state();
+
+  SUBCASE("The header records the format version and the rom hash") {
+    CHECK(saved.size() == save_state_format::header_size + save_state_format::payload_size_v2);
+    CHECK(saved[0] == 'C');
+    CHECK(saved[4] == save_state_format::version);
+    CHECK(emulator.rom_hash() != 0);
+  }
+
+  SUBCASE("Loading into a fresh emulator resumes exactly where the state was saved") {
+    emulator.run(1000);
+    const auto expected = emulator.state();
+
+    Emulator resumed;
+    REQUIRE(resumed.load_state(saved.data(), saved.size()) == LoadStateResult::Ok);
+    CHECK(same_state(resumed.state(), saved_state));
+    CHECK(resumed.rom_hash() == emulator.rom_hash());
+
+    resumed.run(1000);
+    CHECK(same_state(resumed.state(), expected));
+  }
+
+  SUBCASE("Invalid data is rejected and leaves the emulator untouched") {
+    Emulator other;
+    const auto untouched = other.state();
+
+    SUBCASE("Wrong magic") {
+      saved[0] = 'X';
+      CHECK(other.load_state(saved.data(), saved.size()) == LoadStateResult::NotASaveState);
+    }
+    SUBCASE("Newer version") {
+      saved[4] = save_state_format::version + 1;
+      CHECK(other.load_state(saved.data(), saved.size()) == LoadStateResult::UnsupportedVersion);
+    }
+    SUBCASE("Truncated") {
+      CHECK(other.load_state(saved.data(), saved.size() - 1) == LoadStateResult::Truncated);
+    }
+    SUBCASE("Corrupted payload") {
+      saved[save_state_format::header_size + 0x300] ^= 1;
+      CHECK(other.load_state(saved.data(), saved.size()) == LoadStateResult::ChecksumMismatch);
+    }
+    SUBCASE("Version 1 with a Mersenne Twister index out of range") {
+      const auto old = to_version1(saved, 625);
+      CHECK(other.load_state(old.data(), old.size()) == LoadStateResult::InvalidState);
+    }
+    SUBCASE("Pixel neither on nor off") {
+      saved[save_state_format::header_size + 4096 + 5] = 2;
+      rehash(saved);
+      CHECK(other.load_state(saved.data(), saved.size()) == LoadStateResult::InvalidState);
+    }
+    SUBCASE("Impossible RNG state") {
+      // All zeros is the one state Xorshift64* can't be in, and PCG32 needs an odd increment
+      if (!Rng().set_state({0, 0})) {
+        std::fill_n(saved.begin() + save_state_format::header_size + 6208, 16, 0);
+        rehash(saved);
+        CHECK(other.load_state(saved.data(), saved.size()) == LoadStateResult::InvalidState);
+      }
+    }
+
+    CHECK(same_state(other.state(), untouched));
+  }
+}
+
+TEST_CASE("Save states of older versions and other RNG engines still load") {
+  Emulator emulator;
+  load_particle_demo(emulator);
+  emulator.run(500);
+
+  std::vector<uint8_t> saved;
+  emulator.save_state(saved);
+  const auto saved_state = emulator.state();
+
+  SUBCASE("Version 1") {
+    saved = to_version1(saved, 100);
+  }
+  SUBCASE("Another RNG engine") {
+    saved[save_state_format::header_size + 6203] = Rng::id + 1;
+    rehash(saved);
+  }
+
+  Emulator resumed;
+  REQUIRE(resumed.load_state(saved.data(), saved.size()) == LoadStateResult::Ok);
+  CHECK(same_machine(resumed.state(), saved_state));
+  CHECK(resumed.rom_hash() == emulator.rom_hash());
+
+  // The RNG is reseeded from the saved one, the same way every time
+  Emulator again;
+  REQUIRE(again.load_state(saved.data(), saved.size()) == LoadStateResult::Ok);
+  CHECK(again.state().rng_engine == resumed.state().rng_engine);
+  resumed.run(1000);
+  again.run(1000);
+  CHECK(same_state(resumed.state(), again.state()));
+}
+
+TEST_CASE("Save states load fast enough to resume thousands of sessions") {
+  Emulator emulator;
+  load_particle_demo(emulator);
+  emulator.run(100);
+
+  std::vector<uint8_t> saved;
+  emulator.save_state(saved);
+
+  constexpr auto sessions = 1000;
+  std::vector<Emulator> resumed(sessions);
+
+  const auto start = std::chrono::steady_clock::now();
+  for (auto& session : resumed) {
+    session.load_state(saved.data(), saved.size());
+  }
+  const auto elapsed = std::chrono::steady_clock::now() - start;
+
+  MESSAGE("Loaded " << sessions << " save states in "
+                    << std::chrono::duration<double, std::milli>(elapsed).count() << " ms");
+  CHECK(resumed.back().rom_hash() == emulator.rom_hash());
+}
@@ -0,0 +1,133 @@
+#ifndef _WIN32
+
+#  include "SessionArena.h"
+
+#  include <doctest/doctest.h>
+
+#  include <chrono>
+#  include <cstdint>
+#  include <memory>
+#  include <set>
+#  include <vector>
+
+#  include "Emulator.h"
+
+namespace {
+
+struct Counted {
+  static inline int alive = 0;
+  uint64_t value;
+
+  explicit Counted(uint64_t value) : value(value) { alive++; }
+  ~Counted() { alive--; }
+};
+
+}  // namespace
+
+TEST_CASE("Slab allocators hand out aligned slots and recycle them") {
+  SlabAllocator::Config config;
+  config.slot_size = 100;
+  config.slab_size = 4096;
+  config.pages = SlabAllocator::Pages::Normal;
+  SlabAllocator allocator(config);
+  CHECK(allocator.slot_size() == 128);
+
+  std::vector<void*> slots;
+  for (auto i = 0; i < 100; i++) {
+    slots.push_back(allocator.allocate());
+    CHECK(reinterpret_cast<uintptr_t>(slots.back()) % SlabAllocator::slot_alignment == 0);
+  }
+  CHECK(std::set<void*>(slots.begin(), slots.end()).size() == slots.size());
+
+  auto stats = allocator.statistics();
+  CHECK(stats.live == 100);
+  CHECK(stats.slabs == 4);  // 32 slots each
+  CHECK(stats.slots == 128);
+  CHECK(stats.bytes == 4 * 4096);
+  CHECK(stats.fragmentation() == doctest::Approx(1 - 100.0 * 128 / (4 * 4096)));
+
+  // Freed slots come back most recent first, without mapping anything
+  for (auto i = 0; i < 50; i++) {
+    allocator.deallocate(slots[i]);
+  }
+  CHECK(allocator.statistics().live == 50);
+  CHECK(allocator.statistics().fragmentation() > stats.fragmentation());
+  for (auto i = 49; i >= 0; i--) {
+    CHECK(allocator.allocate() == slots[i]);
+  }
+  stats = allocator.statistics();
+  CHECK(stats.slabs == 4);
+  CHECK(stats.live == 100);
+  CHECK(stats.peak == 100);
+}
+
+TEST_CASE("Slab allocators fall back when huge pages or NUMA binding aren't available") {
+  SlabAllocator::Config config;
+  config.slot_size = sizeof(Emulator);
+  config.pages = SlabAllocator::Pages::Huge;
+  config.numa_node = SlabAllocator::current_numa_node();
+  SlabAllocator allocator(config);
+
+  // Either way the slots are usable
+  for (auto i = 0; i < 1000; i++) {
+    new (allocator.allocate()) Emulator();
+  }
+  const auto& stats = allocator.statistics();
+  CHECK(stats.slabs >= 1);
+  CHECK(stats.huge_slabs <= stats.slabs);
+  CHECK(stats.numa_bind_failures <= stats.slabs);
+  MESSAGE("Slabs: " << stats.slabs << " of " << stats.bytes / stats.slabs << " bytes, "
+                    << stats.huge_slabs << " backed by reserved huge pages, "
+                    << stats.numa_bind_failures << " not bound to node "
+                    << config.numa_node);
+}
+
+TEST_CASE("Session arenas construct and destroy objects in their slots") {
+  SessionArena<Counted> arena;
+  {
+    std::vector<SessionArena<Counted>::Pointer> objects;
+    for (uint64_t i = 0; i < 1000; i++) {
+      objects.push_back(arena.make(i));
+    }
+    CHECK(Counted::alive == 1000);
+    CHECK(objects[999]->value == 999);
+    CHECK(arena.statistics().live == 1000);
+    CHECK(arena.statistics().slabs == 1);
+
+    auto* raw = arena.create(uint64_t{7});
+    CHECK(Counted::alive == 1001);
+    arena.destroy(raw);
+    arena.destroy(nullptr);
+  }
+  CHECK(Counted::alive == 0);
+  CHECK(arena.statistics().live == 0);
+  CHECK(arena.statistics().fragmentation() == 1);
+}
+
+TEST_CASE("Session arena benchmark" * doctest::test_suite("benchmark") * doctest::skip()) {
+  constexpr int rounds = 20;
+  constexpr int instances = 10000;
+  SessionArena<Emulator> arena;
+
+  // Churn as a host sees it: every round replaces half of the instances
+  const auto churn = [&](auto make) {
+    std::vector<decltype(make())> emulators(instances);
+    const auto start = std::chrono::steady_clock::now();
+    for (auto round = 0; round < rounds; round++) {
+      for (auto i = round % 2; i < instances; i += 2) {
+        emulators[i] = make();
+        emulators[i]->emulate_cycle();
+      }
+    }
+    const std::chrono::duration<double, std::nano> elapsed
+        = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / (rounds * instances / 2);
+  };
+  const auto heap = churn([] { return std::make_unique<Emulator>(); });
+  const auto slabs = churn([&] { return arena.make(); });
+  MESSAGE("Session arena: " << heap << " ns per instance from the heap, " << slabs
+                            << " ns from slabs, " << arena.statistics().bytes / (1 << 20)
+                            << " MB mapped for " << sizeof(Emulator) << "-byte instances");
+}
+
+#endif  // _WIN32
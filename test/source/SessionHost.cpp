@@ -0,0 +1,244 @@
+#ifdef __linux__
+
+#  include "SessionHost.h"
+
+#  include <doctest/doctest.h>
+#  include <sys/socket.h>
+#  include <sys/un.h>
+#  include <unistd.h>
+
+#  include <cstring>
+#  include <filesystem>
+#  include <string>
+#  include <thread>
+#  include <vector>
+
+#  include "DeltaCodec.h"
+#  include "Emulator.h"
+#  include "SessionProtocol.h"
+#  include "TestUtilities.h"
+
+using namespace session_protocol;
+
+namespace {
+
+std::string socket_path() { return temporary_path("chip8-host-").string(); }
+
+// Serves on a thread of its own until destroyed
+class HostThread {
+public:
+  explicit HostThread(const SessionHost::Config& config)
+      : host(config), thread([this] { host.run(); }) {}
+  ~HostThread() {
+    host.stop();
+    thread.join();
+  }
+
+  SessionHost host;
+
+private:
+  std::thread thread;
+};
+
+// Blocking client, giving up on reads after a timeout
+class Client {
+public:
+  explicit Client(const std::string& path, int timeout_ms = 2000) {
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    std::strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+    connected = connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0;
+    timeval timeout{timeout_ms / 1000, (timeout_ms % 1000) * 1000};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  }
+  ~Client() { close(fd); }
+
+  void send_all(const std::vector<uint8_t>& bytes) {
+    CHECK(send(fd, bytes.data(), bytes.size(), MSG_NOSIGNAL) == static_cast<ssize_t>(bytes.size()));
+  }
+
+  // False on timeout or once the host closed the connection
+  bool receive(Message& message) {
+    while (!reader.next(message)) {
+      const auto received = recv(fd, reader.prepare(4096), 4096, 0);
+      if (received <= 0) {
+        return false;
+      }
+      reader.received(static_cast<std::size_t>(received));
+    }
+    return true;
+  }
+
+  int fd = -1;
+  bool connected = false;
+
+private:
+  MessageReader reader;
+};
+
+}  // namespace
+
+TEST_CASE("Message reader splits a byte stream into messages") {
+  std::vector<uint8_t> stream;
+  append_start(stream, 3, 0x0123456789ABCDEFu);
+  append_key(stream, 0xA, true);
+  append_ack(stream, 42);
+
+  // Fed one byte at a time, every message still comes out whole
+  MessageReader reader;
+  std::vector<Message> messages;
+  std::vector<std::vector<uint8_t>> payloads;
+  for (const auto byte : stream) {
+    *reader.prepare(1) = byte;
+    reader.received(1);
+    Message message;
+    while (reader.next(message)) {
+      messages.push_back(message);
+      payloads.emplace_back(message.payload, message.payload + message.size);
+    }
+  }
+  CHECK(!reader.error());
+  REQUIRE(messages.size() == 3);
+  CHECK(messages[0].type == MessageType::Start);
+  CHECK(load16(payloads[0].data()) == 3);
+  CHECK(load64(payloads[0].data() + 2) == 0x0123456789ABCDEFu);
+  CHECK(messages[1].type == MessageType::Key);
+  CHECK(payloads[1] == std::vector<uint8_t>{0xA, 1});
+  CHECK(messages[2].type == MessageType::Ack);
+  CHECK(load32(payloads[2].data()) == 42);
+
+  SUBCASE("Oversized messages are an error") {
+    const uint8_t header[] = {0xFF, 0xFF, 1};
+    std::memcpy(reader.prepare(sizeof(header)), header, sizeof(header));
+    reader.received(sizeof(header));
+    Message message;
+    CHECK(!reader.next(message));
+    CHECK(reader.error());
+  }
+}
+
+TEST_CASE("Session host streams the screen of every session as deltas") {
+  const auto rom = read_rom(CHIP8_ROMS_DIR "/demos/Particle Demo [zeroZshadow, 2008].ch8");
+  REQUIRE(!rom.empty());
+  SessionHost::Config config;
+  config.socket_path = socket_path();
+  config.roms = {rom};
+  config.frames_per_second = 1000;
+  HostThread host(config);
+
+  SUBCASE("Acknowledged frames follow the emulation") {
+    Client client(config.socket_path);
+    REQUIRE(client.connected);
+    std::vector<uint8_t> out;
+    append_start(out, 0, 7);
+    client.send_all(out);
+
+    Message message;
+    REQUIRE(client.receive(message));
+    CHECK(message.type == MessageType::Started);
+
+    std::array<uint8_t, 64 * 32> screen{};
+    uint32_t frame = 0;
+    uint64_t cycles = 0;
+    for (int update = 0; update < 20; update++) {
+      REQUIRE(client.receive(message));
+      REQUIRE(message.type == MessageType::Frame);
+      CHECK(load32(message.payload + 4) == frame);
+      REQUIRE(delta_apply(message.payload + 16, message.size - 16, screen.data(), screen.size()));
+      frame = load32(message.payload);
+      cycles = load64(message.payload + 8);
+      out.clear();
+      append_ack(out, frame);
+      client.send_all(out);
+    }
+
+    // The same rom and seed run locally for as many cycles draws the same screen
+    Emulator emulator;
+    emulator.load_rom(rom.data(), rom.size());
+    emulator.seed(7);
+    for (uint64_t cycle = 0; cycle < cycles; cycle++) {
+      REQUIRE(!emulator.emulate_cycle());
+    }
+    CHECK(screen == emulator.get_graphic());
+    CHECK(host.host.statistics().updates_sent >= 20);
+  }
+
+  SUBCASE("A client that doesn't acknowledge gets a single frame") {
+    Client client(config.socket_path, 200);
+    REQUIRE(client.connected);
+    std::vector<uint8_t> out;
+    append_start(out, 0, 1);
+    client.send_all(out);
+
+    Message message;
+    REQUIRE(client.receive(message));
+    CHECK(message.type == MessageType::Started);
+    REQUIRE(client.receive(message));
+    CHECK(message.type == MessageType::Frame);
+    // About 200 more host frames pass without another update
+    CHECK(!client.receive(message));
+    CHECK(host.host.statistics().updates_sent == 1);
+  }
+
+  SUBCASE("Unknown roms are refused") {
+    Client client(config.socket_path);
+    REQUIRE(client.connected);
+    std::vector<uint8_t> out;
+    append_start(out, 1, 0);
+    client.send_all(out);
+
+    Message message;
+    REQUIRE(client.receive(message));
+    CHECK(message.type == MessageType::Error);
+    CHECK(message.payload[0] == static_cast<uint8_t>(ErrorCode::InvalidRom));
+    CHECK(!client.receive(message));
+  }
+}
+
+TEST_CASE("Session host starts the roms of a pack") {
+  const auto rom = read_rom(CHIP8_ROMS_DIR "/demos/Particle Demo [zeroZshadow, 2008].ch8");
+  REQUIRE(!rom.empty());
+  const auto pack_path = socket_path() + ".c8p";
+  write_rom_pack({{"particles", rom}, {"other", {0x12, 0x00}}}, pack_path);
+
+  SessionHost::Config config;
+  config.socket_path = socket_path();
+  config.pack = std::make_shared<RomPack>(pack_path);
+  std::filesystem::remove(pack_path);  // The mapping stays valid
+  const auto index = config.pack->find("particles");
+  REQUIRE(index < config.pack->size());
+  HostThread host(config);
+
+  Client client(config.socket_path);
+  REQUIRE(client.connected);
+  std::vector<uint8_t> out;
+  append_start(out, static_cast<uint16_t>(index), 7);
+  client.send_all(out);
+  Message message;
+  REQUIRE(client.receive(message));
+  CHECK(message.type == MessageType::Started);
+  REQUIRE(client.receive(message));
+  REQUIRE(message.type == MessageType::Frame);
+
+  // The same rom started from memory draws the same screen
+  std::array<uint8_t, 64 * 32> screen{};
+  REQUIRE(delta_apply(message.payload + 16, message.size - 16, screen.data(), screen.size()));
+  Emulator emulator;
+  emulator.load_rom(rom.data(), rom.size());
+  emulator.seed(7);
+  for (uint64_t cycle = 0; cycle < load64(message.payload + 8); cycle++) {
+    REQUIRE(!emulator.emulate_cycle());
+  }
+  CHECK(screen == emulator.get_graphic());
+
+  Client unknown(config.socket_path);
+  REQUIRE(unknown.connected);
+  out.clear();
+  append_start(out, 2, 0);
+  unknown.send_all(out);
+  REQUIRE(unknown.receive(message));
+  CHECK(message.type == MessageType::Error);
+}
+
+#endif  // __linux__
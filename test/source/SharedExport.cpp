@@ -0,0 +1,164 @@
+#ifndef _WIN32
+
+#  include "SharedExport.h"
+
+#  include <doctest/doctest.h>
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <unistd.h>
+
+#  include <atomic>
+#  include <fstream>
+#  include <string>
+#  include <system_error>
+#  include <thread>
+
+#  include "Emulator.h"
+
+using namespace shared_export;
+
+namespace {
+
+std::string segment_name() { return "/chip8-test-" + std::to_string(::getpid()); }
+
+// 0x200: 6005  V0 = 5
+// 0x202: A300  I = 0x300
+// 0x204: F055  memory[0x300] = V0
+// 0x206: D001  draw memory[0x300]
+// 0x208: 1208  loop
+const uint8_t program[] = {0x60, 0x05, 0xA3, 0x00, 0xF0, 0x55, 0xD0, 0x01, 0x12, 0x08};
+
+}  // namespace
+
+TEST_CASE("Shared export publishes frames to other mappings") {
+  SharedExport::Config config;
+  config.name = segment_name();
+  config.regions = {{0x300, 16}, {0xFF8, 64}};
+  SharedExport exporter(config);
+  SharedExportReader reader(config.name);
+
+  // Clipped to the end of memory
+  REQUIRE(reader.regions().size() == 2);
+  CHECK(reader.regions()[1].size == 8);
+
+  Frame frame;
+  CHECK(reader.published() == 0);
+  CHECK(!reader.read(frame));
+
+  Emulator emulator;
+  emulator.load_rom(program, sizeof(program));
+  for (int cycle = 0; cycle < 4; cycle++) {
+    REQUIRE(!emulator.emulate_cycle());
+  }
+  exporter.publish(emulator);
+  CHECK(reader.published() == 1);
+
+  REQUIRE(reader.read(frame));
+  CHECK(frame.number == 1);
+  CHECK(frame.cycles == 4);
+  CHECK(frame.V[0] == 5);
+  CHECK(frame.I == 0x300);
+  CHECK(frame.pc == 0x208);
+  CHECK(frame.graphic == emulator.get_graphic());
+  CHECK(frame.memory[0x300] == 5);
+  // Memory outside the regions isn't exported
+  CHECK(frame.memory[0x200] == 0);
+
+  SUBCASE("Frames read in place stay valid until their slot is reused") {
+    uint64_t ticket;
+    const auto in_place = reader.latest(ticket);
+    REQUIRE(in_place != nullptr);
+    CHECK(in_place->number == 1);
+    exporter.publish(emulator);
+    CHECK(reader.valid(ticket));
+    exporter.publish(emulator);
+    CHECK(!reader.valid(ticket));
+    CHECK(reader.latest(ticket)->number == 3);
+  }
+
+  SUBCASE("Keys come back through the input ring") {
+    CHECK(reader.push_key(0xA, true));
+    CHECK(reader.push_key(0x3, true));
+    CHECK(reader.push_key(0xA, false));
+    CHECK(exporter.apply_input(emulator) == 3);
+    CHECK(exporter.apply_input(emulator) == 0);
+    exporter.publish(emulator);
+    REQUIRE(reader.read(frame));
+    CHECK(frame.keys == 1 << 3);
+
+    // A full ring refuses events until the emulator catches up
+    for (std::size_t event = 0; event < input_capacity; event++) {
+      REQUIRE(reader.push_key(1, event % 2 == 0));
+    }
+    CHECK(!reader.push_key(1, true));
+    CHECK(exporter.apply_input(emulator) == input_capacity);
+    CHECK(reader.push_key(1, true));
+  }
+
+  SUBCASE("Readers give up on a frame left half written") {
+    // As if the writer died while writing frame 1 again
+    const auto fd = ::shm_open(config.name.c_str(), O_RDWR, 0);
+    REQUIRE(fd >= 0);
+    const auto mapping
+        = ::mmap(nullptr, sizeof(Segment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    REQUIRE(mapping != MAP_FAILED);
+    static_cast<Segment*>(mapping)->slots[1].sequence.store(1);
+
+    uint64_t ticket;
+    CHECK(reader.latest(ticket) == nullptr);
+    CHECK(!reader.read(frame));
+    ::munmap(mapping, sizeof(Segment));
+  }
+}
+
+TEST_CASE("Shared export readers never see torn frames") {
+  SharedExport::Config config;
+  config.name = segment_name();
+  SharedExport exporter(config);
+  SharedExportReader reader(config.name);
+
+  std::ifstream rom(CHIP8_ROMS_DIR "/demos/Particle Demo [zeroZshadow, 2008].ch8",
+                    std::ios::binary);
+  Emulator emulator;
+  emulator.load_rom(rom);
+
+  constexpr uint64_t frames = 20000;
+  std::atomic<bool> done{false};
+  std::thread writer([&] {
+    for (uint64_t frame = 0; frame < frames; frame++) {
+      emulator.emulate_cycle();
+      exporter.publish(emulator);
+    }
+    done = true;
+  });
+
+  // Every frame is published right after its cycle, so a consistent one has as many cycles as its
+  // number
+  uint64_t reads = 0;
+  uint64_t torn = 0;
+  uint64_t last = 0;
+  bool ordered = true;
+  Frame frame;
+  while (!done) {
+    if (reader.read(frame)) {
+      reads++;
+      torn += frame.cycles != frame.number;
+      ordered = ordered && frame.number >= last;
+      last = frame.number;
+    }
+  }
+  writer.join();
+  CHECK(torn == 0);
+  CHECK(ordered);
+  REQUIRE(reader.read(frame));
+  CHECK(frame.number == frames);
+  CHECK(frame.graphic == emulator.get_graphic());
+  MESSAGE(reads << " consistent reads while " << frames << " frames were published");
+}
+
+TEST_CASE("Shared export readers refuse missing segments") {
+  CHECK_THROWS_AS(SharedExportReader("/chip8-test-missing"), std::system_error);
+}
+
+#endif  // _WIN32
@@ -0,0 +1,67 @@
+#ifndef CHIP8EMUTESTS_TESTUTILITIES_H
+#define CHIP8EMUTESTS_TESTUTILITIES_H
+
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "Emulator.h"
+
+// Helpers shared by the tests
+
+// Contents of a rom file, empty if it can't be read
+inline std::vector<uint8_t> read_rom(const std::filesystem::path& path) {
+  std::ifstream file(path, std::ios::binary);
+  return {std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()};
+}
+
+// Every rom file of the roms/ corpus, sorted by path
+inline std::vector<std::filesystem::path> corpus_files() {
+  std::vector<std::filesystem::path> roms;
+  for (const auto& entry : std::filesystem::recursive_directory_iterator(CHIP8_ROMS_DIR)) {
+    if (entry.is_regular_file() && entry.path().extension() == ".ch8") {
+      roms.push_back(entry.path());
+    }
+  }
+  std::sort(roms.begin(), roms.end());
+  return roms;
+}
+
+// Path in the temporary directory that no other test uses, starting with `prefix`
+inline std::filesystem::path temporary_path(const std::string& prefix) {
+  return std::filesystem::temp_directory_path()
+         / (prefix + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count()));
+}
+
+// Empty directory removed at the end of the test
+struct TemporaryDirectory {
+  std::filesystem::path path;
+
+  explicit TemporaryDirectory(const std::string& prefix) : path(temporary_path(prefix)) {
+    std::filesystem::remove_all(path);
+    std::filesystem::create_directories(path);
+  }
+  ~TemporaryDirectory() { std::filesystem::remove_all(path); }
+};
+
+// File path removed at the end of the test
+struct TemporaryFile {
+  std::string path;
+
+  explicit TemporaryFile(const std::string& prefix) : path(temporary_path(prefix).string()) {}
+  ~TemporaryFile() { std::filesystem::remove(path); }
+};
+
+// Save state of `emulator`, to compare whole machines
+inline std::vector<uint8_t> saved(const Emulator& emulator) {
+  std::vector<uint8_t> out;
+  emulator.save_state(out);
+  return out;
+}
+
+#endif  // CHIP8EMUTESTS_TESTUTILITIES_H
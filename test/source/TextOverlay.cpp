@@ -0,0 +1,43 @@
+#include "TextOverlay.h"
+
+#include <doctest/doctest.h>
+
+#include <vector>
+
+TEST_CASE("Text overlay draws glyphs into RGBA frames") {
+  constexpr unsigned width = 32;
+  constexpr unsigned height = 12;
+  std::vector<uint32_t> pixels(width * height, 0);
+
+  CHECK(text_width("1.5", 2) == 28);
+  CHECK(text_height(2) == 10);
+
+  SUBCASE("Digits use the CHIP-8 font") {
+    // 1 is 0x20, 0x60, 0x20, 0x20, 0x70
+    draw_text(pixels.data(), width * 4, width, height, 1, 1, "1", 1, 7);
+    CHECK(pixels[1 * width + 3] == 7);
+    CHECK(pixels[1 * width + 2] == 0);
+    CHECK(pixels[2 * width + 2] == 7);
+    CHECK(pixels[5 * width + 1] == 0);
+    CHECK(pixels[5 * width + 2] == 7);
+    CHECK(pixels[5 * width + 4] == 7);
+  }
+
+  SUBCASE("Letters are drawn uppercase and scaled") {
+    // T is 0xF0 then 0x40
+    draw_text(pixels.data(), width * 4, width, height, 0, 0, "xt", 2, 9);
+    CHECK(pixels[0 * width + 10] == 9);
+    CHECK(pixels[1 * width + 17] == 9);
+    CHECK(pixels[2 * width + 10] == 0);
+    CHECK(pixels[2 * width + 12] == 9);
+    CHECK(pixels[2 * width + 13] == 9);
+  }
+
+  SUBCASE("Text is clipped at the edges") {
+    draw_text(pixels.data(), width * 4, width, height, 28, 10, "88", 1, 1);
+    CHECK(pixels[10 * width + 28] == 1);
+    CHECK(pixels[11 * width + 29] == 0);
+    CHECK(pixels[11 * width + 31] == 1);
+    CHECK(pixels[11 * width + 28] == 1);
+  }
+}
@@ -0,0 +1,91 @@
+#include "Translation.h"
+
+#include <doctest/doctest.h>
+
+#include <vector>
+
+#include "Emulator.h"
+#include "Hash.h"
+#include "TestUtilities.h"
+
+TEST_CASE("Decoding splits opcodes into operations and operands") {
+  const auto draw = decode(0xD1A5);
+  CHECK(draw.operation == Operation::IDXYN);
+  CHECK(draw.x == 1);
+  CHECK(draw.y == 0xA);
+  CHECK(draw.n() == 5);
+
+  const auto call = decode(0x2ABC);
+  CHECK(call.operation == Operation::I2NNN);
+  CHECK(call.nnn == 0xABC);
+
+  const auto add = decode(0x7F12);
+  CHECK(add.operation == Operation::I7XNN);
+  CHECK(add.x == 0xF);
+  CHECK(add.nn == 0x12);
+
+  for (uint16_t invalid : {0x0000, 0x00E1, 0x5121, 0x800F, 0x9128, 0xE19F, 0xF100}) {
+    INFO(std::hex << invalid);
+    CHECK(decode(invalid).operation == Operation::Invalid);
+    CHECK(decode(invalid).opcode == invalid);
+  }
+}
+
+TEST_CASE("Translations decode the rom and find its code") {
+  // 200: 6001     V0 = 1
+  // 202: 2208     call 208
+  // 204: 3000     skip if V0 == 0
+  // 206: 1206     jump 206
+  // 208: 00EE     return
+  // 20A: data, never reached
+  const uint8_t rom[] = {0x60, 0x01, 0x22, 0x08, 0x30, 0x00, 0x12, 0x06, 0x00, 0xEE, 0xFF, 0xFF};
+  Translation translation;
+  translate(rom, sizeof(rom), translation);
+
+  CHECK(translation.rom_hash == fnv1a64(rom, sizeof(rom)));
+  CHECK(translation.instructions[0x202].operation == Operation::I2NNN);
+  CHECK(translation.instructions[0x203].opcode == 0x0830);
+  CHECK(translation.instructions[0x000].opcode == 0xF090);  // Font
+
+  CHECK(translation.code_size == 5);
+  for (uint16_t address : {0x200, 0x202, 0x204, 0x206, 0x208}) {
+    CHECK((translation.flags[address] & Translation::Code) != 0);
+  }
+  CHECK(translation.flags[0x20A] == 0);
+  CHECK(translation.flags[0x201] == 0);
+  CHECK((translation.flags[0x208] & Translation::CallTarget) != 0);
+  CHECK((translation.flags[0x206] & Translation::JumpTarget) != 0);
+  // After the call, and both sides of the skip
+  CHECK((translation.flags[0x204] & Translation::BlockStart) != 0);
+  CHECK((translation.flags[0x208] & Translation::BlockStart) != 0);
+  CHECK((translation.flags[0x202] & Translation::BlockStart) == 0);
+}
+
+TEST_CASE("Emulators give the same results with or without a translation") {
+  const auto rom = read_rom(CHIP8_ROMS_DIR "/demos/Particle Demo [zeroZshadow, 2008].ch8");
+  REQUIRE(!rom.empty());
+  Translation translation;
+  translate(rom.data(), rom.size(), translation);
+
+  Emulator plain;
+  plain.load_rom(rom.data(), rom.size());
+  Emulator translated;
+  translated.load_rom(rom.data(), rom.size());
+  translated.set_translation(&translation);
+
+  SUBCASE("Running the rom") {}
+  SUBCASE("After the rom overwrites its own code") {
+    // The translation no longer matches memory at 0x200
+    const uint8_t patch[] = {0x00, 0xE0};
+    translated.load_rom(patch, sizeof(patch));
+    plain.load_rom(patch, sizeof(patch));
+  }
+
+  for (auto i = 0; i < 20; i++) {
+    const auto plain_result = plain.run(500);
+    const auto translated_result = translated.run(500);
+    CHECK(plain_result.reason == translated_result.reason);
+    CHECK(plain.get_graphic() == translated.get_graphic());
+    CHECK(plain.state().pc == translated.state().pc);
+  }
+}
@@ -0,0 +1,130 @@
+#ifndef _WIN32
+
+#  include "TranslationCache.h"
+
+#  include <doctest/doctest.h>
+
+#  include <chrono>
+#  include <cstring>
+#  include <filesystem>
+#  include <fstream>
+#  include <thread>
+#  include <vector>
+
+#  include "TestUtilities.h"
+
+namespace {
+
+namespace fs = std::filesystem;
+
+bool same_translation(const Translation& a, const Translation& b) {
+  return std::memcmp(&a, &b, sizeof(Translation)) == 0;
+}
+
+}  // namespace
+
+TEST_CASE("Translation cache maps translations stored by earlier sessions") {
+  TemporaryDirectory directory("chip8-translations-");
+  const auto rom = read_rom(CHIP8_ROMS_DIR "/demos/Particle Demo [zeroZshadow, 2008].ch8");
+  REQUIRE(!rom.empty());
+  Translation expected;
+  translate(rom.data(), rom.size(), expected);
+
+  TranslationCache cache(directory.path.string());
+  const auto built = cache.load(rom.data(), rom.size());
+  CHECK(cache.misses() == 1);
+  CHECK(same_translation(*built, expected));
+  const auto file = cache.path(expected.rom_hash);
+  CHECK(fs::exists(file));
+
+  SUBCASE("Another cache on the same directory finds it") {
+    TranslationCache other(directory.path.string());
+    const auto mapped = other.load(rom.data(), rom.size());
+    CHECK(other.hits() == 1);
+    CHECK(other.misses() == 0);
+    CHECK(same_translation(*mapped, expected));
+
+    // The mapping outlives its file
+    fs::remove(file);
+    CHECK(same_translation(*mapped, expected));
+  }
+
+  SUBCASE("Damaged files are rebuilt") {
+    SUBCASE("Truncated") { fs::resize_file(file, fs::file_size(file) - 1); }
+    SUBCASE("Other version") {
+      std::fstream stream(file, std::ios::in | std::ios::out | std::ios::binary);
+      stream.seekp(4);
+      stream.put(static_cast<char>(translation_version + 1));
+    }
+
+    TranslationCache other(directory.path.string());
+    CHECK(same_translation(*other.load(rom.data(), rom.size()), expected));
+    CHECK(other.misses() == 1);
+    CHECK(same_translation(*other.load(rom.data(), rom.size()), expected));
+    CHECK(other.hits() == 1);
+  }
+
+  SUBCASE("Different roms have different files") {
+    const uint8_t other_rom[] = {0x12, 0x00};
+    const auto other = cache.load(other_rom, sizeof(other_rom));
+    CHECK(other->rom_hash != expected.rom_hash);
+    CHECK(fs::exists(cache.path(other->rom_hash)));
+  }
+
+  // No temporary file left behind
+  for (const auto& entry : fs::directory_iterator(directory.path)) {
+    CHECK(entry.path().extension() == ".c8t");
+  }
+}
+
+TEST_CASE("Translation cache is shared by concurrent sessions") {
+  TemporaryDirectory directory("chip8-translations-");
+  const auto rom = read_rom(CHIP8_ROMS_DIR "/demos/Particle Demo [zeroZshadow, 2008].ch8");
+  Translation expected;
+  translate(rom.data(), rom.size(), expected);
+
+  // Every thread has its own cache, like separate processes
+  std::vector<std::thread> threads;
+  std::vector<int> matches(8);
+  for (std::size_t thread = 0; thread < matches.size(); thread++) {
+    threads.emplace_back([&, thread] {
+      TranslationCache cache(directory.path.string());
+      for (auto i = 0; i < 50; i++) {
+        matches[thread] += same_translation(*cache.load(rom.data(), rom.size()), expected);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  for (auto count : matches) {
+    CHECK(count == 50);
+  }
+}
+
+TEST_CASE("Translation cache warm start time") {
+  TemporaryDirectory directory("chip8-translations-");
+  const auto rom = read_rom(CHIP8_ROMS_DIR "/demos/Particle Demo [zeroZshadow, 2008].ch8");
+  TranslationCache cache(directory.path.string());
+  cache.load(rom.data(), rom.size());
+
+  constexpr auto sessions = 1000;
+  auto start = std::chrono::steady_clock::now();
+  for (auto i = 0; i < sessions; i++) {
+    Translation translation;
+    translate(rom.data(), rom.size(), translation);
+  }
+  const std::chrono::duration<double, std::micro> cold = std::chrono::steady_clock::now() - start;
+
+  start = std::chrono::steady_clock::now();
+  for (auto i = 0; i < sessions; i++) {
+    TranslationCache session(directory.path.string());
+    CHECK(session.load(rom.data(), rom.size()) != nullptr);
+  }
+  const std::chrono::duration<double, std::micro> warm = std::chrono::steady_clock::now() - start;
+
+  MESSAGE("Translation: " << cold.count() / sessions << " us built, " << warm.count() / sessions
+                          << " us mapped from the cache");
+}
+
+#endif  // _WIN32
@@ -0,0 +1,165 @@
+#include "VectorEnv.h"
+
+#include <doctest/doctest.h>
+
+#include <fstream>
+#include <iterator>
+#include <vector>
+
+#include "Emulator.h"
+
+namespace {
+
+// 0x200: A300  I = 0x300
+// 0x202: F065  V0 = memory[0x300]
+// 0x204: 7001  V0 += 1
+// 0x206: F055  memory[0x300] = V0
+// 0x208: 1202  start over
+// With 4 cycles per frame the counter at 0x300 goes up by one every frame.
+const std::vector<uint8_t> counter{0xA3, 0x00, 0xF0, 0x65, 0x70, 0x01, 0xF0, 0x55, 0x12, 0x02};
+
+// Random numbers and sprites, so the screens of differently seeded environments diverge
+std::vector<uint8_t> particle_demo() {
+  std::ifstream rom(CHIP8_ROMS_DIR "/demos/Particle Demo [zeroZshadow, 2008].ch8",
+                    std::ios::binary);
+  return {std::istreambuf_iterator<char>(rom), std::istreambuf_iterator<char>()};
+}
+
+}  // namespace
+
+TEST_CASE("Vector environment steps like separate emulators") {
+  const auto rom = particle_demo();
+  REQUIRE(!rom.empty());
+
+  VectorEnv::Config config;
+  config.environments = 5;
+  config.frames_per_step = 3;
+  config.cycles_per_frame = 2;
+  config.seed = 40;
+  config.threads = 3;
+  VectorEnv environments(config, rom.data(), rom.size());
+  REQUIRE(environments.size() == 5);
+  REQUIRE(environments.observation_size() == 64 * 32);
+
+  std::vector<Emulator> emulators(5);
+  for (std::size_t index = 0; index < emulators.size(); index++) {
+    emulators[index].load_rom(rom.data(), rom.size());
+    emulators[index].seed(static_cast<uint32_t>(40 + index));
+  }
+
+  std::vector<uint16_t> actions(5);
+  std::vector<uint8_t> observations(5 * 64 * 32);
+  std::vector<float> rewards(5);
+  std::vector<uint8_t> dones(5);
+  environments.reset(observations.data());
+
+  for (auto step = 0; step < 50; step++) {
+    for (std::size_t index = 0; index < actions.size(); index++) {
+      actions[index] = static_cast<uint16_t>(1 << ((step + index) % 16));
+    }
+    environments.step(actions.data(), observations.data(), rewards.data(), dones.data());
+
+    for (std::size_t index = 0; index < emulators.size(); index++) {
+      emulators[index].set_keys(actions[index]);
+      emulators[index].run(3 * 2);
+
+      const auto& graphic = emulators[index].get_graphic();
+      CHECK(std::equal(graphic.begin(), graphic.end(), observations.begin() + index * 64 * 32));
+      CHECK(dones[index] == 0);
+      CHECK(rewards[index] == 0);
+    }
+  }
+
+  CHECK(emulators[0].get_graphic() != emulators[1].get_graphic());
+}
+
+TEST_CASE("Vector environment packs observations into bits") {
+  const auto rom = particle_demo();
+  REQUIRE(!rom.empty());
+
+  VectorEnv::Config config;
+  config.environments = 2;
+  config.observation_format = VectorEnv::ObservationFormat::Bits;
+  VectorEnv environments(config, rom.data(), rom.size());
+  REQUIRE(environments.observation_size() == 256);
+
+  std::vector<uint16_t> actions(2);
+  std::vector<uint8_t> observations(2 * 256);
+  std::vector<float> rewards(2);
+  std::vector<uint8_t> dones(2);
+  for (auto step = 0; step < 20; step++) {
+    environments.step(actions.data(), observations.data(), rewards.data(), dones.data());
+  }
+
+  for (std::size_t index = 0; index < 2; index++) {
+    const auto& graphic = environments.environment(index).get_graphic();
+    for (std::size_t pixel = 0; pixel < graphic.size(); pixel++) {
+      const auto bit = (observations[index * 256 + pixel / 8] >> (7 - pixel % 8)) & 1;
+      REQUIRE(bit == (graphic[pixel] != 0));
+    }
+  }
+}
+
+TEST_CASE("Vector environment rewards from memory probes and resets finished episodes") {
+  VectorEnv::Config config;
+  config.environments = 3;
+  config.frames_per_step = 4;
+  config.cycles_per_frame = 4;
+  config.reward_probes.push_back({0x300, 0.5f});
+  config.threads = 2;
+
+  std::vector<uint16_t> actions(3);
+  std::vector<uint8_t> observations(3 * 64 * 32);
+  std::vector<float> rewards(3);
+  std::vector<uint8_t> dones(3);
+
+  SUBCASE("Rewards are the scaled change of the probed bytes") {
+    VectorEnv environments(config, counter.data(), counter.size());
+    environments.step(actions.data(), observations.data(), rewards.data(), dones.data());
+
+    for (std::size_t index = 0; index < 3; index++) {
+      CHECK(rewards[index] == 2);
+      CHECK(dones[index] == 0);
+      CHECK(environments.environment(index).state().memory[0x300] == 4);
+    }
+  }
+
+  SUBCASE("The done probe ends episodes mid step") {
+    config.done_probe = {true, 0x300, 0xFF, 10};
+    VectorEnv environments(config, counter.data(), counter.size());
+
+    environments.step(actions.data(), observations.data(), rewards.data(), dones.data());
+    environments.step(actions.data(), observations.data(), rewards.data(), dones.data());
+    CHECK(dones[0] == 0);
+
+    // Frames 9 and 10, then back to the start
+    environments.step(actions.data(), observations.data(), rewards.data(), dones.data());
+    CHECK(rewards[0] == 1);
+    CHECK(dones[0] == 1);
+    CHECK(environments.environment(0).state().memory[0x300] == 0);
+
+    environments.step(actions.data(), observations.data(), rewards.data(), dones.data());
+    CHECK(rewards[0] == 2);
+    CHECK(dones[0] == 0);
+  }
+
+  SUBCASE("Episodes are cut after max_episode_frames") {
+    config.max_episode_frames = 6;
+    VectorEnv environments(config, counter.data(), counter.size());
+
+    environments.step(actions.data(), observations.data(), rewards.data(), dones.data());
+    CHECK(dones[2] == 0);
+    environments.step(actions.data(), observations.data(), rewards.data(), dones.data());
+    CHECK(dones[2] == 1);
+    CHECK(rewards[2] == 1);
+  }
+
+  SUBCASE("Faults end episodes") {
+    const std::vector<uint8_t> faulting{0x00, 0xEE};
+    VectorEnv environments(config, faulting.data(), faulting.size());
+
+    environments.step(actions.data(), observations.data(), rewards.data(), dones.data());
+    CHECK(dones[1] == 1);
+    CHECK(environments.environment(1).state().pc == 0x200);
+  }
+}
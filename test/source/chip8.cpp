@@ -0,0 +1,95 @@
+#include "chip8.h"
+
+#include <doctest/doctest.h>
+
+#include <vector>
+
+TEST_CASE("C interface runs a rom frame by frame") {
+  auto emulator = chip8_create();
+  REQUIRE(emulator != nullptr);
+  CHECK(chip8_abi_version() == CHIP8_ABI_VERSION);
+
+  // 0x200: A000  I = font sprite 0
+  // 0x202: 6008  V0 = 8
+  // 0x204: D005  draw it at (8, 8)
+  // 0x206: E19E  skip the next instruction if key 1 is pressed
+  // 0x208: 1206  wait for key 1
+  // 0x20A: 00EE  return with an empty stack
+  const std::vector<uint8_t> rom{0xA0, 0x00, 0x60, 0x08, 0xD0, 0x05,
+                                 0xE1, 0x9E, 0x12, 0x06, 0x00, 0xEE};
+  REQUIRE(chip8_load_rom(emulator, rom.data(), rom.size()) == CHIP8_OK);
+
+  chip8_set_cycles_per_frame(emulator, 5);
+  uint64_t executed = 0;
+  CHECK(chip8_run_frames(emulator, 2, &executed) == CHIP8_OK);
+  CHECK(executed == 10);
+  CHECK(chip8_should_draw(emulator) == 1);
+  CHECK(chip8_should_draw(emulator) == 0);
+
+  // The framebuffer is the emulator's own, updated in place
+  const auto framebuffer = chip8_framebuffer(emulator);
+  CHECK(framebuffer[8 * CHIP8_SCREEN_WIDTH + 8] == 1);
+  CHECK(framebuffer[8 * CHIP8_SCREEN_WIDTH + 12] == 0);
+
+  chip8_set_keys(emulator, 1 << 1 | 1 << 0xF);
+  CHECK(chip8_keys(emulator) == (1 << 1 | 1 << 0xF));
+
+  CHECK(chip8_run_cycles(emulator, 100, &executed) == CHIP8_FAULT);
+  CHECK(executed == 2);
+  const auto fault = chip8_last_fault(emulator);
+  CHECK(fault.kind == CHIP8_FAULT_STACK_UNDERFLOW);
+  CHECK(fault.pc == 0x20A);
+  CHECK(fault.opcode == 0x00EE);
+
+  chip8_reset(emulator);
+  CHECK(chip8_framebuffer(emulator) == framebuffer);
+  CHECK(framebuffer[8 * CHIP8_SCREEN_WIDTH + 8] == 0);
+  CHECK(chip8_last_fault(emulator).kind == CHIP8_FAULT_NONE);
+
+  chip8_destroy(emulator);
+}
+
+TEST_CASE("C interface rejects invalid arguments") {
+  CHECK(chip8_load_rom(nullptr, nullptr, 0) == CHIP8_INVALID_ARGUMENT);
+  CHECK(chip8_run_frames(nullptr, 1, nullptr) == CHIP8_INVALID_ARGUMENT);
+  CHECK(chip8_framebuffer(nullptr) == nullptr);
+  chip8_destroy(nullptr);
+
+  auto emulator = chip8_create();
+  CHECK(chip8_load_rom(emulator, nullptr, 4) == CHIP8_INVALID_ARGUMENT);
+
+  const std::vector<uint8_t> rom(4096, 0x12);
+  CHECK(chip8_load_rom(emulator, rom.data(), rom.size()) == CHIP8_ROM_TOO_LARGE);
+  chip8_destroy(emulator);
+}
+
+namespace {
+
+// The 8x8 sprite of random bytes drawn after seeding with `seed`
+std::vector<uint8_t> random_sprite(uint64_t seed) {
+  // 0x200: C0FF ... C7FF  V0-V7 = random bytes
+  // 0x210: A300 F755      store them at 0x300
+  // 0x214: A300 6000      I = 0x300, V0 = 0
+  // 0x218: D008           draw them at (0, 0)
+  const std::vector<uint8_t> rom{0xC0, 0xFF, 0xC1, 0xFF, 0xC2, 0xFF, 0xC3, 0xFF, 0xC4, 0xFF,
+                                 0xC5, 0xFF, 0xC6, 0xFF, 0xC7, 0xFF, 0xA3, 0x00, 0xF7, 0x55,
+                                 0xA3, 0x00, 0x60, 0x00, 0xD0, 0x08};
+  auto emulator = chip8_create();
+  REQUIRE(chip8_load_rom(emulator, rom.data(), rom.size()) == CHIP8_OK);
+  chip8_seed(emulator, seed);
+  CHECK(chip8_run_cycles(emulator, 13, nullptr) == CHIP8_OK);
+  std::vector<uint8_t> sprite;
+  for (int y = 0; y < 8; y++) {
+    const auto row = chip8_framebuffer(emulator) + y * CHIP8_SCREEN_WIDTH;
+    sprite.insert(sprite.end(), row, row + 8);
+  }
+  chip8_destroy(emulator);
+  return sprite;
+}
+
+}  // namespace
+
+TEST_CASE("C interface seeds with all 64 bits") {
+  CHECK(random_sprite(5) == random_sprite(5));
+  CHECK(random_sprite(5) != random_sprite(uint64_t{1} << 32 | 5));
+}